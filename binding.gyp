@@ -47,10 +47,21 @@
         ]
       ],
       "sources": [
+        "src/arrow.cc",
         "src/backup.cc",
+        "src/csv.cc",
         "src/database.cc",
+        "src/import.cc",
+        "src/json.cc",
         "src/node_sqlite3.cc",
-        "src/statement.cc"
+        "src/parallel.cc",
+        "src/query.cc",
+        "src/query_cache.cc",
+        "src/script.cc",
+        "src/session.cc",
+        "src/shard_set.cc",
+        "src/statement.cc",
+        "src/watch.cc"
       ],
       "defines": [ "NAPI_VERSION=<(napi_build_version)", "NAPI_DISABLE_CPP_EXCEPTIONS=1" ]
     }
@@ -82,13 +82,17 @@
       'direct_dependent_settings': {
         'include_dirs': [ '<(SHARED_INTERMEDIATE_DIR)/sqlite-autoconf-<@(sqlite_version)/' ],
         'defines': [
-          'SQLITE_THREADSAFE=1',
+          'SQLITE_THREADSAFE=2',
           'HAVE_USLEEP=1',
           'SQLITE_ENABLE_FTS3',
           'SQLITE_ENABLE_FTS4',
           'SQLITE_ENABLE_FTS5',
           'SQLITE_ENABLE_RTREE',
           'SQLITE_ENABLE_DBSTAT_VTAB=1',
+          'SQLITE_ENABLE_DBPAGE_VTAB=1',
+          'SQLITE_ENABLE_SNAPSHOT=1',
+          'SQLITE_ENABLE_SESSION',
+          'SQLITE_ENABLE_PREUPDATE_HOOK',
           'SQLITE_ENABLE_MATH_FUNCTIONS'
         ],
       },
@@ -97,13 +101,17 @@
       ],
       'defines': [
         '_REENTRANT=1',
-        'SQLITE_THREADSAFE=1',
+        'SQLITE_THREADSAFE=2',
         'HAVE_USLEEP=1',
         'SQLITE_ENABLE_FTS3',
         'SQLITE_ENABLE_FTS4',
         'SQLITE_ENABLE_FTS5',
         'SQLITE_ENABLE_RTREE',
         'SQLITE_ENABLE_DBSTAT_VTAB=1',
+        'SQLITE_ENABLE_DBPAGE_VTAB=1',
+        'SQLITE_ENABLE_SNAPSHOT=1',
+        'SQLITE_ENABLE_SESSION',
+        'SQLITE_ENABLE_PREUPDATE_HOOK',
         'SQLITE_ENABLE_MATH_FUNCTIONS'
       ],
       'export_dependent_settings': [
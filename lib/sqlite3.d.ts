@@ -9,6 +9,7 @@ export const OPEN_READONLY: number;
 export const OPEN_READWRITE: number;
 export const OPEN_CREATE: number;
 export const OPEN_FULLMUTEX: number;
+export const OPEN_NOMUTEX: number;
 export const OPEN_SHAREDCACHE: number;
 export const OPEN_PRIVATECACHE: number;
 export const OPEN_URI: number;
@@ -68,12 +69,59 @@ export interface RunResult extends Statement {
     changes: number;
 }
 
+export interface ExportOptions {
+    format?: "csv" | "ndjson";
+    header?: boolean;
+    delimiter?: string;
+    blobs?: "base64" | "hex" | "array";
+    params?: any;
+    progress?: (this: Statement, progress: ExportResult) => void;
+}
+
+export interface ExportResult {
+    rows: number;
+    bytes: number;
+}
+
+export interface ImportOptions {
+    format?: "csv" | "ndjson";
+    columns?: string[];
+    header?: boolean;
+    delimiter?: string;
+    batchSize?: number;
+    progress?: (this: Database, progress: ImportResult) => void;
+}
+
+export interface ImportResult {
+    rows: number;
+    bytes: number;
+}
+
+export interface ExecFileOptions {
+    transactionEvery?: number;
+    progress?: (this: Database, progress: ExecFileResult) => void;
+}
+
+export interface ExecFileResult {
+    statements: number;
+    bytes: number;
+}
+
+export interface QueryResult<T = any> {
+    rows: T[];
+    changes: number;
+    lastID: number;
+}
+
 export class Statement extends events.EventEmitter {
     bind(callback?: (err: Error | null) => void): this;
     bind(...params: any[]): this;
 
     reset(callback?: (err: null) => void): this;
 
+    rowMode(): "object" | "array" | "pluck";
+    rowMode(mode: "object" | "array" | "pluck"): this;
+
     finalize(callback?: (err: Error) => void): Database;
 
     run(callback?: (err: Error | null) => void): this;
@@ -91,12 +139,92 @@ export class Statement extends events.EventEmitter {
     each<T>(callback?: (err: Error | null, row: T) => void, complete?: (err: Error | null, count: number) => void): this;
     each<T>(params: any, callback?: (this: RunResult, err: Error | null, row: T) => void, complete?: (err: Error | null, count: number) => void): this;
     each(...params: any[]): this;
+
+    allArrow(callback?: (this: Statement, err: Error | null, ipc: Buffer) => void): this;
+    allArrow(params: any, callback?: (this: Statement, err: Error | null, ipc: Buffer) => void): this;
+    allArrow(...params: any[]): this;
+
+    eachArrow(batchRows: number, callback?: (this: Statement, err: Error | null, ipc: Buffer) => void, complete?: (err: Error | null, batches: number) => void): this;
+    eachArrow(batchRows: number, params: any, callback?: (this: Statement, err: Error | null, ipc: Buffer) => void, complete?: (err: Error | null, batches: number) => void): this;
+    eachArrow(batchRows: number, ...params: any[]): this;
+
+    allJSON(callback?: (this: Statement, err: Error | null, json: Buffer) => void): this;
+    allJSON(params: any, callback?: (this: Statement, err: Error | null, json: Buffer) => void): this;
+    allJSON(...params: any[]): this;
+
+    getJSON(callback?: (this: Statement, err: Error | null, json?: Buffer) => void): this;
+    getJSON(params: any, callback?: (this: Statement, err: Error | null, json?: Buffer) => void): this;
+    getJSON(...params: any[]): this;
+
+    exportTo(target: string | number, callback?: (this: Statement, err: Error | null, result?: ExportResult) => void): this;
+    exportTo(target: string | number, options: ExportOptions, callback?: (this: Statement, err: Error | null, result?: ExportResult) => void): this;
+}
+
+export class Session extends events.EventEmitter {
+    readonly schema: string;
+
+    attach(callback?: (this: Session, err: Error | null) => void): this;
+    attach(table: string | null, callback?: (this: Session, err: Error | null) => void): this;
+    changeset(callback?: (this: Session, err: Error | null, changeset: Buffer) => void): this;
+    patchset(callback?: (this: Session, err: Error | null, patchset: Buffer) => void): this;
+    close(callback?: (this: Session, err: Error | null) => void): this;
+}
+
+export interface WatchResult<T = any> {
+    rows: T[];
+    added: T[];
+    removed: T[];
+}
+
+export class Watch {
+    readonly sql: string;
+
+    close(): this;
+}
+
+export interface ShardQueryOptions {
+    params?: any;
+    shards?: number[];
+    key?: any;
+    combine?: "concat" | { [column: string]: "sum" | "count" | "min" | "max" | "group" };
+    orderBy?: string | string[];
+}
+
+export class ShardSet extends events.EventEmitter {
+    constructor(filenames: string[], callback?: (this: ShardSet, err: Error | null) => void);
+    constructor(filenames: string[], mode?: number, callback?: (this: ShardSet, err: Error | null) => void);
+
+    readonly length: number;
+
+    all<T = any>(sql: string, callback?: (this: ShardSet, err: Error | null, rows: T[]) => void): this;
+    all<T = any>(sql: string, options: ShardQueryOptions, callback?: (this: ShardSet, err: Error | null, rows: T[]) => void): this;
+    run(sql: string, callback?: (this: ShardSet, err: Error | null, changes: number) => void): this;
+    run(sql: string, options: ShardQueryOptions, callback?: (this: ShardSet, err: Error | null, changes: number) => void): this;
+    shardFor(key: any): number;
+    close(callback?: (this: ShardSet, err: Error | null) => void): this;
+}
+
+export interface ParallelQueryOptions {
+    params?: any;
+    table?: string;
+    partitionBy?: string;
+    workers?: number;
+    combine?: "concat" | { [column: string]: "sum" | "count" | "min" | "max" | "group" };
+    orderBy?: string | string[];
+}
+
+export interface Snapshot {
+    get<T = any>(sql: string, ...params: any[]): Promise<T | undefined>;
+    all<T = any>(sql: string, ...params: any[]): Promise<T[]>;
 }
 
 export class Database extends events.EventEmitter {
     constructor(filename: string, callback?: (err: Error | null) => void);
     constructor(filename: string, mode?: number, callback?: (err: Error | null) => void);
 
+    static fromBuffer(buffer: Buffer, callback?: (this: Database, err: Error | null) => void): Database;
+    static fromBuffer(buffer: Buffer, options: { readonly?: boolean }, callback?: (this: Database, err: Error | null) => void): Database;
+
     close(callback?: (err: Error | null) => void): void;
 
     run(sql: string, callback?: (this: RunResult, err: Error | null) => void): this;
@@ -115,30 +243,95 @@ export class Database extends events.EventEmitter {
     each<T>(sql: string, params: any, callback?: (this: Statement, err: Error | null, row: T) => void, complete?: (err: Error | null, count: number) => void): this;
     each(sql: string, ...params: any[]): this;
 
+    allArrow(sql: string, callback?: (this: Statement, err: Error | null, ipc: Buffer) => void): this;
+    allArrow(sql: string, params: any, callback?: (this: Statement, err: Error | null, ipc: Buffer) => void): this;
+    allArrow(sql: string, ...params: any[]): this;
+
+    eachArrow(sql: string, batchRows: number, callback?: (this: Statement, err: Error | null, ipc: Buffer) => void, complete?: (err: Error | null, batches: number) => void): this;
+    eachArrow(sql: string, batchRows: number, params: any, callback?: (this: Statement, err: Error | null, ipc: Buffer) => void, complete?: (err: Error | null, batches: number) => void): this;
+    eachArrow(sql: string, batchRows: number, ...params: any[]): this;
+
+    allJSON(sql: string, callback?: (this: Statement, err: Error | null, json: Buffer) => void): this;
+    allJSON(sql: string, params: any, callback?: (this: Statement, err: Error | null, json: Buffer) => void): this;
+    allJSON(sql: string, ...params: any[]): this;
+
+    getJSON(sql: string, callback?: (this: Statement, err: Error | null, json?: Buffer) => void): this;
+    getJSON(sql: string, params: any, callback?: (this: Statement, err: Error | null, json?: Buffer) => void): this;
+    getJSON(sql: string, ...params: any[]): this;
+
+    exportTo(sql: string, target: string | number, callback?: (this: Statement, err: Error | null, result?: ExportResult) => void): this;
+    exportTo(sql: string, target: string | number, options: ExportOptions, callback?: (this: Statement, err: Error | null, result?: ExportResult) => void): this;
+
     exec(sql: string, callback?: (this: Statement, err: Error | null) => void): this;
+    execFile(source: string | number, callback?: (this: Database, err: Error | null, result?: ExecFileResult) => void): this;
+    execFile(source: string | number, options: ExecFileOptions, callback?: (this: Database, err: Error | null, result?: ExecFileResult) => void): this;
 
     prepare(sql: string, callback?: (this: Statement, err: Error | null) => void): Statement;
     prepare(sql: string, params: any, callback?: (this: Statement, err: Error | null) => void): Statement;
     prepare(sql: string, ...params: any[]): Statement;
 
+    prepareMany(sql: string[], callback?: (this: Database, err: Error | null) => void): Statement[];
+
     serialize(callback?: () => void): void;
     parallelize(callback?: () => void): void;
 
+    toBuffer(callback?: (this: Database, err: Error | null, buffer: Buffer) => void): this;
+    toBuffer(schema: string, callback?: (this: Database, err: Error | null, buffer: Buffer) => void): this;
+
+    backupToStream(stream: NodeJS.WritableStream, callback?: (this: Database, err: Error | null) => void): this;
+    backupToStream(stream: NodeJS.WritableStream, options: { pagesPerChunk?: number }, callback?: (this: Database, err: Error | null) => void): this;
+
+    snapshot<T>(fn: (snapshot: Snapshot) => T | Promise<T>, options?: { connections?: number }): Promise<T>;
+
+    query<T = any>(sql: string, callback?: (this: Database, err: Error | null, results: QueryResult<T>[]) => void): this;
+    query<T = any>(sql: string, params: any, callback?: (this: Database, err: Error | null, results: QueryResult<T>[]) => void): this;
+
+    parallelQuery<T = any>(sql: string, callback?: (this: Database, err: Error | null, rows: T[]) => void): this;
+    parallelQuery<T = any>(sql: string, options: ParallelQueryOptions, callback?: (this: Database, err: Error | null, rows: T[]) => void): this;
+
+    watch<T = any>(sql: string, callback: (this: Watch, err: Error | null, result: WatchResult<T>) => void): Watch;
+    watch<T = any>(sql: string, ...params: any[]): Watch;
+
+    session(callback?: (this: Session, err: Error | null) => void): Session;
+    session(schema: string, callback?: (this: Session, err: Error | null) => void): Session;
+
+    applyChangeset(changeset: Buffer, callback?: (this: Database, err: Error | null, conflicts: number) => void): this;
+    applyChangeset(changeset: Buffer, policy: "abort" | "omit" | "replace", callback?: (this: Database, err: Error | null, conflicts: number) => void): this;
+
+    importFile(source: string | number, table: string, callback?: (this: Database, err: Error | null, result?: ImportResult) => void): this;
+    importFile(source: string | number, table: string, options: ImportOptions, callback?: (this: Database, err: Error | null, result?: ImportResult) => void): this;
+
+    loadBuffer(buffer: Buffer, callback?: (this: Database, err: Error | null) => void): this;
+    loadBuffer(buffer: Buffer, options: { schema?: string; readonly?: boolean }, callback?: (this: Database, err: Error | null) => void): this;
+
     on(event: "trace", listener: (sql: string) => void): this;
     on(event: "profile", listener: (sql: string, time: number) => void): this;
     on(event: "change", listener: (type: string, database: string, table: string, rowid: number) => void): this;
+    on(event: "checkpoint", listener: (info: { database: string; mode: "passive" | "restart" | "truncate"; busy: boolean; walFrames: number; logFrames: number; checkpointedFrames: number; duration: number }) => void): this;
+    on(event: "maintenance", listener: (info: { optimized: boolean; vacuumedPages: number; checkedTables: string[]; problems: string[]; busy: boolean; duration: number }) => void): this;
     on(event: "error", listener: (err: Error) => void): this;
     on(event: "open" | "close", listener: () => void): this;
     on(event: string, listener: (...args: any[]) => void): this;
 
     configure(option: "busyTimeout", value: number): void;
     configure(option: "limit", id: number, value: number): void;
+    configure(option: "maintenance", value: { interval?: number; budgetMs?: number; vacuumPages?: number; optimize?: boolean; quickCheck?: boolean } | false): void;
+    configure(option: "walCheckpoint", value: { pages?: number; restartPages?: number; truncatePages?: number } | false): void;
+    configure(option: "queryCache", value: { entries?: number } | false): void;
+    configure(option: "json", value: { blobs?: "base64" | "hex" | "array" }): void;
 
     loadExtension(filename: string, callback?: (err: Error | null) => void): this;
 
     wait(callback?: (param: null) => void): this;
 
     interrupt(): void;
+
+    readonly poolStats: { hits: number; misses: number };
+    readonly queryCacheStats: { hits: number; misses: number; entries: number } | null;
+    cachedRows(sql: string, params?: any[]): any[] | undefined;
+
+    onExternalChange(callback: (this: Database) => void, options?: { intervalMs?: number }): this;
+    onExternalChange(callback: false | null): this;
 }
 
 export function verbose(): sqlite3;
@@ -148,6 +341,7 @@ export interface sqlite3 {
     OPEN_READWRITE: number;
     OPEN_CREATE: number;
     OPEN_FULLMUTEX: number;
+    OPEN_NOMUTEX: number;
     OPEN_SHAREDCACHE: number;
     OPEN_PRIVATECACHE: number;
     OPEN_URI: number;
@@ -59,10 +59,15 @@ sqlite3.cached = {
 const Database = sqlite3.Database;
 const Statement = sqlite3.Statement;
 const Backup = sqlite3.Backup;
+const Session = sqlite3.Session;
+const ShardSet = sqlite3.ShardSet;
+const Watch = sqlite3.Watch;
 
 inherits(Database, EventEmitter);
 inherits(Statement, EventEmitter);
 inherits(Backup, EventEmitter);
+inherits(ShardSet, EventEmitter);
+if (Session) inherits(Session, EventEmitter);
 
 // Database#prepare(sql, [bind1, bind2, ...], [callback])
 Database.prototype.prepare = normalizeMethod(function(statement, params) {
@@ -83,27 +88,87 @@ Database.prototype.get = normalizeMethod(function(statement, params) {
     return this;
 });
 
-// Database#all(sql, [bind1, bind2, ...], [callback])
-Database.prototype.all = normalizeMethod(function(statement, params) {
+const all = normalizeMethod(function(statement, params) {
     statement.all.apply(statement, params).finalize();
     return this;
 });
 
+// Database#all(sql, [bind1, bind2, ...], [callback])
+// With configure("queryCache") on, results of earlier calls are handed out
+// again without preparing the statement, as long as none of the tables they
+// were read from changed.
+Database.prototype.all = function(sql) {
+    const callback = arguments[arguments.length - 1];
+    if (arguments.length > 1 && typeof callback === 'function') {
+        const rows = this.cachedRows(sql, Array.prototype.slice.call(arguments, 1, -1));
+        if (rows) {
+            process.nextTick(() => callback.call(this, null, rows));
+            return this;
+        }
+    }
+    return all.apply(this, arguments);
+};
+
 // Database#each(sql, [bind1, bind2, ...], [callback], [complete])
 Database.prototype.each = normalizeMethod(function(statement, params) {
     statement.each.apply(statement, params).finalize();
     return this;
 });
 
+// Database#allArrow(sql, [bind1, bind2, ...], [callback])
+Database.prototype.allArrow = normalizeMethod(function(statement, params) {
+    statement.allArrow.apply(statement, params).finalize();
+    return this;
+});
+
+// Database#eachArrow(sql, batchRows, [bind1, bind2, ...], [callback], [complete])
+Database.prototype.eachArrow = normalizeMethod(function(statement, params) {
+    statement.eachArrow.apply(statement, params).finalize();
+    return this;
+});
+
+// Database#allJSON(sql, [bind1, bind2, ...], [callback])
+Database.prototype.allJSON = normalizeMethod(function(statement, params) {
+    statement.allJSON.apply(statement, params).finalize();
+    return this;
+});
+
+// Database#getJSON(sql, [bind1, bind2, ...], [callback])
+Database.prototype.getJSON = normalizeMethod(function(statement, params) {
+    statement.getJSON.apply(statement, params).finalize();
+    return this;
+});
+
+// Database#exportTo(sql, path | fd, [options], [callback])
+Database.prototype.exportTo = normalizeMethod(function(statement, params) {
+    statement.exportTo.apply(statement, params).finalize();
+    return this;
+});
+
 Database.prototype.map = normalizeMethod(function(statement, params) {
     statement.map.apply(statement, params).finalize();
     return this;
 });
 
 // Database#backup(filename, [callback])
+// Database#backup(filename, { auto, incremental, targetStepMs, maxPagesPerSec }, [callback])
 // Database#backup(filename, destName, sourceName, filenameIsDest, [callback])
 Database.prototype.backup = function() {
     let backup;
+    if (typeof arguments[1] === 'object' && arguments[1] !== null) {
+        const options = arguments[1];
+        const callback = arguments[2];
+        backup = new Backup(this, arguments[0], 'main', 'main', true, function(err) {
+            if (!err) return;
+            if (typeof callback === 'function') callback.call(backup, err);
+            else backup.emit('error', err);
+        });
+        backup.retryErrors = [sqlite3.BUSY, sqlite3.LOCKED];
+        if (options.auto || options.incremental) {
+            backup.run(options, callback);
+        }
+        return backup;
+    }
     if (arguments.length <= 2) {
         // By default, we write the main database out to the main database of the named file.
         // This is the most likely use of the backup api.
@@ -117,13 +182,240 @@ Database.prototype.backup = function() {
     return backup;
 };
 
+// Database#session([schema], [callback])
+// Starts recording changes to the tables of a database; see Session#attach.
+Database.prototype.session = function(schema, callback) {
+    if (typeof schema === 'function') {
+        callback = schema;
+        schema = undefined;
+    }
+    if (!Session) throw new Error('Sessions are not supported by this SQLite build');
+    return new Session(this, schema, callback);
+};
+
+// Database#watch(sql, [bind1, bind2, ...], callback)
+// Calls back with the rows of the query, and then with the rows that were
+// added and removed each time a commit changes one of the tables it reads,
+// until watch.close() is called.
+Database.prototype.watch = function(sql) {
+    const params = Array.prototype.slice.call(arguments, 1);
+    const callback = params.pop();
+    return new Watch(this, sql, params, callback);
+};
+
+// Database#backupToStream(writable, [{ pagesPerChunk }], [callback])
+// Writes a consistent image of the main database to a writable stream, a
+// chunk of pages at a time as the stream drains. The pages are read through
+// a second, read-only connection that holds a read transaction until the
+// last chunk is read. Needs a database file: an in-memory database can't be
+// opened a second time, so use toBuffer() for those.
+Database.prototype.backupToStream = function(stream, options, callback) {
+    if (typeof options === 'function') {
+        callback = options;
+        options = undefined;
+    }
+    const pagesPerChunk = (options && options.pagesPerChunk) || 256;
+    const db = this;
+    let finished = false;
+    // Closes what the chunks are read from, once it is open.
+    let close = null;
+    let drain = null;
+
+    // Runs once, when the image is written or on the first error, which may
+    // come from the stream while waiting for 'drain'.
+    function finish(err) {
+        if (finished) return;
+        finished = true;
+        stream.removeListener('error', finish);
+        if (drain) stream.removeListener('drain', drain);
+        const done = function(closeErr) {
+            err = err || closeErr;
+            if (typeof callback === 'function') callback.call(db, err || null);
+            else if (err) db.emit('error', err);
+        };
+        if (close) close(done);
+        else done(null);
+    }
+    stream.on('error', finish);
+
+    // Moves chunks from read() to the stream until read() runs out.
+    function pump(read) {
+        read(function(err, chunk) {
+            if (finished) return;
+            if (err || !chunk) return finish(err);
+            if (stream.write(chunk)) return pump(read);
+            drain = function() {
+                drain = null;
+                pump(read);
+            };
+            stream.once('drain', drain);
+        });
+    }
+
+    db.get("SELECT file FROM pragma_database_list WHERE name = 'main'", function(err, row) {
+        if (finished) return;
+        if (err) return finish(err);
+
+        if (!row.file) return finish(new Error('Streaming a backup needs a database file'));
+
+        const reader = new Database(row.file, sqlite3.OPEN_READONLY, function(err) {
+            if (err) return finish(err);
+            reader.serialize();
+            // The writes of other connections between two chunks must not
+            // show up in the image.
+            reader.run("BEGIN", function(err) {
+                if (err) finish(err);
+            });
+            const pages = reader.prepare("SELECT data FROM sqlite_dbpage");
+            close = function(cb) {
+                pages.finalize();
+                reader.run("COMMIT", function() {});
+                reader.close(cb);
+            };
+            if (finished) return close(function() {});
+            pump(function(cb) {
+                const chunk = [];
+                let error = null;
+                let remaining = pagesPerChunk;
+                for (let i = 0; i < pagesPerChunk; i++) {
+                    pages.get(function(err, row) {
+                        if (err) error = error || err;
+                        else if (row) chunk.push(row.data);
+                        if (--remaining === 0) cb(error, chunk.length ? Buffer.concat(chunk) : null);
+                    });
+                }
+            });
+        });
+    });
+    return this;
+};
+
+// Database#snapshot(fn, [{ connections }])
+// Calls fn(snapshot) with a set of read-only connections that all see the
+// same committed state of the database, and returns a promise for the value
+// that fn returns or resolves to. snapshot.get() and snapshot.all() return
+// promises and are spread over the connections, so independent queries run
+// in parallel without seeing each other's writes or those made meanwhile.
+// The first connection takes the snapshot and keeps its read transaction
+// open until fn is done, so checkpoints can't invalidate it for the others.
+// Needs a database file in WAL mode.
+Database.prototype.snapshot = function(fn, options) {
+    const count = Math.max(1, (options && options.connections) || 4);
+    const db = this;
+    let taken = null;
+
+    function open(filename, snapshot) {
+        return new Promise(function(resolve, reject) {
+            const reader = new Database(filename, sqlite3.OPEN_READONLY, function(err) {
+                if (err) return reject(err);
+                reader.busy = 0;
+                if (snapshot) {
+                    reader.beginSnapshot(snapshot, function(err) {
+                        if (err) reader.close(function() { reject(err); });
+                        else resolve(reader);
+                    });
+                } else {
+                    reader.beginSnapshot(function(err, snapshot) {
+                        if (err) reader.close(function() { reject(err); });
+                        else { taken = snapshot; resolve(reader); }
+                    });
+                }
+            });
+        });
+    }
+
+    function close(readers) {
+        return Promise.all(readers.map(function(reader) {
+            return new Promise(function(resolve) {
+                reader.exec("COMMIT", function() { reader.close(function() { resolve(); }); });
+            });
+        }));
+    }
+
+    function query(readers, method) {
+        return function() {
+            const args = Array.prototype.slice.call(arguments);
+            let reader = readers[0];
+            for (let i = 1; i < readers.length; i++) {
+                if (readers[i].busy < reader.busy) reader = readers[i];
+            }
+            reader.busy++;
+            return new Promise(function(resolve, reject) {
+                args.push(function(err, result) {
+                    reader.busy--;
+                    if (err) reject(err);
+                    else resolve(result);
+                });
+                reader[method].apply(reader, args);
+            });
+        };
+    }
+
+    return new Promise(function(resolve, reject) {
+        db.get("SELECT file FROM pragma_database_list WHERE name = 'main'", function(err, row) {
+            if (err) return reject(err);
+            if (!row.file) return reject(new Error('Snapshots need a database file'));
+            resolve(row.file);
+        });
+    }).then(function(filename) {
+        return open(filename).then(function(first) {
+            const others = [];
+            for (let i = 1; i < count; i++) others.push(open(filename, taken));
+            return Promise.allSettled(others).then(function(results) {
+                const readers = [first];
+                let error = null;
+                results.forEach(function(result) {
+                    if (result.status === 'fulfilled') readers.push(result.value);
+                    else error = error || result.reason;
+                });
+                if (error) return close(readers).then(function() { throw error; });
+
+                const snapshot = {
+                    get: query(readers, 'get'),
+                    all: query(readers, 'all'),
+                };
+                return Promise.resolve().then(function() {
+                    return fn(snapshot);
+                }).then(function(result) {
+                    return close(readers).then(function() { return result; });
+                }, function(err) {
+                    return close(readers).then(function() { throw err; });
+                });
+            });
+        });
+    });
+};
+
+// Database.fromBuffer(buffer, [{ readonly }], [callback])
+// Opens an in-memory database with the contents of a buffer from Database#toBuffer.
+Database.fromBuffer = function(buffer, options, callback) {
+    if (typeof options === 'function') {
+        callback = options;
+        options = undefined;
+    }
+    const db = new Database(':memory:');
+    db.loadBuffer(buffer, { readonly: !!(options && options.readonly) }, callback);
+    return db;
+};
+
 Statement.prototype.map = function() {
     const params = Array.prototype.slice.call(arguments);
     const callback = params.pop();
+    // The mode all() below is called with
+    const mode = this.rowMode();
     params.push(function(err, rows) {
         if (err) return callback(err);
         const result = {};
-        if (rows.length) {
+        if (mode === 'pluck') {
+            // Plucked values map to themselves
+            for (let i = 0; i < rows.length; i++) {
+                result[rows[i]] = rows[i];
+            }
+        } else if (mode === 'array') {
+            for (let i = 0; i < rows.length; i++) {
+                result[rows[i][0]] = rows[i].length > 2 ? rows[i] : rows[i][1];
+            }
+        } else if (rows.length) {
             const keys = Object.keys(rows[0]);
             const key = keys[0];
             if (keys.length > 2) {
@@ -178,6 +470,9 @@ sqlite3.verbose = function() {
         const trace = require('./trace');
         [
             'prepare',
+            'prepareMany',
+            'parallelQuery',
+            'query',
             'get',
             'run',
             'all',
@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <initializer_list>
+
+#include "arrow.h"
+
+using namespace node_sqlite3;
+
+namespace {
+
+// Writes a flatbuffer front to back: tables and vectors come before the
+// objects they refer to, and their offsets are filled in with Link() once
+// those are written. Numbers are written in the byte order of the host,
+// which Arrow requires to be little-endian here.
+class FlatBuilder {
+public:
+    std::string buf;
+
+    FlatBuilder() {
+        // Offset of the root table.
+        Put<uint32_t>(0);
+    }
+
+    void Pad(size_t align) {
+        buf.append((align - buf.size() % align) % align, '\0');
+    }
+
+    template <class T> size_t Put(T value) {
+        size_t pos = buf.size();
+        buf.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        return pos;
+    }
+
+    template <class T> void Set(size_t pos, T value) {
+        memcpy(&buf[pos], &value, sizeof(T));
+    }
+
+    // Points the offset at pos to the object at target.
+    void Link(size_t pos, size_t target) {
+        Set<uint32_t>(pos, static_cast<uint32_t>(target - pos));
+    }
+
+    // Writes a table with the fields of the given sizes, in the order of
+    // their ids; fields of size 0 are left out. The fields are zeroed, and
+    // their positions are returned in fields. Returns the position of the
+    // table.
+    size_t Table(std::initializer_list<size_t> sizes, std::vector<size_t>& fields) {
+        std::vector<size_t> order;
+        size_t align = 4;
+        for (size_t i = 0; i < sizes.size(); i++) {
+            if (sizes.begin()[i]) order.push_back(i);
+            align = std::max(align, sizes.begin()[i]);
+        }
+        // Largest fields first, so that they need the least padding.
+        std::stable_sort(order.begin(), order.end(), [&sizes](size_t a, size_t b) {
+            return sizes.begin()[a] > sizes.begin()[b];
+        });
+
+        // Position of each field relative to the table, after the offset of
+        // its vtable.
+        std::vector<uint16_t> offsets(sizes.size(), 0);
+        size_t size = 4;
+        for (size_t i : order) {
+            size_t field = sizes.begin()[i];
+            size = (size + field - 1) / field * field;
+            offsets[i] = static_cast<uint16_t>(size);
+            size += field;
+        }
+
+        Pad(2);
+        size_t vtable = Put<uint16_t>(static_cast<uint16_t>(4 + 2 * sizes.size()));
+        Put<uint16_t>(static_cast<uint16_t>(size));
+        for (uint16_t offset : offsets) Put<uint16_t>(offset);
+
+        Pad(align);
+        size_t table = Put<int32_t>(static_cast<int32_t>(buf.size() - vtable));
+        buf.append(size - 4, '\0');
+
+        fields.assign(sizes.size(), 0);
+        for (size_t i = 0; i < sizes.size(); i++) {
+            if (offsets[i]) fields[i] = table + offsets[i];
+        }
+        return table;
+    }
+
+    // Writes the length of a vector so that its elements, which the caller
+    // writes next, are aligned. Returns the position of the vector.
+    size_t Vector(size_t length, size_t align) {
+        while ((buf.size() + 4) % align) buf += '\0';
+        return Put<uint32_t>(static_cast<uint32_t>(length));
+    }
+
+    // Writes a vector of offsets to tables and returns the positions of the
+    // offsets.
+    size_t Offsets(size_t length, std::vector<size_t>& slots) {
+        size_t vector = Vector(length, 4);
+        slots.clear();
+        for (size_t i = 0; i < length; i++) slots.push_back(Put<uint32_t>(0));
+        return vector;
+    }
+
+    size_t String(const std::string& value) {
+        size_t pos = Vector(value.size(), 4);
+        buf.append(value);
+        buf += '\0';
+        return pos;
+    }
+};
+
+// Values of the Arrow flatbuffer schema (Message.fbs, Schema.fbs).
+const int16_t METADATA_V5 = 4;
+const uint8_t HEADER_SCHEMA = 1;
+const uint8_t HEADER_RECORD_BATCH = 3;
+const uint8_t TYPE_INT = 2;
+const uint8_t TYPE_FLOATING_POINT = 3;
+const uint8_t TYPE_BINARY = 4;
+const uint8_t TYPE_UTF8 = 5;
+const int16_t PRECISION_DOUBLE = 2;
+
+// Writes a message of the IPC stream format: the continuation marker, the
+// size of the metadata and the metadata, padded to 8 bytes, and the body.
+void WriteMessage(std::string& out, FlatBuilder& metadata, const std::string& body) {
+    metadata.Pad(8);
+    uint32_t marker = 0xFFFFFFFF;
+    uint32_t size = static_cast<uint32_t>(metadata.buf.size());
+    out.append(reinterpret_cast<const char*>(&marker), 4);
+    out.append(reinterpret_cast<const char*>(&size), 4);
+    out.append(metadata.buf);
+    out.append(body);
+}
+
+// Writes the Message table that the header is part of, and returns the
+// position of the offset to the header.
+size_t StartMessage(FlatBuilder& b, uint8_t type, int64_t body) {
+    std::vector<size_t> fields;
+    size_t message = b.Table({ 2, 1, 4, 8 }, fields);
+    b.Link(0, message);
+    b.Set<int16_t>(fields[0], METADATA_V5);
+    b.Set<uint8_t>(fields[1], type);
+    b.Set<int64_t>(fields[3], body);
+    return fields[2];
+}
+
+struct StatementColumn {
+    sqlite3_stmt* stmt;
+    int i;
+    int Type() const { return sqlite3_column_type(stmt, i); }
+    sqlite3_int64 Int64() const { return sqlite3_column_int64(stmt, i); }
+    double Double() const { return sqlite3_column_double(stmt, i); }
+    const void* Text() const { return sqlite3_column_text(stmt, i); }
+    const void* Blob() const { return sqlite3_column_blob(stmt, i); }
+    int Bytes() const { return sqlite3_column_bytes(stmt, i); }
+};
+
+struct ValueColumn {
+    sqlite3_value* value;
+    int Type() const { return sqlite3_value_type(value); }
+    sqlite3_int64 Int64() const { return sqlite3_value_int64(value); }
+    double Double() const { return sqlite3_value_double(value); }
+    const void* Text() const { return sqlite3_value_text(value); }
+    const void* Blob() const { return sqlite3_value_blob(value); }
+    int Bytes() const { return sqlite3_value_bytes(value); }
+};
+
+// Maps a declared type to the type its affinity stores, following the
+// rules of "Determination Of Column Affinity". Columns without one, and
+// with NUMERIC affinity, can hold values of any type.
+ArrowWriter::Type DeclaredType(const char* decltype_) {
+    if (!decltype_) return ArrowWriter::UNKNOWN;
+    std::string type(decltype_);
+    std::transform(type.begin(), type.end(), type.begin(), ::toupper);
+    auto has = [&type](const char* part) { return type.find(part) != std::string::npos; };
+    if (has("INT")) return ArrowWriter::INT64;
+    if (has("CHAR") || has("CLOB") || has("TEXT")) return ArrowWriter::UTF8;
+    if (has("BLOB")) return ArrowWriter::BINARY;
+    if (has("REAL") || has("FLOA") || has("DOUB")) return ArrowWriter::FLOAT64;
+    return ArrowWriter::UNKNOWN;
+}
+
+}
+
+ArrowWriter::ArrowWriter(sqlite3_stmt* stmt) {
+    int count = sqlite3_column_count(stmt);
+    columns.resize(count);
+    for (int i = 0; i < count; i++) {
+        auto& column = columns[i];
+        const char* name = sqlite3_column_name(stmt, i);
+        column.name = name ? name : "";
+        column.type = DeclaredType(sqlite3_column_decltype(stmt, i));
+        if (column.type == UTF8 || column.type == BINARY) column.offsets.push_back(0);
+    }
+}
+
+ArrowWriter::~ArrowWriter() {
+    for (auto& column : columns) {
+        for (auto* value : column.pending) sqlite3_value_free(value);
+    }
+}
+
+void ArrowWriter::Append(sqlite3_stmt* stmt) {
+    for (size_t i = 0; i < columns.size(); i++) {
+        auto& column = columns[i];
+        if (column.type == UNKNOWN) {
+            column.pending.push_back(sqlite3_value_dup(sqlite3_column_value(stmt, static_cast<int>(i))));
+        }
+        else {
+            Append(column, StatementColumn{ stmt, static_cast<int>(i) });
+        }
+    }
+    length++;
+}
+
+template <class Source> void ArrowWriter::Append(Column& column, const Source& source) {
+    size_t row = column.type == UTF8 || column.type == BINARY ?
+        column.offsets.size() - 1 : column.data.size() / 8;
+    if (row % 8 == 0) column.validity += '\0';
+
+    bool null = source.Type() == SQLITE_NULL;
+    if (null) {
+        column.nulls++;
+    }
+    else {
+        column.validity.back() |= static_cast<char>(1 << (row % 8));
+    }
+
+    switch (column.type) {
+        case INT64: {
+            int64_t value = null ? 0 : source.Int64();
+            column.data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        } break;
+        case FLOAT64: {
+            double value = null ? 0 : source.Double();
+            column.data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        } break;
+        case UTF8:
+        case BINARY: {
+            if (!null) {
+                const void* value = column.type == UTF8 ? source.Text() : source.Blob();
+                int bytes = source.Bytes();
+                if (value && bytes > 0) column.data.append(static_cast<const char*>(value), bytes);
+            }
+            column.offsets.push_back(static_cast<int32_t>(column.data.size()));
+        } break;
+        default: break;
+    }
+}
+
+bool ArrowWriter::Full() const {
+    for (auto& column : columns) {
+        if (column.data.size() >= (1u << 30)) return true;
+    }
+    return false;
+}
+
+// Gives the columns whose type depends on their values the type of the
+// values of the first batch, and appends those values.
+void ArrowWriter::Resolve() {
+    for (auto& column : columns) {
+        if (column.type != UNKNOWN) continue;
+
+        bool integer = false, real = false, text = false, blob = false;
+        for (auto* value : column.pending) {
+            switch (sqlite3_value_type(value)) {
+                case SQLITE_INTEGER: integer = true; break;
+                case SQLITE_FLOAT: real = true; break;
+                case SQLITE_TEXT: text = true; break;
+                case SQLITE_BLOB: blob = true; break;
+            }
+        }
+        if (blob) column.type = BINARY;
+        else if (text) column.type = UTF8;
+        else if (real) column.type = FLOAT64;
+        else if (integer) column.type = INT64;
+        // Nothing but NULLs: text keeps whatever later batches hold.
+        else column.type = UTF8;
+
+        if (column.type == UTF8 || column.type == BINARY) column.offsets.push_back(0);
+        for (auto* value : column.pending) {
+            Append(column, ValueColumn{ value });
+            sqlite3_value_free(value);
+        }
+        column.pending.clear();
+    }
+}
+
+void ArrowWriter::Clear() {
+    for (auto& column : columns) {
+        column.nulls = 0;
+        column.validity.clear();
+        column.data.clear();
+        column.offsets.clear();
+        if (column.type == UTF8 || column.type == BINARY) column.offsets.push_back(0);
+    }
+    length = 0;
+}
+
+void ArrowWriter::WriteSchema(std::string& out) {
+    Resolve();
+
+    FlatBuilder b;
+    std::vector<size_t> fields;
+    size_t header = StartMessage(b, HEADER_SCHEMA, 0);
+
+    size_t schema = b.Table({ 0, 4 }, fields);
+    b.Link(header, schema);
+    size_t list = fields[1];
+
+    std::vector<size_t> slots;
+    b.Link(list, b.Offsets(columns.size(), slots));
+    for (size_t i = 0; i < columns.size(); i++) {
+        auto& column = columns[i];
+        size_t field = b.Table({ 4, 1, 1, 4, 0, 4 }, fields);
+        b.Link(slots[i], field);
+        size_t name = fields[0], type = fields[3], children = fields[5];
+        b.Set<uint8_t>(fields[1], 1);
+
+        switch (column.type) {
+            case INT64: {
+                b.Set<uint8_t>(fields[2], TYPE_INT);
+                b.Link(type, b.Table({ 4, 1 }, fields));
+                b.Set<int32_t>(fields[0], 64);
+                b.Set<uint8_t>(fields[1], 1);
+            } break;
+            case FLOAT64: {
+                b.Set<uint8_t>(fields[2], TYPE_FLOATING_POINT);
+                b.Link(type, b.Table({ 2 }, fields));
+                b.Set<int16_t>(fields[0], PRECISION_DOUBLE);
+            } break;
+            default: {
+                b.Set<uint8_t>(fields[2], column.type == BINARY ? TYPE_BINARY : TYPE_UTF8);
+                b.Link(type, b.Table({}, fields));
+            } break;
+        }
+
+        b.Link(name, b.String(column.name));
+        b.Link(children, b.Vector(0, 4));
+    }
+
+    WriteMessage(out, b, std::string());
+}
+
+void ArrowWriter::WriteBatch(std::string& out) {
+    Resolve();
+
+    // Buffers of the body, each padded to 8 bytes: the validity bitmap,
+    // left out if there are no NULLs, then the offsets for Utf8 and Binary
+    // columns, and the values.
+    std::string body;
+    std::vector<std::pair<int64_t, int64_t> > buffers;
+    auto add = [&body, &buffers](const char* data, size_t size) {
+        buffers.emplace_back(static_cast<int64_t>(body.size()), static_cast<int64_t>(size));
+        body.append(data, size);
+        body.append((8 - size % 8) % 8, '\0');
+    };
+    for (auto& column : columns) {
+        add(column.validity.data(), column.nulls ? column.validity.size() : 0);
+        if (column.type == UTF8 || column.type == BINARY) {
+            add(reinterpret_cast<const char*>(column.offsets.data()),
+                column.offsets.size() * sizeof(int32_t));
+        }
+        add(column.data.data(), column.data.size());
+    }
+
+    FlatBuilder b;
+    std::vector<size_t> fields;
+    size_t header = StartMessage(b, HEADER_RECORD_BATCH, static_cast<int64_t>(body.size()));
+
+    size_t batch = b.Table({ 8, 4, 4 }, fields);
+    b.Link(header, batch);
+    b.Set<int64_t>(fields[0], static_cast<int64_t>(length));
+    size_t nodes = fields[1], list = fields[2];
+
+    // FieldNode and Buffer are structs of two longs.
+    b.Link(nodes, b.Vector(columns.size(), 8));
+    for (auto& column : columns) {
+        b.Put<int64_t>(static_cast<int64_t>(length));
+        b.Put<int64_t>(static_cast<int64_t>(column.nulls));
+    }
+    b.Link(list, b.Vector(buffers.size(), 8));
+    for (auto& buffer : buffers) {
+        b.Put<int64_t>(buffer.first);
+        b.Put<int64_t>(buffer.second);
+    }
+
+    WriteMessage(out, b, body);
+    Clear();
+}
+
+void ArrowWriter::WriteEnd(std::string& out) {
+    uint32_t end[] = { 0xFFFFFFFF, 0 };
+    out.append(reinterpret_cast<const char*>(end), sizeof(end));
+}
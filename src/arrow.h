@@ -0,0 +1,73 @@
+#ifndef NODE_SQLITE3_SRC_ARROW_H
+#define NODE_SQLITE3_SRC_ARROW_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+namespace node_sqlite3 {
+
+/**
+ *
+ * Encodes the rows of a statement as Apache Arrow IPC streams, straight
+ * from the statement, for Statement#allArrow and Statement#eachArrow.
+ *
+ * Each column gets the type of its declared affinity: INTEGER is Int64,
+ * REAL Float64, TEXT Utf8 and BLOB Binary. The types of other columns,
+ * such as expressions, are taken from the values in the first batch: Int64
+ * if they are all integers, Float64 if there are also floats, and Utf8 or
+ * Binary as soon as there is text or a blob. Values that don't have the
+ * type of their column are converted the way sqlite3_column_*() does. All
+ * columns are nullable.
+ *
+ */
+class ArrowWriter {
+public:
+    enum Type { UNKNOWN = 0, INT64, FLOAT64, UTF8, BINARY };
+
+    explicit ArrowWriter(sqlite3_stmt* stmt);
+    ~ArrowWriter();
+
+    // Appends the row the statement is on.
+    void Append(sqlite3_stmt* stmt);
+
+    // Rows appended since the last batch.
+    size_t Length() const { return length; }
+    // Whether the batch should be written before it gets too large for the
+    // 32 bit offsets of Utf8 and Binary columns.
+    bool Full() const;
+
+    // Appends the schema message to out. The types are fixed from then on.
+    void WriteSchema(std::string& out);
+    // Appends a record batch with the rows appended since the last one.
+    void WriteBatch(std::string& out);
+    // Appends the end-of-stream marker.
+    static void WriteEnd(std::string& out);
+
+protected:
+    struct Column {
+        std::string name;
+        Type type = UNKNOWN;
+        size_t nulls = 0;
+        // Validity bitmap, values, and offsets into the values for Utf8 and
+        // Binary columns.
+        std::string validity;
+        std::string data;
+        std::vector<int32_t> offsets;
+        // Values of the first batch, kept until the type is known.
+        std::vector<sqlite3_value*> pending;
+    };
+
+    template <class Source> void Append(Column& column, const Source& source);
+    void Resolve();
+    void Clear();
+
+    std::vector<Column> columns;
+    size_t length = 0;
+};
+
+}
+
+#endif
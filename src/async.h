@@ -4,7 +4,7 @@
 #include <napi.h>
 #include <uv.h>
 
-#include "threading.h"
+#include "ring.h"
 
 // Generic uv_async handler.
 template <class Item, class Parent> class Async {
@@ -12,8 +12,7 @@ template <class Item, class Parent> class Async {
 
 protected:
     uv_async_t watcher;
-    NODE_SQLITE3_MUTEX_t
-    std::vector<Item*> data;
+    Ring<Item> data;
     Callback callback;
 public:
     Parent* parent;
@@ -22,7 +21,6 @@ public:
     Async(Parent* parent_, Callback cb_)
         : callback(cb_), parent(parent_) {
         watcher.data = this;
-        NODE_SQLITE3_MUTEX_INIT
         uv_loop_t *loop;
         napi_get_uv_event_loop(parent_->Env(), &loop);
         uv_async_init(loop, &watcher, reinterpret_cast<uv_async_cb>(listener));
@@ -30,12 +28,10 @@ public:
 
     static void listener(uv_async_t* handle) {
         auto* async = static_cast<Async*>(handle->data);
-        std::vector<Item*> rows;
-        NODE_SQLITE3_MUTEX_LOCK(&async->mutex)
-        rows.swap(async->data);
-        NODE_SQLITE3_MUTEX_UNLOCK(&async->mutex)
-        for(auto row : rows)
-            async->callback(async->parent, row);
+        async->data.acknowledge();
+        Item item;
+        while (async->data.pop(item))
+            async->callback(async->parent, &item);
     }
 
     static void close(uv_handle_t* handle) {
@@ -53,23 +49,10 @@ public:
         uv_close((uv_handle_t*)&watcher, close);
     }
 
-    void add(Item* item) {
-        NODE_SQLITE3_MUTEX_LOCK(&mutex);
-        data.emplace_back(item);
-        NODE_SQLITE3_MUTEX_UNLOCK(&mutex)
-    }
-
-    void send() {
-        uv_async_send(&watcher);
-    }
-
-    void send(Item* item) {
-        add(item);
-        send();
-    }
-
-    ~Async() {
-        NODE_SQLITE3_MUTEX_DESTROY
+    void send(Item&& item) {
+        if (data.push(std::move(item))) {
+            uv_async_send(&watcher);
+        }
     }
 };
 
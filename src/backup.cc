@@ -1,11 +1,351 @@
+#include <algorithm>
+#include <cstdio>
 #include <cstring>
+#include <vector>
 #include <napi.h>
 #include "macros.h"
 #include "database.h"
 #include "backup.h"
+#include "query_cache.h"
 
 using namespace node_sqlite3;
 
+// Text of message is a little awkward to get, since the error is not associated
+// with a db connection.
+static std::string ErrorMessage(int status) {
+#if SQLITE_VERSION_NUMBER >= 3007015
+    // sqlite3_errstr is a relatively new method
+    return std::string(sqlite3_errstr(status));
+#else
+    return "Sqlite error";
+#endif
+}
+
+static const char PAGE_HASHES_MAGIC[8] = { 'S', 'Q', 'L', 'P', 'A', 'G', 'E', '3' };
+
+static inline uint64_t Rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t Fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// 128-bit checksum of a database page (MurmurHash3, x64 variant). Every bit
+// of the page reaches every bit of the checksum, so a page that changed is
+// practically never taken for the old one. Page sizes are a power of two
+// of at least 512 bytes, so there is no tail to hash.
+static void PageHash(const unsigned char* data, int size, uint64_t hash[2]) {
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+    uint64_t h1 = 0;
+    uint64_t h2 = 0;
+    for (int i = 0; i + 16 <= size; i += 16) {
+        uint64_t k1, k2;
+        memcpy(&k1, data + i, 8);
+        memcpy(&k2, data + i + 8, 8);
+
+        k1 *= c1; k1 = Rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = Rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2; k2 = Rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = Rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+    h1 ^= static_cast<uint64_t>(size);
+    h2 ^= static_cast<uint64_t>(size);
+    h1 += h2;
+    h2 += h1;
+    h1 = Fmix64(h1);
+    h2 = Fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    hash[0] = h1;
+    hash[1] = h2;
+}
+
+// Reads the page checksums written by the last differential backup, two
+// words per page, and the change counter dest had when they were written.
+static void ReadPageHashes(const std::string& path, uint32_t& pageSize,
+                           uint32_t& changeCounter, std::vector<uint64_t>& hashes) {
+    pageSize = 0;
+    changeCounter = 0;
+    hashes.clear();
+
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return;
+    char magic[8];
+    uint32_t header[3];
+    if (fread(magic, 1, 8, file) == 8 && memcmp(magic, PAGE_HASHES_MAGIC, 8) == 0 &&
+            fread(header, sizeof(uint32_t), 3, file) == 3) {
+        hashes.resize(static_cast<size_t>(header[1]) * 2);
+        if (fread(hashes.data(), sizeof(uint64_t), hashes.size(), file) == hashes.size()) {
+            pageSize = header[0];
+            changeCounter = header[2];
+        }
+        else {
+            hashes.clear();
+        }
+    }
+    fclose(file);
+}
+
+static bool WritePageHashes(const std::string& path, uint32_t pageSize,
+                            uint32_t changeCounter, const std::vector<uint64_t>& hashes) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    uint32_t header[3] = { pageSize, static_cast<uint32_t>(hashes.size() / 2), changeCounter };
+    bool ok = fwrite(PAGE_HASHES_MAGIC, 1, 8, file) == 8 &&
+        fwrite(header, sizeof(uint32_t), 3, file) == 3 &&
+        fwrite(hashes.data(), sizeof(uint64_t), hashes.size(), file) == hashes.size();
+    return fclose(file) == 0 && ok;
+}
+
+static int QueryInt(sqlite3* db, const char* sql, int& value) {
+    sqlite3_stmt* stmt = NULL;
+    int status = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    if (status == SQLITE_OK && (status = sqlite3_step(stmt)) == SQLITE_ROW) {
+        value = sqlite3_column_int(stmt, 0);
+        status = SQLITE_OK;
+    }
+    sqlite3_finalize(stmt);
+    return status;
+}
+
+// The file change counter in the header of page 1, which every commit to a
+// database in rollback journal mode increments.
+static int ReadChangeCounter(sqlite3* db, uint32_t& counter) {
+    sqlite3_stmt* stmt = NULL;
+    counter = 0;
+    int status = sqlite3_prepare_v2(db, "SELECT data FROM sqlite_dbpage WHERE pgno = 1", -1, &stmt, NULL);
+    if (status == SQLITE_OK) {
+        status = sqlite3_step(stmt);
+        if (status == SQLITE_ROW && sqlite3_column_bytes(stmt, 0) >= 28) {
+            auto* data = static_cast<const unsigned char*>(sqlite3_column_blob(stmt, 0));
+            counter = (static_cast<uint32_t>(data[24]) << 24) | (data[25] << 16) |
+                (data[26] << 8) | data[27];
+        }
+        if (status == SQLITE_ROW || status == SQLITE_DONE) status = SQLITE_OK;
+    }
+    sqlite3_finalize(stmt);
+    return status;
+}
+
+// Checksums of the pages dest holds right now.
+static int HashPages(sqlite3* db, std::vector<uint64_t>& hashes) {
+    sqlite3_stmt* stmt = NULL;
+    hashes.clear();
+    int status = sqlite3_prepare_v2(db, "SELECT data FROM sqlite_dbpage", -1, &stmt, NULL);
+    while (status == SQLITE_OK && (status = sqlite3_step(stmt)) == SQLITE_ROW) {
+        uint64_t hash[2];
+        PageHash(static_cast<const unsigned char*>(sqlite3_column_blob(stmt, 0)),
+            sqlite3_column_bytes(stmt, 0), hash);
+        hashes.push_back(hash[0]);
+        hashes.push_back(hash[1]);
+        status = SQLITE_OK;
+    }
+    sqlite3_finalize(stmt);
+    return status == SQLITE_DONE ? SQLITE_OK : status;
+}
+
+static bool IsWal(sqlite3* db) {
+    sqlite3_stmt* stmt = NULL;
+    bool wal = false;
+    if (sqlite3_prepare_v2(db, "PRAGMA journal_mode", -1, &stmt, NULL) == SQLITE_OK &&
+            sqlite3_step(stmt) == SQLITE_ROW) {
+        auto* mode = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        wal = mode && sqlite3_stricmp(mode, "wal") == 0;
+    }
+    sqlite3_finalize(stmt);
+    return wal;
+}
+
+// Writes the pages of the source database that changed since the last
+// differential backup to dest. The source is read in a single transaction
+// of a connection of its own, so dest ends up with a consistent image.
+// The pages are written through sqlite_dbpage in a write transaction on
+// dest, so that SQLite takes the locks, rolls back a hot journal first and
+// writes to the WAL if dest is in WAL mode.
+//
+// The checksums of the last run are only trusted while dest's change
+// counter is the one recorded with them, i.e. nobody else wrote to dest in
+// between. Commits in WAL mode leave the counter alone, so a WAL dest is
+// compared against checksums of its own pages instead.
+static int CopyChangedPages(const std::string& source, const std::string& dest, int busyTimeout,
+                            int& pageCount, int& changed, std::string& message) {
+    sqlite3* src = NULL;
+    sqlite3* dst = NULL;
+    sqlite3_stmt* read = NULL;
+    sqlite3_stmt* write = NULL;
+    int pageSize = 0;
+    int destPageSize = 0;
+    int destPageCount = 0;
+    uint32_t destChangeCounter = 0;
+    bool destWal = false;
+    const char* failed = NULL;
+
+    int status = sqlite3_open_v2(source.c_str(), &src, SQLITE_OPEN_READONLY, NULL);
+    if (status == SQLITE_OK) {
+        sqlite3_busy_timeout(src, busyTimeout);
+        status = sqlite3_exec(src, "BEGIN", NULL, NULL, NULL);
+    }
+    if (status == SQLITE_OK) {
+        status = QueryInt(src, "PRAGMA page_size", pageSize);
+    }
+    if (status == SQLITE_OK) {
+        status = sqlite3_prepare_v2(src, "SELECT pgno, data FROM sqlite_dbpage", -1, &read, NULL);
+    }
+    if (status != SQLITE_OK) {
+        message = std::string(src ? sqlite3_errmsg(src) : sqlite3_errstr(status));
+        sqlite3_finalize(read);
+        sqlite3_close(src);
+        return status;
+    }
+
+    status = sqlite3_open_v2(dest.c_str(), &dst, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (status == SQLITE_OK) {
+        sqlite3_busy_timeout(dst, busyTimeout);
+        // Only takes effect while dest is still empty.
+        std::string pragma = "PRAGMA page_size = " + std::to_string(pageSize);
+        status = sqlite3_exec(dst, pragma.c_str(), NULL, NULL, NULL);
+    }
+    if (status == SQLITE_OK) {
+        destWal = IsWal(dst);
+        // Keeps the lock after COMMIT, so that the change counter read
+        // afterwards is the one of our commit.
+        if (!destWal) status = sqlite3_exec(dst, "PRAGMA locking_mode = EXCLUSIVE", NULL, NULL, NULL);
+    }
+    if (status == SQLITE_OK) {
+        status = sqlite3_exec(dst, "BEGIN IMMEDIATE", NULL, NULL, NULL);
+    }
+    if (status == SQLITE_OK) {
+        status = QueryInt(dst, "PRAGMA page_size", destPageSize);
+    }
+    if (status == SQLITE_OK) {
+        status = QueryInt(dst, "PRAGMA page_count", destPageCount);
+    }
+    if (status == SQLITE_OK) {
+        status = ReadChangeCounter(dst, destChangeCounter);
+    }
+    if (status == SQLITE_OK) {
+        status = sqlite3_prepare_v2(dst, "INSERT INTO sqlite_dbpage(pgno, data) VALUES (?, ?)", -1, &write, NULL);
+    }
+    if (status == SQLITE_OK && destPageSize != pageSize) {
+        status = SQLITE_MISMATCH;
+        message = "the page size of " + dest + " differs from the source";
+    }
+    if (status != SQLITE_OK) {
+        if (message.empty()) message = std::string(dst ? sqlite3_errmsg(dst) : sqlite3_errstr(status));
+        sqlite3_finalize(write);
+        sqlite3_close(dst);
+        sqlite3_finalize(read);
+        sqlite3_close(src);
+        return status;
+    }
+
+    std::string hashesPath = dest + "-pages";
+    uint32_t previousPageSize;
+    uint32_t previousChangeCounter;
+    std::vector<uint64_t> previous;
+    ReadPageHashes(hashesPath, previousPageSize, previousChangeCounter, previous);
+    if (destWal) {
+        status = HashPages(dst, previous);
+        if (status != SQLITE_OK) previous.clear();
+    }
+    else if (static_cast<int>(previousPageSize) != pageSize ||
+            previousChangeCounter != destChangeCounter ||
+            previous.size() != static_cast<size_t>(destPageCount) * 2) {
+        previous.clear();
+    }
+    // If we don't get to write the new checksums, the next backup has to
+    // write every page again.
+    remove(hashesPath.c_str());
+
+    // SQLite never uses the page that holds the lock bytes; sqlite_dbpage
+    // reads it as zeros and won't write it.
+    sqlite3_int64 pendingPage = 0x40000000 / pageSize + 1;
+    std::vector<uint64_t> hashes;
+    std::string first;
+    changed = 0;
+    while ((status = sqlite3_step(read)) == SQLITE_ROW) {
+        sqlite3_int64 pgno = sqlite3_column_int64(read, 0);
+        auto* data = static_cast<const unsigned char*>(sqlite3_column_blob(read, 1));
+        int size = sqlite3_column_bytes(read, 1);
+
+        uint64_t hash[2];
+        PageHash(data, size, hash);
+        size_t index = static_cast<size_t>(pgno - 1) * 2;
+        hashes.push_back(hash[0]);
+        hashes.push_back(hash[1]);
+        if (index + 1 < previous.size() && previous[index] == hash[0] &&
+                previous[index + 1] == hash[1]) continue;
+        if (pgno == pendingPage) continue;
+
+        if (pgno == 1 && destWal) {
+            // Keep dest in WAL mode, like sqlite3_backup does.
+            first.assign(reinterpret_cast<const char*>(data), size);
+            first[18] = first[19] = 2;
+            data = reinterpret_cast<const unsigned char*>(first.data());
+        }
+        sqlite3_bind_int64(write, 1, pgno);
+        sqlite3_bind_blob(write, 2, data, size, SQLITE_STATIC);
+        int result = sqlite3_step(write);
+        sqlite3_reset(write);
+        if (result != SQLITE_DONE) {
+            status = result;
+            failed = "write";
+            break;
+        }
+        changed++;
+    }
+    if (status != SQLITE_DONE && !failed) {
+        failed = "read";
+    }
+
+    if (!failed && destPageCount > static_cast<int>(hashes.size() / 2)) {
+        // Writing NULL drops this page and the ones after it.
+        sqlite3_bind_int64(write, 1, static_cast<sqlite3_int64>(hashes.size() / 2) + 1);
+        sqlite3_bind_null(write, 2);
+        status = sqlite3_step(write);
+        sqlite3_reset(write);
+        if (status != SQLITE_DONE) failed = "write";
+    }
+    sqlite3_finalize(write);
+    if (!failed) {
+        status = sqlite3_exec(dst, "COMMIT", NULL, NULL, NULL);
+        if (status != SQLITE_OK) failed = "write";
+    }
+    if (!failed && !destWal) {
+        // Still under the exclusive lock.
+        ReadChangeCounter(dst, destChangeCounter);
+    }
+
+    if (!failed) {
+        status = SQLITE_OK;
+    }
+    else if (strcmp(failed, "read") == 0) {
+        message = std::string(sqlite3_errmsg(src));
+    }
+    else {
+        message = "unable to write " + dest + ": " + sqlite3_errmsg(dst);
+        sqlite3_exec(dst, "ROLLBACK", NULL, NULL, NULL);
+    }
+
+    sqlite3_close(dst);
+    sqlite3_finalize(read);
+    sqlite3_close(src);
+
+    if (status == SQLITE_OK) {
+        pageCount = static_cast<int>(hashes.size() / 2);
+        WritePageHashes(hashesPath, static_cast<uint32_t>(pageSize), destChangeCounter, hashes);
+    }
+    return status;
+}
+
 Napi::Object Backup::Init(Napi::Env env, Napi::Object exports) {
     Napi::HandleScope scope(env);
 
@@ -15,6 +355,7 @@ Napi::Object Backup::Init(Napi::Env env, Napi::Object exports) {
     auto t = DefineClass(env, "Backup", {
         InstanceMethod("step", &Backup::Step, napi_default_method),
         InstanceMethod("finish", &Backup::Finish, napi_default_method),
+        InstanceMethod("run", &Backup::Run, napi_default_method),
         InstanceAccessor("idle", &Backup::IdleGetter, nullptr),
         InstanceAccessor("completed", &Backup::CompletedGetter, nullptr),
         InstanceAccessor("failed", &Backup::FailedGetter, nullptr),
@@ -166,6 +507,10 @@ Backup::Backup(const Napi::CallbackInfo& info) : Napi::ObjectWrap<Backup>(info)
     info.This().As<Napi::Object>().DefineProperty(Napi::PropertyDescriptor::Value("destName", destName));
     info.This().As<Napi::Object>().DefineProperty(Napi::PropertyDescriptor::Value("filenameIsDest", filenameIsDest));
 
+    this->filename = filename.Utf8Value();
+    this->sourceName = sourceName.Utf8Value();
+    this->filenameIsDest = filenameIsDest.Value();
+
     auto* baton = new InitializeBaton(this->db, info[5].As<Napi::Function>(), this);
     baton->filename = filename.Utf8Value();
     baton->sourceName = sourceName.Utf8Value();
@@ -187,7 +532,7 @@ void Backup::Work_Initialize(napi_env e, void* data) {
 
     // In case stepping fails, we use a mutex to make sure we get the associated
     // error message.
-    auto* mtx = sqlite3_db_mutex(baton->db->_handle);
+    auto* mtx = baton->db->GetMutex();
     sqlite3_mutex_enter(mtx);
 
     backup->status = sqlite3_open(baton->filename.c_str(), &backup->_otherDb);
@@ -253,19 +598,16 @@ void Backup::Work_BeginStep(Baton* baton) {
 void Backup::Work_Step(napi_env e, void* data) {
     BACKUP_INIT(StepBaton);
     if (backup->_handle) {
+        auto* mtx = backup->db->GetMutex();
+        sqlite3_mutex_enter(mtx);
         backup->status = sqlite3_backup_step(backup->_handle, baton->pages);
         backup->remaining = sqlite3_backup_remaining(backup->_handle);
         backup->pageCount = sqlite3_backup_pagecount(backup->_handle);
+        backup->FlushQueryCache();
+        sqlite3_mutex_leave(mtx);
     }
     if (backup->status != SQLITE_OK) {
-        // Text of message is a little awkward to get, since the error is not associated
-        // with a db connection.
-#if SQLITE_VERSION_NUMBER >= 3007015
-        // sqlite3_errstr is a relatively new method
-        backup->message = std::string(sqlite3_errstr(backup->status));
-#else
-        backup->message = "Sqlite error";
-#endif
+        backup->message = ErrorMessage(backup->status);
         if (baton->retryErrorsSet.size() > 0) {
             if (baton->retryErrorsSet.find(backup->status) == baton->retryErrorsSet.end()) {
                 backup->FinishSqlite();
@@ -340,6 +682,242 @@ void Backup::Work_AfterFinish(napi_env e, napi_status status, void* data) {
     BACKUP_END();
 }
 
+// Backup#run([{ targetStepMs, maxPagesPerSec }], [callback])
+Napi::Value Backup::Run(const Napi::CallbackInfo& info) {
+    auto* backup = this;
+    auto env = backup->Env();
+
+    double targetStepMs = 10;
+    double maxPagesPerSec = 0;
+    bool incremental = false;
+    int pos = 0;
+    if (info.Length() > 0 && info[0].IsObject() && !info[0].IsFunction()) {
+        auto options = info[0].As<Napi::Object>();
+        Napi::Value value = options.Get("targetStepMs");
+        if (value.IsNumber()) targetStepMs = value.As<Napi::Number>().DoubleValue();
+        value = options.Get("maxPagesPerSec");
+        if (value.IsNumber()) maxPagesPerSec = value.As<Napi::Number>().DoubleValue();
+        incremental = options.Get("incremental").ToBoolean();
+        pos++;
+    }
+    OPTIONAL_ARGUMENT_FUNCTION(pos, callback);
+
+    if (incremental && !backup->filenameIsDest) {
+        Napi::TypeError::New(env, "Differential backups can only write to a file").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    if (!(targetStepMs > 0)) {
+        Napi::RangeError::New(env, "targetStepMs must be positive").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    auto* baton = new RunBaton(backup, callback, targetStepMs, maxPagesPerSec);
+    baton->incremental = incremental;
+    baton->busyTimeout = backup->db->busy_timeout;
+    backup->GetRetryErrors(baton->retryErrorsSet);
+    backup->Schedule(Work_BeginRun, baton);
+    return info.This();
+}
+
+void Backup::Work_BeginRun(Baton* b) {
+    auto* baton = static_cast<RunBaton*>(b);
+    assert(baton->backup);
+    assert(!baton->backup->locked);
+    assert(!baton->backup->finished);
+    assert(baton->backup->inited);
+    // The backup stays locked until the last step is done.
+    baton->backup->locked = true;
+    ScheduleRunStep(baton, 0);
+}
+
+void Backup::ScheduleRunStep(RunBaton* baton, uint64_t delay) {
+    auto* backup = baton->backup;
+    auto env = backup->Env();
+
+    if (delay > 0) {
+        if (!baton->timer) {
+            uv_loop_t* loop;
+            napi_get_uv_event_loop(env, &loop);
+            baton->timer = new uv_timer_t;
+            uv_timer_init(loop, baton->timer);
+            baton->timer->data = baton;
+        }
+        uv_timer_start(baton->timer, RunTimerCallback, delay, 0);
+        return;
+    }
+
+    backup->db->Schedule(Work_BeginRunStep, new RunStepBaton(backup->db, baton));
+}
+
+void Backup::Work_BeginRunStep(Database::Baton* b) {
+    auto* step = static_cast<RunStepBaton*>(b);
+    RunBaton* baton = step->run;
+    step->run = NULL;
+    delete step;
+
+    auto env = baton->backup->Env();
+    baton->backup->db->pending++;
+    // A work item can't be queued twice, so every step gets a new one.
+    if (baton->request) {
+        napi_delete_async_work(env, baton->request);
+        baton->request = NULL;
+    }
+    CREATE_WORK("sqlite3.Backup.Run", Work_Run, Work_AfterRun);
+}
+
+void Backup::RunTimerCallback(uv_timer_t* handle) {
+    ScheduleRunStep(static_cast<RunBaton*>(handle->data), 0);
+}
+
+void Backup::Work_Run(napi_env e, void* data) {
+    BACKUP_INIT(RunBaton);
+    if (baton->incremental) {
+        return Work_RunIncremental(e, data);
+    }
+    if (backup->_handle) {
+        uint64_t start = uv_hrtime();
+        auto* mtx = backup->db->GetMutex();
+        sqlite3_mutex_enter(mtx);
+        // The page counts are only known after the first step.
+        int before = sqlite3_backup_pagecount(backup->_handle) ?
+            sqlite3_backup_remaining(backup->_handle) : -1;
+        backup->status = sqlite3_backup_step(backup->_handle, baton->pages);
+        backup->remaining = sqlite3_backup_remaining(backup->_handle);
+        backup->pageCount = sqlite3_backup_pagecount(backup->_handle);
+        backup->FlushQueryCache();
+        sqlite3_mutex_leave(mtx);
+        baton->elapsedMs = (uv_hrtime() - start) / 1e6;
+        if (before < 0) before = backup->pageCount;
+        // A write to the source restarts the backup, which makes the
+        // remaining pages go up again.
+        baton->copied = std::max(before - backup->remaining, 0);
+    }
+    if (backup->status == SQLITE_DONE) {
+        backup->FinishSqlite();
+    }
+    else if (backup->status != SQLITE_OK) {
+        backup->message = ErrorMessage(backup->status);
+        if (baton->retryErrorsSet.find(backup->status) == baton->retryErrorsSet.end()) {
+            backup->FinishSqlite();
+        }
+    }
+}
+
+void Backup::Work_RunIncremental(napi_env e, void* data) {
+    BACKUP_INIT(RunBaton);
+
+    std::string source;
+    if (backup->db->_handle) {
+        auto* mtx = backup->db->GetMutex();
+        sqlite3_mutex_enter(mtx);
+        const char* name = sqlite3_db_filename(backup->db->_handle, backup->sourceName.c_str());
+        if (name) source = name;
+        sqlite3_mutex_leave(mtx);
+    }
+
+    if (source.empty()) {
+        backup->status = SQLITE_MISUSE;
+        backup->message = "Differential backups need a database file";
+    }
+    else {
+        backup->message.clear();
+        backup->status = CopyChangedPages(source, backup->filename, baton->busyTimeout,
+            backup->pageCount, baton->changed, backup->message);
+    }
+
+    if (backup->status == SQLITE_OK) {
+        backup->status = SQLITE_DONE;
+        backup->remaining = 0;
+    }
+    // The sqlite3_backup handle isn't used in this mode, but an open handle
+    // tells Work_AfterRun to try again.
+    if (backup->status == SQLITE_DONE ||
+            baton->retryErrorsSet.find(backup->status) == baton->retryErrorsSet.end()) {
+        backup->FinishSqlite();
+    }
+}
+
+void Backup::Work_AfterRun(napi_env e, napi_status status, void* data) {
+    auto* baton = static_cast<RunBaton*>(data);
+    auto* backup = baton->backup;
+
+    auto env = backup->Env();
+    Napi::HandleScope scope(env);
+
+    uint64_t delay = 0;
+    bool more = false;
+    if (backup->status == SQLITE_OK) {
+        // Size the next step so that it holds the source for about
+        // targetStepMs, without changing too much at once.
+        double scale = baton->targetStepMs / std::max(baton->elapsedMs, 0.01);
+        scale = std::min(std::max(scale, 0.5), 2.0);
+        baton->pages = static_cast<int>(std::min(std::max(baton->pages * scale, 1.0), 1048576.0));
+        baton->backoff = 0;
+        if (baton->maxPagesPerSec > 0) {
+            double budgetMs = baton->copied * 1000.0 / baton->maxPagesPerSec;
+            if (budgetMs > baton->elapsedMs) {
+                delay = static_cast<uint64_t>(budgetMs - baton->elapsedMs);
+            }
+        }
+        more = true;
+    }
+    else if (backup->status != SQLITE_DONE && backup->_handle) {
+        // The error is listed in retryErrors: someone else holds a lock on one
+        // of the databases. Back off and try again with smaller steps.
+        baton->pages = std::max(baton->pages / 2, 1);
+        baton->backoff = std::min<uint64_t>(baton->backoff ? baton->backoff * 2 : 5, 1000);
+        delay = baton->backoff;
+        more = true;
+    }
+
+    if (more) {
+        uint64_t now = uv_hrtime() / 1000000;
+        if (now - baton->lastProgress >= 100) {
+            baton->lastProgress = now;
+            backup->EmitProgress();
+        }
+
+        // Other work on the database may go ahead between two steps.
+        backup->db->pending--;
+        backup->db->Process();
+        ScheduleRunStep(baton, delay);
+        return;
+    }
+
+    std::unique_ptr<RunBaton> owner(baton);
+    if (backup->status == SQLITE_DONE) {
+        backup->completed = true;
+    }
+    backup->EmitProgress();
+    backup->FinishAll();
+
+    if (backup->status != SQLITE_DONE) {
+        Error(baton);
+    }
+    else {
+        Napi::Function cb = baton->callback.Value();
+        if (!cb.IsEmpty() && cb.IsFunction()) {
+            Napi::Value argv[] = { env.Null(), Napi::Number::New(env, baton->changed) };
+            TRY_CATCH_CALL(backup->Value(), cb, baton->incremental ? 2 : 1, argv);
+        }
+    }
+
+    BACKUP_END();
+}
+
+void Backup::EmitProgress() {
+    auto env = this->Env();
+    Napi::HandleScope scope(env);
+
+    Napi::Value argv[] = {
+        Napi::String::New(env, "progress"),
+        Napi::Number::New(env, remaining),
+        Napi::Number::New(env, pageCount)
+    };
+    EMIT_EVENT(Value(), 3, argv);
+}
+
 void Backup::FinishAll() {
     assert(!finished);
     if (!completed && !failed) {
@@ -351,9 +929,20 @@ void Backup::FinishAll() {
     db->Unref();
 }
 
+// Backups into the database replace its pages without going through the
+// hooks the query cache relies on.
+void Backup::FlushQueryCache() {
+    if (_destDb && _destDb == db->_handle && db->cache) {
+        db->cache->Flush();
+    }
+}
+
 void Backup::FinishSqlite() {
     if (_handle) {
+        auto* mtx = db->_handle ? db->GetMutex() : NULL;
+        sqlite3_mutex_enter(mtx);
         sqlite3_backup_finish(_handle);
+        sqlite3_mutex_leave(mtx);
         _handle = NULL;
     }
     if (_otherDb) {
@@ -9,6 +9,7 @@
 
 #include <sqlite3.h>
 #include <napi.h>
+#include <uv.h>
 
 using namespace Napi;
 
@@ -42,6 +43,26 @@ namespace node_sqlite3 {
  *   - `sqlite3_backup_remaining`: `backup.remaining`.
  *   - `sqlite3_backup_pagecount`: `backup.pageCount`.
  *
+ * Instead of calling `step` from JavaScript, the backup can also be left
+ * to run on its own with `backup.run([options], [callback])`, or
+ * `db.backup(filename, { auto: true, ... }, [callback])`. It then steps
+ * through the database in the background, sizing each step so that it
+ * holds the source for about `targetStepMs` milliseconds (default 10),
+ * optionally limited to `maxPagesPerSec` pages per second. Errors listed
+ * in `retryErrors` make it back off and try again. `progress` events with
+ * the remaining and total number of pages are emitted at most every 100
+ * milliseconds, and once more at the end. The backup is finished when the
+ * callback is called.
+ *
+ * With `{ incremental: true }` the destination file is updated in place
+ * instead: the source is read page by page through a connection of its
+ * own, and only pages whose checksum differs from the last differential
+ * backup are written. The checksums are kept next to the destination in
+ * `<filename>-pages`, together with the destination's change counter;
+ * without them, or once something else wrote to the destination, every
+ * page is written. The callback gets the number of pages that were
+ * written.
+ *
  * There are the following read-only properties:
  *
  *   - `backup.completed` is set to `true` when the backup
@@ -138,6 +159,57 @@ public:
         virtual ~StepBaton() override = default;
     };
 
+    struct RunBaton : Baton {
+        double targetStepMs;
+        double maxPagesPerSec;
+        bool incremental = false;
+        // Busy timeout of the connections of a differential backup.
+        int busyTimeout = 0;
+        std::set<int> retryErrorsSet;
+
+        // Pages to copy in the next step; adapted after each step.
+        int pages = 100;
+        // Milliseconds to wait after an error listed in retryErrors.
+        uint64_t backoff = 0;
+        // Duration and number of copied pages of the last step.
+        double elapsedMs = 0;
+        int copied = 0;
+        // Pages written by a differential backup.
+        int changed = 0;
+        uint64_t lastProgress = 0;
+        // Only allocated when a step has to be delayed.
+        uv_timer_t* timer = NULL;
+
+        RunBaton(Backup* backup_, Napi::Function cb_, double targetStepMs_, double maxPagesPerSec_) :
+            Baton(backup_, cb_), targetStepMs(targetStepMs_), maxPagesPerSec(maxPagesPerSec_) {}
+        virtual ~RunBaton() override {
+            if (timer) {
+                uv_close(reinterpret_cast<uv_handle_t*>(timer), [](uv_handle_t* handle) {
+                    delete reinterpret_cast<uv_timer_t*>(handle);
+                });
+            }
+        }
+    };
+
+    // One step of Backup#run. Every step goes through the database's queue,
+    // so that exclusive work that starts between two steps doesn't run at
+    // the same time as a step.
+    struct RunStepBaton : Database::Baton {
+        RunBaton* run;
+        RunStepBaton(Database* db_, RunBaton* run_) :
+            Baton(db_, run_->callback.Value()), run(run_) {}
+        virtual ~RunStepBaton() override {
+            if (run) {
+                // The database was closed before the step could run.
+                Backup* backup = run->backup;
+                backup->locked = false;
+                backup->FinishAll();
+                delete run;
+                backup->Process();
+            }
+        }
+    };
+
     typedef void (*Work_Callback)(Baton* baton);
 
     struct Call {
@@ -157,6 +229,7 @@ public:
 
     WORK_DEFINITION(Step)
     WORK_DEFINITION(Finish)
+    WORK_DEFINITION(Run)
 
     Napi::Value IdleGetter(const Napi::CallbackInfo& info);
     Napi::Value CompletedGetter(const Napi::CallbackInfo& info);
@@ -174,6 +247,13 @@ protected:
     static void Work_Initialize(napi_env env, void* data);
     static void Work_AfterInitialize(napi_env env, napi_status status, void* data);
 
+    static void Work_RunIncremental(napi_env env, void* data);
+
+    static void ScheduleRunStep(RunBaton* baton, uint64_t delay);
+    static void Work_BeginRunStep(Database::Baton* baton);
+    static void RunTimerCallback(uv_timer_t* handle);
+    void EmitProgress();
+
     void Schedule(Work_Callback callback, Baton* baton);
     void Process();
     void CleanQueue();
@@ -181,10 +261,15 @@ protected:
 
     void FinishAll();
     void FinishSqlite();
+    void FlushQueryCache();
     void GetRetryErrors(std::set<int>& retryErrorsSet);
 
     Database* db;
 
+    std::string filename;
+    std::string sourceName;
+    bool filenameIsDest;
+
     sqlite3_backup* _handle = NULL;
     sqlite3* _otherDb = NULL;
     sqlite3* _destDb = NULL;
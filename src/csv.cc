@@ -0,0 +1,91 @@
+#include <cmath>
+#include <cstring>
+
+#include "csv.h"
+
+using namespace node_sqlite3;
+
+CSVWriter::CSVWriter(sqlite3_stmt* stmt, char delimiter_, JSONWriter::Blobs blobs_) :
+        delimiter(delimiter_), blobs(blobs_) {
+    int count = sqlite3_column_count(stmt);
+    for (int i = 0; i < count; i++) {
+        const char* name = sqlite3_column_name(stmt, i);
+        names.emplace_back(name ? name : "");
+    }
+}
+
+void CSVWriter::AppendHeader(std::string& out) const {
+    for (size_t i = 0; i < names.size(); i++) {
+        if (i) out += delimiter;
+        AppendField(out, names[i].data(), names[i].size());
+    }
+    out += '\n';
+}
+
+void CSVWriter::AppendRow(std::string& out, sqlite3_stmt* stmt) const {
+    for (size_t i = 0; i < names.size(); i++) {
+        int column = static_cast<int>(i);
+        if (i) out += delimiter;
+        size_t start = out.size();
+        switch (sqlite3_column_type(stmt, column)) {
+            case SQLITE_INTEGER: {
+                JSONWriter::AppendInteger(out, sqlite3_column_int64(stmt, column));
+                QuoteAppended(out, start);
+            } break;
+            case SQLITE_FLOAT: {
+                double value = sqlite3_column_double(stmt, column);
+                // JSON has no infinities. These overflow to them when SQLite
+                // or Number() reads them back.
+                if (std::isinf(value)) out += value < 0 ? "-9e999" : "9e999";
+                else JSONWriter::AppendFloat(out, value);
+                QuoteAppended(out, start);
+            } break;
+            case SQLITE_TEXT: {
+                const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, column));
+                AppendField(out, text, sqlite3_column_bytes(stmt, column));
+            } break;
+            case SQLITE_BLOB: {
+                const void* data = sqlite3_column_blob(stmt, column);
+                JSONWriter::AppendEncoded(out, static_cast<const unsigned char*>(data),
+                    sqlite3_column_bytes(stmt, column), blobs);
+                QuoteAppended(out, start);
+            } break;
+            default: break;
+        }
+    }
+    out += '\n';
+}
+
+void CSVWriter::QuoteAppended(std::string& out, size_t start) const {
+    // Numbers, base64 and hex have no quotes or line breaks, but may hold
+    // a delimiter such as '.', '-' or a digit.
+    if (memchr(out.data() + start, delimiter, out.size() - start)) {
+        out.insert(start, 1, '"');
+        out += '"';
+    }
+}
+
+void CSVWriter::AppendField(std::string& out, const char* text, size_t length) const {
+    // Empty strings are quoted so that they read back as strings, not NULL.
+    bool quote = length == 0;
+    for (size_t i = 0; i < length && !quote; i++) {
+        char c = text[i];
+        quote = c == delimiter || c == '"' || c == '\n' || c == '\r';
+    }
+    if (!quote) {
+        out.append(text, length);
+        return;
+    }
+
+    out += '"';
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == '"') {
+            out.append(text + start, i + 1 - start);
+            out += '"';
+            start = i + 1;
+        }
+    }
+    out.append(text + start, length - start);
+    out += '"';
+}
@@ -0,0 +1,45 @@
+#ifndef NODE_SQLITE3_SRC_CSV_H
+#define NODE_SQLITE3_SRC_CSV_H
+
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "json.h"
+
+namespace node_sqlite3 {
+
+/**
+ *
+ * Writes the rows of a statement as CSV (RFC 4180), straight from the
+ * statement, for Statement#exportTo.
+ *
+ * Fields that contain the delimiter, quotes or line breaks are quoted, and
+ * so are empty strings. NULL is an empty field, numbers are written like
+ * JSON numbers, except infinities, which are 9e999 and -9e999, and blobs as
+ * base64 or hex. Lines end with "\n".
+ *
+ */
+class CSVWriter {
+public:
+    CSVWriter(sqlite3_stmt* stmt, char delimiter, JSONWriter::Blobs blobs);
+
+    // Appends the line with the column names.
+    void AppendHeader(std::string& out) const;
+    // Appends the row the statement is on.
+    void AppendRow(std::string& out, sqlite3_stmt* stmt) const;
+
+protected:
+    void AppendField(std::string& out, const char* text, size_t length) const;
+    // Quotes what was appended after start if it holds the delimiter.
+    void QuoteAppended(std::string& out, size_t start) const;
+
+    std::vector<std::string> names;
+    char delimiter;
+    JSONWriter::Blobs blobs;
+};
+
+}
+
+#endif
@@ -1,9 +1,14 @@
+#include <algorithm>
+#include <cctype>
 #include <cstring>
 #include <napi.h>
 
 #include "macros.h"
 #include "database.h"
 #include "statement.h"
+#include "session.h"
+#include "query_cache.h"
+#include "watch.h"
 
 using namespace node_sqlite3;
 
@@ -19,22 +24,35 @@ Napi::Object Database::Init(Napi::Env env, Napi::Object exports) {
     auto t = DefineClass(env, "Database", {
         InstanceMethod("close", &Database::Close, napi_default_method),
         InstanceMethod("exec", &Database::Exec, napi_default_method),
+        InstanceMethod("execFile", &Database::ExecFile, napi_default_method),
         InstanceMethod("wait", &Database::Wait, napi_default_method),
         InstanceMethod("loadExtension", &Database::LoadExtension, napi_default_method),
         InstanceMethod("serialize", &Database::Serialize, napi_default_method),
         InstanceMethod("parallelize", &Database::Parallelize, napi_default_method),
         InstanceMethod("configure", &Database::Configure, napi_default_method),
         InstanceMethod("interrupt", &Database::Interrupt, napi_default_method),
-        InstanceAccessor("open", &Database::Open, nullptr)
+        InstanceMethod("prepareMany", &Database::PrepareMany, napi_default_method),
+        InstanceMethod("toBuffer", &Database::ToBuffer, napi_default_method),
+        InstanceMethod("loadBuffer", &Database::LoadBuffer, napi_default_method),
+        InstanceMethod("beginSnapshot", &Database::BeginSnapshot, napi_default_method),
+        InstanceMethod("applyChangeset", &Database::ApplyChangeset, napi_default_method),
+        InstanceMethod("importFile", &Database::ImportFile, napi_default_method),
+        InstanceMethod("parallelQuery", &Database::ParallelQuery, napi_default_method),
+        InstanceMethod("query", &Database::Query, napi_default_method),
+        InstanceMethod("cachedRows", &Database::CachedRows, napi_default_method),
+        InstanceMethod("onExternalChange", &Database::OnExternalChange, napi_default_method),
+        InstanceAccessor("open", &Database::Open, nullptr),
+        InstanceAccessor("poolStats", &Database::PoolStatsGetter, nullptr),
+        InstanceAccessor("queryCacheStats", &Database::QueryCacheStatsGetter, nullptr)
     });
 
 #if NAPI_VERSION < 6
     constructor = Napi::Persistent(t);
     constructor.SuppressDestruct();
 #else
-    Napi::FunctionReference* constructor = new Napi::FunctionReference();
-    *constructor = Napi::Persistent(t);
-    env.SetInstanceData<Napi::FunctionReference>(constructor);
+    auto* constructors = new Constructors();
+    constructors->database = Napi::Persistent(t);
+    env.SetInstanceData<Constructors>(constructors);
 #endif
 
     exports.Set("Database", t);
@@ -52,9 +70,9 @@ void Database::Process() {
 
         // Call all callbacks with the error object.
         while (!queue.empty()) {
-            auto call = std::unique_ptr<Call>(queue.front());
+            Call call = queue.front();
             queue.pop();
-            auto baton = std::unique_ptr<Baton>(call->baton);
+            auto baton = std::unique_ptr<Baton>(call.baton);
             Napi::Function cb = baton->callback.Value();
             if (IS_FUNCTION(cb)) {
                 TRY_CATCH_CALL(this->Value(), cb, 1, argv);
@@ -72,16 +90,15 @@ void Database::Process() {
     }
 
     while (open && (!locked || pending == 0) && !queue.empty()) {
-        Call *c = queue.front();
+        Call call = queue.front();
 
-        if (c->exclusive && pending > 0) {
+        if (call.exclusive && pending > 0) {
             break;
         }
 
         queue.pop();
-        std::unique_ptr<Call> call(c);
-        locked = call->exclusive;
-        call->callback(call->baton);
+        locked = call.exclusive;
+        call.callback(call.baton);
 
         if (locked) break;
     }
@@ -109,7 +126,7 @@ void Database::Schedule(Work_Callback callback, Baton* baton, bool exclusive) {
     }
 
     if (!open || ((locked || exclusive || serialize) && pending > 0)) {
-        queue.emplace(new Call(callback, baton, exclusive || serialize));
+        queue.emplace(callback, baton, exclusive || serialize);
     }
     else {
         locked = exclusive;
@@ -133,7 +150,7 @@ Database::Database(const Napi::CallbackInfo& info) : Napi::ObjectWrap<Database>(
         mode = info[pos++].As<Napi::Number>().Int32Value();
     }
     else {
-        mode = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX;
+        mode = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX;
     }
 
     Napi::Function callback;
@@ -172,7 +189,14 @@ void Database::Work_Open(napi_env e, void* data) {
     }
     else {
         // Set default database handle values.
-        sqlite3_busy_timeout(db->_handle, 1000);
+        sqlite3_busy_timeout(db->_handle, db->busy_timeout);
+
+        // SQLite only serializes access to connections in serialized mode.
+        // Otherwise the binding has to make sure that the connection is only
+        // used by one thread at a time.
+        if (sqlite3_db_mutex(db->_handle) == NULL) {
+            db->_mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_RECURSIVE);
+        }
     }
 }
 
@@ -235,9 +259,22 @@ void Database::Work_BeginClose(Baton* baton) {
     assert(baton->db->pending == 0);
 
     baton->db->pending++;
+    std::set<Watch*> watches(baton->db->watches);
+    for (auto* watch : watches) {
+        watch->Stop();
+    }
+    baton->db->StopExternalChange();
     baton->db->RemoveCallbacks();
     baton->db->closing = true;
 
+#ifdef NODE_SQLITE3_HAVE_SESSION
+    // Nothing else uses the connection while it is being closed.
+    std::set<Session*> sessions(baton->db->sessions);
+    for (auto* session : sessions) {
+        session->Delete(false);
+    }
+#endif
+
     auto env = baton->db->Env();
     CREATE_WORK("sqlite3.Database.Close", Work_Close, Work_AfterClose);
 }
@@ -246,6 +283,15 @@ void Database::Work_Close(napi_env e, void* data) {
     auto* baton = static_cast<Baton*>(data);
     auto* db = baton->db;
 
+    // Only our own mutex can be held across sqlite3_close; SQLite's
+    // connection mutex goes away with the connection.
+    sqlite3_mutex_enter(db->_mutex);
+
+    for (auto* reader : db->readers) {
+        sqlite3_close(reader);
+    }
+    db->readers.clear();
+
     baton->status = sqlite3_close(db->_handle);
 
     if (baton->status != SQLITE_OK) {
@@ -254,6 +300,8 @@ void Database::Work_Close(napi_env e, void* data) {
     else {
         db->_handle = NULL;
     }
+
+    sqlite3_mutex_leave(db->_mutex);
 }
 
 void Database::Work_AfterClose(napi_env e, napi_status status, void* data) {
@@ -274,6 +322,8 @@ void Database::Work_AfterClose(napi_env e, napi_status status, void* data) {
     }
     else {
         db->open = false;
+        db->buffers.clear();
+        db->StopMaintenance();
         // Leave db->locked to indicate that this db object has reached
         // the end of its life.
         argv[0] = env.Null();
@@ -376,6 +426,110 @@ Napi::Value Database::Configure(const Napi::CallbackInfo& info) {
        auto* baton = new Baton(db, handle);
         db->Schedule(RegisterUpdateCallback, baton);
     }
+    else if (info[0].StrictEquals(Napi::String::New(env, "maintenance"))) {
+        // configure("maintenance", { interval, budgetMs, vacuumPages, optimize, quickCheck })
+        // configure("maintenance", false)
+        if (info[1].IsObject()) {
+            auto options = info[1].As<Napi::Object>();
+            Napi::Value value = options.Get("interval");
+            double interval = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : 60000;
+            value = options.Get("budgetMs");
+            double budgetMs = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : 50;
+            value = options.Get("vacuumPages");
+            int vacuumPages = value.IsNumber() ? value.As<Napi::Number>().Int32Value() : 100;
+            if (!(interval > 0) || !(budgetMs > 0) || vacuumPages < 0) {
+                Napi::RangeError::New(env, "Maintenance interval and budget must be positive").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            value = options.Get("optimize");
+            db->maintenance.optimize = value.IsUndefined() || value.ToBoolean();
+            db->maintenance.quickCheck = options.Get("quickCheck").ToBoolean();
+            db->maintenance.budgetMs = budgetMs;
+            db->maintenance.vacuumPages = vacuumPages;
+
+            if (!db->maintenance.timer) {
+                uv_loop_t* loop;
+                napi_get_uv_event_loop(env, &loop);
+                db->maintenance.timer = new uv_timer_t;
+                uv_timer_init(loop, db->maintenance.timer);
+                db->maintenance.timer->data = db;
+                // Maintenance alone shouldn't keep the process running.
+                uv_unref(reinterpret_cast<uv_handle_t*>(db->maintenance.timer));
+            }
+            uint64_t repeat = static_cast<uint64_t>(interval);
+            uv_timer_start(db->maintenance.timer, MaintenanceTimerCallback, repeat, repeat);
+        }
+        else if (info[1].IsBoolean() && !info[1].As<Napi::Boolean>().Value()) {
+            db->StopMaintenance();
+        }
+        else {
+            Napi::TypeError::New(env, "Value must be an object or false").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+    }
+    else if (info[0].StrictEquals(Napi::String::New(env, "queryCache"))) {
+        // configure("queryCache", { entries })
+        // configure("queryCache", false)
+        size_t entries = 0;
+        if (info[1].IsObject()) {
+            Napi::Value value = info[1].As<Napi::Object>().Get("entries");
+            double number = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : 256;
+            if (!(number >= 1)) {
+                Napi::RangeError::New(env, "Query cache entries must be positive").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            entries = static_cast<size_t>(number);
+        }
+        else if (!info[1].IsBoolean() || info[1].As<Napi::Boolean>().Value()) {
+            Napi::TypeError::New(env, "Value must be an object or false").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        Baton* baton = new QueryCacheBaton(db, handle, entries);
+        db->Schedule(RegisterQueryCache, baton);
+    }
+    else if (info[0].StrictEquals(Napi::String::New(env, "json"))) {
+        // configure("json", { blobs: "base64" | "hex" | "array" })
+        // Applies to the calls made from then on.
+        if (!info[1].IsObject()) {
+            Napi::TypeError::New(env, "Value must be an object").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        Napi::Value value = info[1].As<Napi::Object>().Get("blobs");
+        if (!value.IsUndefined()) {
+            std::string blobs = value.IsString() ? value.As<Napi::String>().Utf8Value() : "";
+            if (blobs == "base64") db->json_blobs = JSONWriter::BASE64;
+            else if (blobs == "hex") db->json_blobs = JSONWriter::HEX;
+            else if (blobs == "array") db->json_blobs = JSONWriter::ARRAY;
+            else {
+                Napi::TypeError::New(env, "Blobs must be \"base64\", \"hex\" or \"array\"").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+        }
+    }
+    else if (info[0].StrictEquals(Napi::String::New(env, "walCheckpoint"))) {
+        // configure("walCheckpoint", { pages, restartPages, truncatePages })
+        // configure("walCheckpoint", false)
+        int pages = 0, restartPages = 0, truncatePages = 0;
+        if (info[1].IsObject()) {
+            auto options = info[1].As<Napi::Object>();
+            Napi::Value value = options.Get("pages");
+            pages = value.IsNumber() ? value.As<Napi::Number>().Int32Value() : 1000;
+            value = options.Get("restartPages");
+            restartPages = value.IsNumber() ? value.As<Napi::Number>().Int32Value() : pages * 4;
+            value = options.Get("truncatePages");
+            truncatePages = value.IsNumber() ? value.As<Napi::Number>().Int32Value() : pages * 16;
+            if (pages <= 0 || restartPages <= 0 || truncatePages <= 0) {
+                Napi::RangeError::New(env, "WAL checkpoint thresholds must be positive").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+        }
+        else if (!info[1].IsBoolean() || info[1].As<Napi::Boolean>().Value()) {
+            Napi::TypeError::New(env, "Value must be an object or false").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        Baton* baton = new WalCheckpointBaton(db, handle, pages, restartPages, truncatePages);
+        db->Schedule(RegisterWalCallback, baton);
+    }
     else {
         Napi::TypeError::New(env, (StringConcat(
 #if V8_MAJOR_VERSION > 6
@@ -410,6 +564,207 @@ Napi::Value Database::Interrupt(const Napi::CallbackInfo& info) {
     return info.This();
 }
 
+Napi::Value Database::PoolStatsGetter(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+    auto* db = this;
+
+    auto stats = Napi::Object::New(env);
+    stats.Set("hits", Napi::Number::New(env, db->pool_hits));
+    stats.Set("misses", Napi::Number::New(env, db->pool_misses));
+    return stats;
+}
+
+Napi::Value Database::QueryCacheStatsGetter(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+    auto* db = this;
+
+    if (!db->cache) return env.Null();
+
+    auto cached = db->cache->GetStats();
+    auto stats = Napi::Object::New(env);
+    stats.Set("hits", Napi::Number::New(env, cached.hits));
+    stats.Set("misses", Napi::Number::New(env, cached.misses));
+    stats.Set("entries", Napi::Number::New(env, cached.entries));
+    return stats;
+}
+
+// Database#cachedRows(sql, [bind1, bind2, ...])
+// Returns the rows the query cache has for the query and parameters, or
+// undefined if there are none or they can't be used yet. The parameters are
+// taken the same way as by Statement#bind.
+Napi::Value Database::CachedRows(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+    auto* db = this;
+
+    // Calls that are still waiting to run may change the result, unless
+    // they run in parallel with this one anyway.
+    if (!db->cache || !db->open || db->closing || db->locked || !db->queue.empty() ||
+            (db->serialize && db->pending) || info.Length() <= 0 || !info[0].IsString()) {
+        return env.Undefined();
+    }
+
+    std::string sql = info[0].As<Napi::String>();
+    Parameters parameters;
+    if (info.Length() > 1 && info[1].IsArray()) {
+        Statement::GetArguments(info[1].As<Napi::Array>(), parameters);
+    }
+    auto rows = db->cache->Get(QueryCache::Key(sql, parameters));
+    if (!rows) return env.Undefined();
+
+    auto result = Napi::Array::New(env, rows->size());
+    for (uint32_t i = 0; i < rows->size(); i++) {
+        result.Set(i, Statement::RowToJS(env, (*rows)[i].get()));
+    }
+    return result;
+}
+
+// Database#onExternalChange(callback, { intervalMs })
+// Database#onExternalChange(false)
+Napi::Value Database::OnExternalChange(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+    auto* db = this;
+
+    if (info.Length() > 0 && (info[0].IsNull() ||
+            (info[0].IsBoolean() && !info[0].As<Napi::Boolean>().Value()))) {
+        db->StopExternalChange();
+        return info.This();
+    }
+
+    REQUIRE_ARGUMENT_FUNCTION(0, callback);
+    double interval = 1000;
+    if (info.Length() > 1 && info[1].IsObject()) {
+        Napi::Value value = info[1].As<Napi::Object>().Get("intervalMs");
+        if (value.IsNumber()) interval = value.As<Napi::Number>().DoubleValue();
+    }
+    if (!(interval >= 1)) {
+        Napi::RangeError::New(env, "Interval must be positive").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!db->open && db->locked) {
+        Napi::Error::New(env, "Database is closed").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    db->external.callback.Reset(callback, 1);
+    if (!db->external.timer) {
+        uv_loop_t* loop;
+        napi_get_uv_event_loop(env, &loop);
+        db->external.timer = new uv_timer_t;
+        uv_timer_init(loop, db->external.timer);
+        db->external.timer->data = db;
+        // Polling alone shouldn't keep the process running.
+        uv_unref(reinterpret_cast<uv_handle_t*>(db->external.timer));
+        // Changes are counted from now on.
+        db->PollExternalChange();
+    }
+    uint64_t repeat = static_cast<uint64_t>(interval);
+    uv_timer_start(db->external.timer, ExternalChangeTimerCallback, repeat, repeat);
+
+    return info.This();
+}
+
+void Database::StopExternalChange() {
+    if (external.timer) {
+        uv_close(reinterpret_cast<uv_handle_t*>(external.timer), [](uv_handle_t* handle) {
+            delete reinterpret_cast<uv_timer_t*>(handle);
+        });
+        external.timer = NULL;
+    }
+    if (external.stmt) {
+        // The statement has to be gone before the connection is closed.
+        sqlite3_finalize(external.stmt);
+        external.stmt = NULL;
+    }
+    external.callback.Reset();
+    external.version = -1;
+}
+
+// Reads PRAGMA data_version, which changes when another connection commits,
+// and returns whether it changed since the last time. This runs on the main
+// thread, and only while nothing else uses the connection: the check only
+// needs to read the WAL index, or the header of the database file, and is
+// cheaper than a trip to the thread pool.
+bool Database::PollExternalChange() {
+    if (!open || closing || pending > 0 || !queue.empty()) return false;
+
+    sqlite3_mutex* mtx = GetMutex();
+    sqlite3_mutex_enter(mtx);
+    sqlite3_int64 version = -1;
+    if (!external.stmt) {
+        sqlite3_prepare_v2(_handle, "PRAGMA data_version", -1, &external.stmt, NULL);
+    }
+    if (external.stmt) {
+        // While another connection writes, the database is checked again on
+        // the next tick instead of waiting on the main thread.
+        sqlite3_busy_handler(_handle, NULL, NULL);
+        if (sqlite3_step(external.stmt) == SQLITE_ROW) {
+            version = sqlite3_column_int64(external.stmt, 0);
+        }
+        sqlite3_reset(external.stmt);
+        sqlite3_busy_timeout(_handle, busy_timeout);
+    }
+    sqlite3_mutex_leave(mtx);
+
+    if (version < 0) return false;
+    bool changed = external.version >= 0 && version != external.version;
+    external.version = version;
+    return changed;
+}
+
+void Database::ExternalChangeTimerCallback(uv_timer_t* handle) {
+    auto* db = static_cast<Database*>(handle->data);
+    if (!db->PollExternalChange()) return;
+
+    auto env = db->Env();
+    Napi::HandleScope scope(env);
+
+    // Nothing is known about what changed.
+    if (db->cache) db->cache->Flush();
+    std::set<Watch*> watches(db->watches);
+    for (auto* watch : watches) {
+        if (db->watches.count(watch)) watch->Rerun();
+    }
+
+    Napi::Function cb = db->external.callback.Value();
+    if (IS_FUNCTION(cb)) {
+        TRY_CATCH_CALL(db->Value(), cb, 0, NULL);
+    }
+}
+
+// Database#prepareMany([sql1, sql2, ...], [callback])
+Napi::Value Database::PrepareMany(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+    auto* db = this;
+
+    if (info.Length() <= 0 || !info[0].IsArray()) {
+        Napi::TypeError::New(env, "Array of SQL queries expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    OPTIONAL_ARGUMENT_FUNCTION(1, callback);
+
+    auto queries = info[0].As<Napi::Array>();
+    uint32_t length = queries.Length();
+    for (uint32_t i = 0; i < length; i++) {
+        if (!queries.Get(i).IsString()) {
+            Napi::TypeError::New(env, "Array of SQL queries expected").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+    }
+
+    auto constructor = Statement::Constructor(env);
+    auto statements = Napi::Array::New(env, length);
+    auto* baton = new Statement::PrepareManyBaton(db, callback);
+
+    db->prepare_group = baton;
+    for (uint32_t i = 0; i < length; i++) {
+        statements.Set(i, constructor.New({ db->Value(), queries.Get(i) }));
+    }
+    db->prepare_group = NULL;
+
+    db->Schedule(Statement::Work_BeginPrepareMany, baton);
+    return statements;
+}
+
 void Database::SetBusyTimeout(Baton* b) {
     auto baton = std::unique_ptr<Baton>(b);
 
@@ -417,7 +772,11 @@ void Database::SetBusyTimeout(Baton* b) {
     assert(baton->db->_handle);
 
     // Abuse the status field for passing the timeout.
+    sqlite3_mutex* mtx = baton->db->GetMutex();
+    sqlite3_mutex_enter(mtx);
     sqlite3_busy_timeout(baton->db->_handle, baton->status);
+    baton->db->busy_timeout = baton->status;
+    sqlite3_mutex_leave(mtx);
 }
 
 void Database::SetLimit(Baton* b) {
@@ -426,7 +785,10 @@ void Database::SetLimit(Baton* b) {
     assert(baton->db->open);
     assert(baton->db->_handle);
 
+    sqlite3_mutex* mtx = baton->db->GetMutex();
+    sqlite3_mutex_enter(mtx);
     sqlite3_limit(baton->db->_handle, baton->id, baton->value);
+    sqlite3_mutex_leave(mtx);
 }
 
 void Database::RegisterTraceCallback(Baton* b) {
@@ -438,11 +800,15 @@ void Database::RegisterTraceCallback(Baton* b) {
     if (db->debug_trace == NULL) {
         // Add it.
         db->debug_trace = new AsyncTrace(db, TraceCallback);
+        sqlite3_mutex_enter(db->GetMutex());
         sqlite3_trace(db->_handle, TraceCallback, db);
+        sqlite3_mutex_leave(db->GetMutex());
     }
     else {
         // Remove it.
+        sqlite3_mutex_enter(db->GetMutex());
         sqlite3_trace(db->_handle, NULL, NULL);
+        sqlite3_mutex_leave(db->GetMutex());
         db->debug_trace->finish();
         db->debug_trace = NULL;
     }
@@ -451,11 +817,10 @@ void Database::RegisterTraceCallback(Baton* b) {
 void Database::TraceCallback(void* db, const char* sql) {
     // Note: This function is called in the thread pool.
     // Note: Some queries, such as "EXPLAIN" queries, are not sent through this.
-    static_cast<Database*>(db)->debug_trace->send(new std::string(sql));
+    static_cast<Database*>(db)->debug_trace->send(std::string(sql));
 }
 
-void Database::TraceCallback(Database* db, std::string* s) {
-    std::unique_ptr<std::string> sql(s);
+void Database::TraceCallback(Database* db, std::string* sql) {
     // Note: This function is called in the main V8 thread.
     auto env = db->Env();
     Napi::HandleScope scope(env);
@@ -476,11 +841,15 @@ void Database::RegisterProfileCallback(Baton* b) {
     if (db->debug_profile == NULL) {
         // Add it.
         db->debug_profile = new AsyncProfile(db, ProfileCallback);
+        sqlite3_mutex_enter(db->GetMutex());
         sqlite3_profile(db->_handle, ProfileCallback, db);
+        sqlite3_mutex_leave(db->GetMutex());
     }
     else {
         // Remove it.
+        sqlite3_mutex_enter(db->GetMutex());
         sqlite3_profile(db->_handle, NULL, NULL);
+        sqlite3_mutex_leave(db->GetMutex());
         db->debug_profile->finish();
         db->debug_profile = NULL;
     }
@@ -489,14 +858,13 @@ void Database::RegisterProfileCallback(Baton* b) {
 void Database::ProfileCallback(void* db, const char* sql, sqlite3_uint64 nsecs) {
     // Note: This function is called in the thread pool.
     // Note: Some queries, such as "EXPLAIN" queries, are not sent through this.
-    auto* info = new ProfileInfo();
-    info->sql = std::string(sql);
-    info->nsecs = nsecs;
-    static_cast<Database*>(db)->debug_profile->send(info);
+    ProfileInfo info;
+    info.sql = std::string(sql);
+    info.nsecs = nsecs;
+    static_cast<Database*>(db)->debug_profile->send(std::move(info));
 }
 
-void Database::ProfileCallback(Database *db, ProfileInfo* i) {
-    auto info = std::unique_ptr<ProfileInfo>(i);
+void Database::ProfileCallback(Database *db, ProfileInfo* info) {
     auto env = db->Env();
     Napi::HandleScope scope(env);
 
@@ -514,33 +882,87 @@ void Database::RegisterUpdateCallback(Baton* b) {
     assert(baton->db->_handle);
     auto* db = baton->db;
 
+    sqlite3_mutex_enter(db->GetMutex());
     if (db->update_event == NULL) {
         // Add it.
         db->update_event = new AsyncUpdate(db, UpdateCallback);
-        sqlite3_update_hook(db->_handle, UpdateCallback, db);
     }
     else {
         // Remove it.
-        sqlite3_update_hook(db->_handle, NULL, NULL);
         db->update_event->finish();
         db->update_event = NULL;
     }
+    db->UpdateHooks();
+    sqlite3_mutex_leave(db->GetMutex());
+}
+
+void Database::RegisterQueryCache(Baton* b) {
+    auto baton = std::unique_ptr<QueryCacheBaton>(static_cast<QueryCacheBaton*>(b));
+    assert(baton->db->open);
+    assert(baton->db->_handle);
+    auto* db = baton->db;
+
+    if (db->cache && baton->entries) {
+        db->cache->SetCapacity(baton->entries);
+        return;
+    }
+
+    // Statements that were prepared before the cache was turned on don't
+    // know the tables they read, so their results aren't cached.
+    QueryCache* previous = db->cache;
+    sqlite3_mutex_enter(db->GetMutex());
+    db->cache = baton->entries ? new QueryCache(baton->entries) : NULL;
+    db->UpdateHooks();
+    sqlite3_mutex_leave(db->GetMutex());
+    delete previous;
+}
+
+// Installs the hooks that the "change" event, the query cache and watches
+// need, and removes the others. Called while holding the connection's mutex.
+void Database::UpdateHooks() {
+    bool tracking = cache || commit_event;
+    if (update_event || tracking) {
+        sqlite3_update_hook(_handle, UpdateCallback, this);
+    }
+    else {
+        sqlite3_update_hook(_handle, NULL, NULL);
+    }
+    if (tracking) {
+        sqlite3_commit_hook(_handle, CommitCallback, this);
+        sqlite3_rollback_hook(_handle, RollbackCallback, this);
+        sqlite3_set_authorizer(_handle, AuthorizeCallback, this);
+    }
+    else {
+        sqlite3_commit_hook(_handle, NULL, NULL);
+        sqlite3_rollback_hook(_handle, NULL, NULL);
+        sqlite3_set_authorizer(_handle, NULL, NULL);
+        changed.clear();
+        schema_changed = false;
+    }
 }
 
-void Database::UpdateCallback(void* db, int type, const char* database,
+void Database::UpdateCallback(void* data, int type, const char* database,
         const char* table, sqlite3_int64 rowid) {
     // Note: This function is called in the thread pool.
     // Note: Some queries, such as "EXPLAIN" queries, are not sent through this.
-    auto* info = new UpdateInfo();
-    info->type = type;
-    info->database = std::string(database);
-    info->table = std::string(table);
-    info->rowid = rowid;
-    static_cast<Database*>(db)->update_event->send(info);
+    auto* db = static_cast<Database*>(data);
+    if (db->cache) {
+        db->cache->Changed(Table(database, table));
+    }
+    if (db->commit_event) {
+        db->changed.emplace(database, table);
+    }
+    if (db->update_event) {
+        UpdateInfo info;
+        info.type = type;
+        info.database = std::string(database);
+        info.table = std::string(table);
+        info.rowid = rowid;
+        db->update_event->send(std::move(info));
+    }
 }
 
-void Database::UpdateCallback(Database *db, UpdateInfo* i) {
-    auto info = std::unique_ptr<UpdateInfo>(i);
+void Database::UpdateCallback(Database *db, UpdateInfo* info) {
     auto env = db->Env();
     Napi::HandleScope scope(env);
 
@@ -554,6 +976,411 @@ void Database::UpdateCallback(Database *db, UpdateInfo* i) {
     EMIT_EVENT(db->Value(), 5, argv);
 }
 
+// Functions whose result isn't only determined by their arguments and the
+// tables a query reads.
+static const char* const volatile_functions[] = {
+    "random", "randomblob", "changes", "total_changes", "last_insert_rowid",
+    "date", "time", "datetime", "julianday", "unixepoch", "strftime", "timediff",
+    "current_date", "current_time", "current_timestamp", NULL
+};
+
+int Database::AuthorizeCallback(void* data, int action, const char* arg1,
+        const char* arg2, const char* schema, const char* trigger) {
+    // Note: This function is called in the thread pool, while a statement
+    // is prepared.
+    auto* db = static_cast<Database*>(data);
+    switch (action) {
+        case SQLITE_READ: {
+            if (db->collecting && arg1 && schema) {
+                db->collecting->tables.emplace(schema, arg1);
+            }
+        } break;
+        case SQLITE_FUNCTION: {
+            if (!db->collecting || !arg2) break;
+            for (int i = 0; volatile_functions[i]; i++) {
+                if (sqlite3_stricmp(arg2, volatile_functions[i]) == 0) {
+                    db->collecting->deterministic = false;
+                    break;
+                }
+            }
+        } break;
+        case SQLITE_DELETE: {
+            // For DELETE statements, this turns off the truncate optimization,
+            // which deletes all rows of a table without calling the update
+            // hook. Dropping a table or changing the schema table checks the
+            // same action, but would be skipped.
+            bool dropping = db->dropping;
+            db->dropping = false;
+            if (!dropping && arg1 && sqlite3_strnicmp(arg1, "sqlite_", 7) != 0) {
+                return SQLITE_IGNORE;
+            }
+        } break;
+        case SQLITE_DROP_TABLE:
+        case SQLITE_DROP_TEMP_TABLE:
+        case SQLITE_DROP_TEMP_VIEW:
+        case SQLITE_DROP_VIEW:
+        case SQLITE_DROP_VTABLE: {
+            db->dropping = true;
+            db->SchemaChanged();
+        } break;
+        case SQLITE_CREATE_TEMP_TABLE:
+        case SQLITE_CREATE_TEMP_VIEW:
+        case SQLITE_CREATE_VIEW:
+        case SQLITE_ALTER_TABLE:
+        case SQLITE_ATTACH:
+        case SQLITE_DETACH: {
+            // Changes what the names in queries refer to.
+            db->SchemaChanged();
+        } break;
+    }
+    return SQLITE_OK;
+}
+
+void Database::SchemaChanged() {
+    if (cache) cache->SchemaChanged();
+    schema_changed = true;
+}
+
+int Database::CommitCallback(void* data) {
+    // Note: This function is called in the thread pool.
+    auto* db = static_cast<Database*>(data);
+    if (db->cache) {
+        db->cache->TransactionEnded();
+    }
+    if (db->commit_event && (!db->changed.empty() || db->schema_changed)) {
+        CommitInfo info;
+        info.tables = std::move(db->changed);
+        info.schema = db->schema_changed;
+        db->commit_event->send(std::move(info));
+    }
+    db->changed.clear();
+    db->schema_changed = false;
+    return 0;
+}
+
+void Database::CommitCallback(Database* db, CommitInfo* info) {
+    // Watches may be closed by the callbacks of others.
+    std::vector<Watch*> affected;
+    for (auto* watch : db->watches) {
+        if (watch->Affected(*info)) affected.push_back(watch);
+    }
+    for (auto* watch : affected) {
+        if (db->watches.count(watch)) watch->Rerun();
+    }
+}
+
+void Database::RollbackCallback(void* data) {
+    // Note: This function is called in the thread pool.
+    auto* db = static_cast<Database*>(data);
+    if (db->cache) {
+        db->cache->TransactionEnded();
+    }
+    db->changed.clear();
+    db->schema_changed = false;
+}
+
+void Database::RegisterWalCallback(Baton* b) {
+    auto baton = std::unique_ptr<WalCheckpointBaton>(static_cast<WalCheckpointBaton*>(b));
+    assert(baton->db->open);
+    assert(baton->db->_handle);
+    auto* db = baton->db;
+
+    db->wal_pages = baton->pages;
+    db->wal_restart_pages = baton->restartPages;
+    db->wal_truncate_pages = baton->truncatePages;
+
+    if (baton->pages > 0 && db->wal_event == NULL) {
+        // Add it. This replaces SQLite's own autocheckpoint, which would run
+        // in whichever statement happens to commit past the threshold.
+        db->wal_event = new AsyncWal(db, WalCallback);
+        sqlite3_mutex_enter(db->GetMutex());
+        sqlite3_wal_hook(db->_handle, WalCallback, db);
+        sqlite3_mutex_leave(db->GetMutex());
+    }
+    else if (baton->pages == 0 && db->wal_event != NULL) {
+        // Remove it and go back to SQLite's default autocheckpoint.
+        sqlite3_mutex_enter(db->GetMutex());
+        sqlite3_wal_autocheckpoint(db->_handle, 1000);
+        sqlite3_mutex_leave(db->GetMutex());
+        db->wal_event->finish();
+        db->wal_event = NULL;
+    }
+}
+
+int Database::WalCallback(void* db, sqlite3* handle, const char* database, int frames) {
+    // Note: This function is called in the thread pool, after a transaction
+    // has been committed to the WAL.
+    WalInfo info;
+    info.database = std::string(database);
+    info.frames = frames;
+    static_cast<Database*>(db)->wal_event->send(std::move(info));
+    return SQLITE_OK;
+}
+
+void Database::WalCallback(Database* db, WalInfo* info) {
+    if (db->checkpointing || !db->open || db->closing || db->wal_pages <= 0 ||
+            info->frames < db->wal_pages) {
+        return;
+    }
+
+    int mode = SQLITE_CHECKPOINT_PASSIVE;
+    if (info->frames >= db->wal_truncate_pages) {
+        mode = SQLITE_CHECKPOINT_TRUNCATE;
+    }
+    else if (info->frames >= db->wal_restart_pages) {
+        mode = SQLITE_CHECKPOINT_RESTART;
+    }
+
+    db->checkpointing = true;
+    Baton* baton = new CheckpointBaton(db, Napi::Function(), info->database, mode, info->frames);
+    db->Schedule(Work_BeginCheckpoint, baton);
+}
+
+void Database::StopMaintenance() {
+    if (maintenance.timer) {
+        uv_close(reinterpret_cast<uv_handle_t*>(maintenance.timer), [](uv_handle_t* handle) {
+            delete reinterpret_cast<uv_timer_t*>(handle);
+        });
+        maintenance.timer = NULL;
+    }
+}
+
+void Database::MaintenanceTimerCallback(uv_timer_t* handle) {
+    auto* db = static_cast<Database*>(handle->data);
+
+    // Only use the connection while nothing else wants it. Inside a
+    // transaction of the user, the maintenance would become part of it.
+    if (!db->open || db->closing || db->pending > 0 || !db->queue.empty() ||
+            db->maintenance.running || !sqlite3_get_autocommit(db->_handle)) {
+        return;
+    }
+
+    auto env = db->Env();
+    Napi::HandleScope scope(env);
+
+    db->maintenance.running = true;
+    auto* baton = new MaintenanceBaton(db, Napi::Function());
+    baton->budgetMs = db->maintenance.budgetMs;
+    baton->vacuumPages = db->maintenance.vacuumPages;
+    baton->optimize = db->maintenance.optimize;
+    baton->quickCheck = db->maintenance.quickCheck;
+    baton->checkPosition = db->maintenance.checkPosition;
+    db->Schedule(Work_BeginMaintenance, baton);
+}
+
+void Database::Work_BeginMaintenance(Baton* baton) {
+    assert(baton->db->open);
+    assert(baton->db->_handle);
+    baton->db->pending++;
+
+    auto env = baton->db->Env();
+    CREATE_WORK("sqlite3.Database.Maintenance", Work_Maintenance, Work_AfterMaintenance);
+}
+
+static int QueryInt(sqlite3* handle, const char* sql) {
+    sqlite3_stmt* stmt = NULL;
+    int value = -1;
+    if (sqlite3_prepare_v2(handle, sql, -1, &stmt, NULL) == SQLITE_OK &&
+            sqlite3_step(stmt) == SQLITE_ROW) {
+        value = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return value;
+}
+
+void Database::Work_Maintenance(napi_env e, void* data) {
+    auto* baton = static_cast<MaintenanceBaton*>(data);
+    auto* db = baton->db;
+    sqlite3_mutex* mtx = db->GetMutex();
+
+    uint64_t start = uv_hrtime();
+    auto elapsed = [start]() { return (uv_hrtime() - start) / 1e6; };
+    // The connection is released after every chunk so that other work can get
+    // to it in between. Nothing is written once the user began a transaction
+    // in the meantime.
+    auto exec = [&](const char* sql) {
+        sqlite3_mutex_enter(mtx);
+        if (!sqlite3_get_autocommit(db->_handle)) {
+            sqlite3_mutex_leave(mtx);
+            return false;
+        }
+        baton->status = sqlite3_exec(db->_handle, sql, NULL, NULL, NULL);
+        if (baton->status != SQLITE_OK) {
+            baton->message = std::string(sqlite3_errmsg(db->_handle));
+        }
+        sqlite3_mutex_leave(mtx);
+        return baton->status == SQLITE_OK;
+    };
+
+    if (baton->optimize) {
+        baton->optimized = exec("PRAGMA optimize");
+    }
+
+    // Each task gets at least one chunk per run, even if the budget is gone.
+    for (int chunk = 0; baton->status == SQLITE_OK && baton->vacuumPages > 0 &&
+            (chunk == 0 || elapsed() < baton->budgetMs); chunk++) {
+        // A no-op unless the database uses auto_vacuum = INCREMENTAL.
+        std::string sql = "PRAGMA incremental_vacuum(" + std::to_string(baton->vacuumPages) + ")";
+        sqlite3_mutex_enter(mtx);
+        int before = QueryInt(db->_handle, "PRAGMA freelist_count");
+        sqlite3_mutex_leave(mtx);
+        if (before <= 0 || !exec(sql.c_str())) break;
+        sqlite3_mutex_enter(mtx);
+        int after = QueryInt(db->_handle, "PRAGMA freelist_count");
+        sqlite3_mutex_leave(mtx);
+        if (after < 0 || after >= before) break;
+        baton->vacuumedPages += before - after;
+    }
+
+    if (baton->status == SQLITE_OK && baton->quickCheck) {
+        std::vector<std::string> tables;
+        sqlite3_mutex_enter(mtx);
+        sqlite3_stmt* stmt = NULL;
+        if (sqlite3_prepare_v2(db->_handle,
+                "SELECT name FROM sqlite_schema WHERE type = 'table' ORDER BY name",
+                -1, &stmt, NULL) == SQLITE_OK) {
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                tables.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+            }
+        }
+        sqlite3_finalize(stmt);
+        sqlite3_mutex_leave(mtx);
+
+        // Check one table at a time, continuing where the last run stopped.
+        if (baton->checkPosition >= tables.size()) baton->checkPosition = 0;
+        while (baton->checkPosition < tables.size() &&
+                (baton->checked.empty() || elapsed() < baton->budgetMs)) {
+            const std::string& table = tables[baton->checkPosition++];
+            char* sql = sqlite3_mprintf("PRAGMA quick_check(%Q)", table.c_str());
+            sqlite3_mutex_enter(mtx);
+            if (sqlite3_prepare_v2(db->_handle, sql, -1, &stmt, NULL) == SQLITE_OK) {
+                while (sqlite3_step(stmt) == SQLITE_ROW) {
+                    auto* result = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+                    if (result && strcmp(result, "ok") != 0) baton->problems.push_back(result);
+                }
+            }
+            sqlite3_finalize(stmt);
+            sqlite3_mutex_leave(mtx);
+            sqlite3_free(sql);
+            baton->checked.push_back(table);
+        }
+    }
+
+    baton->duration = elapsed();
+}
+
+void Database::Work_AfterMaintenance(napi_env e, napi_status status, void* data) {
+    std::unique_ptr<MaintenanceBaton> baton(static_cast<MaintenanceBaton*>(data));
+
+    auto* db = baton->db;
+    db->pending--;
+    db->maintenance.running = false;
+    db->maintenance.checkPosition = baton->checkPosition;
+
+    auto env = db->Env();
+    Napi::HandleScope scope(env);
+
+    // Locks held by other connections just mean trying again next time.
+    if (baton->status == SQLITE_OK || baton->status == SQLITE_BUSY ||
+            baton->status == SQLITE_LOCKED) {
+        auto checked = Napi::Array::New(env, baton->checked.size());
+        for (size_t i = 0; i < baton->checked.size(); i++) {
+            checked.Set(i, baton->checked[i]);
+        }
+        auto problems = Napi::Array::New(env, baton->problems.size());
+        for (size_t i = 0; i < baton->problems.size(); i++) {
+            problems.Set(i, baton->problems[i]);
+        }
+        auto result = Napi::Object::New(env);
+        result.Set("optimized", baton->optimized);
+        result.Set("vacuumedPages", baton->vacuumedPages);
+        result.Set("checkedTables", checked);
+        result.Set("problems", problems);
+        result.Set("busy", baton->status != SQLITE_OK);
+        result.Set("duration", baton->duration);
+        Napi::Value argv[] = { Napi::String::New(env, "maintenance"), result };
+        EMIT_EVENT(db->Value(), 2, argv);
+    }
+    else {
+        EXCEPTION(Napi::String::New(env, baton->message.c_str()), baton->status, exception);
+        Napi::Value argv[] = { Napi::String::New(env, "error"), exception };
+        EMIT_EVENT(db->Value(), 2, argv);
+    }
+
+    db->Process();
+}
+
+void Database::Work_BeginCheckpoint(Baton* baton) {
+    assert(baton->db->open);
+    assert(baton->db->_handle);
+    baton->db->pending++;
+
+    auto env = baton->db->Env();
+    CREATE_WORK("sqlite3.Database.Checkpoint", Work_Checkpoint, Work_AfterCheckpoint);
+}
+
+void Database::Work_Checkpoint(napi_env e, void* data) {
+    auto* baton = static_cast<CheckpointBaton*>(data);
+    auto* db = baton->db;
+
+    std::string filename;
+    sqlite3_mutex* mtx = db->GetMutex();
+    sqlite3_mutex_enter(mtx);
+    const char* name = sqlite3_db_filename(db->_handle, baton->database.c_str());
+    if (name) filename = name;
+    sqlite3_mutex_leave(mtx);
+
+    // Checkpoint through a connection of our own so that statements on this
+    // one aren't held up while the WAL is copied back.
+    sqlite3* other = NULL;
+    baton->status = sqlite3_open_v2(filename.c_str(), &other, SQLITE_OPEN_READWRITE, NULL);
+    if (baton->status == SQLITE_OK) {
+        uint64_t start = uv_hrtime();
+        baton->status = sqlite3_wal_checkpoint_v2(other, "main", baton->mode,
+            &baton->logFrames, &baton->checkpointedFrames);
+        baton->duration = (uv_hrtime() - start) / 1e6;
+    }
+    if (baton->status != SQLITE_OK) {
+        baton->message = std::string(other ? sqlite3_errmsg(other) : sqlite3_errstr(baton->status));
+    }
+    sqlite3_close(other);
+}
+
+void Database::Work_AfterCheckpoint(napi_env e, napi_status status, void* data) {
+    std::unique_ptr<CheckpointBaton> baton(static_cast<CheckpointBaton*>(data));
+
+    auto* db = baton->db;
+    db->pending--;
+    db->checkpointing = false;
+
+    auto env = db->Env();
+    Napi::HandleScope scope(env);
+
+    // A checkpoint that can't get all the locks it needs is simply retried
+    // after a later commit.
+    if (baton->status == SQLITE_OK || baton->status == SQLITE_BUSY) {
+        const char* mode = baton->mode == SQLITE_CHECKPOINT_TRUNCATE ? "truncate" :
+            baton->mode == SQLITE_CHECKPOINT_RESTART ? "restart" : "passive";
+        auto result = Napi::Object::New(env);
+        result.Set("database", baton->database);
+        result.Set("mode", mode);
+        result.Set("busy", baton->status == SQLITE_BUSY);
+        result.Set("walFrames", baton->walFrames);
+        result.Set("logFrames", baton->logFrames);
+        result.Set("checkpointedFrames", baton->checkpointedFrames);
+        result.Set("duration", baton->duration);
+        Napi::Value argv[] = { Napi::String::New(env, "checkpoint"), result };
+        EMIT_EVENT(db->Value(), 2, argv);
+    }
+    else {
+        EXCEPTION(Napi::String::New(env, baton->message.c_str()), baton->status, exception);
+        Napi::Value argv[] = { Napi::String::New(env, "error"), exception };
+        EMIT_EVENT(db->Value(), 2, argv);
+    }
+
+    db->Process();
+}
+
 Napi::Value Database::Exec(const Napi::CallbackInfo& info) {
     auto env = this->Env();
     auto* db = this;
@@ -581,6 +1408,9 @@ void Database::Work_BeginExec(Baton* baton) {
 void Database::Work_Exec(napi_env e, void* data) {
     auto* baton = static_cast<ExecBaton*>(data);
 
+    sqlite3_mutex* mtx = baton->db->GetMutex();
+    sqlite3_mutex_enter(mtx);
+
     char* message = NULL;
     baton->status = sqlite3_exec(
         baton->db->_handle,
@@ -590,6 +1420,8 @@ void Database::Work_Exec(napi_env e, void* data) {
         &message
     );
 
+    sqlite3_mutex_leave(mtx);
+
     if (baton->status != SQLITE_OK && message != NULL) {
         baton->message = std::string(message);
         sqlite3_free(message);
@@ -627,11 +1459,1069 @@ void Database::Work_AfterExec(napi_env e, napi_status status, void* data) {
     db->Process();
 }
 
-Napi::Value Database::Wait(const Napi::CallbackInfo& info) {
-    auto env = info.Env();
+// Database#execFile(path | fd, [{ transactionEvery, progress }], [callback])
+// Runs an SQL script from a file like Database#exec, without reading all of
+// it into memory. With transactionEvery, statements outside of the
+// transactions of the script are grouped into transactions of that many;
+// PRAGMA, VACUUM, ATTACH and DETACH are run on their own.
+Napi::Value Database::ExecFile(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
     auto* db = this;
 
-    OPTIONAL_ARGUMENT_FUNCTION(0, callback);
+    if (info.Length() <= 0 || !(info[0].IsString() || info[0].IsNumber())) {
+        Napi::TypeError::New(env, "Path or file descriptor expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    Napi::Object options = info.Length() > 1 && info[1].IsObject() && !info[1].IsFunction() ?
+        info[1].As<Napi::Object>() : Napi::Object::New(env);
+    Napi::Function callback;
+    if (info.Length() > 1 && info[info.Length() - 1].IsFunction()) {
+        callback = info[info.Length() - 1].As<Napi::Function>();
+    }
+
+    Napi::Value value = options.Get("transactionEvery");
+    if (!value.IsUndefined() && (!value.IsNumber() || value.As<Napi::Number>().Int64Value() < 0)) {
+        Napi::TypeError::New(env, "transactionEvery must be a number of statements").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    size_t transaction_every = value.IsNumber() ? value.As<Napi::Number>().Int64Value() : 0;
+    value = options.Get("progress");
+    if (!value.IsUndefined() && !value.IsFunction()) {
+        Napi::TypeError::New(env, "Progress must be a function").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    auto* baton = new ExecFileBaton(db, callback);
+    if (info[0].IsString()) {
+        baton->path = info[0].As<Napi::String>().Utf8Value();
+    }
+    else {
+        baton->fd = info[0].As<Napi::Number>().Int32Value();
+    }
+    baton->transaction_every = transaction_every;
+    if (value.IsFunction()) baton->progress.Reset(value.As<Napi::Function>(), 1);
+    napi_get_uv_event_loop(env, &baton->loop);
+
+    db->Schedule(Work_BeginExecFile, baton, true);
+    return info.This();
+}
+
+void Database::ExecFileBaton::Close() {
+    if (owned && fd >= 0) {
+        uv_fs_t req;
+        uv_fs_close(loop, &req, fd, NULL);
+        uv_fs_req_cleanup(&req);
+    }
+    fd = -1;
+}
+
+void Database::Work_BeginExecFile(Baton* baton) {
+    assert(baton->db->locked);
+    assert(baton->db->open);
+    assert(baton->db->_handle);
+    assert(baton->db->pending == 0);
+    baton->db->pending++;
+
+    auto env = baton->db->Env();
+    CREATE_WORK("sqlite3.Database.ExecFile", Work_ExecFile, Work_AfterExecFile);
+}
+
+// Whether the statement begins or ends a transaction or savepoint, or has
+// to run outside of one to take effect (PRAGMA foreign_keys = OFF at the
+// top of a .dump) or at all (VACUUM, ATTACH, DETACH). The transactions of
+// execFile must not be around those.
+static bool IsOutsideTransactionStatement(const char* sql, const char* end) {
+    while (sql < end) {
+        if (isspace(static_cast<unsigned char>(*sql))) {
+            sql++;
+        }
+        else if (end - sql >= 2 && sql[0] == '-' && sql[1] == '-') {
+            while (sql < end && *sql != '\n') sql++;
+        }
+        else if (end - sql >= 2 && sql[0] == '/' && sql[1] == '*') {
+            sql += 2;
+            while (sql < end && !(end - sql >= 2 && sql[0] == '*' && sql[1] == '/')) sql++;
+            sql += 2;
+        }
+        else {
+            break;
+        }
+    }
+
+    static const char* const keywords[] = {
+        "BEGIN", "COMMIT", "END", "ROLLBACK", "SAVEPOINT", "RELEASE",
+        "PRAGMA", "VACUUM", "ATTACH", "DETACH"
+    };
+    for (const char* keyword : keywords) {
+        size_t length = strlen(keyword);
+        if (static_cast<size_t>(end - sql) >= length && sqlite3_strnicmp(sql, keyword, length) == 0 &&
+                (static_cast<size_t>(end - sql) == length || !isalnum(static_cast<unsigned char>(sql[length])))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Database::Work_ExecFile(napi_env e, void* data) {
+    auto* baton = static_cast<ExecFileBaton*>(data);
+    auto* db = baton->db;
+
+    if (!baton->started) {
+        baton->started = true;
+        if (!baton->path.empty()) {
+            uv_fs_t req;
+            int fd = uv_fs_open(baton->loop, &req, baton->path.c_str(), UV_FS_O_RDONLY, 0, NULL);
+            uv_fs_req_cleanup(&req);
+            if (fd < 0) {
+                baton->status = SQLITE_CANTOPEN;
+                baton->message = std::string("Could not open ") + baton->path + ": " + uv_strerror(fd);
+                baton->done = true;
+                return;
+            }
+            baton->fd = fd;
+            baton->owned = true;
+        }
+        baton->reader = std::make_unique<ScriptReader>(baton->loop, baton->fd);
+    }
+
+    auto& reader = *baton->reader;
+    sqlite3* handle = db->_handle;
+    sqlite3_mutex* mtx = db->GetMutex();
+    sqlite3_mutex_enter(mtx);
+
+    // Statements per run, between which the progress is reported.
+    size_t limit = baton->transaction_every ? baton->transaction_every : 1000;
+    bool transaction = false;
+    for (size_t count = 0; count < limit; ) {
+        if (!reader.Fill()) {
+            baton->done = true;
+            if (reader.status != SQLITE_OK) {
+                baton->status = reader.status;
+                baton->message = reader.message;
+            }
+            break;
+        }
+
+        const char* sql = reader.Data();
+        const char* tail = sql;
+        sqlite3_stmt* stmt = NULL;
+        int status = sqlite3_prepare_v2(handle, sql, static_cast<int>(reader.Size()), &stmt, &tail);
+        if (status == SQLITE_OK && !stmt) {
+            // Only comments and white space.
+            reader.Consume(tail);
+            continue;
+        }
+
+        if (status == SQLITE_OK) {
+            if (IsOutsideTransactionStatement(sql, tail)) {
+                if (transaction) {
+                    status = sqlite3_exec(handle, "COMMIT", NULL, NULL, NULL);
+                    transaction = false;
+                }
+            }
+            else if (baton->transaction_every && !transaction && sqlite3_get_autocommit(handle)) {
+                status = sqlite3_exec(handle, "BEGIN", NULL, NULL, NULL);
+                transaction = status == SQLITE_OK;
+            }
+        }
+        if (status == SQLITE_OK) {
+            while ((status = sqlite3_step(stmt)) == SQLITE_ROW) {}
+            if (status == SQLITE_DONE) status = SQLITE_OK;
+        }
+        if (status != SQLITE_OK) {
+            const char* start = sql;
+            while (start < tail && isspace(static_cast<unsigned char>(*start))) start++;
+            baton->status = status;
+            baton->message = "Line " + std::to_string(reader.line + std::count(sql, start, '\n')) +
+                ": " + sqlite3_errmsg(handle);
+            baton->done = true;
+            sqlite3_finalize(stmt);
+            break;
+        }
+        sqlite3_finalize(stmt);
+
+        reader.Consume(tail);
+        baton->statements++;
+        count++;
+    }
+
+    if (transaction) {
+        if (baton->status == SQLITE_OK) {
+            baton->status = sqlite3_exec(handle, "COMMIT", NULL, NULL, NULL);
+            if (baton->status != SQLITE_OK) {
+                baton->message = std::string(sqlite3_errmsg(handle));
+                baton->done = true;
+            }
+        }
+        if (baton->status != SQLITE_OK && !sqlite3_get_autocommit(handle)) {
+            sqlite3_exec(handle, "ROLLBACK", NULL, NULL, NULL);
+        }
+    }
+
+    sqlite3_mutex_leave(mtx);
+}
+
+void Database::Work_AfterExecFile(napi_env e, napi_status status, void* data) {
+    auto* baton = static_cast<ExecFileBaton*>(data);
+    auto* db = baton->db;
+
+    auto env = db->Env();
+    Napi::HandleScope scope(env);
+
+    auto result = Napi::Object::New(env);
+    result.Set("statements", Napi::Number::New(env, static_cast<double>(baton->statements)));
+    result.Set("bytes", Napi::Number::New(env,
+        static_cast<double>(baton->reader ? baton->reader->bytes : 0)));
+
+    if (!baton->done) {
+        // The next part is queued first so that a throwing progress
+        // callback doesn't stop it.
+        REQUEUE_WORK("sqlite3.Database.ExecFile", Work_ExecFile, Work_AfterExecFile);
+        Napi::Function progress = baton->progress.Value();
+        if (IS_FUNCTION(progress)) {
+            Napi::Value argv[] = { result };
+            TRY_CATCH_CALL(db->Value(), progress, 1, argv);
+        }
+        return;
+    }
+
+    std::unique_ptr<ExecFileBaton> owner(baton);
+    owner->Close();
+    db->pending--;
+
+    Napi::Function cb = baton->callback.Value();
+
+    if (baton->status != SQLITE_OK) {
+        EXCEPTION(Napi::String::New(env, baton->message.c_str()), baton->status, exception);
+
+        if (IS_FUNCTION(cb)) {
+            Napi::Value argv[] = { exception };
+            TRY_CATCH_CALL(db->Value(), cb, 1, argv);
+        }
+        else {
+            Napi::Value info[] = { Napi::String::New(env, "error"), exception };
+            EMIT_EVENT(db->Value(), 2, info);
+        }
+    }
+    else if (IS_FUNCTION(cb)) {
+        Napi::Value argv[] = { env.Null(), result };
+        TRY_CATCH_CALL(db->Value(), cb, 2, argv);
+    }
+
+    db->Process();
+}
+
+// Database#toBuffer([schema], [callback])
+Napi::Value Database::ToBuffer(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+    auto* db = this;
+
+    std::string schema = "main";
+    int pos = 0;
+    if (info.Length() > 0 && info[0].IsString()) {
+        schema = info[0].As<Napi::String>();
+        pos++;
+    }
+    OPTIONAL_ARGUMENT_FUNCTION(pos, callback);
+
+    Baton* baton = new ToBufferBaton(db, callback, schema.c_str());
+    db->Schedule(Work_BeginToBuffer, baton);
+
+    return info.This();
+}
+
+void Database::Work_BeginToBuffer(Baton* baton) {
+    assert(baton->db->open);
+    assert(baton->db->_handle);
+    baton->db->pending++;
+
+    auto env = baton->db->Env();
+    CREATE_WORK("sqlite3.Database.ToBuffer", Work_ToBuffer, Work_AfterToBuffer);
+}
+
+void Database::Work_ToBuffer(napi_env e, void* data) {
+    auto* baton = static_cast<ToBufferBaton*>(data);
+
+    sqlite3_mutex* mtx = baton->db->GetMutex();
+    sqlite3_mutex_enter(mtx);
+
+    baton->data = sqlite3_serialize(
+        baton->db->_handle,
+        baton->schema.c_str(),
+        &baton->size,
+        0
+    );
+
+    sqlite3_mutex_leave(mtx);
+
+    if (baton->data == NULL && baton->size < 0) {
+        baton->status = SQLITE_ERROR;
+        baton->message = "unknown database " + baton->schema;
+    }
+    else if (baton->data == NULL && baton->size > 0) {
+        baton->status = SQLITE_NOMEM;
+        baton->message = "out of memory";
+    }
+}
+
+void Database::Work_AfterToBuffer(napi_env e, napi_status status, void* data) {
+    std::unique_ptr<ToBufferBaton> baton(static_cast<ToBufferBaton*>(data));
+
+    auto* db = baton->db;
+    db->pending--;
+
+    auto env = db->Env();
+    Napi::HandleScope scope(env);
+
+    Napi::Function cb = baton->callback.Value();
+
+    if (baton->status != SQLITE_OK) {
+        EXCEPTION(Napi::String::New(env, baton->message.c_str()), baton->status, exception);
+
+        if (IS_FUNCTION(cb)) {
+            Napi::Value argv[] = { exception };
+            TRY_CATCH_CALL(db->Value(), cb, 1, argv);
+        }
+        else {
+            Napi::Value info[] = { Napi::String::New(env, "error"), exception };
+            EMIT_EVENT(db->Value(), 2, info);
+        }
+    }
+    else if (IS_FUNCTION(cb)) {
+        Napi::Value buffer;
+        if (baton->data) {
+            // Hand the serialization over to the Buffer instead of copying it.
+            buffer = Napi::Buffer<unsigned char>::New(env, baton->data, baton->size,
+                [](Napi::Env, unsigned char* data) { sqlite3_free(data); });
+            baton->data = NULL;
+        }
+        else {
+            buffer = Napi::Buffer<unsigned char>::New(env, 0);
+        }
+        Napi::Value argv[] = { env.Null(), buffer };
+        TRY_CATCH_CALL(db->Value(), cb, 2, argv);
+    }
+
+    db->Process();
+}
+
+// Database#loadBuffer(buffer, [{ schema, readonly }], [callback])
+Napi::Value Database::LoadBuffer(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+    auto* db = this;
+
+    if (info.Length() <= 0 || !info[0].IsBuffer()) {
+        Napi::TypeError::New(env, "Buffer expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    auto buffer = info[0].As<Napi::Buffer<unsigned char>>();
+
+    std::string schema = "main";
+    bool readonly = false;
+    int pos = 1;
+    if (info.Length() > 1 && info[1].IsObject() && !info[1].IsFunction()) {
+        auto options = info[1].As<Napi::Object>();
+        if (options.Has("schema")) {
+            Napi::Value value = options.Get("schema");
+            if (!value.IsString()) {
+                Napi::TypeError::New(env, "Schema must be a string").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            schema = value.As<Napi::String>();
+        }
+        readonly = options.Get("readonly").ToBoolean();
+        pos++;
+    }
+    OPTIONAL_ARGUMENT_FUNCTION(pos, callback);
+
+    Baton* baton = new LoadBufferBaton(db, callback, schema.c_str(), buffer, readonly);
+    db->Schedule(Work_BeginLoadBuffer, baton, true);
+
+    return info.This();
+}
+
+void Database::Work_BeginLoadBuffer(Baton* baton) {
+    assert(baton->db->locked);
+    assert(baton->db->open);
+    assert(baton->db->_handle);
+    assert(baton->db->pending == 0);
+    baton->db->pending++;
+
+    auto env = baton->db->Env();
+    CREATE_WORK("sqlite3.Database.LoadBuffer", Work_LoadBuffer, Work_AfterLoadBuffer);
+}
+
+void Database::Work_LoadBuffer(napi_env e, void* data) {
+    auto* baton = static_cast<LoadBufferBaton*>(data);
+
+    unsigned char* contents = baton->data;
+    unsigned int flags = SQLITE_DESERIALIZE_READONLY;
+    if (!baton->readonly) {
+        // SQLite needs memory of its own to write to. Read-only databases use
+        // the Buffer directly; it is kept alive until the schema is replaced
+        // or the database is closed.
+        contents = static_cast<unsigned char*>(sqlite3_malloc64(baton->size));
+        if (contents == NULL && baton->size > 0) {
+            baton->status = SQLITE_NOMEM;
+            baton->message = "out of memory";
+            return;
+        }
+        if (baton->size > 0) memcpy(contents, baton->data, baton->size);
+        flags = SQLITE_DESERIALIZE_FREEONCLOSE | SQLITE_DESERIALIZE_RESIZEABLE;
+    }
+
+    sqlite3_mutex* mtx = baton->db->GetMutex();
+    sqlite3_mutex_enter(mtx);
+
+    baton->status = sqlite3_deserialize(
+        baton->db->_handle,
+        baton->schema.c_str(),
+        contents,
+        baton->size,
+        baton->size,
+        flags
+    );
+
+    if (baton->status != SQLITE_OK) {
+        baton->message = std::string(sqlite3_errmsg(baton->db->_handle));
+    }
+    else if (baton->db->cache) {
+        // The hooks don't see the contents being replaced.
+        baton->db->cache->Flush();
+    }
+
+    sqlite3_mutex_leave(mtx);
+}
+
+void Database::Work_AfterLoadBuffer(napi_env e, napi_status status, void* data) {
+    std::unique_ptr<LoadBufferBaton> baton(static_cast<LoadBufferBaton*>(data));
+
+    auto* db = baton->db;
+    db->pending--;
+
+    auto env = db->Env();
+    Napi::HandleScope scope(env);
+
+    if (baton->status == SQLITE_OK) {
+        // The previous contents of the schema are gone now.
+        if (baton->readonly) {
+            db->buffers[baton->schema] = std::move(baton->buffer);
+        }
+        else {
+            db->buffers.erase(baton->schema);
+        }
+    }
+
+    Napi::Function cb = baton->callback.Value();
+
+    if (baton->status != SQLITE_OK) {
+        EXCEPTION(Napi::String::New(env, baton->message.c_str()), baton->status, exception);
+
+        if (IS_FUNCTION(cb)) {
+            Napi::Value argv[] = { exception };
+            TRY_CATCH_CALL(db->Value(), cb, 1, argv);
+        }
+        else {
+            Napi::Value info[] = { Napi::String::New(env, "error"), exception };
+            EMIT_EVENT(db->Value(), 2, info);
+        }
+    }
+    else if (IS_FUNCTION(cb)) {
+        Napi::Value argv[] = { env.Null() };
+        TRY_CATCH_CALL(db->Value(), cb, 1, argv);
+    }
+
+    db->Process();
+}
+
+// Database#beginSnapshot([snapshot], [callback])
+// Begins a read transaction. Without a snapshot, the callback gets one for the
+// state that the transaction sees; with one, the transaction sees that state.
+// Either way the transaction is ended with COMMIT or ROLLBACK.
+Napi::Value Database::BeginSnapshot(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+    auto* db = this;
+
+#ifdef SQLITE_ENABLE_SNAPSHOT
+    int pos = 0;
+    Napi::External<sqlite3_snapshot> source;
+    if (info.Length() > 0 && info[0].IsExternal()) {
+        source = info[0].As<Napi::External<sqlite3_snapshot>>();
+        pos++;
+    }
+    OPTIONAL_ARGUMENT_FUNCTION(pos, callback);
+
+    auto* baton = new SnapshotBaton(db, callback, "main");
+    if (!source.IsEmpty()) {
+        baton->source = Napi::Persistent(source.As<Napi::Object>());
+        baton->snapshot = source.Data();
+    }
+    db->Schedule(Work_BeginBeginSnapshot, baton, true);
+
+    return info.This();
+#else
+    Napi::Error::New(env, "Snapshots are not supported by this SQLite build").ThrowAsJavaScriptException();
+    return env.Null();
+#endif
+}
+
+void Database::Work_BeginBeginSnapshot(Baton* baton) {
+    assert(baton->db->locked);
+    assert(baton->db->open);
+    assert(baton->db->_handle);
+    assert(baton->db->pending == 0);
+    baton->db->pending++;
+
+    auto env = baton->db->Env();
+    CREATE_WORK("sqlite3.Database.BeginSnapshot", Work_BeginSnapshot, Work_AfterBeginSnapshot);
+}
+
+void Database::Work_BeginSnapshot(napi_env e, void* data) {
+#ifdef SQLITE_ENABLE_SNAPSHOT
+    auto* baton = static_cast<SnapshotBaton*>(data);
+    auto* handle = baton->db->_handle;
+
+    sqlite3_mutex* mtx = baton->db->GetMutex();
+    sqlite3_mutex_enter(mtx);
+
+    baton->status = sqlite3_exec(handle, "BEGIN", NULL, NULL, NULL);
+    if (baton->status == SQLITE_OK) {
+        if (baton->snapshot) {
+            baton->status = sqlite3_snapshot_open(handle, baton->schema.c_str(), baton->snapshot);
+        }
+        else {
+            // Reading something starts the read transaction the snapshot is
+            // taken of.
+            baton->status = sqlite3_exec(handle, "SELECT 1 FROM sqlite_schema LIMIT 1", NULL, NULL, NULL);
+            if (baton->status == SQLITE_OK) {
+                baton->status = sqlite3_snapshot_get(handle, baton->schema.c_str(), &baton->snapshot);
+            }
+        }
+    }
+    if (baton->status != SQLITE_OK) {
+        baton->message = std::string(sqlite3_errmsg(handle));
+        if (!sqlite3_get_autocommit(handle)) {
+            sqlite3_exec(handle, "ROLLBACK", NULL, NULL, NULL);
+        }
+    }
+
+    sqlite3_mutex_leave(mtx);
+#endif
+}
+
+void Database::Work_AfterBeginSnapshot(napi_env e, napi_status status, void* data) {
+    std::unique_ptr<SnapshotBaton> baton(static_cast<SnapshotBaton*>(data));
+
+    auto* db = baton->db;
+    db->pending--;
+
+    auto env = db->Env();
+    Napi::HandleScope scope(env);
+
+    Napi::Function cb = baton->callback.Value();
+
+    if (baton->status != SQLITE_OK) {
+        EXCEPTION(Napi::String::New(env, baton->message.c_str()), baton->status, exception);
+
+        if (IS_FUNCTION(cb)) {
+            Napi::Value argv[] = { exception };
+            TRY_CATCH_CALL(db->Value(), cb, 1, argv);
+        }
+        else {
+            Napi::Value info[] = { Napi::String::New(env, "error"), exception };
+            EMIT_EVENT(db->Value(), 2, info);
+        }
+    }
+#ifdef SQLITE_ENABLE_SNAPSHOT
+    else if (baton->source.IsEmpty()) {
+        auto snapshot = Napi::External<sqlite3_snapshot>::New(env, baton->snapshot,
+            [](Napi::Env, sqlite3_snapshot* snapshot) { sqlite3_snapshot_free(snapshot); });
+        if (IS_FUNCTION(cb)) {
+            Napi::Value argv[] = { env.Null(), snapshot };
+            TRY_CATCH_CALL(db->Value(), cb, 2, argv);
+        }
+    }
+#endif
+    else if (IS_FUNCTION(cb)) {
+        Napi::Value argv[] = { env.Null() };
+        TRY_CATCH_CALL(db->Value(), cb, 1, argv);
+    }
+
+    db->Process();
+}
+
+#ifdef NODE_SQLITE3_HAVE_SESSION
+static int ChangesetConflict(void* data, int conflict, sqlite3_changeset_iter* iter) {
+    auto* baton = static_cast<Database::ApplyChangesetBaton*>(data);
+    baton->conflicts++;
+    if (baton->policy == SQLITE_CHANGESET_REPLACE &&
+            conflict != SQLITE_CHANGESET_DATA && conflict != SQLITE_CHANGESET_CONFLICT) {
+        // Rows that are missing or violate a constraint can't be replaced.
+        return SQLITE_CHANGESET_OMIT;
+    }
+    return baton->policy;
+}
+#endif
+
+// Database#applyChangeset(buffer, ['abort' | 'omit' | 'replace'], [callback])
+// Applies a changeset or patchset from Session in a single transaction. The
+// policy decides what happens to changes that conflict with the contents of
+// the database: 'abort' (the default) rolls everything back, 'omit' skips
+// them and 'replace' overwrites the conflicting rows. The callback gets the
+// number of conflicts.
+Napi::Value Database::ApplyChangeset(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+    auto* db = this;
+
+#ifdef NODE_SQLITE3_HAVE_SESSION
+    if (info.Length() <= 0 || !info[0].IsBuffer()) {
+        Napi::TypeError::New(env, "Buffer expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    auto buffer = info[0].As<Napi::Buffer<unsigned char>>();
+
+    int policy = SQLITE_CHANGESET_ABORT;
+    int pos = 1;
+    if (info.Length() > 1 && info[1].IsString()) {
+        std::string name = info[1].As<Napi::String>();
+        if (name == "omit") policy = SQLITE_CHANGESET_OMIT;
+        else if (name == "replace") policy = SQLITE_CHANGESET_REPLACE;
+        else if (name != "abort") {
+            Napi::TypeError::New(env, "Conflict policy must be 'abort', 'omit' or 'replace'").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        pos++;
+    }
+    OPTIONAL_ARGUMENT_FUNCTION(pos, callback);
+
+    Baton* baton = new ApplyChangesetBaton(db, callback, buffer, policy);
+    db->Schedule(Work_BeginApplyChangeset, baton, true);
+
+    return info.This();
+#else
+    Napi::Error::New(env, "Sessions are not supported by this SQLite build").ThrowAsJavaScriptException();
+    return env.Null();
+#endif
+}
+
+void Database::Work_BeginApplyChangeset(Baton* baton) {
+    assert(baton->db->locked);
+    assert(baton->db->open);
+    assert(baton->db->_handle);
+    assert(baton->db->pending == 0);
+    baton->db->pending++;
+
+    auto env = baton->db->Env();
+    CREATE_WORK("sqlite3.Database.ApplyChangeset", Work_ApplyChangeset, Work_AfterApplyChangeset);
+}
+
+void Database::Work_ApplyChangeset(napi_env e, void* data) {
+#ifdef NODE_SQLITE3_HAVE_SESSION
+    auto* baton = static_cast<ApplyChangesetBaton*>(data);
+
+    sqlite3_mutex* mtx = baton->db->GetMutex();
+    sqlite3_mutex_enter(mtx);
+
+    baton->status = sqlite3changeset_apply(baton->db->_handle, baton->size, baton->data,
+        NULL, ChangesetConflict, baton);
+    if (baton->status != SQLITE_OK) {
+        baton->message = baton->status == SQLITE_ABORT ?
+            std::string("changeset conflicts with the database") :
+            std::string(sqlite3_errmsg(baton->db->_handle));
+    }
+
+    sqlite3_mutex_leave(mtx);
+#endif
+}
+
+void Database::Work_AfterApplyChangeset(napi_env e, napi_status status, void* data) {
+    std::unique_ptr<ApplyChangesetBaton> baton(static_cast<ApplyChangesetBaton*>(data));
+
+    auto* db = baton->db;
+    db->pending--;
+
+    auto env = db->Env();
+    Napi::HandleScope scope(env);
+
+    Napi::Function cb = baton->callback.Value();
+
+    if (baton->status != SQLITE_OK) {
+        EXCEPTION(Napi::String::New(env, baton->message.c_str()), baton->status, exception);
+
+        if (IS_FUNCTION(cb)) {
+            Napi::Value argv[] = { exception };
+            TRY_CATCH_CALL(db->Value(), cb, 1, argv);
+        }
+        else {
+            Napi::Value info[] = { Napi::String::New(env, "error"), exception };
+            EMIT_EVENT(db->Value(), 2, info);
+        }
+    }
+    else if (IS_FUNCTION(cb)) {
+        Napi::Value argv[] = { env.Null(), Napi::Number::New(env, baton->conflicts) };
+        TRY_CATCH_CALL(db->Value(), cb, 2, argv);
+    }
+
+    db->Process();
+}
+
+// Database#importFile(path | fd, table, [{ format, columns, header, delimiter, batchSize, progress }], [callback])
+// Inserts the records of a CSV or NDJSON file into a table, without parsing
+// them in JavaScript. The database is locked for other calls until the
+// import is done. Every batch is inserted in a transaction of its own,
+// unless a transaction was already open; batches that were committed stay
+// when a later one fails.
+Napi::Value Database::ImportFile(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+    auto* db = this;
+
+    if (info.Length() <= 0 || !(info[0].IsString() || info[0].IsNumber())) {
+        Napi::TypeError::New(env, "Path or file descriptor expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    REQUIRE_ARGUMENT_STRING(1, table);
+    Napi::Object options = info.Length() > 2 && info[2].IsObject() && !info[2].IsFunction() ?
+        info[2].As<Napi::Object>() : Napi::Object::New(env);
+    Napi::Function callback;
+    if (info.Length() > 2 && info[info.Length() - 1].IsFunction()) {
+        callback = info[info.Length() - 1].As<Napi::Function>();
+    }
+
+    Napi::Value value = options.Get("format");
+    std::string format = value.IsString() ? value.As<Napi::String>().Utf8Value() : "csv";
+    if (format != "csv" && format != "ndjson") {
+        Napi::TypeError::New(env, "Format must be \"csv\" or \"ndjson\"").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    value = options.Get("delimiter");
+    std::string delimiter = value.IsString() ? value.As<Napi::String>().Utf8Value() : ",";
+    if (delimiter.size() != 1 || delimiter[0] == '"' || delimiter[0] == '\n' || delimiter[0] == '\r') {
+        Napi::TypeError::New(env, "Delimiter must be a single character").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    std::vector<std::string> columns;
+    value = options.Get("columns");
+    if (!value.IsUndefined()) {
+        if (!value.IsArray() || !value.As<Napi::Array>().Length()) {
+            Napi::TypeError::New(env, "Columns must be an array of column names").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        auto array = value.As<Napi::Array>();
+        for (uint32_t i = 0; i < array.Length(); i++) {
+            Napi::Value name = array.Get(i);
+            if (!name.IsString()) {
+                Napi::TypeError::New(env, "Columns must be an array of column names").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            columns.emplace_back(name.As<Napi::String>().Utf8Value());
+        }
+    }
+    value = options.Get("batchSize");
+    if (!value.IsUndefined() && (!value.IsNumber() || value.As<Napi::Number>().Int64Value() <= 0)) {
+        Napi::TypeError::New(env, "Batch size must be a positive number").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    size_t batch_size = value.IsNumber() ? value.As<Napi::Number>().Int64Value() : 10000;
+    value = options.Get("progress");
+    if (!value.IsUndefined() && !value.IsFunction()) {
+        Napi::TypeError::New(env, "Progress must be a function").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    auto* baton = new ImportBaton(db, callback);
+    if (info[0].IsString()) {
+        baton->path = info[0].As<Napi::String>().Utf8Value();
+    }
+    else {
+        baton->fd = info[0].As<Napi::Number>().Int32Value();
+    }
+    baton->table = table;
+    baton->columns = std::move(columns);
+    baton->format = format == "csv" ? ImportReader::CSV : ImportReader::NDJSON;
+    baton->delimiter = delimiter[0];
+    baton->header = options.Get("header").IsUndefined() || options.Get("header").ToBoolean();
+    baton->batch_size = batch_size;
+    if (value.IsFunction()) baton->progress.Reset(value.As<Napi::Function>(), 1);
+    napi_get_uv_event_loop(env, &baton->loop);
+
+    db->Schedule(Work_BeginImportFile, baton, true);
+    return info.This();
+}
+
+void Database::ImportBaton::Close() {
+    if (insert) {
+        sqlite3_finalize(insert);
+        insert = NULL;
+    }
+    for (auto& it : partial) sqlite3_finalize(it.second);
+    partial.clear();
+    if (owned && fd >= 0) {
+        uv_fs_t req;
+        uv_fs_close(loop, &req, fd, NULL);
+        uv_fs_req_cleanup(&req);
+    }
+    fd = -1;
+}
+
+void Database::Work_BeginImportFile(Baton* baton) {
+    assert(baton->db->locked);
+    assert(baton->db->open);
+    assert(baton->db->_handle);
+    assert(baton->db->pending == 0);
+    baton->db->pending++;
+
+    auto env = baton->db->Env();
+    CREATE_WORK("sqlite3.Database.ImportFile", Work_ImportFile, Work_AfterImportFile);
+}
+
+static std::string QuoteIdentifier(const std::string& name) {
+    std::string quoted = "\"";
+    for (char c : name) {
+        if (c == '"') quoted += '"';
+        quoted += c;
+    }
+    return quoted + '"';
+}
+
+// INSERT of the columns that are there; the others get their default.
+static std::string InsertSQL(const std::string& table,
+                             const std::vector<std::string>& columns,
+                             const std::vector<bool>& present) {
+    std::string sql = "INSERT INTO " + QuoteIdentifier(table);
+    std::string names;
+    std::string values;
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (!present[i]) continue;
+        if (!names.empty()) {
+            names += ", ";
+            values += ", ";
+        }
+        names += QuoteIdentifier(columns[i]);
+        values += '?';
+    }
+    if (names.empty()) return sql + " DEFAULT VALUES";
+    return sql + " (" + names + ") VALUES (" + values + ')';
+}
+
+// Opens the file, reads the column names and prepares the insert.
+static bool StartImport(Database::ImportBaton* baton, sqlite3* handle) {
+    if (!baton->path.empty()) {
+        uv_fs_t req;
+        int fd = uv_fs_open(baton->loop, &req, baton->path.c_str(), UV_FS_O_RDONLY, 0, NULL);
+        uv_fs_req_cleanup(&req);
+        if (fd < 0) {
+            baton->status = SQLITE_CANTOPEN;
+            baton->message = std::string("Could not open ") + baton->path + ": " + uv_strerror(fd);
+            return false;
+        }
+        baton->fd = fd;
+        baton->owned = true;
+    }
+
+    baton->reader = std::make_unique<ImportReader>(baton->loop, baton->fd,
+        baton->format, baton->delimiter);
+    auto& reader = *baton->reader;
+
+    if (baton->format == ImportReader::CSV && baton->header) {
+        if (!reader.Next()) {
+            baton->status = reader.status != SQLITE_OK ? reader.status : SQLITE_ERROR;
+            baton->message = reader.status != SQLITE_OK ? reader.message : "The file is empty";
+            return false;
+        }
+        // Given column names take the place of the header.
+        if (baton->columns.empty()) {
+            for (auto& field : reader.values) {
+                baton->columns.emplace_back(field.text ? std::string(field.text, field.length) : "");
+            }
+        }
+    }
+
+    if (baton->columns.empty()) {
+        sqlite3_stmt* stmt = NULL;
+        baton->status = sqlite3_prepare_v2(handle,
+            "SELECT name FROM pragma_table_xinfo(?1) WHERE hidden = 0", -1, &stmt, NULL);
+        if (baton->status == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, baton->table.c_str(), -1, SQLITE_STATIC);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                baton->columns.emplace_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+            }
+        }
+        sqlite3_finalize(stmt);
+        if (baton->columns.empty()) {
+            baton->status = SQLITE_ERROR;
+            baton->message = "no such table: " + baton->table;
+            return false;
+        }
+    }
+    reader.SetColumns(baton->columns);
+
+    std::string sql = InsertSQL(baton->table, baton->columns,
+        std::vector<bool>(baton->columns.size(), true));
+    baton->status = sqlite3_prepare_v2(handle, sql.c_str(), -1, &baton->insert, NULL);
+    if (baton->status != SQLITE_OK) {
+        baton->message = std::string(sqlite3_errmsg(handle));
+        return false;
+    }
+    return true;
+}
+
+void Database::Work_ImportFile(napi_env e, void* data) {
+    auto* baton = static_cast<ImportBaton*>(data);
+    auto* db = baton->db;
+
+    sqlite3_mutex* mtx = db->GetMutex();
+    sqlite3_mutex_enter(mtx);
+
+    if (!baton->started) {
+        baton->started = true;
+        if (!StartImport(baton, db->_handle)) {
+            baton->done = true;
+            sqlite3_mutex_leave(mtx);
+            return;
+        }
+    }
+
+    auto& reader = *baton->reader;
+    std::vector<bool> present;
+    // Every batch is a savepoint, which is a transaction of its own unless
+    // one is open already; then a failing batch only takes back its rows.
+    baton->status = sqlite3_exec(db->_handle, "SAVEPOINT sqlite3_import", NULL, NULL, NULL);
+    if (baton->status != SQLITE_OK) {
+        baton->message = std::string(sqlite3_errmsg(db->_handle));
+    }
+    bool savepoint = baton->status == SQLITE_OK;
+
+    uint64_t rows = 0;
+    while (baton->status == SQLITE_OK && rows < baton->batch_size) {
+        if (!reader.Next()) {
+            baton->done = true;
+            if (reader.status != SQLITE_OK) {
+                baton->status = reader.status;
+                baton->message = reader.message;
+            }
+            break;
+        }
+
+        sqlite3_stmt* insert = baton->insert;
+        present.clear();
+        bool complete = true;
+        for (auto& value : reader.values) {
+            present.push_back(value.present);
+            complete = complete && value.present;
+        }
+        if (!complete) {
+            sqlite3_stmt*& partial = baton->partial[present];
+            if (!partial) {
+                std::string sql = InsertSQL(baton->table, baton->columns, present);
+                int status = sqlite3_prepare_v2(db->_handle, sql.c_str(), -1, &partial, NULL);
+                if (status != SQLITE_OK) {
+                    baton->status = status;
+                    baton->message = std::string(sqlite3_errmsg(db->_handle));
+                    break;
+                }
+            }
+            insert = partial;
+        }
+
+        int index = 0;
+        for (auto& value : reader.values) {
+            if (!value.present) continue;
+            index++;
+            switch (value.type) {
+                case SQLITE_INTEGER: sqlite3_bind_int64(insert, index, value.integer); break;
+                case SQLITE_FLOAT: sqlite3_bind_double(insert, index, value.number); break;
+                case SQLITE_TEXT: sqlite3_bind_text(insert, index, value.text,
+                    static_cast<int>(value.length), SQLITE_STATIC); break;
+                default: sqlite3_bind_null(insert, index); break;
+            }
+        }
+        int status = sqlite3_step(insert);
+        sqlite3_reset(insert);
+        if (status != SQLITE_DONE) {
+            baton->status = status;
+            baton->message = "Line " + std::to_string(reader.line) + ": " +
+                sqlite3_errmsg(db->_handle);
+            break;
+        }
+        rows++;
+    }
+
+    if (savepoint && baton->status == SQLITE_OK) {
+        baton->status = sqlite3_exec(db->_handle, "RELEASE sqlite3_import", NULL, NULL, NULL);
+        if (baton->status != SQLITE_OK) {
+            baton->message = std::string(sqlite3_errmsg(db->_handle));
+        }
+    }
+    if (baton->status != SQLITE_OK) {
+        baton->done = true;
+        // Some errors roll back the whole transaction by themselves.
+        if (savepoint && !sqlite3_get_autocommit(db->_handle)) {
+            sqlite3_exec(db->_handle, "ROLLBACK TO sqlite3_import", NULL, NULL, NULL);
+            sqlite3_exec(db->_handle, "RELEASE sqlite3_import", NULL, NULL, NULL);
+        }
+    }
+    else {
+        baton->rows += rows;
+    }
+
+    sqlite3_mutex_leave(mtx);
+}
+
+void Database::Work_AfterImportFile(napi_env e, napi_status status, void* data) {
+    auto* baton = static_cast<ImportBaton*>(data);
+    auto* db = baton->db;
+
+    auto env = db->Env();
+    Napi::HandleScope scope(env);
+
+    auto result = Napi::Object::New(env);
+    result.Set("rows", Napi::Number::New(env, static_cast<double>(baton->rows)));
+    result.Set("bytes", Napi::Number::New(env,
+        static_cast<double>(baton->reader ? baton->reader->bytes : 0)));
+
+    if (!baton->done) {
+        // The next batch is queued first so that a throwing progress
+        // callback doesn't stop it.
+        REQUEUE_WORK("sqlite3.Database.ImportFile", Work_ImportFile, Work_AfterImportFile);
+        Napi::Function progress = baton->progress.Value();
+        if (IS_FUNCTION(progress)) {
+            Napi::Value argv[] = { result };
+            TRY_CATCH_CALL(db->Value(), progress, 1, argv);
+        }
+        return;
+    }
+
+    std::unique_ptr<ImportBaton> owner(baton);
+    owner->Close();
+    db->pending--;
+
+    Napi::Function cb = baton->callback.Value();
+
+    if (baton->status != SQLITE_OK) {
+        EXCEPTION(Napi::String::New(env, baton->message.c_str()), baton->status, exception);
+
+        if (IS_FUNCTION(cb)) {
+            Napi::Value argv[] = { exception };
+            TRY_CATCH_CALL(db->Value(), cb, 1, argv);
+        }
+        else {
+            Napi::Value info[] = { Napi::String::New(env, "error"), exception };
+            EMIT_EVENT(db->Value(), 2, info);
+        }
+    }
+    else if (IS_FUNCTION(cb)) {
+        Napi::Value argv[] = { env.Null(), result };
+        TRY_CATCH_CALL(db->Value(), cb, 2, argv);
+    }
+
+    db->Process();
+}
+
+Napi::Value Database::Wait(const Napi::CallbackInfo& info) {
+    auto env = info.Env();
+    auto* db = this;
+
+    OPTIONAL_ARGUMENT_FUNCTION(0, callback);
 
    auto* baton = new Baton(db, callback);
     db->Schedule(Work_Wait, baton, true);
@@ -686,6 +2576,9 @@ void Database::Work_BeginLoadExtension(Baton* baton) {
 void Database::Work_LoadExtension(napi_env e, void* data) {
     auto* baton = static_cast<LoadExtensionBaton*>(data);
 
+    sqlite3_mutex* mtx = baton->db->GetMutex();
+    sqlite3_mutex_enter(mtx);
+
     sqlite3_enable_load_extension(baton->db->_handle, 1);
 
     char* message = NULL;
@@ -698,6 +2591,8 @@ void Database::Work_LoadExtension(napi_env e, void* data) {
 
     sqlite3_enable_load_extension(baton->db->_handle, 0);
 
+    sqlite3_mutex_leave(mtx);
+
     if (baton->status != SQLITE_OK && message != NULL) {
         baton->message = std::string(message);
         sqlite3_free(message);
@@ -748,4 +2643,22 @@ void Database::RemoveCallbacks() {
         update_event->finish();
         update_event = NULL;
     }
+    if (wal_event) {
+        wal_event->finish();
+        wal_event = NULL;
+    }
+    if (commit_event) {
+        commit_event->finish();
+        commit_event = NULL;
+    }
+
+    QueryCache* previous = cache;
+    if (_handle) {
+        sqlite3_mutex_enter(GetMutex());
+        cache = NULL;
+        UpdateHooks();
+        sqlite3_mutex_leave(GetMutex());
+    }
+    cache = NULL;
+    delete previous;
 }
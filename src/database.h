@@ -4,20 +4,51 @@
 
 
 #include <assert.h>
+#include <map>
+#include <memory>
 #include <string>
 #include <queue>
+#include <set>
+#include <utility>
+#include <vector>
 
 #include <sqlite3.h>
 #include <napi.h>
 
 #include "async.h"
+#include "import.h"
+#include "json.h"
+#include "script.h"
 
 using namespace Napi;
 
 namespace node_sqlite3 {
 
 class Database;
+class Session;
+class QueryCache;
+class Watch;
+struct ParallelQueryBaton;
+
+// Schema and name of a table.
+typedef std::pair<std::string, std::string> Table;
+
+// What the authorizer saw while a statement was prepared.
+struct ReadSet {
+    std::set<Table> tables;
+    // Cleared if the statement calls a function whose result may differ
+    // between calls, such as random() or datetime('now').
+    bool deterministic = true;
+};
 
+#if NAPI_VERSION >= 6
+// Constructors of the classes that are created from native code, kept in the
+// instance data of the environment.
+struct Constructors {
+    Napi::FunctionReference database;
+    Napi::FunctionReference statement;
+};
+#endif
 
 class Database : public Napi::ObjectWrap<Database> {
 public:
@@ -34,9 +65,8 @@ public:
 #if NAPI_VERSION < 6
         return obj.InstanceOf(constructor.Value());
 #else
-        auto constructor =
-            env.GetInstanceData<Napi::FunctionReference>();
-        return obj.InstanceOf(constructor->Value());
+        auto constructors = env.GetInstanceData<Constructors>();
+        return obj.InstanceOf(constructors->database.Value());
 #endif
     }
 
@@ -76,6 +106,34 @@ public:
         virtual ~ExecBaton() override = default;
     };
 
+    // Database#execFile. The script is run a number of statements at a time,
+    // by running the same work again, which reports the progress in between.
+    struct ExecFileBaton : Baton {
+        Napi::FunctionReference progress;
+        uv_loop_t* loop = NULL;
+        std::string path;
+        uv_file fd = -1;
+        // Whether the file was opened here, and is closed when done.
+        bool owned = false;
+
+        // Statements per transaction, or zero to run them as they are.
+        size_t transaction_every = 0;
+
+        std::unique_ptr<ScriptReader> reader;
+        uint64_t statements = 0;
+        bool started = false;
+        bool done = false;
+
+        ExecFileBaton(Database* db_, Napi::Function cb_) :
+            Baton(db_, cb_) {}
+        virtual ~ExecFileBaton() override {
+            Close();
+            progress.Reset();
+        }
+
+        void Close();
+    };
+
     struct LoadExtensionBaton : Baton {
         std::string filename;
         LoadExtensionBaton(Database* db_, Napi::Function cb_, const char* filename_) :
@@ -91,6 +149,149 @@ public:
         virtual ~LimitBaton() override = default;
     };
 
+    struct ToBufferBaton : Baton {
+        std::string schema;
+        unsigned char* data = NULL;
+        sqlite3_int64 size = 0;
+        ToBufferBaton(Database* db_, Napi::Function cb_, const char* schema_) :
+            Baton(db_, cb_), schema(schema_) {}
+        virtual ~ToBufferBaton() override {
+            // Only set if the data didn't make it into a Buffer.
+            if (data) sqlite3_free(data);
+        }
+    };
+
+    struct LoadBufferBaton : Baton {
+        std::string schema;
+        Napi::ObjectReference buffer;
+        unsigned char* data;
+        size_t size;
+        bool readonly;
+        LoadBufferBaton(Database* db_, Napi::Function cb_, const char* schema_,
+                        Napi::Buffer<unsigned char> buffer_, bool readonly_) :
+            Baton(db_, cb_), schema(schema_), buffer(Napi::Persistent(buffer_.As<Napi::Object>())),
+            data(buffer_.Data()), size(buffer_.Length()), readonly(readonly_) {}
+        virtual ~LoadBufferBaton() override {
+            buffer.Reset();
+        }
+    };
+
+    struct WalCheckpointBaton : Baton {
+        int pages;
+        int restartPages;
+        int truncatePages;
+        WalCheckpointBaton(Database* db_, Napi::Function cb_, int pages_,
+                           int restartPages_, int truncatePages_) :
+            Baton(db_, cb_), pages(pages_), restartPages(restartPages_),
+            truncatePages(truncatePages_) {}
+        virtual ~WalCheckpointBaton() override = default;
+    };
+
+    struct CheckpointBaton : Baton {
+        std::string database;
+        int mode;
+        int walFrames;
+        int logFrames = -1;
+        int checkpointedFrames = -1;
+        double duration = 0;
+        CheckpointBaton(Database* db_, Napi::Function cb_, const std::string& database_,
+                        int mode_, int walFrames_) :
+            Baton(db_, cb_), database(database_), mode(mode_), walFrames(walFrames_) {}
+        virtual ~CheckpointBaton() override = default;
+    };
+
+    struct SnapshotBaton : Baton {
+        std::string schema;
+        // The snapshot to open, or the one that was taken.
+        Napi::ObjectReference source;
+#ifdef SQLITE_ENABLE_SNAPSHOT
+        sqlite3_snapshot* snapshot = NULL;
+#endif
+        SnapshotBaton(Database* db_, Napi::Function cb_, const char* schema_) :
+            Baton(db_, cb_), schema(schema_) {}
+        virtual ~SnapshotBaton() override {
+            source.Reset();
+        }
+    };
+
+    struct ApplyChangesetBaton : Baton {
+        Napi::ObjectReference buffer;
+        void* data;
+        int size;
+        int policy;
+        int conflicts = 0;
+        ApplyChangesetBaton(Database* db_, Napi::Function cb_,
+                            Napi::Buffer<unsigned char> buffer_, int policy_) :
+            Baton(db_, cb_), buffer(Napi::Persistent(buffer_.As<Napi::Object>())),
+            data(buffer_.Data()), size(static_cast<int>(buffer_.Length())), policy(policy_) {}
+        virtual ~ApplyChangesetBaton() override {
+            buffer.Reset();
+        }
+    };
+
+    // Database#importFile. Each batch of rows is inserted by running the same
+    // work again, which reports the progress in between.
+    struct ImportBaton : Baton {
+        Napi::FunctionReference progress;
+        uv_loop_t* loop = NULL;
+        std::string path;
+        uv_file fd = -1;
+        // Whether the file was opened here, and is closed when done.
+        bool owned = false;
+
+        std::string table;
+        std::vector<std::string> columns;
+        ImportReader::Format format = ImportReader::CSV;
+        char delimiter = ',';
+        bool header = true;
+        // Rows per transaction, after which the progress is reported.
+        size_t batch_size = 10000;
+
+        std::unique_ptr<ImportReader> reader;
+        sqlite3_stmt* insert = NULL;
+        // Inserts that leave out the columns of missing NDJSON keys, by
+        // which columns are there.
+        std::map<std::vector<bool>, sqlite3_stmt*> partial;
+        uint64_t rows = 0;
+        bool started = false;
+        bool done = false;
+
+        ImportBaton(Database* db_, Napi::Function cb_) :
+            Baton(db_, cb_) {}
+        virtual ~ImportBaton() override {
+            Close();
+            progress.Reset();
+        }
+
+        void Close();
+    };
+
+    struct MaintenanceBaton : Baton {
+        // Copied from the configuration when the run is scheduled.
+        double budgetMs = 0;
+        int vacuumPages = 0;
+        bool optimize = false;
+        bool quickCheck = false;
+        size_t checkPosition = 0;
+
+        bool optimized = false;
+        int vacuumedPages = 0;
+        std::vector<std::string> checked;
+        std::vector<std::string> problems;
+        double duration = 0;
+        MaintenanceBaton(Database* db_, Napi::Function cb_) :
+            Baton(db_, cb_) {}
+        virtual ~MaintenanceBaton() override = default;
+    };
+
+    struct QueryCacheBaton : Baton {
+        // Zero turns the cache off.
+        size_t entries;
+        QueryCacheBaton(Database* db_, Napi::Function cb_, size_t entries_) :
+            Baton(db_, cb_), entries(entries_) {}
+        virtual ~QueryCacheBaton() override = default;
+    };
+
     typedef void (*Work_Callback)(Baton* baton);
 
     struct Call {
@@ -113,30 +314,72 @@ public:
         sqlite3_int64 rowid;
     };
 
+    struct WalInfo {
+        std::string database;
+        int frames;
+    };
+
+    // Tables changed by a transaction that was committed.
+    struct CommitInfo {
+        std::set<Table> tables;
+        bool schema = false;
+    };
+
     bool IsOpen() { return open; }
     bool IsLocked() { return locked; }
 
+    // Returns the mutex to hold while using the connection. The handle must
+    // be open.
+    sqlite3_mutex* GetMutex() {
+        return _mutex ? _mutex : sqlite3_db_mutex(_handle);
+    }
+
     typedef Async<std::string, Database> AsyncTrace;
     typedef Async<ProfileInfo, Database> AsyncProfile;
     typedef Async<UpdateInfo, Database> AsyncUpdate;
+    typedef Async<WalInfo, Database> AsyncWal;
+    typedef Async<CommitInfo, Database> AsyncCommit;
 
     friend class Statement;
     friend class Backup;
+    friend class Session;
+    friend class QueryCache;
+    friend class Watch;
 
     Database(const Napi::CallbackInfo& info);
 
     ~Database() {
         RemoveCallbacks();
+        for (auto* reader : readers) sqlite3_close(reader);
+        readers.clear();
+        StopExternalChange();
         sqlite3_close(_handle);
         _handle = NULL;
         open = false;
+        if (_mutex) {
+            sqlite3_mutex_free(_mutex);
+            _mutex = NULL;
+        }
+        StopMaintenance();
     }
 
 protected:
     WORK_DEFINITION(Open);
     WORK_DEFINITION(Exec);
+    WORK_DEFINITION(ExecFile);
     WORK_DEFINITION(Close);
     WORK_DEFINITION(LoadExtension);
+    WORK_DEFINITION(ToBuffer);
+    WORK_DEFINITION(LoadBuffer);
+    WORK_DEFINITION(BeginSnapshot);
+    WORK_DEFINITION(ApplyChangeset);
+    WORK_DEFINITION(ImportFile);
+    WORK_DEFINITION(ParallelQuery);
+    WORK_DEFINITION(Query);
+
+    static void Work_ParallelPart(napi_env env, void* data);
+    static void Work_AfterParallelPart(napi_env env, napi_status status, void* data);
+    static void FinishParallelQuery(ParallelQueryBaton* baton);
 
     void Schedule(Work_Callback callback, Baton* baton, bool exclusive = false);
     void Process();
@@ -148,6 +391,11 @@ protected:
     Napi::Value Parallelize(const Napi::CallbackInfo& info);
     Napi::Value Configure(const Napi::CallbackInfo& info);
     Napi::Value Interrupt(const Napi::CallbackInfo& info);
+    Napi::Value PoolStatsGetter(const Napi::CallbackInfo& info);
+    Napi::Value QueryCacheStatsGetter(const Napi::CallbackInfo& info);
+    Napi::Value CachedRows(const Napi::CallbackInfo& info);
+    Napi::Value OnExternalChange(const Napi::CallbackInfo& info);
+    Napi::Value PrepareMany(const Napi::CallbackInfo& info);
 
     static void SetBusyTimeout(Baton* baton);
     static void SetLimit(Baton* baton);
@@ -164,10 +412,43 @@ protected:
     static void UpdateCallback(void* db, int type, const char* database, const char* table, sqlite3_int64 rowid);
     static void UpdateCallback(Database* db, UpdateInfo* info);
 
+    static void RegisterQueryCache(Baton* baton);
+
+    // Hooks shared by the "change" event, the query cache and watches.
+    void UpdateHooks();
+    void SchemaChanged();
+    static int AuthorizeCallback(void* db, int action, const char* arg1,
+        const char* arg2, const char* schema, const char* trigger);
+    static int CommitCallback(void* db);
+    static void CommitCallback(Database* db, CommitInfo* info);
+    static void RollbackCallback(void* db);
+
+    static void RegisterWalCallback(Baton* baton);
+    static int WalCallback(void* db, sqlite3* handle, const char* database, int frames);
+    static void WalCallback(Database* db, WalInfo* info);
+    void StopMaintenance();
+    static void MaintenanceTimerCallback(uv_timer_t* handle);
+    static void Work_BeginMaintenance(Baton* baton);
+    static void Work_Maintenance(napi_env env, void* data);
+    static void Work_AfterMaintenance(napi_env env, napi_status status, void* data);
+
+    static void Work_BeginCheckpoint(Baton* baton);
+    static void Work_Checkpoint(napi_env env, void* data);
+    static void Work_AfterCheckpoint(napi_env env, napi_status status, void* data);
+
+    void StopExternalChange();
+    bool PollExternalChange();
+    static void ExternalChangeTimerCallback(uv_timer_t* handle);
+
     void RemoveCallbacks();
 
 protected:
     sqlite3* _handle = NULL;
+    // Connections opened without SQLite's connection mutex (in multi-thread
+    // mode, e.g. with SQLITE_OPEN_NOMUTEX) are guarded by this one instead,
+    // so that statements running in parallel on the thread pool never use the
+    // connection at the same time.
+    sqlite3_mutex* _mutex = NULL;
 
     bool open = false;
     bool closing = false;
@@ -176,11 +457,84 @@ protected:
 
     bool serialize = false;
 
-    std::queue<Call*> queue;
+    // Baton pool usage of all statements on this database.
+    uint64_t pool_hits = 0;
+    uint64_t pool_misses = 0;
+
+    std::queue<Call> queue;
+
+    // Buffers that read-only schemas were deserialized from without making a
+    // copy. They have to stay alive for as long as SQLite uses them.
+    std::map<std::string, Napi::ObjectReference> buffers;
+
+    // Read-only connections to the same database that Database#parallelQuery
+    // runs its partitions on, kept for the next query.
+    std::vector<sqlite3*> readers;
+
+    // Sessions that are recording changes; they are deleted before the
+    // connection is closed.
+    std::set<Session*> sessions;
+
+    // Results of read-only queries, see configure("queryCache").
+    QueryCache* cache = NULL;
+
+    // Live queries, see Database#watch. They are told about the tables that
+    // each commit changed.
+    std::set<Watch*> watches;
+    AsyncCommit* commit_event = NULL;
+
+    // State of the hooks, only used while holding the connection's mutex:
+    // where the authorizer puts the reads of the statement that is being
+    // prepared, whether it is between the checks of a DROP statement, and
+    // what the open transaction changed so far.
+    ReadSet* collecting = NULL;
+    bool dropping = false;
+    std::set<Table> changed;
+    bool schema_changed = false;
+
+    // Set while Database#prepareMany creates its statements; they are added
+    // to this batch instead of being scheduled one by one.
+    Baton* prepare_group = NULL;
 
     AsyncTrace* debug_trace = NULL;
     AsyncProfile* debug_profile = NULL;
     AsyncUpdate* update_event = NULL;
+    AsyncWal* wal_event = NULL;
+
+    // WAL sizes in pages at which the background checkpoint is passive,
+    // restarts or truncates the WAL.
+    int wal_pages = 0;
+    int wal_restart_pages = 0;
+    int wal_truncate_pages = 0;
+    bool checkpointing = false;
+
+    // Background maintenance, see configure("maintenance").
+    struct Maintenance {
+        uv_timer_t* timer = NULL;
+        double budgetMs = 50;
+        int vacuumPages = 100;
+        bool optimize = true;
+        bool quickCheck = false;
+        bool running = false;
+        // Tables are checked a few at a time; this is the next one.
+        size_t checkPosition = 0;
+    } maintenance;
+
+    // How Statement#allJSON and #getJSON write blobs, see configure("json").
+    JSONWriter::Blobs json_blobs = JSONWriter::BASE64;
+
+    // Busy timeout of the connection, see configure("busyTimeout").
+    int busy_timeout = 1000;
+
+    // Polling for commits of other connections, see Database#onExternalChange.
+    struct ExternalChange {
+        uv_timer_t* timer = NULL;
+        // PRAGMA data_version, prepared once.
+        sqlite3_stmt* stmt = NULL;
+        Napi::FunctionReference callback;
+        // The last data version, or -1 until it was read.
+        sqlite3_int64 version = -1;
+    } external;
 };
 
 }
@@ -0,0 +1,428 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "import.h"
+
+using namespace node_sqlite3;
+
+ImportReader::ImportReader(uv_loop_t* loop_, uv_file fd_, Format format_, char delimiter_) :
+        loop(loop_), fd(fd_), format(format_), delimiter(delimiter_) {}
+
+void ImportReader::SetColumns(const std::vector<std::string>& names) {
+    columns = names.size();
+    index.clear();
+    for (size_t i = 0; i < names.size(); i++) {
+        index.emplace(names[i], i);
+    }
+}
+
+bool ImportReader::Next() {
+    if (status != SQLITE_OK) return false;
+
+    while (true) {
+        if (!started && (end - position >= 3 || eof)) {
+            started = true;
+            // Skip the byte order mark that some programs write.
+            if (end - position >= 3 && memcmp(&buffer[position], "\xEF\xBB\xBF", 3) == 0) {
+                position += 3;
+                bytes += 3;
+            }
+        }
+
+        Result result = !started ? NEED_MORE : format == CSV ? ParseCSV() : ParseJSON();
+        if (result == RECORD) return true;
+        if (result != NEED_MORE || !Fill()) return false;
+    }
+}
+
+bool ImportReader::Fill() {
+    if (position > 0) {
+        memmove(&buffer[0], &buffer[position], end - position);
+        end -= position;
+        position = 0;
+    }
+    // Records that don't fit make the buffer grow.
+    if (end == buffer.size()) {
+        buffer.resize(buffer.empty() ? 1 << 20 : buffer.size() * 2);
+    }
+
+    uv_fs_t req;
+    uv_buf_t buf = uv_buf_init(&buffer[end], static_cast<unsigned int>(buffer.size() - end));
+    int result = uv_fs_read(loop, &req, fd, &buf, 1, -1, NULL);
+    uv_fs_req_cleanup(&req);
+    if (result < 0) {
+        status = SQLITE_IOERR;
+        message = std::string("Could not read: ") + uv_strerror(result);
+        return false;
+    }
+    if (result == 0) eof = true;
+    end += result;
+    return true;
+}
+
+ImportReader::Result ImportReader::Fail(const std::string& error) {
+    status = SQLITE_ERROR;
+    message = "Line " + std::to_string(line) + ": " + error;
+    return FAILED;
+}
+
+ImportReader::Result ImportReader::ParseCSV() {
+    char* data = &buffer[0];
+    char* p = data + position;
+    char* limit = data + end;
+
+    while (p < limit) {
+        if (*p == '\n') p++;
+        else if (*p == '\r' && p + 1 < limit && p[1] == '\n') p += 2;
+        else break;
+        next_line++;
+    }
+    bytes += p - (data + position);
+    position = p - data;
+    if (p == limit) return eof ? END : NEED_MORE;
+
+    line = next_line;
+    spans.clear();
+    // Line breaks in quoted fields.
+    uint64_t breaks = 0;
+    char* line_end = static_cast<char*>(memchr(p, '\n', limit - p));
+
+    while (true) {
+        Span span = { p, p, false, false };
+        if (p < limit && *p == '"') {
+            char* q = p + 1;
+            while (true) {
+                q = static_cast<char*>(memchr(q, '"', limit - q));
+                if (!q) return eof ? Fail("unterminated quoted field") : NEED_MORE;
+                // A quote at the end might be the first of two.
+                if (q + 1 == limit && !eof) return NEED_MORE;
+                if (q + 1 < limit && q[1] == '"') {
+                    span.escaped = true;
+                    q += 2;
+                    continue;
+                }
+                break;
+            }
+            span.start = p + 1;
+            span.end = q;
+            span.quoted = true;
+            p = q + 1;
+            if (line_end && line_end < p) {
+                breaks += std::count(span.start, span.end, '\n');
+                line_end = static_cast<char*>(memchr(p, '\n', limit - p));
+            }
+            if (p < limit && *p != delimiter && *p != '\n' && *p != '\r') {
+                return Fail("unexpected character after a quoted field");
+            }
+        }
+        else {
+            if (!line_end && !eof) return NEED_MORE;
+            char* stop = line_end ? line_end : limit;
+            char* found = static_cast<char*>(memchr(p, delimiter, stop - p));
+            span.end = found ? found : stop;
+            if (!found && span.end > span.start && span.end[-1] == '\r') span.end--;
+            p = span.end;
+        }
+        spans.push_back(span);
+
+        if (p < limit && *p == delimiter) {
+            p++;
+            continue;
+        }
+        break;
+    }
+
+    if (p < limit && *p == '\r') p++;
+    if (p < limit && *p == '\n') p++;
+    else if (p < limit) return Fail("unexpected carriage return");
+    else if (!eof) return NEED_MORE;
+
+    next_line += 1 + breaks;
+    bytes += p - (data + position);
+    position = p - data;
+
+    if (columns && spans.size() != columns) {
+        return Fail("expected " + std::to_string(columns) + " fields, found " +
+            std::to_string(spans.size()));
+    }
+
+    values.resize(spans.size());
+    for (size_t i = 0; i < spans.size(); i++) {
+        Span& span = spans[i];
+        Value& value = values[i];
+        value = Value();
+        if (!span.quoted && span.start == span.end) continue;
+
+        if (span.escaped) {
+            // Quotes in the field are doubled.
+            char* out = span.start;
+            for (char* in = span.start; in < span.end; in++) {
+                *out++ = *in;
+                if (*in == '"') in++;
+            }
+            span.end = out;
+        }
+        value.type = SQLITE_TEXT;
+        value.text = span.start;
+        value.length = span.end - span.start;
+    }
+    return RECORD;
+}
+
+static inline void SkipSpace(char*& p, char* stop) {
+    while (p < stop && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+}
+
+// Moves p past the string that starts at it.
+static bool SkipString(char*& p, char* stop, bool& escaped) {
+    char* q = p + 1;
+    while (q < stop && *q != '"') {
+        if (*q == '\\') {
+            escaped = true;
+            q++;
+        }
+        q++;
+    }
+    if (q >= stop) return false;
+    p = q + 1;
+    return true;
+}
+
+static bool ParseHex(const char* in, const char* end, unsigned int& code) {
+    if (end - in < 4) return false;
+    code = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = in[i];
+        code <<= 4;
+        if (c >= '0' && c <= '9') code |= c - '0';
+        else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+        else return false;
+    }
+    return true;
+}
+
+// Undoes the escapes of a JSON string in place; none of them is shorter
+// than what it stands for. Returns the new end, or NULL if one is invalid.
+static char* Unescape(char* in, char* end) {
+    char* out = in;
+    while (in < end) {
+        if (*in != '\\') {
+            *out++ = *in++;
+            continue;
+        }
+        in++;
+        switch (*in++) {
+            case '"': *out++ = '"'; break;
+            case '\\': *out++ = '\\'; break;
+            case '/': *out++ = '/'; break;
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u': {
+                unsigned int code;
+                if (!ParseHex(in, end, code)) return NULL;
+                in += 4;
+                if (code >= 0xD800 && code < 0xE000) {
+                    unsigned int low;
+                    if (code < 0xDC00 && end - in >= 6 && in[0] == '\\' && in[1] == 'u' &&
+                            ParseHex(in + 2, end, low) && low >= 0xDC00 && low < 0xE000) {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        in += 6;
+                    }
+                    else {
+                        // Lone surrogates can't be UTF-8.
+                        code = 0xFFFD;
+                    }
+                }
+                if (code < 0x80) {
+                    *out++ = static_cast<char>(code);
+                }
+                else if (code < 0x800) {
+                    *out++ = static_cast<char>(0xC0 | (code >> 6));
+                    *out++ = static_cast<char>(0x80 | (code & 0x3F));
+                }
+                else if (code < 0x10000) {
+                    *out++ = static_cast<char>(0xE0 | (code >> 12));
+                    *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    *out++ = static_cast<char>(0x80 | (code & 0x3F));
+                }
+                else {
+                    *out++ = static_cast<char>(0xF0 | (code >> 18));
+                    *out++ = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                    *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    *out++ = static_cast<char>(0x80 | (code & 0x3F));
+                }
+            } break;
+            default: return NULL;
+        }
+    }
+    return out;
+}
+
+bool ImportReader::ParseString(char*& p, char* stop, Value& value) {
+    char* start = p + 1;
+    bool escaped = false;
+    if (!SkipString(p, stop, escaped)) return false;
+    char* finish = p - 1;
+    if (escaped && !(finish = Unescape(start, finish))) return false;
+
+    value.type = SQLITE_TEXT;
+    value.text = start;
+    value.length = finish - start;
+    return true;
+}
+
+static bool ParseLiteral(char*& p, char* stop, const char* literal) {
+    size_t length = strlen(literal);
+    if (static_cast<size_t>(stop - p) < length || memcmp(p, literal, length) != 0) return false;
+    p += length;
+    return true;
+}
+
+bool ImportReader::ParseValue(char*& p, char* stop, Value& value) {
+    if (p >= stop) return false;
+
+    switch (*p) {
+        case '"': {
+            return ParseString(p, stop, value);
+        }
+        case '{':
+        case '[': {
+            // Kept as JSON text.
+            char* start = p;
+            int depth = 0;
+            while (p < stop) {
+                if (*p == '"') {
+                    bool escaped = false;
+                    if (!SkipString(p, stop, escaped)) return false;
+                    continue;
+                }
+                if (*p == '{' || *p == '[') {
+                    depth++;
+                }
+                else if ((*p == '}' || *p == ']') && --depth == 0) {
+                    p++;
+                    value.type = SQLITE_TEXT;
+                    value.text = start;
+                    value.length = p - start;
+                    return true;
+                }
+                p++;
+            }
+            return false;
+        }
+        case 't': {
+            value.type = SQLITE_INTEGER;
+            value.integer = 1;
+            return ParseLiteral(p, stop, "true");
+        }
+        case 'f': {
+            value.type = SQLITE_INTEGER;
+            value.integer = 0;
+            return ParseLiteral(p, stop, "false");
+        }
+        case 'n': {
+            value.type = SQLITE_NULL;
+            return ParseLiteral(p, stop, "null");
+        }
+        default: {
+            char* start = p;
+            bool integer = true;
+            if (*p == '-') p++;
+            bool digits = p < stop && *p >= '0' && *p <= '9';
+            while (p < stop && ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' ||
+                    *p == 'E' || *p == '+' || *p == '-')) {
+                if (*p < '0' || *p > '9') integer = false;
+                p++;
+            }
+            if (!digits) return false;
+
+            // The buffer isn't terminated after the number.
+            std::string text(start, p - start);
+            char* parsed;
+            if (integer) {
+                errno = 0;
+                long long number = strtoll(text.c_str(), &parsed, 10);
+                if (errno != ERANGE && *parsed == '\0') {
+                    value.type = SQLITE_INTEGER;
+                    value.integer = number;
+                    return true;
+                }
+            }
+            double number = strtod(text.c_str(), &parsed);
+            if (*parsed != '\0') return false;
+            value.type = SQLITE_FLOAT;
+            value.number = number;
+            return true;
+        }
+    }
+}
+
+ImportReader::Result ImportReader::ParseJSON() {
+    char* data = &buffer[0];
+    char* p = data + position;
+    char* limit = data + end;
+
+    while (p < limit && (*p == '\n' || *p == '\r' || *p == ' ' || *p == '\t')) {
+        if (*p == '\n') next_line++;
+        p++;
+    }
+    bytes += p - (data + position);
+    position = p - data;
+    if (p == limit) return eof ? END : NEED_MORE;
+
+    line = next_line;
+    // JSON strings can't have line breaks, so the object ends on this line.
+    char* line_end = static_cast<char*>(memchr(p, '\n', limit - p));
+    if (!line_end && !eof) return NEED_MORE;
+    char* stop = line_end ? line_end : limit;
+
+    Value missing;
+    missing.present = false;
+    values.assign(columns, missing);
+    if (*p != '{') return Fail("expected a JSON object");
+    p++;
+    SkipSpace(p, stop);
+    if (p < stop && *p == '}') {
+        p++;
+    }
+    else while (true) {
+        Value name;
+        if (p >= stop || *p != '"' || !ParseString(p, stop, name)) return Fail("invalid JSON");
+        SkipSpace(p, stop);
+        if (p >= stop || *p != ':') return Fail("invalid JSON");
+        p++;
+        SkipSpace(p, stop);
+        Value value;
+        if (!ParseValue(p, stop, value)) return Fail("invalid JSON");
+
+        key.assign(name.text, name.length);
+        auto it = index.find(key);
+        if (it != index.end()) values[it->second] = value;
+
+        SkipSpace(p, stop);
+        if (p < stop && *p == ',') {
+            p++;
+            SkipSpace(p, stop);
+            continue;
+        }
+        if (p < stop && *p == '}') {
+            p++;
+            break;
+        }
+        return Fail("invalid JSON");
+    }
+    SkipSpace(p, stop);
+    if (p != stop) return Fail("unexpected text after the JSON object");
+
+    next_line++;
+    p = line_end ? line_end + 1 : limit;
+    bytes += p - (data + position);
+    position = p - data;
+    return RECORD;
+}
@@ -0,0 +1,105 @@
+#ifndef NODE_SQLITE3_SRC_IMPORT_H
+#define NODE_SQLITE3_SRC_IMPORT_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sqlite3.h>
+#include <uv.h>
+
+namespace node_sqlite3 {
+
+/**
+ *
+ * Reads the records of a CSV or NDJSON file for Database#importFile, on the
+ * thread pool.
+ *
+ * The file is read in large pieces into one buffer that the values point
+ * into; they stay valid until the next record is read. Fields are found
+ * with memchr(), which scans many bytes at a time, and quotes and escapes
+ * are only undone for the fields that have them.
+ *
+ * CSV (RFC 4180) fields are text, except empty fields that aren't quoted,
+ * which are NULL. Lines may end with "\n" or "\r\n", and empty lines are
+ * skipped. NDJSON lines are objects whose keys are matched against the
+ * column names: numbers become integers or floats, true and false 1 and 0,
+ * and nested objects and arrays their JSON text. Missing keys are marked as
+ * such, so that their columns get their default, and keys of no column are
+ * ignored.
+ *
+ */
+class ImportReader {
+public:
+    enum Format { CSV, NDJSON };
+
+    struct Value {
+        int type = SQLITE_NULL;
+        // False for the columns of keys that an NDJSON object doesn't have.
+        bool present = true;
+        const char* text = NULL;
+        size_t length = 0;
+        sqlite3_int64 integer = 0;
+        double number = 0;
+    };
+
+    ImportReader(uv_loop_t* loop, uv_file fd, Format format, char delimiter);
+
+    // Names of the columns. NDJSON keys are matched against them, and CSV
+    // records must have as many fields.
+    void SetColumns(const std::vector<std::string>& columns);
+
+    // Reads the next record into values. Returns false at the end of the
+    // file, or on an error, which sets the status and the message.
+    bool Next();
+
+    std::vector<Value> values;
+    int status = SQLITE_OK;
+    std::string message;
+    // Line the last record started on, counting from 1.
+    uint64_t line = 0;
+    // Bytes of the file read up to the end of the last record.
+    uint64_t bytes = 0;
+
+protected:
+    enum Result { NEED_MORE, RECORD, END, FAILED };
+
+    struct Span {
+        char* start;
+        char* end;
+        bool quoted;
+        bool escaped;
+    };
+
+    // Reads more of the file after the unread data, which is moved to the
+    // front of the buffer first.
+    bool Fill();
+    Result ParseCSV();
+    Result ParseJSON();
+    bool ParseValue(char*& p, char* stop, Value& value);
+    bool ParseString(char*& p, char* stop, Value& value);
+    Result Fail(const std::string& error);
+
+    uv_loop_t* loop;
+    uv_file fd;
+    Format format;
+    char delimiter;
+
+    size_t columns = 0;
+    std::unordered_map<std::string, size_t> index;
+
+    std::string buffer;
+    size_t position = 0;
+    size_t end = 0;
+    bool eof = false;
+    bool started = false;
+    // Line the next record starts on.
+    uint64_t next_line = 1;
+
+    std::vector<Span> spans;
+    std::string key;
+};
+
+}
+
+#endif
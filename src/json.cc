@@ -0,0 +1,191 @@
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "json.h"
+
+using namespace node_sqlite3;
+
+JSONWriter::JSONWriter(sqlite3_stmt* stmt, Blobs blobs_) : blobs(blobs_) {
+    int count = sqlite3_column_count(stmt);
+    for (int i = 0; i < count; i++) {
+        const char* name = sqlite3_column_name(stmt, i);
+        std::string key;
+        AppendString(key, name ? name : "", name ? strlen(name) : 0);
+        key += ':';
+        keys.push_back(std::move(key));
+    }
+}
+
+void JSONWriter::AppendRow(std::string& out, sqlite3_stmt* stmt) const {
+    out += '{';
+    for (size_t i = 0; i < keys.size(); i++) {
+        int column = static_cast<int>(i);
+        if (i) out += ',';
+        out += keys[i];
+        switch (sqlite3_column_type(stmt, column)) {
+            case SQLITE_INTEGER: {
+                AppendInteger(out, sqlite3_column_int64(stmt, column));
+            } break;
+            case SQLITE_FLOAT: {
+                AppendFloat(out, sqlite3_column_double(stmt, column));
+            } break;
+            case SQLITE_TEXT: {
+                const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, column));
+                AppendString(out, text, sqlite3_column_bytes(stmt, column));
+            } break;
+            case SQLITE_BLOB: {
+                const void* data = sqlite3_column_blob(stmt, column);
+                AppendBlob(out, static_cast<const unsigned char*>(data),
+                    sqlite3_column_bytes(stmt, column), blobs);
+            } break;
+            default: {
+                out += "null";
+            } break;
+        }
+    }
+    out += '}';
+}
+
+void JSONWriter::AppendString(std::string& out, const char* text, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        out.append(text + start, i - start);
+        start = i + 1;
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default: {
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 0xf];
+            } break;
+        }
+    }
+    out.append(text + start, length - start);
+    out += '"';
+}
+
+void JSONWriter::AppendInteger(std::string& out, sqlite3_int64 value) {
+    char buffer[24];
+    int length = snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(value));
+    out.append(buffer, length);
+}
+
+void JSONWriter::AppendFloat(std::string& out, double value) {
+    if (!std::isfinite(value)) {
+        // Like JSON.stringify.
+        out += "null";
+        return;
+    }
+    if (value == 0) {
+        out += '0';
+        return;
+    }
+
+    // The fewest significant digits that read back the same.
+    char buffer[32];
+    // Subnormal numbers have fewer digits of precision.
+    int least = std::fabs(value) < DBL_MIN ? 1 : 15;
+    for (int precision = least; precision <= 17; precision++) {
+        snprintf(buffer, sizeof(buffer), "%.*e", precision - 1, value);
+        if (strtod(buffer, NULL) == value) break;
+    }
+    char* mantissa = buffer;
+    if (*mantissa == '-') {
+        out += '-';
+        mantissa++;
+    }
+    char* e = strchr(mantissa, 'e');
+    int exponent = atoi(e + 1);
+    std::string digits;
+    for (char* c = mantissa; c < e; c++) {
+        if (*c != '.') digits += *c;
+    }
+    while (digits.size() > 1 && digits.back() == '0') digits.pop_back();
+
+    // Laid out the way Number#toString does.
+    int k = static_cast<int>(digits.size());
+    int n = exponent + 1;
+    if (k <= n && n <= 21) {
+        out += digits;
+        out.append(n - k, '0');
+    }
+    else if (0 < n && n <= 21) {
+        out.append(digits, 0, n);
+        out += '.';
+        out.append(digits, n, std::string::npos);
+    }
+    else if (-6 < n && n <= 0) {
+        out += "0.";
+        out.append(-n, '0');
+        out += digits;
+    }
+    else {
+        out += digits[0];
+        if (k > 1) {
+            out += '.';
+            out.append(digits, 1, std::string::npos);
+        }
+        out += n - 1 < 0 ? "e-" : "e+";
+        AppendInteger(out, n - 1 < 0 ? 1 - n : n - 1);
+    }
+}
+
+void JSONWriter::AppendBlob(std::string& out, const unsigned char* data, size_t length, Blobs blobs) {
+    if (blobs == ARRAY) {
+        out += '[';
+        for (size_t i = 0; i < length; i++) {
+            if (i) out += ',';
+            AppendInteger(out, data[i]);
+        }
+        out += ']';
+    }
+    else {
+        out += '"';
+        AppendEncoded(out, data, length, blobs);
+        out += '"';
+    }
+}
+
+void JSONWriter::AppendEncoded(std::string& out, const unsigned char* data, size_t length, Blobs blobs) {
+    if (blobs == HEX) {
+        static const char hex[] = "0123456789abcdef";
+        for (size_t i = 0; i < length; i++) {
+            out += hex[data[i] >> 4];
+            out += hex[data[i] & 0xf];
+        }
+        return;
+    }
+
+    static const char base64[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i = 0;
+    for (; i + 2 < length; i += 3) {
+        unsigned int bits = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        out += base64[bits >> 18];
+        out += base64[(bits >> 12) & 0x3f];
+        out += base64[(bits >> 6) & 0x3f];
+        out += base64[bits & 0x3f];
+    }
+    if (i < length) {
+        unsigned int bits = data[i] << 16;
+        if (i + 1 < length) bits |= data[i + 1] << 8;
+        out += base64[bits >> 18];
+        out += base64[(bits >> 12) & 0x3f];
+        out += i + 1 < length ? base64[(bits >> 6) & 0x3f] : '=';
+        out += '=';
+    }
+}
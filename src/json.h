@@ -0,0 +1,47 @@
+#ifndef NODE_SQLITE3_SRC_JSON_H
+#define NODE_SQLITE3_SRC_JSON_H
+
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+namespace node_sqlite3 {
+
+/**
+ *
+ * Writes the rows of a statement as JSON text, straight from the statement,
+ * for Statement#allJSON and Statement#getJSON.
+ *
+ * Rows are objects keyed by column name, like the ones Statement#all
+ * returns: integers and floats are numbers, text is a string, NULL is null.
+ * Floats are written with as few digits as read back the same, and
+ * infinities, which JSON doesn't have, as null. Blobs are written as base64
+ * or hex strings, or arrays of bytes, see configure("json").
+ *
+ */
+class JSONWriter {
+public:
+    enum Blobs { BASE64 = 0, HEX, ARRAY };
+
+    JSONWriter(sqlite3_stmt* stmt, Blobs blobs);
+
+    // Appends the row the statement is on as an object.
+    void AppendRow(std::string& out, sqlite3_stmt* stmt) const;
+
+    static void AppendString(std::string& out, const char* text, size_t length);
+    static void AppendInteger(std::string& out, sqlite3_int64 value);
+    static void AppendFloat(std::string& out, double value);
+    static void AppendBlob(std::string& out, const unsigned char* data, size_t length, Blobs blobs);
+    // Appends a blob as base64 or hex, without quotes.
+    static void AppendEncoded(std::string& out, const unsigned char* data, size_t length, Blobs blobs);
+
+protected:
+    // Column names as `"name":`, written once.
+    std::vector<std::string> keys;
+    Blobs blobs;
+};
+
+}
+
+#endif
@@ -144,12 +144,22 @@ inline bool OtherIsInt(Napi::Number source) {
 #endif
 
 #define CREATE_WORK(name, workerFn, afterFn)                                    \
-    int status = napi_create_async_work(env, NULL, Napi::String::New(env, name),\
-                             workerFn, afterFn, baton, &baton->request);        \
+    {                                                                           \
+        int status = napi_create_async_work(env, NULL,                          \
+                                 Napi::String::New(env, name),                  \
+                                 workerFn, afterFn, baton, &baton->request);    \
                                                                                 \
-    ASSERT_STATUS();                                                            \
+        ASSERT_STATUS();                                                        \
+    }                                                                           \
     napi_queue_async_work(env, baton->request);
 
+// Work that goes on in chunks runs again from its complete callback. A work
+// item must not be queued a second time, so every chunk gets a new one.
+#define REQUEUE_WORK(name, workerFn, afterFn)                                   \
+    napi_delete_async_work(env, baton->request);                                \
+    baton->request = NULL;                                                      \
+    CREATE_WORK(name, workerFn, afterFn);
+
 #define STATEMENT_BEGIN(type)                                                  \
     assert(baton);                                                             \
     assert(baton->stmt);                                                       \
@@ -171,7 +181,7 @@ inline bool OtherIsInt(Napi::Number source) {
         stmt->message = "Database handle is closed"; \
         return; \
     } \
-    sqlite3_mutex* name = sqlite3_db_mutex(stmt->db->_handle);
+    sqlite3_mutex* name = stmt->db->GetMutex();
 
 #define STATEMENT_END()                                                        \
     assert(stmt->locked);                                                      \
@@ -8,6 +8,9 @@
 #include "database.h"
 #include "statement.h"
 #include "backup.h"
+#include "session.h"
+#include "shard_set.h"
+#include "watch.h"
 
 using namespace node_sqlite3;
 
@@ -19,12 +22,18 @@ Napi::Object RegisterModule(Napi::Env env, Napi::Object exports) {
     Database::Init(env, exports);
     Statement::Init(env, exports);
     Backup::Init(env, exports);
+    ShardSet::Init(env, exports);
+    Watch::Init(env, exports);
+#ifdef NODE_SQLITE3_HAVE_SESSION
+    Session::Init(env, exports);
+#endif
 
     exports.DefineProperties({
         DEFINE_CONSTANT_INTEGER(exports, SQLITE_OPEN_READONLY, OPEN_READONLY)
         DEFINE_CONSTANT_INTEGER(exports, SQLITE_OPEN_READWRITE, OPEN_READWRITE)
         DEFINE_CONSTANT_INTEGER(exports, SQLITE_OPEN_CREATE, OPEN_CREATE)
         DEFINE_CONSTANT_INTEGER(exports, SQLITE_OPEN_FULLMUTEX, OPEN_FULLMUTEX)
+        DEFINE_CONSTANT_INTEGER(exports, SQLITE_OPEN_NOMUTEX, OPEN_NOMUTEX)
         DEFINE_CONSTANT_INTEGER(exports, SQLITE_OPEN_URI, OPEN_URI)
         DEFINE_CONSTANT_INTEGER(exports, SQLITE_OPEN_SHAREDCACHE, OPEN_SHAREDCACHE)
         DEFINE_CONSTANT_INTEGER(exports, SQLITE_OPEN_PRIVATECACHE, OPEN_PRIVATECACHE)
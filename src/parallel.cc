@@ -0,0 +1,700 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <queue>
+#include <napi.h>
+#include "macros.h"
+#include "database.h"
+#include "statement.h"
+#include "parallel.h"
+
+using namespace node_sqlite3;
+
+static int TypeRank(int type) {
+    switch (type) {
+        case SQLITE_NULL: return 0;
+        case SQLITE_INTEGER:
+        case SQLITE_FLOAT: return 1;
+        case SQLITE_TEXT: return 2;
+        default: return 3;
+    }
+}
+
+static double ToDouble(const Values::Field* field) {
+    if (field->type == SQLITE_INTEGER) {
+        return static_cast<double>(static_cast<const Values::Integer*>(field)->value);
+    }
+    return static_cast<const Values::Float*>(field)->value;
+}
+
+int Parallel::Compare(const Values::Field* a, const Values::Field* b) {
+    int rank = TypeRank(a->type);
+    if (rank != TypeRank(b->type)) {
+        return rank < TypeRank(b->type) ? -1 : 1;
+    }
+
+    switch (rank) {
+        case 1: {
+            if (a->type == SQLITE_INTEGER && b->type == SQLITE_INTEGER) {
+                int64_t x = static_cast<const Values::Integer*>(a)->value;
+                int64_t y = static_cast<const Values::Integer*>(b)->value;
+                return x < y ? -1 : (x > y ? 1 : 0);
+            }
+            double x = ToDouble(a);
+            double y = ToDouble(b);
+            return x < y ? -1 : (x > y ? 1 : 0);
+        }
+        case 2: {
+            int c = static_cast<const Values::Text*>(a)->value.compare(
+                static_cast<const Values::Text*>(b)->value);
+            return c < 0 ? -1 : (c > 0 ? 1 : 0);
+        }
+        case 3: {
+            auto* x = static_cast<const Values::Blob*>(a);
+            auto* y = static_cast<const Values::Blob*>(b);
+            int c = memcmp(x->value, y->value, std::min(x->length, y->length));
+            if (c == 0) c = x->length - y->length;
+            return c < 0 ? -1 : (c > 0 ? 1 : 0);
+        }
+        default:
+            return 0;
+    }
+}
+
+// Appends a value to the key of the group that a row belongs to. Numbers
+// that are equal end up with the same key whether they are stored as
+// integers or floats.
+static void AppendKey(std::string& key, const Values::Field* field) {
+    switch (field->type) {
+        case SQLITE_INTEGER: {
+            int64_t value = static_cast<const Values::Integer*>(field)->value;
+            key += 'i';
+            key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        } break;
+        case SQLITE_FLOAT: {
+            double value = static_cast<const Values::Float*>(field)->value;
+            if (value >= -9223372036854775808.0 && value < 9223372036854775808.0 &&
+                    value == static_cast<double>(static_cast<int64_t>(value))) {
+                int64_t integer = static_cast<int64_t>(value);
+                key += 'i';
+                key.append(reinterpret_cast<const char*>(&integer), sizeof(integer));
+            }
+            else {
+                key += 'f';
+                key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+            }
+        } break;
+        case SQLITE_TEXT: {
+            auto& value = static_cast<const Values::Text*>(field)->value;
+            uint32_t length = static_cast<uint32_t>(value.size());
+            key += 't';
+            key.append(reinterpret_cast<const char*>(&length), sizeof(length));
+            key += value;
+        } break;
+        case SQLITE_BLOB: {
+            auto* blob = static_cast<const Values::Blob*>(field);
+            uint32_t length = static_cast<uint32_t>(blob->length);
+            key += 'b';
+            key.append(reinterpret_cast<const char*>(&length), sizeof(length));
+            key.append(blob->value, blob->length);
+        } break;
+        default: {
+            key += 'n';
+        } break;
+    }
+}
+
+// Adds value to the aggregate in into. NULLs are ignored, as they are by
+// SQL's aggregate functions.
+static void Accumulate(std::unique_ptr<Values::Field>& into,
+                       std::unique_ptr<Values::Field>& value, Parallel::Combine::Op op) {
+    if (value->type == SQLITE_NULL) return;
+    if (into->type == SQLITE_NULL) {
+        into = std::move(value);
+        return;
+    }
+
+    switch (op) {
+        case Parallel::Combine::SUM: {
+            if (into->type == SQLITE_INTEGER && value->type == SQLITE_INTEGER) {
+                int64_t a = static_cast<Values::Integer*>(into.get())->value;
+                int64_t b = static_cast<Values::Integer*>(value.get())->value;
+                if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b)) {
+                    into = std::make_unique<Values::Float>(into->name.c_str(),
+                        static_cast<double>(a) + static_cast<double>(b));
+                }
+                else {
+                    static_cast<Values::Integer*>(into.get())->value = a + b;
+                }
+            }
+            else if (TypeRank(value->type) == 1 && TypeRank(into->type) == 1) {
+                into = std::make_unique<Values::Float>(into->name.c_str(),
+                    ToDouble(into.get()) + ToDouble(value.get()));
+            }
+        } break;
+        case Parallel::Combine::MIN: {
+            if (Parallel::Compare(value.get(), into.get()) < 0) into = std::move(value);
+        } break;
+        case Parallel::Combine::MAX: {
+            if (Parallel::Compare(value.get(), into.get()) > 0) into = std::move(value);
+        } break;
+        default:
+            break;
+    }
+}
+
+static std::string Trim(const std::string& text) {
+    size_t begin = 0;
+    size_t end = text.size();
+    while (begin < end && isspace(static_cast<unsigned char>(text[begin]))) begin++;
+    while (end > begin && isspace(static_cast<unsigned char>(text[end - 1]))) end--;
+    return text.substr(begin, end - begin);
+}
+
+bool Parallel::Combine::Parse(Napi::Env env, Napi::Value combine, Napi::Value order) {
+    if (combine.IsObject() && !combine.IsArray()) {
+        auto object = combine.As<Napi::Object>();
+        auto names = object.GetPropertyNames();
+        for (uint32_t i = 0; i < names.Length(); i++) {
+            std::string name = names.Get(i).As<Napi::String>();
+            Napi::Value value = object.Get(name);
+            std::string op = value.IsString() ? value.As<Napi::String>().Utf8Value() : "";
+            if (op == "sum" || op == "count") columns.emplace_back(name, SUM);
+            else if (op == "min") columns.emplace_back(name, MIN);
+            else if (op == "max") columns.emplace_back(name, MAX);
+            else if (op == "group") columns.emplace_back(name, GROUP);
+            else {
+                Napi::TypeError::New(env, "Columns must be combined with 'sum', 'count', 'min', 'max' or 'group'").ThrowAsJavaScriptException();
+                return false;
+            }
+        }
+    }
+    else if (!combine.IsUndefined() && !(combine.IsString() &&
+            combine.As<Napi::String>().Utf8Value() == "concat")) {
+        Napi::TypeError::New(env, "combine must be 'concat' or an object").ThrowAsJavaScriptException();
+        return false;
+    }
+
+    // Either a list like "a DESC, b" or an array of such terms.
+    std::vector<std::string> terms;
+    if (order.IsString()) {
+        std::string list = order.As<Napi::String>();
+        size_t start = 0;
+        size_t comma;
+        while ((comma = list.find(',', start)) != std::string::npos) {
+            terms.push_back(list.substr(start, comma - start));
+            start = comma + 1;
+        }
+        terms.push_back(list.substr(start));
+    }
+    else if (order.IsArray()) {
+        auto array = order.As<Napi::Array>();
+        for (uint32_t i = 0; i < array.Length(); i++) {
+            terms.push_back(array.Get(i).ToString().Utf8Value());
+        }
+    }
+    else if (!order.IsUndefined()) {
+        Napi::TypeError::New(env, "orderBy must be a string or an array").ThrowAsJavaScriptException();
+        return false;
+    }
+
+    for (auto& term : terms) {
+        std::string text = Trim(term);
+        bool desc = false;
+        size_t space = text.find_last_of(" \t");
+        if (space != std::string::npos) {
+            std::string direction = text.substr(space + 1);
+            std::transform(direction.begin(), direction.end(), direction.begin(), ::toupper);
+            if (direction == "DESC" || direction == "ASC") {
+                desc = direction == "DESC";
+                text = Trim(text.substr(0, space));
+            }
+        }
+        if (text.empty()) {
+            Napi::TypeError::New(env, "orderBy has an empty term").ThrowAsJavaScriptException();
+            return false;
+        }
+        orderBy.emplace_back(text, desc);
+    }
+
+    return true;
+}
+
+bool Parallel::Combine::Apply(std::vector<Rows>& parts, Rows& result, std::string& message) const {
+    const Row* sample = NULL;
+    for (auto& rows : parts) {
+        if (!rows.empty()) {
+            sample = rows.front().get();
+            break;
+        }
+    }
+    if (!sample) return true;
+
+    auto indexOf = [sample, &message](const std::string& name) {
+        for (size_t i = 0; i < sample->size(); i++) {
+            if ((*sample)[i]->name == name) return static_cast<int>(i);
+        }
+        message = "No such column in the results: " + name;
+        return -1;
+    };
+
+    std::vector<Op> ops(sample->size(), GROUP);
+    bool aggregate = false;
+    for (auto& column : columns) {
+        int index = indexOf(column.first);
+        if (index < 0) return false;
+        ops[index] = column.second;
+        if (column.second != GROUP) aggregate = true;
+    }
+
+    std::vector<std::pair<int, bool> > order;
+    for (auto& term : orderBy) {
+        int index = indexOf(term.first);
+        if (index < 0) return false;
+        order.emplace_back(index, term.second);
+    }
+    auto less = [&order](const Row& a, const Row& b) {
+        for (auto& term : order) {
+            int c = Compare(a[term.first].get(), b[term.first].get());
+            if (c != 0) return term.second ? c > 0 : c < 0;
+        }
+        return false;
+    };
+
+    if (aggregate) {
+        // Rows that agree on all columns that aren't aggregated are folded
+        // into the first of them.
+        std::map<std::string, size_t> groups;
+        for (auto& rows : parts) {
+            for (auto& row : rows) {
+                std::string key;
+                for (size_t i = 0; i < ops.size(); i++) {
+                    if (ops[i] == GROUP) AppendKey(key, (*row)[i].get());
+                }
+                auto it = groups.find(key);
+                if (it == groups.end()) {
+                    groups.emplace(std::move(key), result.size());
+                    result.push_back(std::move(row));
+                    continue;
+                }
+                Row& into = *result[it->second];
+                for (size_t i = 0; i < ops.size(); i++) {
+                    if (ops[i] != GROUP) Accumulate(into[i], (*row)[i], ops[i]);
+                }
+            }
+        }
+        if (!order.empty()) {
+            std::stable_sort(result.begin(), result.end(),
+                [&less](const std::unique_ptr<Row>& a, const std::unique_ptr<Row>& b) {
+                    return less(*a, *b);
+                });
+        }
+    }
+    else if (!order.empty()) {
+        // Each part is ordered already, so a k-way merge is enough. Rows that
+        // compare equal are kept in the order of the parts.
+        std::vector<size_t> pos(parts.size(), 0);
+        auto after = [&parts, &pos, &less](size_t a, size_t b) {
+            const Row& x = *parts[a][pos[a]];
+            const Row& y = *parts[b][pos[b]];
+            return less(y, x) || (!less(x, y) && b < a);
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(after)> heap(after);
+        for (size_t i = 0; i < parts.size(); i++) {
+            if (!parts[i].empty()) heap.push(i);
+        }
+        while (!heap.empty()) {
+            size_t i = heap.top();
+            heap.pop();
+            result.push_back(std::move(parts[i][pos[i]++]));
+            if (pos[i] < parts[i].size()) heap.push(i);
+        }
+    }
+    else {
+        for (auto& rows : parts) {
+            for (auto& row : rows) result.push_back(std::move(row));
+        }
+    }
+
+    return true;
+}
+
+ParallelPart::~ParallelPart() {
+    if (request) napi_delete_async_work(parent->db->Env(), request);
+    if (handle) sqlite3_close(handle);
+}
+
+static int OpenReader(const std::string& filename, sqlite3** handle) {
+    int status = sqlite3_open_v2(filename.c_str(), handle,
+        SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL);
+    if (status != SQLITE_OK) {
+        sqlite3_close(*handle);
+        *handle = NULL;
+    }
+    return status;
+}
+
+// Authorizer that collects the tables of the main database a statement reads.
+static int CollectTables(void* data, int action, const char* table,
+                         const char* column, const char* database, const char* trigger) {
+    auto* tables = static_cast<std::vector<std::string>*>(data);
+    if (action == SQLITE_READ && table && database && strcmp(database, "main") == 0 &&
+            strncmp(table, "sqlite_", 7) != 0 &&
+            std::find(tables->begin(), tables->end(), table) == tables->end()) {
+        tables->push_back(table);
+    }
+    return SQLITE_OK;
+}
+
+// Database#parallelQuery(sql, [{ params, table, partitionBy, workers, combine, orderBy }], [callback])
+// Splits the range of an integer column (the rowid by default) of the table
+// the query reads into one partition per worker and runs the query on each
+// of them at the same time, on read-only connections of its own. The query
+// restricts itself to a partition with the $first and $last parameters,
+// e.g. "WHERE rowid BETWEEN $first AND $last". The results are put together
+// as described by combine and orderBy (see Parallel::Combine) before the
+// callback gets them as one array of rows.
+//
+// All partitions see the same state of the database: the first connection
+// keeps the transaction it measured the range in open until the end, and
+// the others read the same WAL snapshot, or are kept consistent by the
+// shared lock it holds if the database isn't in WAL mode.
+Napi::Value Database::ParallelQuery(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+    auto* db = this;
+
+    REQUIRE_ARGUMENT_STRING(0, sql);
+    int pos = 1;
+    Napi::Object options = Napi::Object::New(env);
+    if (info.Length() > 1 && info[1].IsObject() && !info[1].IsFunction()) {
+        options = info[1].As<Napi::Object>();
+        pos++;
+    }
+    OPTIONAL_ARGUMENT_FUNCTION(pos, callback);
+
+    std::unique_ptr<ParallelQueryBaton> baton(new ParallelQueryBaton(db, callback));
+    baton->sql = sql;
+
+    Napi::Value workers = options.Get("workers");
+    int count = 4;
+    if (workers.IsNumber()) {
+        count = workers.As<Napi::Number>().Int32Value();
+    }
+    else if (!workers.IsUndefined()) {
+        Napi::TypeError::New(env, "workers must be a number").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    count = std::max(1, std::min(count, 64));
+
+    Napi::Value partitionBy = options.Get("partitionBy");
+    Napi::Value table = options.Get("table");
+    if ((!partitionBy.IsUndefined() && !partitionBy.IsString()) ||
+            (!table.IsUndefined() && !table.IsString())) {
+        Napi::TypeError::New(env, "partitionBy and table must be strings").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    baton->column = partitionBy.IsString() ? partitionBy.As<Napi::String>().Utf8Value() : "rowid";
+    if (table.IsString()) {
+        baton->table = table.As<Napi::String>().Utf8Value();
+    }
+    else if (baton->column.find('.') != std::string::npos) {
+        baton->table = baton->column.substr(0, baton->column.find('.'));
+        baton->column = baton->column.substr(baton->column.find('.') + 1);
+    }
+
+    if (!baton->combine.Parse(env, options.Get("combine"), options.Get("orderBy"))) {
+        return env.Null();
+    }
+    Statement::GetParameters(options.Get("params"), baton->parameters);
+
+    for (int i = 0; i < count; i++) {
+        baton->parts.emplace_back(new ParallelPart(baton.get(), i));
+    }
+
+    db->Schedule(Work_BeginParallelQuery, baton.release());
+    return info.This();
+}
+
+void Database::Work_BeginParallelQuery(Baton* b) {
+    auto* baton = static_cast<ParallelQueryBaton*>(b);
+    auto* db = baton->db;
+    assert(db->open);
+    assert(db->_handle);
+    db->pending++;
+
+    for (auto& part : baton->parts) {
+        if (db->readers.empty()) break;
+        part->handle = db->readers.back();
+        db->readers.pop_back();
+    }
+
+    auto env = db->Env();
+    CREATE_WORK("sqlite3.Database.ParallelQuery", Work_ParallelQuery, Work_AfterParallelQuery);
+}
+
+void Database::Work_ParallelQuery(napi_env e, void* data) {
+    auto* baton = static_cast<ParallelQueryBaton*>(data);
+    auto* db = baton->db;
+    auto* part = baton->parts.front().get();
+
+    sqlite3_mutex* mtx = db->GetMutex();
+    sqlite3_mutex_enter(mtx);
+    const char* name = sqlite3_db_filename(db->_handle, "main");
+    if (name) baton->filename = name;
+    sqlite3_mutex_leave(mtx);
+
+    if (baton->filename.empty()) {
+        baton->status = SQLITE_MISUSE;
+        baton->message = "parallelQuery needs a database file";
+        return;
+    }
+    if (!part->handle) {
+        baton->status = OpenReader(baton->filename, &part->handle);
+        if (baton->status != SQLITE_OK) {
+            baton->message = std::string(sqlite3_errstr(baton->status));
+            return;
+        }
+    }
+    sqlite3* handle = part->handle;
+
+    // Check the query, and find the table to partition if it wasn't given.
+    std::vector<std::string> tables;
+    sqlite3_stmt* stmt = NULL;
+    sqlite3_set_authorizer(handle, CollectTables, &tables);
+    baton->status = sqlite3_prepare_v2(handle, baton->sql.c_str(), -1, &stmt, NULL);
+    sqlite3_set_authorizer(handle, NULL, NULL);
+    if (baton->status != SQLITE_OK) {
+        baton->message = std::string(sqlite3_errmsg(handle));
+    }
+    else if (!sqlite3_bind_parameter_index(stmt, "$first") ||
+             !sqlite3_bind_parameter_index(stmt, "$last")) {
+        baton->status = SQLITE_MISUSE;
+        baton->message = "parallelQuery needs $first and $last in the query";
+    }
+    else if (baton->table.empty() && tables.size() != 1) {
+        baton->status = SQLITE_MISUSE;
+        baton->message = "parallelQuery needs the table option for queries that read several tables";
+    }
+    else {
+        // The parts bind $first and $last after params, so a param that
+        // lands on either of them would be overwritten without notice.
+        int first = sqlite3_bind_parameter_index(stmt, "$first");
+        int last = sqlite3_bind_parameter_index(stmt, "$last");
+        for (auto& field : baton->parameters) {
+            if (field == NULL) continue;
+            int pos = field->index > 0 ? field->index :
+                sqlite3_bind_parameter_index(stmt, field->name.c_str());
+            if (pos == first || pos == last) {
+                baton->status = SQLITE_MISUSE;
+                baton->message = "parallelQuery sets $first and $last itself, params can't bind them";
+                break;
+            }
+        }
+    }
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+    if (baton->status != SQLITE_OK) return;
+    if (baton->table.empty()) baton->table = tables.front();
+
+    baton->status = sqlite3_exec(handle, "BEGIN", NULL, NULL, NULL);
+    if (baton->status == SQLITE_OK) {
+        char* sql = sqlite3_mprintf("SELECT min(\"%w\"), max(\"%w\") FROM main.\"%w\"",
+            baton->column.c_str(), baton->column.c_str(), baton->table.c_str());
+        baton->status = sqlite3_prepare_v2(handle, sql, -1, &stmt, NULL);
+        sqlite3_free(sql);
+    }
+    if (baton->status == SQLITE_OK) {
+        baton->status = sqlite3_step(stmt);
+        if (baton->status == SQLITE_ROW) {
+            baton->status = SQLITE_OK;
+            if (sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+                baton->min = sqlite3_column_int64(stmt, 0);
+                baton->max = sqlite3_column_int64(stmt, 1);
+            }
+        }
+    }
+    if (baton->status != SQLITE_OK) {
+        baton->message = std::string(sqlite3_errmsg(handle));
+    }
+    sqlite3_finalize(stmt);
+
+#ifdef SQLITE_ENABLE_SNAPSHOT
+    if (baton->status == SQLITE_OK &&
+            sqlite3_snapshot_get(handle, "main", &baton->snapshot) != SQLITE_OK) {
+        // Only databases in WAL mode have snapshots.
+        baton->snapshot = NULL;
+    }
+#endif
+}
+
+void Database::Work_AfterParallelQuery(napi_env e, napi_status status, void* data) {
+    auto* baton = static_cast<ParallelQueryBaton*>(data);
+    auto* db = baton->db;
+
+    auto env = db->Env();
+    Napi::HandleScope scope(env);
+
+    if (baton->status != SQLITE_OK) {
+        return FinishParallelQuery(baton);
+    }
+
+    // Split the range into partitions of the same size, but not into more
+    // partitions than there are values.
+    auto& parts = baton->parts;
+    size_t count = parts.size();
+    uint64_t span = 0;
+    uint64_t size = 1;
+    if (baton->max < baton->min) {
+        count = 1;
+    }
+    else {
+        span = static_cast<uint64_t>(baton->max) - static_cast<uint64_t>(baton->min);
+        if (span < count - 1) count = static_cast<size_t>(span + 1);
+        size = span / count + 1;
+        count = static_cast<size_t>(span / size + 1);
+    }
+    while (parts.size() > count) {
+        if (parts.back()->handle) db->readers.push_back(parts.back()->handle);
+        parts.back()->handle = NULL;
+        parts.pop_back();
+    }
+
+    baton->remaining = count;
+    for (size_t i = 0; i < count; i++) {
+        auto* part = parts[i].get();
+        if (baton->max < baton->min) {
+            part->first = 1;
+            part->last = 0;
+        }
+        else {
+            part->first = static_cast<sqlite3_int64>(static_cast<uint64_t>(baton->min) + i * size);
+            part->last = i + 1 == count ? baton->max :
+                static_cast<sqlite3_int64>(static_cast<uint64_t>(part->first) + size - 1);
+        }
+
+        napi_create_async_work(env, NULL,
+            Napi::String::New(env, "sqlite3.Database.ParallelPart"),
+            Work_ParallelPart, Work_AfterParallelPart, part, &part->request);
+        napi_queue_async_work(env, part->request);
+    }
+}
+
+void Database::Work_ParallelPart(napi_env e, void* data) {
+    auto* part = static_cast<ParallelPart*>(data);
+    auto* baton = part->parent;
+
+    if (!part->handle) {
+        part->status = OpenReader(baton->filename, &part->handle);
+        if (part->status != SQLITE_OK) {
+            part->message = std::string(sqlite3_errstr(part->status));
+            return;
+        }
+    }
+    sqlite3* handle = part->handle;
+
+    // The first part runs in the transaction the range was measured in.
+    if (part->index > 0) {
+        part->status = sqlite3_exec(handle, "BEGIN", NULL, NULL, NULL);
+#ifdef SQLITE_ENABLE_SNAPSHOT
+        if (part->status == SQLITE_OK && baton->snapshot) {
+            part->status = sqlite3_snapshot_open(handle, "main", baton->snapshot);
+        }
+#endif
+    }
+
+    sqlite3_stmt* stmt = NULL;
+    if (part->status == SQLITE_OK) {
+        part->status = sqlite3_prepare_v2(handle, baton->sql.c_str(), -1, &stmt, NULL);
+    }
+    if (part->status == SQLITE_OK) {
+        part->status = Statement::BindParameters(stmt, baton->parameters);
+    }
+    if (part->status == SQLITE_OK) {
+        part->status = sqlite3_bind_int64(stmt,
+            sqlite3_bind_parameter_index(stmt, "$first"), part->first);
+    }
+    if (part->status == SQLITE_OK) {
+        part->status = sqlite3_bind_int64(stmt,
+            sqlite3_bind_parameter_index(stmt, "$last"), part->last);
+    }
+    if (part->status == SQLITE_OK) {
+        while ((part->status = sqlite3_step(stmt)) == SQLITE_ROW) {
+            std::unique_ptr<Row> row(new Row());
+            Statement::GetRow(row.get(), stmt);
+            part->rows.push_back(std::move(row));
+        }
+        if (part->status == SQLITE_DONE) {
+            part->status = SQLITE_OK;
+        }
+    }
+    if (part->status != SQLITE_OK) {
+        part->message = std::string(sqlite3_errmsg(handle));
+    }
+    sqlite3_finalize(stmt);
+}
+
+void Database::Work_AfterParallelPart(napi_env e, napi_status status, void* data) {
+    auto* part = static_cast<ParallelPart*>(data);
+    auto* baton = part->parent;
+    if (--baton->remaining == 0) {
+        FinishParallelQuery(baton);
+    }
+}
+
+void Database::FinishParallelQuery(ParallelQueryBaton* b) {
+    std::unique_ptr<ParallelQueryBaton> baton(b);
+    auto* db = baton->db;
+
+    auto env = db->Env();
+    Napi::HandleScope scope(env);
+
+    // End the transactions and keep the connections for the next query.
+    std::vector<Rows> results;
+    for (auto& part : baton->parts) {
+        if (part->handle) {
+            if (!sqlite3_get_autocommit(part->handle)) {
+                sqlite3_exec(part->handle, "COMMIT", NULL, NULL, NULL);
+            }
+            db->readers.push_back(part->handle);
+            part->handle = NULL;
+        }
+        if (baton->status == SQLITE_OK && part->status != SQLITE_OK) {
+            baton->status = part->status;
+            baton->message = part->message;
+        }
+        results.push_back(std::move(part->rows));
+    }
+
+    Rows rows;
+    if (baton->status == SQLITE_OK && !baton->combine.Apply(results, rows, baton->message)) {
+        baton->status = SQLITE_MISUSE;
+    }
+
+    db->pending--;
+
+    Napi::Function cb = baton->callback.Value();
+    if (baton->status != SQLITE_OK) {
+        EXCEPTION(Napi::String::New(env, baton->message.c_str()), baton->status, exception);
+
+        if (IS_FUNCTION(cb)) {
+            Napi::Value argv[] = { exception };
+            TRY_CATCH_CALL(db->Value(), cb, 1, argv);
+        }
+        else {
+            Napi::Value info[] = { Napi::String::New(env, "error"), exception };
+            EMIT_EVENT(db->Value(), 2, info);
+        }
+    }
+    else if (IS_FUNCTION(cb)) {
+        auto result = Napi::Array::New(env, rows.size());
+        for (size_t i = 0; i < rows.size(); i++) {
+            result.Set(i, Statement::RowToJS(env, rows[i].get()));
+        }
+        Napi::Value argv[] = { env.Null(), result };
+        TRY_CATCH_CALL(db->Value(), cb, 2, argv);
+    }
+
+    db->Process();
+}
@@ -0,0 +1,97 @@
+#ifndef NODE_SQLITE3_SRC_PARALLEL_H
+#define NODE_SQLITE3_SRC_PARALLEL_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sqlite3.h>
+#include <napi.h>
+
+#include "database.h"
+#include "statement.h"
+
+namespace node_sqlite3 {
+
+namespace Parallel {
+
+// Orders values the way SQLite does with the BINARY collation: NULL first,
+// then numbers, text and blobs.
+int Compare(const Values::Field* a, const Values::Field* b);
+
+// How the results of the parts of a query that runs in pieces are put back
+// together.
+//
+// Columns that are listed with an operation are aggregated over the rows
+// that agree on all other columns: 'sum' and 'count' add up, 'min' and 'max'
+// keep the smallest or largest value. Without any such columns the results
+// are concatenated in the order of the parts, or merged on `orderBy` if each
+// part is ordered the same way.
+struct Combine {
+    enum Op { GROUP = 0, SUM, MIN, MAX };
+
+    std::vector<std::pair<std::string, Op> > columns;
+    // Column names and whether they are sorted in descending order.
+    std::vector<std::pair<std::string, bool> > orderBy;
+
+    // Reads the `combine` and `orderBy` options. Throws and returns false if
+    // they aren't valid.
+    bool Parse(Napi::Env env, Napi::Value combine, Napi::Value order);
+
+    // Moves the rows of all parts into result. Returns false with a message
+    // if the results don't have a column that was named in the options.
+    bool Apply(std::vector<Rows>& parts, Rows& result, std::string& message) const;
+};
+
+}
+
+struct ParallelQueryBaton;
+
+// One partition of Database#parallelQuery, which runs on a read connection
+// of its own.
+struct ParallelPart {
+    ParallelQueryBaton* parent;
+    napi_async_work request = NULL;
+    size_t index;
+    sqlite3* handle = NULL;
+    sqlite3_int64 first = 0;
+    sqlite3_int64 last = 0;
+    Rows rows;
+    int status = SQLITE_OK;
+    std::string message;
+
+    ParallelPart(ParallelQueryBaton* parent_, size_t index_) :
+        parent(parent_), index(index_) {}
+    ~ParallelPart();
+};
+
+struct ParallelQueryBaton : Database::Baton {
+    std::string sql;
+    Parameters parameters;
+    std::string table;
+    std::string column;
+    Parallel::Combine combine;
+
+    std::string filename;
+    // Range of the partition column; empty if max < min.
+    sqlite3_int64 min = 0;
+    sqlite3_int64 max = -1;
+    std::vector<std::unique_ptr<ParallelPart> > parts;
+    size_t remaining = 0;
+#ifdef SQLITE_ENABLE_SNAPSHOT
+    sqlite3_snapshot* snapshot = NULL;
+#endif
+
+    ParallelQueryBaton(Database* db_, Napi::Function cb_) :
+        Baton(db_, cb_) {}
+    virtual ~ParallelQueryBaton() override {
+#ifdef SQLITE_ENABLE_SNAPSHOT
+        if (snapshot) sqlite3_snapshot_free(snapshot);
+#endif
+    }
+};
+
+}
+
+#endif
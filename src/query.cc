@@ -0,0 +1,169 @@
+#include <napi.h>
+#include "macros.h"
+#include "database.h"
+#include "statement.h"
+#include "query.h"
+
+using namespace node_sqlite3;
+
+// Database#query(sql, [params], [callback])
+// Runs each statement of the SQL in turn on the thread pool, like
+// Database#exec, and calls back with an array that has the rows, changes
+// and lastID of every statement. Positional parameters are taken in turn
+// by the statements, named ones by every statement that has them; a
+// statement can't have both if there are positional parameters. The first
+// statement that fails stops the rest; the ones before it keep
+// their effects.
+Napi::Value Database::Query(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+    auto* db = this;
+
+    REQUIRE_ARGUMENT_STRING(0, sql);
+    int pos = 1;
+    Parameters parameters;
+    if (info.Length() > 1 && !info[1].IsFunction()) {
+        Statement::GetParameters(info[1], parameters);
+        pos++;
+    }
+    OPTIONAL_ARGUMENT_FUNCTION(pos, callback);
+
+    for (auto& parameter : parameters) {
+        if (!parameter) {
+            Napi::Error::New(env, "Data type is not supported").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+    }
+
+    auto* baton = new QueryBaton(db, callback);
+    baton->sql = sql;
+    baton->parameters = std::move(parameters);
+    db->Schedule(Work_BeginQuery, baton, true);
+    return info.This();
+}
+
+void Database::Work_BeginQuery(Baton* baton) {
+    assert(baton->db->locked);
+    assert(baton->db->open);
+    assert(baton->db->_handle);
+    assert(baton->db->pending == 0);
+    baton->db->pending++;
+
+    auto env = baton->db->Env();
+    CREATE_WORK("sqlite3.Database.Query", Work_Query, Work_AfterQuery);
+}
+
+void Database::Work_Query(napi_env e, void* data) {
+    auto* baton = static_cast<QueryBaton*>(data);
+    sqlite3* handle = baton->db->_handle;
+
+    sqlite3_mutex* mtx = baton->db->GetMutex();
+    sqlite3_mutex_enter(mtx);
+
+    bool positional = false;
+    for (auto& field : baton->parameters) {
+        if (field->index > 0) positional = true;
+    }
+
+    const char* tail = baton->sql.c_str();
+    int offset = 0;
+    while (*tail) {
+        sqlite3_stmt* stmt = NULL;
+        baton->status = sqlite3_prepare_v2(handle, tail, -1, &stmt, &tail);
+        // Only comments and white space are left.
+        if (baton->status != SQLITE_OK || !stmt) break;
+
+        // The statement gets the named parameters that it has, and the
+        // positional ones after the ones the statements before it took.
+        // Named parameters have indexes too, which would shift the
+        // positional ones.
+        int count = sqlite3_bind_parameter_count(stmt);
+        int numbered = 0;
+        bool named = false;
+        for (int i = 1; i <= count; i++) {
+            const char* name = sqlite3_bind_parameter_name(stmt, i);
+            if (!name || name[0] == '?') numbered = i;
+            else named = true;
+        }
+        if (positional && named && numbered) {
+            baton->status = SQLITE_MISUSE;
+            baton->message = "Statement " + std::to_string(baton->results.size() + 1) +
+                " mixes positional and named parameters";
+        }
+        for (auto& field : baton->parameters) {
+            if (baton->status != SQLITE_OK) break;
+            int pos = field->index > 0 ? field->index - offset :
+                sqlite3_bind_parameter_index(stmt, field->name.c_str());
+            if (pos < 1 || pos > count || (field->index > 0 && pos > numbered)) continue;
+            baton->status = Statement::BindField(stmt, pos, field.get());
+        }
+        offset += numbered;
+
+        QueryBaton::Result result;
+        int total = sqlite3_total_changes(handle);
+        if (baton->status == SQLITE_OK) {
+            while ((baton->status = sqlite3_step(stmt)) == SQLITE_ROW) {
+                auto row = std::make_unique<Row>();
+                Statement::GetRow(row.get(), stmt);
+                result.rows.emplace_back(std::move(row));
+            }
+        }
+        sqlite3_finalize(stmt);
+        if (baton->status != SQLITE_DONE) break;
+        baton->status = SQLITE_OK;
+
+        // sqlite3_changes() keeps the count of the last statement that
+        // changed rows, which this one may not be.
+        if (sqlite3_total_changes(handle) != total) {
+            result.changes = sqlite3_changes(handle);
+        }
+        result.lastID = sqlite3_last_insert_rowid(handle);
+        baton->results.emplace_back(std::move(result));
+    }
+    if (baton->status != SQLITE_OK && baton->message.empty()) {
+        baton->message = std::string(sqlite3_errmsg(handle));
+    }
+
+    sqlite3_mutex_leave(mtx);
+}
+
+void Database::Work_AfterQuery(napi_env e, napi_status status, void* data) {
+    std::unique_ptr<QueryBaton> baton(static_cast<QueryBaton*>(data));
+    auto* db = baton->db;
+    db->pending--;
+
+    auto env = db->Env();
+    Napi::HandleScope scope(env);
+
+    Napi::Function cb = baton->callback.Value();
+    if (baton->status != SQLITE_OK) {
+        EXCEPTION(Napi::String::New(env, baton->message.c_str()), baton->status, exception);
+
+        if (IS_FUNCTION(cb)) {
+            Napi::Value argv[] = { exception };
+            TRY_CATCH_CALL(db->Value(), cb, 1, argv);
+        }
+        else {
+            Napi::Value info[] = { Napi::String::New(env, "error"), exception };
+            EMIT_EVENT(db->Value(), 2, info);
+        }
+    }
+    else if (IS_FUNCTION(cb)) {
+        auto results = Napi::Array::New(env, baton->results.size());
+        for (size_t i = 0; i < baton->results.size(); i++) {
+            auto& result = baton->results[i];
+            auto rows = Napi::Array::New(env, result.rows.size());
+            for (size_t j = 0; j < result.rows.size(); j++) {
+                rows.Set(j, Statement::RowToJS(env, result.rows[j].get()));
+            }
+            auto object = Napi::Object::New(env);
+            object.Set("rows", rows);
+            object.Set("changes", Napi::Number::New(env, static_cast<double>(result.changes)));
+            object.Set("lastID", Napi::Number::New(env, static_cast<double>(result.lastID)));
+            results.Set(i, object);
+        }
+        Napi::Value argv[] = { env.Null(), results };
+        TRY_CATCH_CALL(db->Value(), cb, 2, argv);
+    }
+
+    db->Process();
+}
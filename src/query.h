@@ -0,0 +1,35 @@
+#ifndef NODE_SQLITE3_SRC_QUERY_H
+#define NODE_SQLITE3_SRC_QUERY_H
+
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+#include <napi.h>
+
+#include "database.h"
+#include "statement.h"
+
+namespace node_sqlite3 {
+
+// Database#query runs all statements of its SQL in one piece of work and
+// calls back with one result for each of them.
+struct QueryBaton : Database::Baton {
+    struct Result {
+        Rows rows;
+        sqlite3_int64 changes = 0;
+        sqlite3_int64 lastID = 0;
+    };
+
+    std::string sql;
+    Parameters parameters;
+    std::vector<Result> results;
+
+    QueryBaton(Database* db_, Napi::Function cb_) :
+        Baton(db_, cb_) {}
+    virtual ~QueryBaton() override = default;
+};
+
+}
+
+#endif
@@ -0,0 +1,209 @@
+#include <cstring>
+#include <napi.h>
+#include "macros.h"
+#include "database.h"
+#include "statement.h"
+#include "query_cache.h"
+
+using namespace node_sqlite3;
+
+static void AppendValue(std::string& key, const void* data, size_t size) {
+    key.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    key.append(static_cast<const char*>(data), size);
+}
+
+std::string QueryCache::Key(const std::string& sql, const Parameters& parameters) {
+    std::string key;
+    AppendValue(key, sql.data(), sql.size());
+    for (auto& field : parameters) {
+        if (!field) {
+            key += 'u';
+            continue;
+        }
+        if (field->index) {
+            key += '#';
+            key.append(reinterpret_cast<const char*>(&field->index), sizeof(field->index));
+        }
+        else {
+            key += '$';
+            AppendValue(key, field->name.data(), field->name.size());
+        }
+        AppendField(key, field.get());
+    }
+    return key;
+}
+
+void QueryCache::AppendField(std::string& key, const Values::Field* field) {
+    switch (field->type) {
+        case SQLITE_INTEGER: {
+            key += 'i';
+            int64_t value = static_cast<const Values::Integer*>(field)->value;
+            key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        } break;
+        case SQLITE_FLOAT: {
+            key += 'f';
+            double value = static_cast<const Values::Float*>(field)->value;
+            key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        } break;
+        case SQLITE_TEXT: {
+            key += 't';
+            auto& value = static_cast<const Values::Text*>(field)->value;
+            AppendValue(key, value.data(), value.size());
+        } break;
+        case SQLITE_BLOB: {
+            key += 'b';
+            auto* blob = static_cast<const Values::Blob*>(field);
+            AppendValue(key, blob->value, blob->length);
+        } break;
+        default: {
+            key += 'n';
+        } break;
+    }
+}
+
+std::shared_ptr<const Rows> QueryCache::Get(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    order.splice(order.begin(), order, it->second.position);
+    return it->second.rows;
+}
+
+void QueryCache::Put(const std::string& key, std::shared_ptr<const Rows> rows,
+                     const std::set<Table>& read, uint64_t since) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (since != version || dirty_schema || !capacity) return;
+    for (auto& table : read) {
+        if (dirty.count(table)) return;
+    }
+
+    auto it = entries.find(key);
+    if (it != entries.end()) Erase(it);
+
+    order.push_front(key);
+    Entry& entry = entries[key];
+    entry.rows = std::move(rows);
+    entry.tables = read;
+    entry.position = order.begin();
+    for (auto& table : read) {
+        tables[table].insert(key);
+    }
+
+    while (entries.size() > capacity) {
+        Erase(entries.find(order.back()));
+    }
+}
+
+uint64_t QueryCache::Version() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return version;
+}
+
+QueryCache::Stats QueryCache::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.entries = entries.size();
+    return stats;
+}
+
+void QueryCache::SetCapacity(size_t capacity_) {
+    std::lock_guard<std::mutex> lock(mutex);
+    capacity = capacity_;
+    while (entries.size() > capacity) {
+        Erase(entries.find(order.back()));
+    }
+}
+
+void QueryCache::Flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    Clear();
+}
+
+void QueryCache::Changed(const Table& table) {
+    std::lock_guard<std::mutex> lock(mutex);
+    dirty.insert(table);
+    Invalidate(table);
+}
+
+void QueryCache::SchemaChanged() {
+    std::lock_guard<std::mutex> lock(mutex);
+    dirty_schema = true;
+    Clear();
+}
+
+void QueryCache::TransactionEnded() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (dirty_schema) {
+        Clear();
+    }
+    else {
+        for (auto& table : dirty) Invalidate(table);
+    }
+    dirty.clear();
+    dirty_schema = false;
+}
+
+void QueryCache::Invalidate(const Table& table) {
+    version++;
+    auto it = tables.find(table);
+    if (it == tables.end()) return;
+    std::set<std::string> keys = std::move(it->second);
+    tables.erase(it);
+    for (auto& key : keys) {
+        auto entry = entries.find(key);
+        if (entry != entries.end()) Erase(entry);
+    }
+}
+
+void QueryCache::Erase(std::unordered_map<std::string, Entry>::iterator it) {
+    for (auto& table : it->second.tables) {
+        auto keys = tables.find(table);
+        if (keys == tables.end()) continue;
+        keys->second.erase(it->first);
+        if (keys->second.empty()) tables.erase(keys);
+    }
+    order.erase(it->second.position);
+    entries.erase(it);
+}
+
+void QueryCache::Clear() {
+    version++;
+    entries.clear();
+    order.clear();
+    tables.clear();
+}
+
+bool QueryCache::Cacheable(sqlite3* handle, const ReadSet& reads) {
+    if (!reads.deterministic || reads.tables.empty()) return false;
+
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(handle,
+            "SELECT type = 'table' AND NOT wr FROM pragma_table_list "
+            "WHERE schema = ?1 AND name = ?2", -1, &stmt, NULL) != SQLITE_OK) {
+        // pragma_table_list needs SQLite 3.37.
+        return false;
+    }
+
+    bool cacheable = true;
+    for (auto& table : reads.tables) {
+        // SQLite changes sqlite_sequence and sqlite_stat* without calling
+        // the update hook.
+        if (table.second.compare(0, 7, "sqlite_") == 0) {
+            cacheable = false;
+            break;
+        }
+        sqlite3_bind_text(stmt, 1, table.first.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, table.second.c_str(), -1, SQLITE_STATIC);
+        cacheable = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0);
+        sqlite3_reset(stmt);
+        if (!cacheable) break;
+    }
+    sqlite3_finalize(stmt);
+    return cacheable;
+}
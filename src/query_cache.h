@@ -0,0 +1,102 @@
+#ifndef NODE_SQLITE3_SRC_QUERY_CACHE_H
+#define NODE_SQLITE3_SRC_QUERY_CACHE_H
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "statement.h"
+
+namespace node_sqlite3 {
+
+/**
+ *
+ * Results of read-only queries, by SQL and bound parameters, so that
+ * Database#all can answer repeated queries without going to the thread pool.
+ * See configure("queryCache").
+ *
+ * Each entry knows the tables it was read from, which the authorizer records
+ * when the statement is prepared. The update hook drops the entries of a table
+ * as soon as a row of it changes, and the commit and rollback hooks drop them
+ * again once the transaction is over, since a result read in the middle of it
+ * may have seen changes that were rolled back afterwards.
+ *
+ * The hooks run in the thread pool, so the cache has a lock of its own.
+ *
+ */
+class QueryCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t entries = 0;
+    };
+
+    explicit QueryCache(size_t capacity_) : capacity(capacity_) {}
+
+    static std::string Key(const std::string& sql, const Parameters& parameters);
+    // Appends the type and value of a field to a key.
+    static void AppendField(std::string& key, const Values::Field* field);
+
+    // Returns the rows stored for key, or NULL.
+    std::shared_ptr<const Rows> Get(const std::string& key);
+
+    // Stores rows unless one of the tables changed since version was taken,
+    // or is changed by a transaction that is still open.
+    void Put(const std::string& key, std::shared_ptr<const Rows> rows,
+             const std::set<Table>& tables, uint64_t version);
+
+    uint64_t Version();
+    Stats GetStats();
+    void SetCapacity(size_t capacity);
+
+    // Drops everything, e.g. when the contents of a schema were replaced.
+    void Flush();
+
+    // Called from the hooks.
+    void Changed(const Table& table);
+    void SchemaChanged();
+    void TransactionEnded();
+
+    // Whether the results of a statement with these reads can be cached.
+    // Only plain rowid tables are, since the update hook doesn't see changes
+    // to virtual or WITHOUT ROWID tables.
+    static bool Cacheable(sqlite3* handle, const ReadSet& reads);
+
+protected:
+    struct Entry {
+        std::shared_ptr<const Rows> rows;
+        std::set<Table> tables;
+        std::list<std::string>::iterator position;
+    };
+
+    void Invalidate(const Table& table);
+    void Erase(std::unordered_map<std::string, Entry>::iterator it);
+    void Clear();
+
+    std::mutex mutex;
+    size_t capacity;
+    uint64_t version = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    std::unordered_map<std::string, Entry> entries;
+    // Keys of the entries, most recently used first.
+    std::list<std::string> order;
+    std::map<Table, std::set<std::string> > tables;
+
+    // Tables changed by the transaction that is open, if any.
+    std::set<Table> dirty;
+    bool dirty_schema = false;
+};
+
+}
+
+#endif
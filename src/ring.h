@@ -0,0 +1,130 @@
+#ifndef NODE_SQLITE3_SRC_RING_H
+#define NODE_SQLITE3_SRC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include <uv.h>
+
+#include "threading.h"
+
+// Bounded lock-free single-producer/single-consumer queue used to hand items
+// from a thread pool thread over to the main thread.
+//
+// The fast path is a fixed size ring. If the consumer falls so far behind that
+// the ring fills up, the producer spills into a mutex protected overflow list
+// rather than blocking, so items are never dropped and the producer never
+// waits on JavaScript. Once something has spilled, all further items go to
+// the overflow list until the consumer has picked it up, which keeps items in
+// the order they were pushed.
+//
+// Only one thread may push at a time. Hooks that are invoked by SQLite are
+// serialized by the connection, so this holds even though the producing
+// thread may change from one call to the next.
+template <class T, size_t Capacity = 1024> class Ring {
+    static_assert((Capacity & (Capacity - 1)) == 0,
+        "Ring capacity must be a power of two");
+
+public:
+    Ring() {
+        NODE_SQLITE3_MUTEX_INIT
+    }
+
+    ~Ring() {
+        NODE_SQLITE3_MUTEX_DESTROY
+    }
+
+    // Called on the producer thread. Returns true when the consumer needs to
+    // be woken up; it stays false until the consumer has called acknowledge(),
+    // so a burst of items results in a single signal.
+    bool push(T&& item) {
+        if (overflowed.load(std::memory_order_acquire) || !enqueue(item)) {
+            NODE_SQLITE3_MUTEX_LOCK(&mutex)
+            overflow.emplace_back(std::move(item));
+            overflowed.store(true, std::memory_order_release);
+            NODE_SQLITE3_MUTEX_UNLOCK(&mutex)
+        }
+        return !signaled.exchange(true, std::memory_order_acq_rel);
+    }
+
+    // Called on the consumer thread before draining, so that items pushed from
+    // now on signal the consumer again.
+    void acknowledge() {
+        signaled.exchange(false, std::memory_order_acq_rel);
+    }
+
+    // Called on the consumer thread. Returns false when there is nothing left.
+    bool pop(T& item) {
+        if (spill_pos < spill.size()) {
+            // Items that made it into the ring before the producer started
+            // spilling are older than anything in the spill list.
+            if (head.load(std::memory_order_relaxed) != spill_head) {
+                return dequeue(item);
+            }
+            item = std::move(spill[spill_pos++]);
+            return true;
+        }
+        if (dequeue(item)) {
+            return true;
+        }
+        if (!overflowed.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        spill.clear();
+        spill_pos = 0;
+        NODE_SQLITE3_MUTEX_LOCK(&mutex)
+        spill.swap(overflow);
+        // The producer doesn't touch the ring while the overflow flag is set,
+        // so this is where the spilled items fit in.
+        spill_head = tail.load(std::memory_order_acquire);
+        overflowed.store(false, std::memory_order_release);
+        NODE_SQLITE3_MUTEX_UNLOCK(&mutex)
+
+        return pop(item);
+    }
+
+private:
+    bool enqueue(T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head_cache == Capacity) {
+            head_cache = head.load(std::memory_order_acquire);
+            if (t - head_cache == Capacity) return false;
+        }
+        slots[t & (Capacity - 1)] = std::move(item);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool dequeue(T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail_cache) {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (h == tail_cache) return false;
+        }
+        item = std::move(slots[h & (Capacity - 1)]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side.
+    alignas(64) std::atomic<size_t> head{0};
+    size_t tail_cache = 0;
+    std::vector<T> spill;
+    size_t spill_pos = 0;
+    size_t spill_head = 0;
+
+    // Producer side.
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t head_cache = 0;
+
+    alignas(64) std::atomic<bool> overflowed{false};
+    std::atomic<bool> signaled{false};
+    NODE_SQLITE3_MUTEX_t
+    std::vector<T> overflow;
+
+    T slots[Capacity];
+};
+
+#endif
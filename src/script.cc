@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cstring>
+
+#include "script.h"
+
+using namespace node_sqlite3;
+
+ScriptReader::ScriptReader(uv_loop_t* loop_, uv_file fd_) :
+        loop(loop_), fd(fd_) {}
+
+bool ScriptReader::Fill() {
+    while (position >= complete) {
+        if (status != SQLITE_OK) return false;
+        if (eof) {
+            if (position >= end) return false;
+            // The last statement doesn't need a semicolon.
+            complete = end;
+            break;
+        }
+        if (!Read()) return false;
+        Split();
+    }
+    return true;
+}
+
+void ScriptReader::Consume(const char* to) {
+    size_t length = to - Data();
+    line += std::count(Data(), to, '\n');
+    bytes += length;
+    position += length;
+}
+
+bool ScriptReader::Read() {
+    if (position > 0) {
+        memmove(&buffer[0], &buffer[position], end - position);
+        end -= position;
+        scanned -= position;
+        complete = 0;
+        position = 0;
+    }
+    // Statements that don't fit make the buffer grow. One byte is kept free
+    // for terminating the text.
+    if (end + 1 >= buffer.size()) {
+        buffer.resize(buffer.empty() ? 1 << 20 : buffer.size() * 2);
+    }
+
+    uv_fs_t req;
+    uv_buf_t buf = uv_buf_init(&buffer[end], static_cast<unsigned int>(buffer.size() - end - 1));
+    int result = uv_fs_read(loop, &req, fd, &buf, 1, -1, NULL);
+    uv_fs_req_cleanup(&req);
+    if (result < 0) {
+        status = SQLITE_IOERR;
+        message = std::string("Could not read: ") + uv_strerror(result);
+        return false;
+    }
+    if (result == 0) eof = true;
+    end += result;
+
+    if (!started && (end >= 3 || eof)) {
+        started = true;
+        // Skip the byte order mark that some programs write.
+        if (end >= 3 && memcmp(&buffer[0], "\xEF\xBB\xBF", 3) == 0) {
+            position = complete = scanned = 3;
+            bytes += 3;
+        }
+    }
+    return true;
+}
+
+void ScriptReader::Split() {
+    while (scanned < end) {
+        char c = buffer[scanned];
+        switch (lexer) {
+            case MINUS:
+            case SLASH: {
+                if (c == (lexer == MINUS ? '-' : '*')) {
+                    lexer = lexer == MINUS ? LINE_COMMENT : BLOCK_COMMENT;
+                    break;
+                }
+                // Not a comment after all; the character is looked at again.
+                lexer = NORMAL;
+                continue;
+            }
+            case LINE_COMMENT: {
+                if (c == '\n') lexer = NORMAL;
+            } break;
+            case BLOCK_COMMENT: {
+                if (c == '*') lexer = BLOCK_STAR;
+            } break;
+            case BLOCK_STAR: {
+                if (c == '/') lexer = NORMAL;
+                else if (c != '*') lexer = BLOCK_COMMENT;
+            } break;
+            case QUOTED: {
+                // A doubled quote ends the string and starts it again.
+                if (c == quote) lexer = NORMAL;
+            } break;
+            case NORMAL: {
+                if (c == '\'' || c == '"' || c == '`') {
+                    quote = c;
+                    lexer = QUOTED;
+                }
+                else if (c == '[') {
+                    quote = ']';
+                    lexer = QUOTED;
+                }
+                else if (c == '-') lexer = MINUS;
+                else if (c == '/') lexer = SLASH;
+                else if (c == ';') {
+                    // The buffer always has a byte left after the text.
+                    char saved = buffer[scanned + 1];
+                    buffer[scanned + 1] = '\0';
+                    if (sqlite3_complete(&buffer[complete])) complete = scanned + 1;
+                    buffer[scanned + 1] = saved;
+                }
+            } break;
+        }
+        scanned++;
+    }
+}
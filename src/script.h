@@ -0,0 +1,72 @@
+#ifndef NODE_SQLITE3_SRC_SCRIPT_H
+#define NODE_SQLITE3_SRC_SCRIPT_H
+
+#include <string>
+
+#include <sqlite3.h>
+#include <uv.h>
+
+namespace node_sqlite3 {
+
+/**
+ *
+ * Reads an SQL script for Database#execFile a piece at a time, on the
+ * thread pool, so that a dump doesn't have to fit into memory.
+ *
+ * The file is read in large pieces into one buffer, which is scanned once,
+ * front to back, for semicolons outside of strings and comments. The scan
+ * state is kept between reads. sqlite3_complete() decides whether the text
+ * up to such a semicolon ends a statement, which it doesn't inside a
+ * trigger, so that only complete statements are handed out and the rest
+ * waits for more of the file. The text after the last statement is handed
+ * out as it is, like sqlite3_exec() runs a last statement without a
+ * semicolon.
+ *
+ */
+class ScriptReader {
+public:
+    ScriptReader(uv_loop_t* loop, uv_file fd);
+
+    // Makes sure that there is text to run. Returns false at the end of the
+    // file, or on an error, which sets the status and the message.
+    bool Fill();
+
+    // Text of complete statements, up to the end of the last one.
+    const char* Data() const { return buffer.data() + position; }
+    size_t Size() const { return complete - position; }
+    // Marks the text up to this point as run.
+    void Consume(const char* to);
+
+    int status = SQLITE_OK;
+    std::string message;
+    // Line of the text that is next to run, counting from 1.
+    uint64_t line = 1;
+    // Bytes of the file that were run.
+    uint64_t bytes = 0;
+
+protected:
+    bool Read();
+    void Split();
+
+    enum Lexer { NORMAL, MINUS, SLASH, LINE_COMMENT, BLOCK_COMMENT, BLOCK_STAR, QUOTED };
+
+    uv_loop_t* loop;
+    uv_file fd;
+
+    std::string buffer;
+    size_t position = 0;
+    // End of the complete statements.
+    size_t complete = 0;
+    // End of the text that was scanned for semicolons.
+    size_t scanned = 0;
+    size_t end = 0;
+    Lexer lexer = NORMAL;
+    // Closing quote while in a string or quoted identifier.
+    char quote = 0;
+    bool eof = false;
+    bool started = false;
+};
+
+}
+
+#endif
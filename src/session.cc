@@ -0,0 +1,302 @@
+#include <napi.h>
+#include "macros.h"
+#include "database.h"
+#include "session.h"
+
+using namespace node_sqlite3;
+
+#ifdef NODE_SQLITE3_HAVE_SESSION
+
+Napi::Object Session::Init(Napi::Env env, Napi::Object exports) {
+    Napi::HandleScope scope(env);
+
+    // declare napi_default_method here as it is only available in Node v14.12.0+
+    auto napi_default_method = static_cast<napi_property_attributes>(napi_writable | napi_configurable);
+
+    auto t = DefineClass(env, "Session", {
+        InstanceMethod("attach", &Session::Attach, napi_default_method),
+        InstanceMethod("changeset", &Session::Changeset, napi_default_method),
+        InstanceMethod("patchset", &Session::Patchset, napi_default_method),
+        InstanceMethod("close", &Session::Close, napi_default_method),
+    });
+
+    exports.Set("Session", t);
+    return exports;
+}
+
+// new Session(db, [schema], [callback])
+Session::Session(const Napi::CallbackInfo& info) : Napi::ObjectWrap<Session>(info) {
+    auto env = info.Env();
+    if (!info.IsConstructCall()) {
+        Napi::TypeError::New(env, "Use the new operator to create new Session objects").ThrowAsJavaScriptException();
+        return;
+    }
+
+    auto length = info.Length();
+
+    if (length <= 0 || !Database::HasInstance(info[0])) {
+        Napi::TypeError::New(env, "Database object expected").ThrowAsJavaScriptException();
+        return;
+    }
+    else if (length > 1 && !info[1].IsUndefined() && !info[1].IsString()) {
+        Napi::TypeError::New(env, "Database name expected").ThrowAsJavaScriptException();
+        return;
+    }
+    else if (length > 2 && !info[2].IsUndefined() && !info[2].IsFunction()) {
+        Napi::TypeError::New(env, "Callback expected").ThrowAsJavaScriptException();
+        return;
+    }
+
+    this->db = Napi::ObjectWrap<Database>::Unwrap(info[0].As<Napi::Object>());
+    this->db->Ref();
+
+    std::string schema = length > 1 && info[1].IsString() ?
+        info[1].As<Napi::String>().Utf8Value() : "main";
+    info.This().As<Napi::Object>().DefineProperty(
+        Napi::PropertyDescriptor::Value("schema", Napi::String::New(env, schema)));
+
+    auto* baton = new CreateBaton(db, info[2].As<Napi::Function>(), this, schema);
+    db->Schedule(Work_BeginCreate, baton, true);
+}
+
+void Session::Delete(bool lock) {
+    if (!_handle) return;
+    auto* mtx = lock && db->_handle ? db->GetMutex() : NULL;
+    sqlite3_mutex_enter(mtx);
+    sqlite3session_delete(_handle);
+    _handle = NULL;
+    sqlite3_mutex_leave(mtx);
+    db->sessions.erase(this);
+}
+
+// Session calls take turns with the other calls on the database, so that
+// changes are recorded, and changesets taken, exactly where they were
+// requested.
+Napi::Value Session::Schedule(const Napi::CallbackInfo& info, Baton* baton,
+                              Database::Work_Callback begin) {
+    db->Schedule(begin, baton, true);
+    return info.This();
+}
+
+#define SESSION_BEGIN(type, after)                                             \
+    assert(baton->db->locked);                                                 \
+    assert(baton->db->open);                                                   \
+    assert(baton->db->_handle);                                                \
+    assert(baton->db->pending == 0);                                           \
+    baton->db->pending++;                                                      \
+    auto env = baton->db->Env();                                               \
+    CREATE_WORK("sqlite3.Session."#type, Work_##type, after);
+
+// Fails calls on a session that was closed, or never opened.
+#define SESSION_REQUIRE_OPEN()                                                 \
+    if (!session->_handle) {                                                   \
+        baton->status = SQLITE_MISUSE;                                         \
+        baton->message = "Session is closed";                                  \
+        return;                                                                \
+    }
+
+void Session::Work_BeginCreate(Database::Baton* baton) {
+    SESSION_BEGIN(Create, Work_After);
+}
+
+void Session::Work_Create(napi_env e, void* data) {
+    auto* baton = static_cast<CreateBaton*>(data);
+    auto* handle = baton->db->_handle;
+
+    sqlite3_mutex* mtx = baton->db->GetMutex();
+    sqlite3_mutex_enter(mtx);
+
+    baton->status = sqlite3session_create(handle, baton->schema.c_str(), &baton->session->_handle);
+    if (baton->status != SQLITE_OK) {
+        baton->message = std::string(sqlite3_errmsg(handle));
+    }
+
+    sqlite3_mutex_leave(mtx);
+}
+
+// Session#attach([table], [callback])
+// Records changes to the given table, or to all tables when none is given.
+Napi::Value Session::Attach(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+
+    int pos = 0;
+    std::string table;
+    bool all = true;
+    if (info.Length() > 0 && (info[0].IsString() || info[0].IsNull())) {
+        if (info[0].IsString()) {
+            table = info[0].As<Napi::String>().Utf8Value();
+            all = false;
+        }
+        pos++;
+    }
+    OPTIONAL_ARGUMENT_FUNCTION(pos, callback);
+
+    return Schedule(info, new AttachBaton(db, callback, this, table, all), Work_BeginAttach);
+}
+
+void Session::Work_BeginAttach(Database::Baton* baton) {
+    SESSION_BEGIN(Attach, Work_After);
+}
+
+void Session::Work_Attach(napi_env e, void* data) {
+    auto* baton = static_cast<AttachBaton*>(data);
+    auto* session = baton->session;
+    SESSION_REQUIRE_OPEN();
+
+    sqlite3_mutex* mtx = baton->db->GetMutex();
+    sqlite3_mutex_enter(mtx);
+
+    baton->status = sqlite3session_attach(session->_handle,
+        baton->all ? NULL : baton->table.c_str());
+    if (baton->status != SQLITE_OK) {
+        baton->message = std::string(sqlite3_errstr(baton->status));
+    }
+
+    sqlite3_mutex_leave(mtx);
+}
+
+// Session#changeset([callback])
+Napi::Value Session::Changeset(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+    OPTIONAL_ARGUMENT_FUNCTION(0, callback);
+    return Schedule(info, new ChangesetBaton(db, callback, this, false), Work_BeginChangeset);
+}
+
+// Session#patchset([callback])
+// Like a changeset, but without the original values of updated and deleted
+// rows, which makes it smaller but unable to detect some conflicts.
+Napi::Value Session::Patchset(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+    OPTIONAL_ARGUMENT_FUNCTION(0, callback);
+    return Schedule(info, new ChangesetBaton(db, callback, this, true), Work_BeginChangeset);
+}
+
+void Session::Work_BeginChangeset(Database::Baton* baton) {
+    SESSION_BEGIN(Changeset, Work_AfterChangeset);
+}
+
+void Session::Work_Changeset(napi_env e, void* data) {
+    auto* baton = static_cast<ChangesetBaton*>(data);
+    auto* session = baton->session;
+    SESSION_REQUIRE_OPEN();
+
+    sqlite3_mutex* mtx = baton->db->GetMutex();
+    sqlite3_mutex_enter(mtx);
+
+    if (baton->patchset) {
+        baton->status = sqlite3session_patchset(session->_handle, &baton->size, &baton->data);
+    }
+    else {
+        baton->status = sqlite3session_changeset(session->_handle, &baton->size, &baton->data);
+    }
+    if (baton->status != SQLITE_OK) {
+        baton->message = std::string(sqlite3_errmsg(baton->db->_handle));
+    }
+
+    sqlite3_mutex_leave(mtx);
+}
+
+void Session::Work_AfterChangeset(napi_env e, napi_status status, void* data) {
+    std::unique_ptr<ChangesetBaton> baton(static_cast<ChangesetBaton*>(data));
+    auto* session = baton->session;
+    auto* db = baton->db;
+    db->pending--;
+
+    auto env = session->Env();
+    Napi::HandleScope scope(env);
+
+    if (baton->status != SQLITE_OK) {
+        Error(baton.get());
+    }
+    else {
+        Napi::Function cb = baton->callback.Value();
+        if (IS_FUNCTION(cb)) {
+            Napi::Value buffer;
+            if (baton->data) {
+                // Hand the changeset over to the Buffer instead of copying it.
+                buffer = Napi::Buffer<unsigned char>::New(env,
+                    static_cast<unsigned char*>(baton->data), baton->size,
+                    [](Napi::Env, unsigned char* data) { sqlite3_free(data); });
+                baton->data = NULL;
+            }
+            else {
+                buffer = Napi::Buffer<unsigned char>::New(env, 0);
+            }
+            Napi::Value argv[] = { env.Null(), buffer };
+            TRY_CATCH_CALL(session->Value(), cb, 2, argv);
+        }
+    }
+
+    db->Process();
+}
+
+// Session#close([callback])
+Napi::Value Session::Close(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+    OPTIONAL_ARGUMENT_FUNCTION(0, callback);
+    return Schedule(info, new Baton(db, callback, this), Work_BeginClose);
+}
+
+void Session::Work_BeginClose(Database::Baton* baton) {
+    SESSION_BEGIN(Close, Work_After);
+}
+
+void Session::Work_Close(napi_env e, void* data) {
+    auto* baton = static_cast<Baton*>(data);
+    auto* session = baton->session;
+    SESSION_REQUIRE_OPEN();
+
+    sqlite3_mutex* mtx = baton->db->GetMutex();
+    sqlite3_mutex_enter(mtx);
+    sqlite3session_delete(session->_handle);
+    session->_handle = NULL;
+    sqlite3_mutex_leave(mtx);
+}
+
+void Session::Work_After(napi_env e, napi_status status, void* data) {
+    std::unique_ptr<Baton> baton(static_cast<Baton*>(data));
+    auto* session = baton->session;
+    auto* db = baton->db;
+    db->pending--;
+
+    auto env = session->Env();
+    Napi::HandleScope scope(env);
+
+    // The database has to know about live sessions to delete them before it
+    // closes the connection.
+    if (session->_handle) db->sessions.insert(session);
+    else db->sessions.erase(session);
+
+    if (baton->status != SQLITE_OK) {
+        Error(baton.get());
+    }
+    else {
+        Napi::Function cb = baton->callback.Value();
+        if (IS_FUNCTION(cb)) {
+            Napi::Value argv[] = { env.Null() };
+            TRY_CATCH_CALL(session->Value(), cb, 1, argv);
+        }
+    }
+
+    db->Process();
+}
+
+void Session::Error(Baton* baton) {
+    auto* session = baton->session;
+    auto env = session->Env();
+    Napi::HandleScope scope(env);
+
+    EXCEPTION(Napi::String::New(env, baton->message.c_str()), baton->status, exception);
+
+    Napi::Function cb = baton->callback.Value();
+    if (IS_FUNCTION(cb)) {
+        Napi::Value argv[] = { exception };
+        TRY_CATCH_CALL(session->Value(), cb, 1, argv);
+    }
+    else {
+        Napi::Value argv[] = { Napi::String::New(env, "error"), exception };
+        EMIT_EVENT(session->Value(), 2, argv);
+    }
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef NODE_SQLITE3_SRC_SESSION_H
+#define NODE_SQLITE3_SRC_SESSION_H
+
+#include "database.h"
+
+#include <string>
+
+#include <sqlite3.h>
+#include <napi.h>
+
+#if defined(SQLITE_ENABLE_SESSION) && defined(SQLITE_ENABLE_PREUPDATE_HOOK)
+#define NODE_SQLITE3_HAVE_SESSION
+#endif
+
+using namespace Napi;
+
+namespace node_sqlite3 {
+
+#ifdef NODE_SQLITE3_HAVE_SESSION
+
+/**
+ *
+ * A class for managing an sqlite3_session object, which records the
+ * changes made to the tables of a database so they can be applied to
+ * another copy of it.
+ *
+ * Intended usage from node:
+ *
+ *   var session = db.session();
+ *   session.attach();              // or session.attach('table')
+ *   db.run("UPDATE ...");
+ *   session.changeset(function(err, changes) {
+ *       other.applyChangeset(changes, 'replace', callback);
+ *   });
+ *
+ * Here is how sqlite's session api is exposed:
+ *
+ *   - `sqlite3session_create`: `db.session([schema], [callback])`.
+ *   - `sqlite3session_attach`: `session.attach([table], [callback])`.
+ *   - `sqlite3session_changeset`: `session.changeset([callback])`.
+ *   - `sqlite3session_patchset`: `session.patchset([callback])`.
+ *   - `sqlite3session_delete`: `session.close([callback])`.
+ *   - `sqlite3changeset_apply`: `db.applyChangeset(buffer, [policy], [callback])`.
+ *
+ * Changesets and patchsets are Buffers. They are produced on the thread
+ * pool, in the order the calls were made relative to the other calls on
+ * the database, and only take time proportional to the recorded changes.
+ * Only tables with a PRIMARY KEY are recorded.
+ *
+ * Closing the database closes its sessions.
+ *
+ */
+class Session : public Napi::ObjectWrap<Session> {
+public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+    struct Baton : Database::Baton {
+        Session* session;
+        Baton(Database* db_, Napi::Function cb_, Session* session_) :
+            Database::Baton(db_, cb_), session(session_) {
+            session->Ref();
+        }
+        virtual ~Baton() override {
+            session->Unref();
+        }
+    };
+
+    struct CreateBaton : Baton {
+        std::string schema;
+        CreateBaton(Database* db_, Napi::Function cb_, Session* session_, std::string schema_) :
+            Baton(db_, cb_, session_), schema(std::move(schema_)) {}
+        virtual ~CreateBaton() override = default;
+    };
+
+    struct AttachBaton : Baton {
+        std::string table;
+        bool all;
+        AttachBaton(Database* db_, Napi::Function cb_, Session* session_, std::string table_, bool all_) :
+            Baton(db_, cb_, session_), table(std::move(table_)), all(all_) {}
+        virtual ~AttachBaton() override = default;
+    };
+
+    struct ChangesetBaton : Baton {
+        bool patchset;
+        int size = 0;
+        void* data = NULL;
+        ChangesetBaton(Database* db_, Napi::Function cb_, Session* session_, bool patchset_) :
+            Baton(db_, cb_, session_), patchset(patchset_) {}
+        virtual ~ChangesetBaton() override {
+            sqlite3_free(data);
+        }
+    };
+
+    Session(const Napi::CallbackInfo& info);
+
+    ~Session() {
+        Delete(true);
+        db->Unref();
+    }
+
+    // Deletes the sqlite3_session. Without lock, the caller makes sure that
+    // nothing else uses the connection.
+    void Delete(bool lock);
+
+    Napi::Value Attach(const Napi::CallbackInfo& info);
+    Napi::Value Changeset(const Napi::CallbackInfo& info);
+    Napi::Value Patchset(const Napi::CallbackInfo& info);
+    Napi::Value Close(const Napi::CallbackInfo& info);
+
+protected:
+    Napi::Value Schedule(const Napi::CallbackInfo& info, Baton* baton,
+        Database::Work_Callback begin);
+
+    static void Work_BeginCreate(Database::Baton* baton);
+    static void Work_Create(napi_env env, void* data);
+    static void Work_BeginAttach(Database::Baton* baton);
+    static void Work_Attach(napi_env env, void* data);
+    static void Work_BeginChangeset(Database::Baton* baton);
+    static void Work_Changeset(napi_env env, void* data);
+    static void Work_AfterChangeset(napi_env env, napi_status status, void* data);
+    static void Work_BeginClose(Database::Baton* baton);
+    static void Work_Close(napi_env env, void* data);
+
+    // Shared by the calls that only report success or failure.
+    static void Work_After(napi_env env, napi_status status, void* data);
+    static void Error(Baton* baton);
+
+    Database* db;
+    sqlite3_session* _handle = NULL;
+};
+
+#endif
+
+}
+
+#endif
@@ -0,0 +1,372 @@
+#include <algorithm>
+#include <napi.h>
+#include "macros.h"
+#include "shard_set.h"
+
+using namespace node_sqlite3;
+
+Napi::Object ShardSet::Init(Napi::Env env, Napi::Object exports) {
+    Napi::HandleScope scope(env);
+
+    // declare napi_default_method here as it is only available in Node v14.12.0+
+    auto napi_default_method = static_cast<napi_property_attributes>(napi_writable | napi_configurable);
+
+    auto t = DefineClass(env, "ShardSet", {
+        InstanceMethod("all", &ShardSet::All, napi_default_method),
+        InstanceMethod("run", &ShardSet::Run, napi_default_method),
+        InstanceMethod("close", &ShardSet::Close, napi_default_method),
+        InstanceMethod("shardFor", &ShardSet::ShardFor, napi_default_method),
+        InstanceAccessor("length", &ShardSet::LengthGetter, nullptr),
+    });
+
+    exports.Set("ShardSet", t);
+    return exports;
+}
+
+// new ShardSet(filenames, [mode], [callback])
+ShardSet::ShardSet(const Napi::CallbackInfo& info) : Napi::ObjectWrap<ShardSet>(info) {
+    auto env = info.Env();
+    if (!info.IsConstructCall()) {
+        Napi::TypeError::New(env, "Use the new operator to create new ShardSet objects").ThrowAsJavaScriptException();
+        return;
+    }
+
+    if (info.Length() <= 0 || !info[0].IsArray() || info[0].As<Napi::Array>().Length() == 0) {
+        Napi::TypeError::New(env, "Array of filenames expected").ThrowAsJavaScriptException();
+        return;
+    }
+    auto filenames = info[0].As<Napi::Array>();
+
+    int pos = 1;
+    mode = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    if (info.Length() > pos && info[pos].IsNumber()) {
+        mode = info[pos].As<Napi::Number>().Int32Value();
+        pos++;
+    }
+    if (info.Length() > pos && !info[pos].IsUndefined() && !info[pos].IsFunction()) {
+        Napi::TypeError::New(env, "Callback expected").ThrowAsJavaScriptException();
+        return;
+    }
+    Napi::Function callback = info.Length() > pos ? info[pos].As<Napi::Function>() : Napi::Function();
+
+    shards.resize(filenames.Length());
+    std::vector<size_t> targets;
+    for (uint32_t i = 0; i < filenames.Length(); i++) {
+        Napi::Value filename = filenames.Get(i);
+        if (!filename.IsString()) {
+            Napi::TypeError::New(env, "Array of filenames expected").ThrowAsJavaScriptException();
+            return;
+        }
+        shards[i].filename = filename.As<Napi::String>().Utf8Value();
+        targets.push_back(i);
+    }
+
+    Dispatch(new Baton(this, callback, OPEN), targets);
+}
+
+ShardSet::~ShardSet() {
+    for (auto& shard : shards) {
+        for (auto& entry : shard.statements) sqlite3_finalize(entry.second);
+        sqlite3_close(shard.handle);
+    }
+}
+
+Napi::Value ShardSet::LengthGetter(const Napi::CallbackInfo& info) {
+    return Napi::Number::New(this->Env(), static_cast<double>(shards.size()));
+}
+
+// Picks a shard for a key with FNV-1a over its string value, so the same key
+// always maps to the same shard for as long as there are as many shards.
+size_t ShardSet::Hash(Napi::Value key) {
+    std::string text = key.ToString().Utf8Value();
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : text) {
+        hash = (hash ^ c) * 16777619u;
+    }
+    return hash % shards.size();
+}
+
+Napi::Value ShardSet::ShardFor(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+    REQUIRE_ARGUMENTS(1);
+    return Napi::Number::New(env, static_cast<double>(Hash(info[0])));
+}
+
+// ShardSet#all(sql, [{ params, shards, key, combine, orderBy }], [callback])
+Napi::Value ShardSet::All(const Napi::CallbackInfo& info) {
+    return Query(info, ALL);
+}
+
+// ShardSet#run(sql, [{ params, shards, key }], [callback])
+// The callback gets the number of rows changed on all shards together.
+Napi::Value ShardSet::Run(const Napi::CallbackInfo& info) {
+    return Query(info, RUN);
+}
+
+Napi::Value ShardSet::Query(const Napi::CallbackInfo& info, Type type) {
+    auto env = this->Env();
+
+    REQUIRE_ARGUMENT_STRING(0, sql);
+    int pos = 1;
+    Napi::Object options = Napi::Object::New(env);
+    if (info.Length() > 1 && info[1].IsObject() && !info[1].IsFunction()) {
+        options = info[1].As<Napi::Object>();
+        pos++;
+    }
+    OPTIONAL_ARGUMENT_FUNCTION(pos, callback);
+
+    std::vector<size_t> targets;
+    Napi::Value selected = options.Get("shards");
+    Napi::Value key = options.Get("key");
+    if (selected.IsArray()) {
+        auto array = selected.As<Napi::Array>();
+        for (uint32_t i = 0; i < array.Length(); i++) {
+            Napi::Value index = array.Get(i);
+            if (!index.IsNumber() || index.As<Napi::Number>().Int64Value() < 0 ||
+                    index.As<Napi::Number>().Int64Value() >= static_cast<int64_t>(shards.size())) {
+                Napi::RangeError::New(env, "Shard index out of range").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            targets.push_back(static_cast<size_t>(index.As<Napi::Number>().Int64Value()));
+        }
+    }
+    else if (key.IsArray()) {
+        auto array = key.As<Napi::Array>();
+        for (uint32_t i = 0; i < array.Length(); i++) {
+            targets.push_back(Hash(array.Get(i)));
+        }
+    }
+    else if (!key.IsUndefined()) {
+        targets.push_back(Hash(key));
+    }
+    else {
+        for (size_t i = 0; i < shards.size(); i++) targets.push_back(i);
+    }
+    // Each shard runs the query once, and in the order of the shards.
+    std::sort(targets.begin(), targets.end());
+    targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+
+    std::unique_ptr<Baton> baton(new Baton(this, callback, type));
+    baton->sql = sql;
+    if (type == ALL && !baton->combine.Parse(env, options.Get("combine"), options.Get("orderBy"))) {
+        return env.Null();
+    }
+    Statement::GetParameters(options.Get("params"), baton->parameters);
+
+    Dispatch(baton.release(), targets);
+    return info.This();
+}
+
+// ShardSet#close([callback])
+// Closes all shards once the calls that were made before are done. The set
+// only counts as closed when every shard closed; after an error, close()
+// can be called again.
+Napi::Value ShardSet::Close(const Napi::CallbackInfo& info) {
+    auto env = this->Env();
+    OPTIONAL_ARGUMENT_FUNCTION(0, callback);
+
+    std::vector<size_t> targets;
+    for (size_t i = 0; i < shards.size(); i++) targets.push_back(i);
+    Dispatch(new Baton(this, callback, CLOSE), targets);
+    return info.This();
+}
+
+void ShardSet::Dispatch(Baton* baton, const std::vector<size_t>& targets) {
+    auto env = this->Env();
+    Napi::HandleScope scope(env);
+
+    if (closed) {
+        baton->status = SQLITE_MISUSE;
+        baton->message = "ShardSet is closed";
+        return Finish(baton);
+    }
+    if (targets.empty()) {
+        return Finish(baton);
+    }
+
+    baton->results.resize(targets.size());
+    baton->remaining = targets.size();
+    for (size_t i = 0; i < targets.size(); i++) {
+        shards[targets[i]].queue.emplace(new Task(baton, targets[i], i));
+        Process(targets[i]);
+    }
+}
+
+void ShardSet::Process(size_t index) {
+    auto& shard = shards[index];
+    if (shard.running || shard.queue.empty()) return;
+
+    shard.running = std::move(shard.queue.front());
+    shard.queue.pop();
+
+    auto env = this->Env();
+    auto* task = shard.running.get();
+    napi_create_async_work(env, NULL, Napi::String::New(env, "sqlite3.ShardSet.Task"),
+        Work_Task, Work_AfterTask, task, &task->request);
+    napi_queue_async_work(env, task->request);
+}
+
+int ShardSet::Execute(Shard& shard, Task* task) {
+    auto* baton = task->baton;
+
+    if (baton->type == OPEN) {
+        // Only one task of a shard runs at a time.
+        int status = sqlite3_open_v2(shard.filename.c_str(), &shard.handle,
+            baton->set->mode | SQLITE_OPEN_NOMUTEX, NULL);
+        if (status != SQLITE_OK) {
+            task->message = std::string(sqlite3_errmsg(shard.handle));
+            sqlite3_close(shard.handle);
+            shard.handle = NULL;
+        }
+        return status;
+    }
+
+    // Closed by an earlier close() that failed on another shard.
+    if (baton->type == CLOSE && !shard.handle) {
+        return SQLITE_OK;
+    }
+
+    if (!shard.handle) {
+        task->message = "Shard " + shard.filename + " is not open";
+        return SQLITE_MISUSE;
+    }
+
+    if (baton->type == CLOSE) {
+        for (auto& entry : shard.statements) sqlite3_finalize(entry.second);
+        shard.statements.clear();
+        int status = sqlite3_close(shard.handle);
+        if (status != SQLITE_OK) {
+            task->message = std::string(sqlite3_errmsg(shard.handle));
+        }
+        else {
+            shard.handle = NULL;
+        }
+        return status;
+    }
+
+    sqlite3_stmt* stmt = NULL;
+    auto it = shard.statements.find(baton->sql);
+    if (it != shard.statements.end()) {
+        stmt = it->second;
+    }
+    else {
+        if (shard.statements.size() >= 64) {
+            for (auto& entry : shard.statements) sqlite3_finalize(entry.second);
+            shard.statements.clear();
+        }
+#if SQLITE_VERSION_NUMBER >= 3020000
+        int status = sqlite3_prepare_v3(shard.handle, baton->sql.c_str(), baton->sql.size(),
+            SQLITE_PREPARE_PERSISTENT, &stmt, NULL);
+#else
+        int status = sqlite3_prepare_v2(shard.handle, baton->sql.c_str(), baton->sql.size(),
+            &stmt, NULL);
+#endif
+        if (status != SQLITE_OK) {
+            task->message = std::string(sqlite3_errmsg(shard.handle));
+            sqlite3_finalize(stmt);
+            return status;
+        }
+        shard.statements[baton->sql] = stmt;
+    }
+
+    int status = Statement::BindParameters(stmt, baton->parameters);
+    if (status == SQLITE_OK) {
+        while ((status = sqlite3_step(stmt)) == SQLITE_ROW) {
+            if (baton->type == ALL) {
+                std::unique_ptr<Row> row(new Row());
+                Statement::GetRow(row.get(), stmt);
+                task->rows.push_back(std::move(row));
+            }
+        }
+        if (status == SQLITE_DONE) {
+            status = SQLITE_OK;
+            task->changes = sqlite3_changes(shard.handle);
+        }
+    }
+    if (status != SQLITE_OK) {
+        task->message = std::string(sqlite3_errmsg(shard.handle));
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return status;
+}
+
+void ShardSet::Work_Task(napi_env e, void* data) {
+    auto* task = static_cast<Task*>(data);
+    auto* set = task->baton->set;
+    task->status = Execute(set->shards[task->shard], task);
+}
+
+void ShardSet::Work_AfterTask(napi_env e, napi_status status, void* data) {
+    auto* task = static_cast<Task*>(data);
+    auto* baton = task->baton;
+    auto* set = baton->set;
+    auto env = set->Env();
+    Napi::HandleScope scope(env);
+
+    std::unique_ptr<Task> done(std::move(set->shards[task->shard].running));
+    napi_delete_async_work(env, task->request);
+    task->request = NULL;
+
+    if (baton->status == SQLITE_OK && task->status != SQLITE_OK) {
+        baton->status = task->status;
+        baton->message = task->message;
+    }
+    baton->results[task->slot] = std::move(task->rows);
+    baton->changes += task->changes;
+
+    set->Process(task->shard);
+    if (--baton->remaining == 0) {
+        Finish(baton);
+    }
+}
+
+void ShardSet::Finish(Baton* b) {
+    std::unique_ptr<Baton> baton(b);
+    auto* set = baton->set;
+    auto env = set->Env();
+    Napi::HandleScope scope(env);
+
+    if (baton->status == SQLITE_OK && baton->type == CLOSE) {
+        set->closed = true;
+    }
+
+    Rows rows;
+    if (baton->status == SQLITE_OK && baton->type == ALL &&
+            !baton->combine.Apply(baton->results, rows, baton->message)) {
+        baton->status = SQLITE_MISUSE;
+    }
+
+    Napi::Function cb = baton->callback.Value();
+    if (baton->status != SQLITE_OK) {
+        EXCEPTION(Napi::String::New(env, baton->message.c_str()), baton->status, exception);
+
+        if (IS_FUNCTION(cb)) {
+            Napi::Value argv[] = { exception };
+            TRY_CATCH_CALL(set->Value(), cb, 1, argv);
+        }
+        else {
+            Napi::Value argv[] = { Napi::String::New(env, "error"), exception };
+            EMIT_EVENT(set->Value(), 2, argv);
+        }
+    }
+    else if (IS_FUNCTION(cb)) {
+        Napi::Value result;
+        if (baton->type == ALL) {
+            auto array = Napi::Array::New(env, rows.size());
+            for (size_t i = 0; i < rows.size(); i++) {
+                array.Set(i, Statement::RowToJS(env, rows[i].get()));
+            }
+            result = array;
+        }
+        else if (baton->type == RUN) {
+            result = Napi::Number::New(env, static_cast<double>(baton->changes));
+        }
+        else {
+            result = env.Null();
+        }
+        int argc = baton->type == ALL || baton->type == RUN ? 2 : 1;
+        Napi::Value argv[] = { env.Null(), result };
+        TRY_CATCH_CALL(set->Value(), cb, argc, argv);
+    }
+}
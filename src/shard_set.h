@@ -0,0 +1,137 @@
+#ifndef NODE_SQLITE3_SRC_SHARD_SET_H
+#define NODE_SQLITE3_SRC_SHARD_SET_H
+
+#include <map>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+#include <napi.h>
+
+#include "statement.h"
+#include "parallel.h"
+
+using namespace Napi;
+
+namespace node_sqlite3 {
+
+/**
+ *
+ * A set of databases with the same schema that one logical database is
+ * split across, e.g. by tenant. Queries are sent to all shards, or to
+ * the ones picked by hashing keys, at the same time, and their results
+ * are put together natively.
+ *
+ * Intended usage from node:
+ *
+ *   var shards = new sqlite3.ShardSet(['a.db', 'b.db', 'c.db']);
+ *   shards.all("SELECT tenant, count(*) AS n FROM orders GROUP BY tenant",
+ *       { combine: { n: 'sum' }, orderBy: 'n DESC' }, callback);
+ *   shards.run("INSERT INTO orders VALUES (?, ?)",
+ *       { params: [tenant, total], key: tenant }, callback);
+ *
+ * Calls take `{ params, shards, key, combine, orderBy }`:
+ *
+ *   - `params` are bound to the statement like the parameters of
+ *     Statement#bind.
+ *   - `shards` is an array of the indexes of the shards to use, or `key`
+ *     a key or array of keys that are hashed to pick them (see
+ *     `shards.shardFor(key)`). By default all shards are used.
+ *   - `combine` and `orderBy` say how the results of the shards are put
+ *     together, the same way as for Database#parallelQuery.
+ *
+ * Each shard has a connection of its own that runs one call at a time, in
+ * the order they were made, and keeps the statements it prepared for the
+ * next calls with the same SQL.
+ *
+ */
+class ShardSet : public Napi::ObjectWrap<ShardSet> {
+public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+    enum Type { OPEN, ALL, RUN, CLOSE };
+
+    // One call, which is made up of one task per shard it uses.
+    struct Baton {
+        ShardSet* set;
+        Napi::FunctionReference callback;
+        Type type;
+        std::string sql;
+        Parameters parameters;
+        Parallel::Combine combine;
+
+        std::vector<Rows> results;
+        sqlite3_int64 changes = 0;
+        size_t remaining = 0;
+        int status = SQLITE_OK;
+        std::string message;
+
+        Baton(ShardSet* set_, Napi::Function cb_, Type type_) :
+                set(set_), type(type_) {
+            set->Ref();
+            if (!cb_.IsUndefined() && cb_.IsFunction()) {
+                callback.Reset(cb_, 1);
+            }
+        }
+        ~Baton() {
+            set->Unref();
+            callback.Reset();
+        }
+    };
+
+    struct Task {
+        Baton* baton;
+        size_t shard;
+        // Index of the results in the baton.
+        size_t slot;
+        napi_async_work request = NULL;
+        Rows rows;
+        int changes = 0;
+        int status = SQLITE_OK;
+        std::string message;
+
+        Task(Baton* baton_, size_t shard_, size_t slot_) :
+            baton(baton_), shard(shard_), slot(slot_) {}
+    };
+
+    struct Shard {
+        std::string filename;
+        sqlite3* handle = NULL;
+        // Prepared statements by SQL.
+        std::map<std::string, sqlite3_stmt*> statements;
+        std::queue<std::unique_ptr<Task> > queue;
+        std::unique_ptr<Task> running;
+    };
+
+    ShardSet(const Napi::CallbackInfo& info);
+
+    ~ShardSet();
+
+    Napi::Value All(const Napi::CallbackInfo& info);
+    Napi::Value Run(const Napi::CallbackInfo& info);
+    Napi::Value Close(const Napi::CallbackInfo& info);
+    Napi::Value ShardFor(const Napi::CallbackInfo& info);
+    Napi::Value LengthGetter(const Napi::CallbackInfo& info);
+
+protected:
+    Napi::Value Query(const Napi::CallbackInfo& info, Type type);
+    void Dispatch(Baton* baton, const std::vector<size_t>& targets);
+    void Process(size_t shard);
+    static void Finish(Baton* baton);
+
+    static void Work_Task(napi_env env, void* data);
+    static void Work_AfterTask(napi_env env, napi_status status, void* data);
+    static int Execute(Shard& shard, Task* task);
+
+    size_t Hash(Napi::Value key);
+
+    std::vector<Shard> shards;
+    int mode;
+    bool closed = false;
+};
+
+}
+
+#endif
@@ -5,9 +5,14 @@
 #include "macros.h"
 #include "database.h"
 #include "statement.h"
+#include "query_cache.h"
 
 using namespace node_sqlite3;
 
+#if NAPI_VERSION < 6
+Napi::FunctionReference Statement::constructor;
+#endif
+
 Napi::Object Statement::Init(Napi::Env env, Napi::Object exports) {
     Napi::HandleScope scope(env);
 
@@ -20,14 +25,35 @@ Napi::Object Statement::Init(Napi::Env env, Napi::Object exports) {
       InstanceMethod("run", &Statement::Run, napi_default_method),
       InstanceMethod("all", &Statement::All, napi_default_method),
       InstanceMethod("each", &Statement::Each, napi_default_method),
+      InstanceMethod("allArrow", &Statement::AllArrow, napi_default_method),
+      InstanceMethod("eachArrow", &Statement::EachArrow, napi_default_method),
+      InstanceMethod("allJSON", &Statement::AllJSON, napi_default_method),
+      InstanceMethod("getJSON", &Statement::GetJSON, napi_default_method),
+      InstanceMethod("exportTo", &Statement::ExportTo, napi_default_method),
       InstanceMethod("reset", &Statement::Reset, napi_default_method),
+      InstanceMethod("rowMode", &Statement::SetRowMode, napi_default_method),
       InstanceMethod("finalize", &Statement::Finalize_, napi_default_method),
     });
 
+#if NAPI_VERSION < 6
+    constructor = Napi::Persistent(t);
+    constructor.SuppressDestruct();
+#else
+    env.GetInstanceData<Constructors>()->statement = Napi::Persistent(t);
+#endif
+
     exports.Set("Statement", t);
     return exports;
 }
 
+Napi::Function Statement::Constructor(Napi::Env env) {
+#if NAPI_VERSION < 6
+    return constructor.Value();
+#else
+    return env.GetInstanceData<Constructors>()->statement.Value();
+#endif
+}
+
 // A Napi InstanceOf for Javascript Objects "Date" and "RegExp"
 bool OtherInstanceOf(Napi::Object source, const char* object_type) {
     if (strncmp(object_type, "Date", 4) == 0) {
@@ -45,20 +71,101 @@ void Statement::Process() {
     }
 
     while (prepared && !locked && !queue.empty()) {
-        auto call = std::unique_ptr<Call>(queue.front());
+        Call call = queue.front();
         queue.pop();
 
-        call->callback(call->baton);
+        if (!queue.empty() && Batchable(call.callback) &&
+                Batchable(queue.front().callback)) {
+            // There is a run of calls that don't need to go back to JS before
+            // the next one starts. Execute them all in a single work item
+            // instead of paying a threadpool round trip for each one.
+            auto* batch = new BatchBaton(this);
+            while (true) {
+                napi_async_execute_callback execute;
+                Deliver_Callback deliver;
+                Batchable(call.callback, &execute, &deliver);
+                batch->items.emplace_back(call.baton, execute, deliver);
+
+                if (queue.empty() || !Batchable(queue.front().callback)) {
+                    break;
+                }
+                call = queue.front();
+                queue.pop();
+            }
+            Work_BeginBatch(batch);
+        }
+        else {
+            call.callback(call.baton);
+        }
+    }
+}
+
+bool Statement::Batchable(Work_Callback callback,
+        napi_async_execute_callback* execute, Deliver_Callback* deliver) {
+    napi_async_execute_callback e = NULL;
+    Deliver_Callback d = NULL;
+
+    if (callback == Work_BeginBind) {
+        e = Work_Bind;
+        d = Work_DeliverBind;
+    }
+    else if (callback == Work_BeginGet) {
+        e = Work_Get;
+        d = Work_DeliverGet;
+    }
+    else if (callback == Work_BeginRun) {
+        e = Work_Run;
+        d = Work_DeliverRun;
+    }
+
+    if (execute) *execute = e;
+    if (deliver) *deliver = d;
+    return e != NULL;
+}
+
+void Statement::Work_BeginBatch(Baton* baton) {
+    STATEMENT_BEGIN(Batch);
+}
+
+void Statement::Work_Batch(napi_env e, void* data) {
+    STATEMENT_INIT(BatchBaton);
+
+    for (auto& item : baton->items) {
+        item.execute(e, item.baton.get());
+        item.status = stmt->status;
+        if (stmt->status != SQLITE_OK && stmt->status != SQLITE_ROW &&
+                stmt->status != SQLITE_DONE) {
+            item.message = stmt->message;
+        }
+    }
+}
+
+void Statement::Work_AfterBatch(napi_env e, napi_status status, void* data) {
+    std::unique_ptr<BatchBaton> baton(static_cast<BatchBaton*>(data));
+    auto* stmt = baton->stmt;
+
+    auto env = stmt->Env();
+    Napi::HandleScope scope(env);
+
+    // Fire the callbacks in the order the calls were queued, with the status
+    // each of them left behind. After a callback threw, the others aren't
+    // called, but the statement is still unlocked.
+    for (auto& item : baton->items) {
+        stmt->status = item.status;
+        stmt->message = item.message;
+        if (!item.deliver(item.baton.get())) break;
     }
+
+    STATEMENT_END();
 }
 
 void Statement::Schedule(Work_Callback callback, Baton* baton) {
     if (finalized) {
-        queue.emplace(new Call(callback, baton));
+        queue.emplace(callback, baton);
         CleanQueue();
     }
     else if (!prepared || locked) {
-        queue.emplace(new Call(callback, baton));
+        queue.emplace(callback, baton);
     }
     else {
         callback(baton);
@@ -117,6 +224,16 @@ Statement::Statement(const Napi::CallbackInfo& info) : Napi::ObjectWrap<Statemen
 
     auto* baton = new PrepareBaton(this->db, info[2].As<Napi::Function>(), stmt);
     baton->sql = std::string(sql.As<Napi::String>().Utf8Value().c_str());
+
+    if (this->db->prepare_group) {
+        // Created by Database#prepareMany, which prepares the whole set at
+        // once. Those statements are meant to be kept around.
+#ifdef SQLITE_PREPARE_PERSISTENT
+        baton->flags = SQLITE_PREPARE_PERSISTENT;
+#endif
+        static_cast<PrepareManyBaton*>(this->db->prepare_group)->batons.emplace_back(baton);
+        return;
+    }
     this->db->Schedule(Work_BeginPrepare, baton);
 }
 
@@ -136,6 +253,22 @@ void Statement::Work_Prepare(napi_env e, void* data) {
     STATEMENT_MUTEX(mtx);
     sqlite3_mutex_enter(mtx);
 
+    // Have the authorizer note the tables the statement reads, to know which
+    // cached results depend on them.
+    ReadSet reads;
+    auto* cache = baton->db->cache;
+    if (cache) baton->db->collecting = &reads;
+
+#if SQLITE_VERSION_NUMBER >= 3020000
+    stmt->status = sqlite3_prepare_v3(
+        baton->db->_handle,
+        baton->sql.c_str(),
+        baton->sql.size(),
+        baton->flags,
+        &stmt->_handle,
+        NULL
+    );
+#else
     stmt->status = sqlite3_prepare_v2(
         baton->db->_handle,
         baton->sql.c_str(),
@@ -143,11 +276,20 @@ void Statement::Work_Prepare(napi_env e, void* data) {
         &stmt->_handle,
         NULL
     );
+#endif
+
+    baton->db->collecting = NULL;
 
     if (stmt->status != SQLITE_OK) {
         stmt->message = std::string(sqlite3_errmsg(baton->db->_handle));
         stmt->_handle = NULL;
     }
+    else if (cache && sqlite3_stmt_readonly(stmt->_handle) &&
+             QueryCache::Cacheable(baton->db->_handle, reads)) {
+        stmt->sql = baton->sql;
+        stmt->reads = std::move(reads.tables);
+        stmt->cacheable = true;
+    }
 
     sqlite3_mutex_leave(mtx);
 }
@@ -175,6 +317,88 @@ void Statement::Work_AfterPrepare(napi_env e, napi_status status, void* data) {
     STATEMENT_END();
 }
 
+void Statement::Work_BeginPrepareMany(Database::Baton* baton) {
+    assert(baton->db->open);
+    baton->db->pending++;
+
+    auto env = baton->db->Env();
+    CREATE_WORK("sqlite3.Statement.PrepareMany", Work_PrepareMany, Work_AfterPrepareMany);
+}
+
+void Statement::Work_PrepareMany(napi_env e, void* data) {
+    auto* baton = static_cast<PrepareManyBaton*>(data);
+    auto* db = baton->db;
+
+    if (!db->_handle) {
+        for (auto& prepare : baton->batons) {
+            prepare->stmt->status = SQLITE_MISUSE;
+            prepare->stmt->message = "Database handle is closed";
+        }
+        return;
+    }
+
+    // Hold the connection for the whole set; Work_Prepare takes the same
+    // (recursive) mutex again for each statement.
+    sqlite3_mutex* mtx = db->GetMutex();
+    sqlite3_mutex_enter(mtx);
+    for (auto& prepare : baton->batons) {
+        Work_Prepare(e, prepare.get());
+    }
+    sqlite3_mutex_leave(mtx);
+}
+
+void Statement::Work_AfterPrepareMany(napi_env e, napi_status status, void* data) {
+    std::unique_ptr<PrepareManyBaton> baton(static_cast<PrepareManyBaton*>(data));
+    auto* db = baton->db;
+
+    auto env = db->Env();
+    Napi::HandleScope scope(env);
+
+    // Statements that failed to prepare are finalized. Only the first error is
+    // reported since the callback is shared by the whole set.
+    Statement* failed = NULL;
+    int error_status = SQLITE_OK;
+    std::string error_message;
+    for (auto& prepare : baton->batons) {
+        auto* stmt = prepare->stmt;
+        stmt->locked = false;
+        if (stmt->status != SQLITE_OK) {
+            if (!failed) {
+                failed = stmt;
+                error_status = stmt->status;
+                error_message = stmt->message;
+            }
+            stmt->Finalize_();
+        }
+        else {
+            stmt->prepared = true;
+        }
+    }
+    db->pending--;
+
+    Napi::Function cb = baton->callback.Value();
+    if (failed) {
+        EXCEPTION(Napi::String::New(env, error_message.c_str()), error_status, exception);
+        if (IS_FUNCTION(cb)) {
+            Napi::Value argv[] = { exception };
+            TRY_CATCH_CALL(db->Value(), cb, 1, argv);
+        }
+        else {
+            Napi::Value argv[] = { Napi::String::New(env, "error"), exception };
+            EMIT_EVENT(db->Value(), 2, argv);
+        }
+    }
+    else if (IS_FUNCTION(cb)) {
+        Napi::Value argv[] = { env.Null() };
+        TRY_CATCH_CALL(db->Value(), cb, 1, argv);
+    }
+
+    for (auto& prepare : baton->batons) {
+        prepare->stmt->Process();
+    }
+    db->Process();
+}
+
 template <class T> std::unique_ptr<Values::Field>
                    Statement::BindParameter(const Napi::Value source, T pos) {
     if (source.IsString()) {
@@ -220,6 +444,31 @@ template <class T> std::unique_ptr<Values::Field>
     }
 }
 
+template <class T> T* Statement::NewBaton(Napi::Function callback) {
+    return new T(this, callback);
+}
+
+template <class T> T* Statement::AcquireBaton(Pool<T>& pool, Napi::Function callback) {
+    bool hit;
+    T* baton = pool.Acquire(this, callback, hit);
+    if (hit) db->pool_hits++;
+    else db->pool_misses++;
+    return baton;
+}
+
+// The calls that make up point queries reuse their batons.
+template <> Statement::RowBaton* Statement::NewBaton<Statement::RowBaton>(Napi::Function callback) {
+    return AcquireBaton(get_pool, callback);
+}
+
+template <> Statement::RunBaton* Statement::NewBaton<Statement::RunBaton>(Napi::Function callback) {
+    return AcquireBaton(run_pool, callback);
+}
+
+template <> Statement::RowsBaton* Statement::NewBaton<Statement::RowsBaton>(Napi::Function callback) {
+    return AcquireBaton(all_pool, callback);
+}
+
 template <class T> T* Statement::Bind(const Napi::CallbackInfo& info, int start, int last) {
     auto env = info.Env();
     Napi::HandleScope scope(env);
@@ -231,7 +480,8 @@ template <class T> T* Statement::Bind(const Napi::CallbackInfo& info, int start,
         last--;
     }
 
-    auto *baton = new T(this, callback);
+    auto *baton = NewBaton<T>(callback);
+    baton->mode = row_mode;
 
     if (start < last) {
         if (info[start].IsArray()) {
@@ -284,6 +534,18 @@ bool Statement::Bind(const Parameters & parameters) {
     sqlite3_reset(_handle);
     sqlite3_clear_bindings(_handle);
 
+    status = BindParameters(_handle, parameters);
+    if (status != SQLITE_OK) {
+        message = std::string(sqlite3_errmsg(db->_handle));
+        return false;
+    }
+
+    return true;
+}
+
+int Statement::BindParameters(sqlite3_stmt* handle, const Parameters& parameters) {
+    int status = SQLITE_OK;
+
     for (auto& field : parameters) {
         if (field == NULL)
             continue;
@@ -293,40 +555,99 @@ bool Statement::Bind(const Parameters & parameters) {
             pos = field->index;
         }
         else {
-            pos = sqlite3_bind_parameter_index(_handle, field->name.c_str());
+            pos = sqlite3_bind_parameter_index(handle, field->name.c_str());
         }
 
-        switch (field->type) {
-            case SQLITE_INTEGER: {
-                status = sqlite3_bind_int(_handle, pos,
-                    (static_cast<Values::Integer*>(field.get()))->value);
-            } break;
-            case SQLITE_FLOAT: {
-                status = sqlite3_bind_double(_handle, pos,
-                    (static_cast<Values::Float*>(field.get()))->value);
-            } break;
-            case SQLITE_TEXT: {
-                status = sqlite3_bind_text(_handle, pos,
-                    (static_cast<Values::Text*>(field.get()))->value.c_str(),
-                    (static_cast<Values::Text*>(field.get()))->value.size(), SQLITE_TRANSIENT);
-            } break;
-            case SQLITE_BLOB: {
-                status = sqlite3_bind_blob(_handle, pos,
-                    (static_cast<Values::Blob*>(field.get()))->value,
-                    (static_cast<Values::Blob*>(field.get()))->length, SQLITE_TRANSIENT);
-            } break;
-            case SQLITE_NULL: {
-                status = sqlite3_bind_null(_handle, pos);
-            } break;
+        status = BindField(handle, pos, field.get());
+        if (status != SQLITE_OK) {
+            return status;
+        }
+    }
+
+    return status;
+}
+
+int Statement::BindField(sqlite3_stmt* handle, int pos, const Values::Field* field) {
+    switch (field->type) {
+        case SQLITE_INTEGER: {
+            return sqlite3_bind_int(handle, pos,
+                (static_cast<const Values::Integer*>(field))->value);
+        }
+        case SQLITE_FLOAT: {
+            return sqlite3_bind_double(handle, pos,
+                (static_cast<const Values::Float*>(field))->value);
+        }
+        case SQLITE_TEXT: {
+            return sqlite3_bind_text(handle, pos,
+                (static_cast<const Values::Text*>(field))->value.c_str(),
+                (static_cast<const Values::Text*>(field))->value.size(), SQLITE_TRANSIENT);
         }
+        case SQLITE_BLOB: {
+            return sqlite3_bind_blob(handle, pos,
+                (static_cast<const Values::Blob*>(field))->value,
+                (static_cast<const Values::Blob*>(field))->length, SQLITE_TRANSIENT);
+        }
+        case SQLITE_NULL: {
+            return sqlite3_bind_null(handle, pos);
+        }
+    }
+    return SQLITE_OK;
+}
 
-            if (status != SQLITE_OK) {
-                message = std::string(sqlite3_errmsg(db->_handle));
-                return false;
+// Converts an array or object of parameters, as accepted by Statement#bind,
+// or a single value for the first parameter.
+void Statement::GetParameters(Napi::Value source, Parameters& parameters) {
+    if (source.IsUndefined()) {
+        return;
+    }
+    if (source.IsArray()) {
+        auto array = source.As<Napi::Array>();
+        int length = array.Length();
+        // Note: bind parameters start with 1.
+        for (int i = 0; i < length; i++) {
+            parameters.emplace_back(BindParameter((array).Get(i), i + 1));
+        }
+    }
+    else if (!source.IsObject() || OtherInstanceOf(source.As<Object>(), "RegExp")
+            || OtherInstanceOf(source.As<Object>(), "Date") || source.IsBuffer()) {
+        parameters.emplace_back(BindParameter(source, 1));
+    }
+    else {
+        auto object = source.As<Napi::Object>();
+        auto array = object.GetPropertyNames();
+        int length = array.Length();
+        for (int i = 0; i < length; i++) {
+            Napi::Value name = (array).Get(i);
+            Napi::Number num = name.ToNumber();
+
+            if (num.Int32Value() == num.DoubleValue()) {
+                parameters.emplace_back(
+                    BindParameter((object).Get(name), num.Int32Value()));
+            }
+            else {
+                parameters.emplace_back(BindParameter((object).Get(name),
+                    name.As<Napi::String>().Utf8Value().c_str()));
             }
         }
+    }
+}
 
-    return true;
+// Converts the arguments of a call like Statement#bind, without the callback.
+void Statement::GetArguments(Napi::Array args, Parameters& parameters) {
+    uint32_t length = args.Length();
+    if (length == 0) {
+        return;
+    }
+    Napi::Value first = args.Get(0u);
+    if (length == 1 || first.IsArray() || (first.IsObject() &&
+            !OtherInstanceOf(first.As<Object>(), "RegExp") &&
+            !OtherInstanceOf(first.As<Object>(), "Date") && !first.IsBuffer())) {
+        GetParameters(first, parameters);
+        return;
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        parameters.emplace_back(BindParameter(args.Get(i), static_cast<int>(i + 1)));
+    }
 }
 
 Napi::Value Statement::Bind(const Napi::CallbackInfo& info) {
@@ -364,19 +685,30 @@ void Statement::Work_AfterBind(napi_env e, napi_status status, void* data) {
     auto env = stmt->Env();
     Napi::HandleScope scope(env);
 
+    if (!Work_DeliverBind(baton.get())) return;
+
+    STATEMENT_END();
+}
+
+bool Statement::Work_DeliverBind(Baton* baton) {
+    auto* stmt = baton->stmt;
+
+    auto env = stmt->Env();
+    Napi::HandleScope scope(env);
+
     if (stmt->status != SQLITE_OK) {
-        Error(baton.get());
+        Error(baton);
     }
     else {
         // Fire callbacks.
         Napi::Function cb = baton->callback.Value();
         if (IS_FUNCTION(cb)) {
             Napi::Value argv[] = { env.Null() };
-            TRY_CATCH_CALL(stmt->Value(), cb, 1, argv);
+            TRY_CATCH_CALL(stmt->Value(), cb, 1, argv, false);
         }
     }
 
-    STATEMENT_END();
+    return true;
 }
 
 
@@ -415,24 +747,36 @@ void Statement::Work_Get(napi_env e, void* data) {
             }
         }
 
-        sqlite3_mutex_leave(mtx);
-
         if (stmt->status == SQLITE_ROW) {
             // Acquire one result row before returning.
             GetRow(&baton->row, stmt->_handle);
         }
+
+        sqlite3_mutex_leave(mtx);
     }
 }
 
 void Statement::Work_AfterGet(napi_env e, napi_status status, void* data) {
-    std::unique_ptr<RowBaton> baton(static_cast<RowBaton*>(data));
+    std::unique_ptr<RowBaton, Releaser> baton(static_cast<RowBaton*>(data));
+    auto* stmt = baton->stmt;
+
+    auto env = stmt->Env();
+    Napi::HandleScope scope(env);
+
+    if (!Work_DeliverGet(baton.get())) return;
+
+    STATEMENT_END();
+}
+
+bool Statement::Work_DeliverGet(Baton* b) {
+    auto* baton = static_cast<RowBaton*>(b);
     auto* stmt = baton->stmt;
 
     auto env = stmt->Env();
     Napi::HandleScope scope(env);
 
     if (stmt->status != SQLITE_ROW && stmt->status != SQLITE_DONE) {
-        Error(baton.get());
+        Error(baton);
     }
     else {
         // Fire callbacks.
@@ -440,17 +784,17 @@ void Statement::Work_AfterGet(napi_env e, napi_status status, void* data) {
         if (IS_FUNCTION(cb)) {
             if (stmt->status == SQLITE_ROW) {
                 // Create the result array from the data we acquired.
-                Napi::Value argv[] = { env.Null(), RowToJS(env, &baton->row) };
-                TRY_CATCH_CALL(stmt->Value(), cb, 2, argv);
+                Napi::Value argv[] = { env.Null(), RowToJS(env, &baton->row, baton->mode) };
+                TRY_CATCH_CALL(stmt->Value(), cb, 2, argv, false);
             }
             else {
                 Napi::Value argv[] = { env.Null() };
-                TRY_CATCH_CALL(stmt->Value(), cb, 1, argv);
+                TRY_CATCH_CALL(stmt->Value(), cb, 1, argv, false);
             }
         }
     }
 
-    STATEMENT_END();
+    return true;
 }
 
 Napi::Value Statement::Run(const Napi::CallbackInfo& info) {
@@ -499,14 +843,26 @@ void Statement::Work_Run(napi_env e, void* data) {
 }
 
 void Statement::Work_AfterRun(napi_env e, napi_status status, void* data) {
-    std::unique_ptr<RunBaton> baton(static_cast<RunBaton*>(data));
+    std::unique_ptr<RunBaton, Releaser> baton(static_cast<RunBaton*>(data));
+    auto* stmt = baton->stmt;
+
+    auto env = stmt->Env();
+    Napi::HandleScope scope(env);
+
+    if (!Work_DeliverRun(baton.get())) return;
+
+    STATEMENT_END();
+}
+
+bool Statement::Work_DeliverRun(Baton* b) {
+    auto* baton = static_cast<RunBaton*>(b);
     auto* stmt = baton->stmt;
 
     auto env = stmt->Env();
     Napi::HandleScope scope(env);
 
     if (stmt->status != SQLITE_ROW && stmt->status != SQLITE_DONE) {
-        Error(baton.get());
+        Error(baton);
     }
     else {
         // Fire callbacks.
@@ -516,11 +872,11 @@ void Statement::Work_AfterRun(napi_env e, napi_status status, void* data) {
             (stmt->Value()).Set( Napi::String::New(env, "changes"), Napi::Number::New(env, baton->changes));
 
             Napi::Value argv[] = { env.Null() };
-            TRY_CATCH_CALL(stmt->Value(), cb, 1, argv);
+            TRY_CATCH_CALL(stmt->Value(), cb, 1, argv, false);
         }
     }
 
-    STATEMENT_END();
+    return true;
 }
 
 Napi::Value Statement::All(const Napi::CallbackInfo& info) {
@@ -539,6 +895,11 @@ Napi::Value Statement::All(const Napi::CallbackInfo& info) {
 }
 
 void Statement::Work_BeginAll(Baton* baton) {
+    // Results can only be cached if nothing changed before they were read.
+    auto* cache = baton->stmt->db->cache;
+    if (cache && baton->stmt->cacheable) {
+        static_cast<RowsBaton*>(baton)->cache_version = cache->Version();
+    }
     STATEMENT_BEGIN(All);
 }
 
@@ -569,7 +930,7 @@ void Statement::Work_All(napi_env e, void* data) {
 }
 
 void Statement::Work_AfterAll(napi_env e, napi_status status, void* data) {
-    std::unique_ptr<RowsBaton> baton(static_cast<RowsBaton*>(data));
+    std::unique_ptr<RowsBaton, Releaser> baton(static_cast<RowsBaton*>(data));
     auto* stmt = baton->stmt;
 
     auto env = stmt->Env();
@@ -579,16 +940,28 @@ void Statement::Work_AfterAll(napi_env e, napi_status status, void* data) {
         Error(baton.get());
     }
     else {
+        // Results of statements with parameters bound by an earlier
+        // Statement#bind can't be cached, since their key isn't known.
+        std::shared_ptr<const Rows> cached;
+        auto* cache = stmt->db->cache;
+        if (cache && stmt->cacheable && (baton->parameters.size() ||
+                !sqlite3_bind_parameter_count(stmt->_handle))) {
+            cached = std::make_shared<const Rows>(std::move(baton->rows));
+            cache->Put(QueryCache::Key(stmt->sql, baton->parameters), cached,
+                       stmt->reads, baton->cache_version);
+        }
+        const Rows& rows = cached ? *cached : baton->rows;
+
         // Fire callbacks.
         Napi::Function cb = baton->callback.Value();
         if (IS_FUNCTION(cb)) {
-            if (baton->rows.size()) {
+            if (rows.size()) {
                 // Create the result array from the data we acquired.
-                Napi::Array result(Napi::Array::New(env, baton->rows.size()));
-                auto it = static_cast<Rows::const_iterator>(baton->rows.begin());
-                decltype(it) end = baton->rows.end();
+                Napi::Array result(Napi::Array::New(env, rows.size()));
+                auto it = static_cast<Rows::const_iterator>(rows.begin());
+                decltype(it) end = rows.end();
                 for (int i = 0; it < end; ++it, i++) {
-                    (result).Set(i, RowToJS(env, it->get()));
+                    (result).Set(i, RowToJS(env, it->get(), baton->mode));
                 }
 
                 Napi::Value argv[] = { env.Null(), result };
@@ -638,6 +1011,7 @@ void Statement::Work_BeginEach(Baton* baton) {
     each_baton->async = new Async(each_baton->stmt, reinterpret_cast<uv_async_cb>(AsyncEach));
     each_baton->async->item_cb.Reset(each_baton->callback.Value(), 1);
     each_baton->async->completed_cb.Reset(each_baton->completed.Value(), 1);
+    each_baton->async->mode = each_baton->mode;
 
     STATEMENT_BEGIN(Each);
 }
@@ -648,25 +1022,29 @@ void Statement::Work_Each(napi_env e, void* data) {
     auto* async = baton->async;
 
     STATEMENT_MUTEX(mtx);
+    sqlite3_mutex_enter(mtx);
 
     // Make sure that we also reset when there are no parameters.
     if (!baton->parameters.size()) {
         sqlite3_reset(stmt->_handle);
     }
 
-    if (stmt->Bind(baton->parameters)) {
+    bool bound = stmt->Bind(baton->parameters);
+    sqlite3_mutex_leave(mtx);
+
+    if (bound) {
         while (true) {
+            // The connection may be shared with statements running in
+            // parallel, so it is only held for one row at a time.
             sqlite3_mutex_enter(mtx);
             stmt->status = sqlite3_step(stmt->_handle);
             if (stmt->status == SQLITE_ROW) {
-                sqlite3_mutex_leave(mtx);
                 auto row = std::make_unique<Row>();
                 GetRow(row.get(), stmt->_handle);
-                NODE_SQLITE3_MUTEX_LOCK(&async->mutex)
-                async->data.emplace_back(std::move(row));
-                NODE_SQLITE3_MUTEX_UNLOCK(&async->mutex)
-
-                uv_async_send(&async->watcher);
+                sqlite3_mutex_leave(mtx);
+                if (async->data.push(std::move(row))) {
+                    uv_async_send(&async->watcher);
+                }
             }
             else {
                 if (stmt->status != SQLITE_DONE) {
@@ -695,32 +1073,23 @@ void Statement::AsyncEach(uv_async_t* handle) {
     auto env = async->stmt->Env();
     Napi::HandleScope scope(env);
 
-    while (true) {
-        // Get the contents out of the data cache for us to process in the JS callback.
-        Rows rows;
-        NODE_SQLITE3_MUTEX_LOCK(&async->mutex)
-        rows.swap(async->data);
-        NODE_SQLITE3_MUTEX_UNLOCK(&async->mutex)
-
-        if (rows.empty()) {
-            break;
-        }
-
-        Napi::Function cb = async->item_cb.Value();
-        if (IS_FUNCTION(cb)) {
-            Napi::Value argv[2];
-            argv[0] = env.Null();
-
-            for(auto& row : rows) {
-                argv[1] = RowToJS(env,row.get());
-                async->retrieved++;
-                TRY_CATCH_CALL(async->stmt->Value(), cb, 2, argv);
-            }
+    // Check for completion before draining the rows, so that rows sent right
+    // before the worker finished can't slip past the completion callback.
+    bool completed = async->completed;
+    async->data.acknowledge();
+
+    std::unique_ptr<Row> row;
+    Napi::Function item_cb = async->item_cb.Value();
+    while (async->data.pop(row)) {
+        if (IS_FUNCTION(item_cb)) {
+            Napi::Value argv[] = { env.Null(), RowToJS(env, row.get(), async->mode) };
+            async->retrieved++;
+            TRY_CATCH_CALL(async->stmt->Value(), item_cb, 2, argv);
         }
     }
 
     Napi::Function cb = async->completed_cb.Value();
-    if (async->completed) {
+    if (completed) {
         if (!cb.IsEmpty() &&
                 cb.IsFunction()) {
             Napi::Value argv[] = {
@@ -747,76 +1116,691 @@ void Statement::Work_AfterEach(napi_env e, napi_status status, void* data) {
     STATEMENT_END();
 }
 
-Napi::Value Statement::Reset(const Napi::CallbackInfo& info) {
+// Statement#allArrow([bind1, bind2, ...], [callback])
+Napi::Value Statement::AllArrow(const Napi::CallbackInfo& info) {
     auto env = info.Env();
     Statement* stmt = this;
 
-    OPTIONAL_ARGUMENT_FUNCTION(0, callback);
-
-    auto* baton = new Baton(stmt, callback);
-    stmt->Schedule(Work_BeginReset, baton);
-
-    return info.This();
+    Baton* baton = stmt->Bind<ArrowBaton>(info);
+    if (baton == NULL) {
+        Napi::Error::New(env, "Data type is not supported").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    else {
+        stmt->Schedule(Work_BeginAllArrow, baton);
+        return info.This();
+    }
 }
 
-void Statement::Work_BeginReset(Baton* baton) {
-    STATEMENT_BEGIN(Reset);
+void Statement::Work_BeginAllArrow(Baton* baton) {
+    STATEMENT_BEGIN(AllArrow);
 }
 
-void Statement::Work_Reset(napi_env e, void* data) {
-    STATEMENT_INIT(Baton);
+void Statement::Work_AllArrow(napi_env e, void* data) {
+    STATEMENT_INIT(ArrowBaton);
 
-    sqlite3_reset(stmt->_handle);
-    stmt->status = SQLITE_OK;
+    STATEMENT_MUTEX(mtx);
+    sqlite3_mutex_enter(mtx);
+
+    // Make sure that we also reset when there are no parameters.
+    if (!baton->parameters.size()) {
+        sqlite3_reset(stmt->_handle);
+    }
+
+    if (stmt->Bind(baton->parameters)) {
+        ArrowWriter writer(stmt->_handle);
+        auto output = std::make_unique<std::string>();
+        while ((stmt->status = sqlite3_step(stmt->_handle)) == SQLITE_ROW) {
+            writer.Append(stmt->_handle);
+            if (writer.Length() >= baton->batch_rows || writer.Full()) {
+                if (!baton->batches++) writer.WriteSchema(*output);
+                writer.WriteBatch(*output);
+            }
+        }
+
+        if (stmt->status == SQLITE_DONE) {
+            if (!baton->batches) writer.WriteSchema(*output);
+            if (writer.Length()) writer.WriteBatch(*output);
+            ArrowWriter::WriteEnd(*output);
+            baton->output = std::move(output);
+        }
+        else {
+            stmt->message = std::string(sqlite3_errmsg(stmt->db->_handle));
+        }
+    }
+
+    sqlite3_mutex_leave(mtx);
 }
 
-void Statement::Work_AfterReset(napi_env e, napi_status status, void* data) {
-    std::unique_ptr<Baton> baton(static_cast<Baton*>(data));
+void Statement::Work_AfterAllArrow(napi_env e, napi_status status, void* data) {
+    std::unique_ptr<ArrowBaton> baton(static_cast<ArrowBaton*>(data));
     auto* stmt = baton->stmt;
 
     auto env = stmt->Env();
     Napi::HandleScope scope(env);
 
-    // Fire callbacks.
-    Napi::Function cb = baton->callback.Value();
-    if (IS_FUNCTION(cb)) {
-        Napi::Value argv[] = { env.Null() };
-        TRY_CATCH_CALL(stmt->Value(), cb, 1, argv);
+    if (stmt->status != SQLITE_DONE) {
+        Error(baton.get());
+    }
+    else {
+        Napi::Function cb = baton->callback.Value();
+        if (IS_FUNCTION(cb)) {
+            Napi::Value argv[] = { env.Null(), TakeBuffer(env, baton->output) };
+            TRY_CATCH_CALL(stmt->Value(), cb, 2, argv);
+        }
     }
 
     STATEMENT_END();
 }
 
-Napi::Value Statement::RowToJS(Napi::Env env, Row* row) {
-    Napi::EscapableHandleScope scope(env);
-
-    auto result = Napi::Object::New(env);
+// Statement#eachArrow(batchRows, [bind1, bind2, ...], [callback], [complete])
+Napi::Value Statement::EachArrow(const Napi::CallbackInfo& info) {
+    auto env = info.Env();
+    Statement* stmt = this;
 
-    for (auto& field : *row) {
+    if (info.Length() <= 0 || !info[0].IsNumber() ||
+            !(info[0].As<Napi::Number>().DoubleValue() >= 1)) {
+        Napi::TypeError::New(env, "Number of rows per batch expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
 
-        Napi::Value value;
+    int last = info.Length();
 
-        switch (field->type) {
-            case SQLITE_INTEGER: {
-                value = Napi::Number::New(env, (static_cast<Values::Integer*>(field.get()))->value);
-            } break;
-            case SQLITE_FLOAT: {
-                value = Napi::Number::New(env, (static_cast<Values::Float*>(field.get()))->value);
-            } break;
-            case SQLITE_TEXT: {
-                value = Napi::String::New(env, (static_cast<Values::Text*>(field.get()))->value.c_str(), 
-                                               (static_cast<Values::Text*>(field.get()))->value.size());
-            } break;
-            case SQLITE_BLOB: {
-                value = Napi::Buffer<char>::Copy(env, (static_cast<Values::Blob*>(field.get()))->value, 
-                                                      (static_cast<Values::Blob*>(field.get()))->length);
-            } break;
-            case SQLITE_NULL: {
-                value = env.Null();
-            } break;
+    Napi::Function completed;
+    if (last >= 3 && info[last - 1].IsFunction() && info[last - 2].IsFunction()) {
+        completed = info[--last].As<Napi::Function>();
+    }
+
+    auto baton = stmt->Bind<ArrowBaton>(info, 1, last);
+    if (baton == NULL) {
+        Napi::Error::New(env, "Data type is not supported").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    else {
+        baton->batch_rows = static_cast<size_t>(info[0].As<Napi::Number>().DoubleValue());
+        baton->completed.Reset(completed, 1);
+        stmt->Schedule(Work_BeginEachArrow, baton);
+        return info.This();
+    }
+}
+
+void Statement::Work_BeginEachArrow(Baton* baton) {
+    STATEMENT_BEGIN(EachArrow);
+}
+
+// Reads one batch. The statement stays locked until the last one was
+// delivered, but the connection is released in between.
+void Statement::Work_EachArrow(napi_env e, void* data) {
+    STATEMENT_INIT(ArrowBaton);
+
+    STATEMENT_MUTEX(mtx);
+    sqlite3_mutex_enter(mtx);
+
+    if (!baton->writer) {
+        // Make sure that we also reset when there are no parameters.
+        if (!baton->parameters.size()) {
+            sqlite3_reset(stmt->_handle);
+        }
+        if (!stmt->Bind(baton->parameters)) {
+            baton->done = true;
+            sqlite3_mutex_leave(mtx);
+            return;
         }
+        baton->writer = std::make_unique<ArrowWriter>(stmt->_handle);
+    }
 
-        result.Set(field->name, value);
+    auto* writer = baton->writer.get();
+    while ((stmt->status = sqlite3_step(stmt->_handle)) == SQLITE_ROW) {
+        writer->Append(stmt->_handle);
+        if (writer->Length() >= baton->batch_rows || writer->Full()) break;
+    }
+
+    if (stmt->status != SQLITE_ROW) {
+        baton->done = true;
+        if (stmt->status != SQLITE_DONE) {
+            stmt->message = std::string(sqlite3_errmsg(stmt->db->_handle));
+        }
+    }
+    if (writer->Length() && (stmt->status == SQLITE_ROW || stmt->status == SQLITE_DONE)) {
+        // Every batch is a stream of its own, which can be read without the
+        // others.
+        baton->output = std::make_unique<std::string>();
+        writer->WriteSchema(*baton->output);
+        writer->WriteBatch(*baton->output);
+        ArrowWriter::WriteEnd(*baton->output);
+    }
+
+    sqlite3_mutex_leave(mtx);
+}
+
+void Statement::Work_AfterEachArrow(napi_env e, napi_status status, void* data) {
+    auto* baton = static_cast<ArrowBaton*>(data);
+    auto* stmt = baton->stmt;
+
+    auto env = stmt->Env();
+    Napi::HandleScope scope(env);
+
+    if (baton->output) {
+        baton->batches++;
+        Napi::Function cb = baton->callback.Value();
+        if (IS_FUNCTION(cb)) {
+            Napi::Value argv[] = { env.Null(), TakeBuffer(env, baton->output) };
+            TRY_CATCH_CALL(stmt->Value(), cb, 2, argv);
+        }
+        baton->output.reset();
+    }
+
+    if (!baton->done) {
+        REQUEUE_WORK("sqlite3.Statement.EachArrow", Work_EachArrow, Work_AfterEachArrow);
+        return;
+    }
+
+    std::unique_ptr<ArrowBaton> owner(baton);
+    if (stmt->status != SQLITE_DONE) {
+        Error(baton);
+    }
+
+    Napi::Function cb = baton->completed.Value();
+    if (IS_FUNCTION(cb)) {
+        Napi::Value argv[] = { env.Null(), Napi::Number::New(env, baton->batches) };
+        TRY_CATCH_CALL(stmt->Value(), cb, 2, argv);
+    }
+
+    STATEMENT_END();
+}
+
+// Statement#allJSON([bind1, bind2, ...], [callback])
+Napi::Value Statement::AllJSON(const Napi::CallbackInfo& info) {
+    auto env = info.Env();
+    Statement* stmt = this;
+
+    auto* baton = stmt->Bind<JSONBaton>(info);
+    if (baton == NULL) {
+        Napi::Error::New(env, "Data type is not supported").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    else {
+        baton->blobs = stmt->db->json_blobs;
+        stmt->Schedule(Work_BeginAllJSON, baton);
+        return info.This();
+    }
+}
+
+void Statement::Work_BeginAllJSON(Baton* baton) {
+    STATEMENT_BEGIN(AllJSON);
+}
+
+void Statement::Work_AllJSON(napi_env e, void* data) {
+    STATEMENT_INIT(JSONBaton);
+
+    STATEMENT_MUTEX(mtx);
+    sqlite3_mutex_enter(mtx);
+
+    // Make sure that we also reset when there are no parameters.
+    if (!baton->parameters.size()) {
+        sqlite3_reset(stmt->_handle);
+    }
+
+    if (stmt->Bind(baton->parameters)) {
+        JSONWriter writer(stmt->_handle, baton->blobs);
+        auto output = std::make_unique<std::string>("[");
+        bool first = true;
+        while ((stmt->status = sqlite3_step(stmt->_handle)) == SQLITE_ROW) {
+            if (!first) *output += ',';
+            first = false;
+            writer.AppendRow(*output, stmt->_handle);
+        }
+
+        if (stmt->status == SQLITE_DONE) {
+            *output += ']';
+            baton->output = std::move(output);
+        }
+        else {
+            stmt->message = std::string(sqlite3_errmsg(stmt->db->_handle));
+        }
+    }
+
+    sqlite3_mutex_leave(mtx);
+}
+
+void Statement::Work_AfterAllJSON(napi_env e, napi_status status, void* data) {
+    std::unique_ptr<JSONBaton> baton(static_cast<JSONBaton*>(data));
+    auto* stmt = baton->stmt;
+
+    auto env = stmt->Env();
+    Napi::HandleScope scope(env);
+
+    if (stmt->status != SQLITE_DONE) {
+        Error(baton.get());
+    }
+    else {
+        Napi::Function cb = baton->callback.Value();
+        if (IS_FUNCTION(cb)) {
+            Napi::Value argv[] = { env.Null(), TakeBuffer(env, baton->output) };
+            TRY_CATCH_CALL(stmt->Value(), cb, 2, argv);
+        }
+    }
+
+    STATEMENT_END();
+}
+
+// Statement#getJSON([bind1, bind2, ...], [callback])
+Napi::Value Statement::GetJSON(const Napi::CallbackInfo& info) {
+    auto env = info.Env();
+    Statement* stmt = this;
+
+    auto* baton = stmt->Bind<JSONBaton>(info);
+    if (baton == NULL) {
+        Napi::Error::New(env, "Data type is not supported").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    else {
+        baton->blobs = stmt->db->json_blobs;
+        stmt->Schedule(Work_BeginGetJSON, baton);
+        return info.This();
+    }
+}
+
+void Statement::Work_BeginGetJSON(Baton* baton) {
+    STATEMENT_BEGIN(GetJSON);
+}
+
+void Statement::Work_GetJSON(napi_env e, void* data) {
+    STATEMENT_INIT(JSONBaton);
+
+    if (stmt->status != SQLITE_DONE || baton->parameters.size()) {
+        STATEMENT_MUTEX(mtx);
+        sqlite3_mutex_enter(mtx);
+
+        if (stmt->Bind(baton->parameters)) {
+            stmt->status = sqlite3_step(stmt->_handle);
+
+            if (!(stmt->status == SQLITE_ROW || stmt->status == SQLITE_DONE)) {
+                stmt->message = std::string(sqlite3_errmsg(stmt->db->_handle));
+            }
+        }
+
+        if (stmt->status == SQLITE_ROW) {
+            baton->output = std::make_unique<std::string>();
+            JSONWriter(stmt->_handle, baton->blobs).AppendRow(*baton->output, stmt->_handle);
+        }
+
+        sqlite3_mutex_leave(mtx);
+    }
+}
+
+void Statement::Work_AfterGetJSON(napi_env e, napi_status status, void* data) {
+    std::unique_ptr<JSONBaton> baton(static_cast<JSONBaton*>(data));
+    auto* stmt = baton->stmt;
+
+    auto env = stmt->Env();
+    Napi::HandleScope scope(env);
+
+    if (stmt->status != SQLITE_ROW && stmt->status != SQLITE_DONE) {
+        Error(baton.get());
+    }
+    else {
+        Napi::Function cb = baton->callback.Value();
+        if (IS_FUNCTION(cb)) {
+            if (stmt->status == SQLITE_ROW) {
+                Napi::Value argv[] = { env.Null(), TakeBuffer(env, baton->output) };
+                TRY_CATCH_CALL(stmt->Value(), cb, 2, argv);
+            }
+            else {
+                Napi::Value argv[] = { env.Null() };
+                TRY_CATCH_CALL(stmt->Value(), cb, 1, argv);
+            }
+        }
+    }
+
+    STATEMENT_END();
+}
+
+// Statement#exportTo(path | fd, [{ format, header, delimiter, blobs, params, progress }], [callback])
+Napi::Value Statement::ExportTo(const Napi::CallbackInfo& info) {
+    auto env = info.Env();
+    Statement* stmt = this;
+
+    if (info.Length() <= 0 || !(info[0].IsString() || info[0].IsNumber())) {
+        Napi::TypeError::New(env, "Path or file descriptor expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    Napi::Object options = info.Length() > 1 && info[1].IsObject() && !info[1].IsFunction() ?
+        info[1].As<Napi::Object>() : Napi::Object::New(env);
+    Napi::Function callback;
+    if (info.Length() > 1 && info[info.Length() - 1].IsFunction()) {
+        callback = info[info.Length() - 1].As<Napi::Function>();
+    }
+
+    Napi::Value value = options.Get("format");
+    std::string format = value.IsString() ? value.As<Napi::String>().Utf8Value() : "csv";
+    if (format != "csv" && format != "ndjson") {
+        Napi::TypeError::New(env, "Format must be \"csv\" or \"ndjson\"").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    value = options.Get("delimiter");
+    std::string delimiter = value.IsString() ? value.As<Napi::String>().Utf8Value() : ",";
+    if (delimiter.size() != 1 || delimiter[0] == '"' || delimiter[0] == '\n' || delimiter[0] == '\r') {
+        Napi::TypeError::New(env, "Delimiter must be a single character").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    value = options.Get("blobs");
+    JSONWriter::Blobs blobs = JSONWriter::BASE64;
+    if (!value.IsUndefined()) {
+        std::string name = value.IsString() ? value.As<Napi::String>().Utf8Value() : "";
+        if (name == "hex") blobs = JSONWriter::HEX;
+        else if (name == "array" && format == "ndjson") blobs = JSONWriter::ARRAY;
+        else if (name != "base64") {
+            Napi::TypeError::New(env, "Blobs must be \"base64\" or \"hex\", or \"array\" for NDJSON").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+    }
+    value = options.Get("progress");
+    if (!value.IsUndefined() && !value.IsFunction()) {
+        Napi::TypeError::New(env, "Progress must be a function").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    auto* baton = new ExportBaton(stmt, callback);
+    if (info[0].IsString()) {
+        baton->path = info[0].As<Napi::String>().Utf8Value();
+    }
+    else {
+        baton->fd = info[0].As<Napi::Number>().Int32Value();
+    }
+    baton->format = format == "csv" ? ExportBaton::CSV : ExportBaton::NDJSON;
+    baton->delimiter = delimiter[0];
+    baton->header = options.Get("header").IsUndefined() || options.Get("header").ToBoolean();
+    baton->blobs = blobs;
+    if (value.IsFunction()) baton->progress.Reset(value.As<Napi::Function>(), 1);
+    GetParameters(options.Get("params"), baton->parameters);
+    for (auto& parameter : baton->parameters) {
+        if (!parameter) {
+            delete baton;
+            Napi::Error::New(env, "Data type is not supported").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+    }
+    napi_get_uv_event_loop(env, &baton->loop);
+
+    stmt->Schedule(Work_BeginExportTo, baton);
+    return info.This();
+}
+
+void Statement::Work_BeginExportTo(Baton* baton) {
+    STATEMENT_BEGIN(ExportTo);
+}
+
+bool Statement::ExportBaton::Flush(std::string& message) {
+    size_t written = 0;
+    while (written < buffer.size()) {
+        uv_fs_t req;
+        uv_buf_t buf = uv_buf_init(&buffer[written],
+            static_cast<unsigned int>(buffer.size() - written));
+        int result = uv_fs_write(loop, &req, fd, &buf, 1, -1, NULL);
+        uv_fs_req_cleanup(&req);
+        if (result < 0) {
+            message = std::string("Could not write: ") + uv_strerror(result);
+            return false;
+        }
+        written += result;
+    }
+    bytes += written;
+    buffer.clear();
+    return true;
+}
+
+void Statement::ExportBaton::Close() {
+    if (owned && fd >= 0) {
+        uv_fs_t req;
+        uv_fs_close(loop, &req, fd, NULL);
+        uv_fs_req_cleanup(&req);
+    }
+    fd = -1;
+}
+
+// Writes one chunk of rows. The statement stays locked until the last one
+// was written, but the connection is released in between, and while writing.
+void Statement::Work_ExportTo(napi_env e, void* data) {
+    STATEMENT_INIT(ExportBaton);
+
+    STATEMENT_MUTEX(mtx);
+    // Output is written out in large pieces.
+    const size_t flush_size = 1 << 20;
+
+    if (!baton->started) {
+        baton->started = true;
+        baton->buffer.reserve(flush_size + (flush_size >> 2));
+
+        if (!baton->path.empty()) {
+            uv_fs_t req;
+            int fd = uv_fs_open(baton->loop, &req, baton->path.c_str(),
+                UV_FS_O_WRONLY | UV_FS_O_CREAT | UV_FS_O_TRUNC, 0644, NULL);
+            uv_fs_req_cleanup(&req);
+            if (fd < 0) {
+                stmt->status = SQLITE_CANTOPEN;
+                stmt->message = std::string("Could not open ") + baton->path + ": " + uv_strerror(fd);
+                baton->done = true;
+                return;
+            }
+            baton->fd = fd;
+            baton->owned = true;
+        }
+
+        sqlite3_mutex_enter(mtx);
+        // Make sure that we also reset when there are no parameters.
+        if (!baton->parameters.size()) {
+            sqlite3_reset(stmt->_handle);
+        }
+        bool bound = stmt->Bind(baton->parameters);
+        if (bound) {
+            if (baton->format == ExportBaton::CSV) {
+                baton->csv = std::make_unique<CSVWriter>(stmt->_handle, baton->delimiter, baton->blobs);
+                if (baton->header) baton->csv->AppendHeader(baton->buffer);
+            }
+            else {
+                baton->json = std::make_unique<JSONWriter>(stmt->_handle, baton->blobs);
+            }
+        }
+        sqlite3_mutex_leave(mtx);
+
+        if (!bound) {
+            baton->done = true;
+            return;
+        }
+    }
+
+    bool written = true;
+    size_t count = 0;
+    sqlite3_mutex_enter(mtx);
+    while ((stmt->status = sqlite3_step(stmt->_handle)) == SQLITE_ROW) {
+        if (baton->csv) {
+            baton->csv->AppendRow(baton->buffer, stmt->_handle);
+        }
+        else {
+            baton->json->AppendRow(baton->buffer, stmt->_handle);
+            baton->buffer += '\n';
+        }
+        baton->rows++;
+
+        if (baton->buffer.size() >= flush_size) {
+            sqlite3_mutex_leave(mtx);
+            written = baton->Flush(stmt->message);
+            sqlite3_mutex_enter(mtx);
+            if (!written) break;
+        }
+        if (++count >= baton->chunk_rows) break;
+    }
+    if (stmt->status != SQLITE_ROW) {
+        baton->done = true;
+        if (stmt->status != SQLITE_DONE) {
+            stmt->message = std::string(sqlite3_errmsg(stmt->db->_handle));
+        }
+    }
+    sqlite3_mutex_leave(mtx);
+
+    if (written && baton->done && stmt->status == SQLITE_DONE) {
+        written = baton->Flush(stmt->message);
+    }
+    if (!written) {
+        stmt->status = SQLITE_IOERR;
+        baton->done = true;
+    }
+}
+
+void Statement::Work_AfterExportTo(napi_env e, napi_status status, void* data) {
+    auto* baton = static_cast<ExportBaton*>(data);
+    auto* stmt = baton->stmt;
+
+    auto env = stmt->Env();
+    Napi::HandleScope scope(env);
+
+    auto result = Napi::Object::New(env);
+    result.Set("rows", Napi::Number::New(env, static_cast<double>(baton->rows)));
+    result.Set("bytes", Napi::Number::New(env, static_cast<double>(baton->bytes + baton->buffer.size())));
+
+    // Also stops when the database handle was closed under the statement.
+    if (!baton->done && stmt->status == SQLITE_ROW) {
+        // The next chunk is queued first so that a throwing progress
+        // callback doesn't stop it.
+        REQUEUE_WORK("sqlite3.Statement.ExportTo", Work_ExportTo, Work_AfterExportTo);
+        Napi::Function progress = baton->progress.Value();
+        if (IS_FUNCTION(progress)) {
+            Napi::Value argv[] = { result };
+            TRY_CATCH_CALL(stmt->Value(), progress, 1, argv);
+        }
+        return;
+    }
+
+    std::unique_ptr<ExportBaton> owner(baton);
+    owner->Close();
+    if (stmt->status != SQLITE_DONE) {
+        Error(baton);
+    }
+    else {
+        Napi::Function cb = baton->callback.Value();
+        if (IS_FUNCTION(cb)) {
+            Napi::Value argv[] = { env.Null(), result };
+            TRY_CATCH_CALL(stmt->Value(), cb, 2, argv);
+        }
+    }
+
+    STATEMENT_END();
+}
+
+// Hands the output over to a Buffer instead of copying it.
+Napi::Value Statement::TakeBuffer(Napi::Env env, std::unique_ptr<std::string>& output) {
+    if (!output) return Napi::Buffer<char>::New(env, 0);
+    std::string* data = output.release();
+    return Napi::Buffer<char>::New(env, &(*data)[0], data->size(),
+        [](Napi::Env, char*, std::string* hint) { delete hint; }, data);
+}
+
+// Statement#rowMode('object' | 'array' | 'pluck')
+// How the calls made after it hand out rows: as objects keyed by column
+// name, as arrays of the values, or as the value of the first column.
+// Without an argument, returns the mode.
+Napi::Value Statement::SetRowMode(const Napi::CallbackInfo& info) {
+    auto env = info.Env();
+
+    if (info.Length() == 0) {
+        const char* name = row_mode == ARRAY ? "array" : row_mode == PLUCK ? "pluck" : "object";
+        return Napi::String::New(env, name);
+    }
+    REQUIRE_ARGUMENT_STRING(0, mode);
+    if (mode == "object") row_mode = OBJECT;
+    else if (mode == "array") row_mode = ARRAY;
+    else if (mode == "pluck") row_mode = PLUCK;
+    else {
+        Napi::TypeError::New(env, "Row mode must be 'object', 'array' or 'pluck'").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    return info.This();
+}
+
+Napi::Value Statement::Reset(const Napi::CallbackInfo& info) {
+    auto env = info.Env();
+    Statement* stmt = this;
+
+    OPTIONAL_ARGUMENT_FUNCTION(0, callback);
+
+    auto* baton = new Baton(stmt, callback);
+    stmt->Schedule(Work_BeginReset, baton);
+
+    return info.This();
+}
+
+void Statement::Work_BeginReset(Baton* baton) {
+    STATEMENT_BEGIN(Reset);
+}
+
+void Statement::Work_Reset(napi_env e, void* data) {
+    STATEMENT_INIT(Baton);
+
+    STATEMENT_MUTEX(mtx);
+    sqlite3_mutex_enter(mtx);
+    sqlite3_reset(stmt->_handle);
+    sqlite3_mutex_leave(mtx);
+    stmt->status = SQLITE_OK;
+}
+
+void Statement::Work_AfterReset(napi_env e, napi_status status, void* data) {
+    std::unique_ptr<Baton> baton(static_cast<Baton*>(data));
+    auto* stmt = baton->stmt;
+
+    auto env = stmt->Env();
+    Napi::HandleScope scope(env);
+
+    // Fire callbacks.
+    Napi::Function cb = baton->callback.Value();
+    if (IS_FUNCTION(cb)) {
+        Napi::Value argv[] = { env.Null() };
+        TRY_CATCH_CALL(stmt->Value(), cb, 1, argv);
+    }
+
+    STATEMENT_END();
+}
+
+Napi::Value Statement::FieldToJS(Napi::Env env, Values::Field* field) {
+    switch (field->type) {
+        case SQLITE_INTEGER: {
+            return Napi::Number::New(env, (static_cast<Values::Integer*>(field))->value);
+        }
+        case SQLITE_FLOAT: {
+            return Napi::Number::New(env, (static_cast<Values::Float*>(field))->value);
+        }
+        case SQLITE_TEXT: {
+            return Napi::String::New(env, (static_cast<Values::Text*>(field))->value.c_str(), 
+                                          (static_cast<Values::Text*>(field))->value.size());
+        }
+        case SQLITE_BLOB: {
+            return Napi::Buffer<char>::Copy(env, (static_cast<Values::Blob*>(field))->value, 
+                                                 (static_cast<Values::Blob*>(field))->length);
+        }
+        default: {
+            return env.Null();
+        }
+    }
+}
+
+Napi::Value Statement::RowToJS(Napi::Env env, Row* row, RowMode mode) {
+    Napi::EscapableHandleScope scope(env);
+
+    if (mode == PLUCK) {
+        return scope.Escape(row->empty() ? env.Null() : FieldToJS(env, row->front().get()));
+    }
+    if (mode == ARRAY) {
+        auto result = Napi::Array::New(env, row->size());
+        for (uint32_t i = 0; i < row->size(); i++) {
+            result.Set(i, FieldToJS(env, (*row)[i].get()));
+        }
+        return scope.Escape(result);
+    }
+
+    auto result = Napi::Object::New(env);
+
+    for (auto& field : *row) {
+        result.Set(field->name, FieldToJS(env, field.get()));
     }
 
     return scope.Escape(result);
@@ -889,8 +1873,16 @@ void Statement::Finalize_() {
     CleanQueue();
     // Finalize returns the status code of the last operation. We already fired
     // error events in case those failed.
-    sqlite3_finalize(_handle);
+    if (_handle) {
+        sqlite3_mutex* mtx = db->GetMutex();
+        sqlite3_mutex_enter(mtx);
+        sqlite3_finalize(_handle);
+        sqlite3_mutex_leave(mtx);
+    }
     _handle = NULL;
+    get_pool.Clear();
+    run_pool.Clear();
+    all_pool.Clear();
     db->Unref();
 }
 
@@ -907,10 +1899,10 @@ void Statement::CleanQueue() {
 
         // Clear out the queue so that this object can get GC'ed.
         while (!queue.empty()) {
-            auto call = std::unique_ptr<Call>(queue.front());
+            Call call = queue.front();
             queue.pop();
 
-            auto baton = std::unique_ptr<Baton>(call->baton);
+            auto baton = std::unique_ptr<Baton>(call.baton);
             Napi::Function cb = baton->callback.Value();
 
             if (prepared && !cb.IsEmpty() &&
@@ -930,10 +1922,10 @@ void Statement::CleanQueue() {
     else while (!queue.empty()) {
         // Just delete all items in the queue; we already fired an event when
         // preparing the statement failed.
-        auto call = std::unique_ptr<Call>(queue.front());
+        Call call = queue.front();
         queue.pop();
         // We don't call the actual callback, so we have to make sure that
         // the baton gets destroyed.
-        delete call->baton;
+        delete call.baton;
     }
 }
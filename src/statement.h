@@ -1,17 +1,23 @@
 #ifndef NODE_SQLITE3_SRC_STATEMENT_H
 #define NODE_SQLITE3_SRC_STATEMENT_H
 
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
 #include <string>
 #include <queue>
+#include <set>
+#include <utility>
 #include <vector>
 #include <sqlite3.h>
 #include <napi.h>
 #include <uv.h>
 
 #include "database.h"
-#include "threading.h"
+#include "arrow.h"
+#include "csv.h"
+#include "json.h"
+#include "ring.h"
 
 using namespace Napi;
 
@@ -77,14 +83,26 @@ typedef Row Parameters;
 
 class Statement : public Napi::ObjectWrap<Statement> {
 public:
+#if NAPI_VERSION < 6
+    static Napi::FunctionReference constructor;
+#endif
     static Napi::Object Init(Napi::Env env, Napi::Object exports);
     static Napi::Value New(const Napi::CallbackInfo& info);
+    static Napi::Function Constructor(Napi::Env env);
+
+    // How rows are handed out, see Statement#rowMode.
+    enum RowMode { OBJECT = 0, ARRAY, PLUCK };
 
     struct Baton {
         napi_async_work request = NULL;
         Statement* stmt;
         Napi::FunctionReference callback;
         Parameters parameters;
+        // Row mode of the statement when the call was made.
+        RowMode mode = OBJECT;
+        // Set while the baton sits in one of the statement's pools. Pooled
+        // batons don't hold a reference to the statement.
+        bool pooled = false;
 
         Baton(Statement* stmt_, Napi::Function cb_) : stmt(stmt_) {
             stmt->Ref();
@@ -93,9 +111,28 @@ public:
         virtual ~Baton() {
             parameters.clear();
             if (request) napi_delete_async_work(stmt->Env(), request);
-            stmt->Unref();
+            if (!pooled) stmt->Unref();
+            callback.Reset();
+        }
+
+        // Drops the per-call state so that the baton can be reused.
+        virtual void Clear() {
+            parameters.clear();
             callback.Reset();
+            if (request) {
+                napi_delete_async_work(stmt->Env(), request);
+                request = NULL;
+            }
         }
+
+        // Called once the call is done with the baton.
+        virtual void Release() {
+            delete this;
+        }
+    };
+
+    struct Releaser {
+        void operator()(Baton* baton) const { baton->Release(); }
     };
 
     struct RowBaton : Baton {
@@ -103,6 +140,13 @@ public:
             Baton(stmt_, cb_) {}
         Row row;
         virtual ~RowBaton() override = default;
+        virtual void Clear() override {
+            Baton::Clear();
+            row.clear();
+        }
+        virtual void Release() override {
+            stmt->get_pool.Release(this);
+        }
     };
 
     struct RunBaton : Baton {
@@ -111,13 +155,72 @@ public:
         sqlite3_int64 inserted_id;
         int changes;
         virtual ~RunBaton() override = default;
+        virtual void Clear() override {
+            Baton::Clear();
+            inserted_id = 0;
+            changes = 0;
+        }
+        virtual void Release() override {
+            stmt->run_pool.Release(this);
+        }
     };
 
     struct RowsBaton : Baton {
         RowsBaton(Statement* stmt_, Napi::Function cb_) :
             Baton(stmt_, cb_) {}
         Rows rows;
+        // Version of the query cache when the statement started.
+        uint64_t cache_version = 0;
         virtual ~RowsBaton() override = default;
+        virtual void Clear() override {
+            Baton::Clear();
+            rows.clear();
+        }
+        virtual void Release() override {
+            stmt->all_pool.Release(this);
+        }
+    };
+
+    // Free list of batons for one kind of call. Only the baton memory is
+    // reused: N-API doesn't allow queueing a work item a second time, so
+    // the work item is deleted when the baton is released and every call
+    // creates its own.
+    template <class T> struct Pool {
+        static const size_t capacity = 16;
+        std::vector<T*> items;
+
+        ~Pool() {
+            Clear();
+        }
+
+        T* Acquire(Statement* stmt, Napi::Function cb, bool& hit) {
+            hit = !items.empty();
+            if (!hit) {
+                return new T(stmt, cb);
+            }
+            T* baton = items.back();
+            items.pop_back();
+            baton->pooled = false;
+            stmt->Ref();
+            baton->callback.Reset(cb, 1);
+            return baton;
+        }
+
+        void Release(T* baton) {
+            if (baton->stmt->finalized || items.size() >= capacity) {
+                delete baton;
+                return;
+            }
+            baton->Clear();
+            baton->pooled = true;
+            baton->stmt->Unref();
+            items.push_back(baton);
+        }
+
+        void Clear() {
+            for (auto* baton : items) delete baton;
+            items.clear();
+        }
     };
 
     struct Async;
@@ -133,9 +236,83 @@ public:
         }
     };
 
+    // Statement#allArrow and Statement#eachArrow. Each batch of eachArrow is
+    // read by running the same work again.
+    struct ArrowBaton : Baton {
+        Napi::FunctionReference completed;
+        // Rows per record batch.
+        size_t batch_rows = 65536;
+        std::unique_ptr<ArrowWriter> writer;
+        // IPC stream for the callback, see TakeBuffer().
+        std::unique_ptr<std::string> output;
+        bool done = false;
+        int batches = 0;
+
+        ArrowBaton(Statement* stmt_, Napi::Function cb_) :
+            Baton(stmt_, cb_) {}
+        virtual ~ArrowBaton() override {
+            completed.Reset();
+        }
+    };
+
+    // Statement#allJSON and Statement#getJSON.
+    struct JSONBaton : Baton {
+        JSONWriter::Blobs blobs = JSONWriter::BASE64;
+        // JSON text for the callback, see TakeBuffer(). Not set if getJSON
+        // found no row.
+        std::unique_ptr<std::string> output;
+
+        JSONBaton(Statement* stmt_, Napi::Function cb_) :
+            Baton(stmt_, cb_) {}
+        virtual ~JSONBaton() override = default;
+    };
+
+    // Statement#exportTo. Each chunk of rows is written by running the same
+    // work again, which reports the progress in between.
+    struct ExportBaton : Baton {
+        enum Format { CSV, NDJSON };
+
+        Napi::FunctionReference progress;
+        uv_loop_t* loop = NULL;
+        std::string path;
+        uv_file fd = -1;
+        // Whether the file was opened here, and is closed when done.
+        bool owned = false;
+
+        Format format = CSV;
+        char delimiter = ',';
+        bool header = true;
+        JSONWriter::Blobs blobs = JSONWriter::BASE64;
+        // Rows per chunk, after which the progress is reported.
+        size_t chunk_rows = 65536;
+
+        std::unique_ptr<CSVWriter> csv;
+        std::unique_ptr<JSONWriter> json;
+        // Output that wasn't written yet; reused for all of it.
+        std::string buffer;
+        uint64_t rows = 0;
+        uint64_t bytes = 0;
+        bool started = false;
+        bool done = false;
+
+        ExportBaton(Statement* stmt_, Napi::Function cb_) :
+            Baton(stmt_, cb_) {}
+        virtual ~ExportBaton() override {
+            Close();
+            progress.Reset();
+        }
+
+        // Writes out the buffer. Returns false with a message if that
+        // failed.
+        bool Flush(std::string& message);
+        void Close();
+    };
+
     struct PrepareBaton : Database::Baton {
         Statement* stmt;
         std::string sql;
+        // SQLITE_PREPARE_* flags passed to sqlite3_prepare_v3().
+        unsigned int flags = 0;
         PrepareBaton(Database* db_, Napi::Function cb_, Statement* stmt_) :
             Baton(db_, cb_), stmt(stmt_) {
             stmt->Ref();
@@ -150,7 +327,17 @@ public:
         }
     };
 
+    // Prepares all statements created by Database#prepareMany in one work
+    // item.
+    struct PrepareManyBaton : Database::Baton {
+        std::vector<std::unique_ptr<PrepareBaton> > batons;
+        PrepareManyBaton(Database* db_, Napi::Function cb_) :
+            Baton(db_, cb_) {}
+        virtual ~PrepareManyBaton() override = default;
+    };
+
     typedef void (*Work_Callback)(Baton* baton);
+    typedef bool (*Deliver_Callback)(Baton* baton);
 
     struct Call {
         Call(Work_Callback cb_, Baton* baton_) : callback(cb_), baton(baton_) {};
@@ -158,13 +345,35 @@ public:
         Baton* baton;
     };
 
+    // One queued call that is executed as part of a batch. The status and
+    // message of the statement after running it are stashed here so that
+    // callbacks can be fired in order once the whole batch is done.
+    struct BatchItem {
+        BatchItem(Baton* baton_, napi_async_execute_callback execute_,
+                  Deliver_Callback deliver_) :
+            baton(baton_), execute(execute_), deliver(deliver_),
+            status(SQLITE_OK) {}
+        std::unique_ptr<Baton, Releaser> baton;
+        napi_async_execute_callback execute;
+        Deliver_Callback deliver;
+        int status;
+        std::string message;
+    };
+
+    struct BatchBaton : Baton {
+        std::vector<BatchItem> items;
+        BatchBaton(Statement* stmt_) :
+            Baton(stmt_, Napi::Function()) {}
+        virtual ~BatchBaton() override = default;
+    };
+
     struct Async {
         uv_async_t watcher;
         Statement* stmt;
-        Rows data;
-        NODE_SQLITE3_MUTEX_t;
-        bool completed;
+        Ring<std::unique_ptr<Row> > data;
+        std::atomic<bool> completed;
         int retrieved;
+        RowMode mode = OBJECT;
 
         // Store the callbacks here because we don't have
         // access to the baton in the async callback.
@@ -174,7 +383,6 @@ public:
         Async(Statement* st, uv_async_cb async_cb) :
                 stmt(st), completed(false), retrieved(0) {
             watcher.data = this;
-            NODE_SQLITE3_MUTEX_INIT
             stmt->Ref();
             uv_loop_t *loop;
             napi_get_uv_event_loop(stmt->Env(), &loop);
@@ -185,7 +393,6 @@ public:
             stmt->Unref();
             item_cb.Reset();
             completed_cb.Reset();
-            NODE_SQLITE3_MUTEX_DESTROY
         }
     };
 
@@ -200,27 +407,59 @@ public:
     WORK_DEFINITION(Run)
     WORK_DEFINITION(All)
     WORK_DEFINITION(Each)
+    WORK_DEFINITION(AllArrow)
+    WORK_DEFINITION(EachArrow)
+    WORK_DEFINITION(AllJSON)
+    WORK_DEFINITION(GetJSON)
+    WORK_DEFINITION(ExportTo)
     WORK_DEFINITION(Reset)
 
     Napi::Value Finalize_(const Napi::CallbackInfo& info);
+    Napi::Value SetRowMode(const Napi::CallbackInfo& info);
 
 protected:
     static void Work_BeginPrepare(Database::Baton* baton);
     static void Work_Prepare(napi_env env, void* data);
     static void Work_AfterPrepare(napi_env env, napi_status status, void* data);
 
+    static void Work_BeginPrepareMany(Database::Baton* baton);
+    static void Work_PrepareMany(napi_env env, void* data);
+    static void Work_AfterPrepareMany(napi_env env, napi_status status, void* data);
+
+    static void Work_BeginBatch(Baton* baton);
+    static void Work_Batch(napi_env env, void* data);
+    static void Work_AfterBatch(napi_env env, napi_status status, void* data);
+    static bool Batchable(Work_Callback callback,
+        napi_async_execute_callback* execute = NULL, Deliver_Callback* deliver = NULL);
+
+    static bool Work_DeliverBind(Baton* baton);
+    static bool Work_DeliverGet(Baton* baton);
+    static bool Work_DeliverRun(Baton* baton);
+
     static void AsyncEach(uv_async_t* handle);
     static void CloseCallback(uv_handle_t* handle);
 
     static void Finalize_(Baton* baton);
     void Finalize_();
 
-    template <class T> inline std::unique_ptr<Values::Field> BindParameter(const Napi::Value source, T pos);
+    friend class Database;
+    friend class ShardSet;
+    friend class Watch;
+
+    template <class T> static inline std::unique_ptr<Values::Field> BindParameter(const Napi::Value source, T pos);
+    static void GetParameters(Napi::Value source, Parameters& parameters);
+    static void GetArguments(Napi::Array args, Parameters& parameters);
+    static int BindParameters(sqlite3_stmt* handle, const Parameters& parameters);
+    static int BindField(sqlite3_stmt* handle, int pos, const Values::Field* field);
     template <class T> T* Bind(const Napi::CallbackInfo& info, int start = 0, int end = -1);
+    template <class T> T* NewBaton(Napi::Function callback);
+    template <class T> T* AcquireBaton(Pool<T>& pool, Napi::Function callback);
     bool Bind(const Parameters &parameters);
 
     static void GetRow(Row* row, sqlite3_stmt* stmt);
-    static Napi::Value RowToJS(Napi::Env env, Row* row);
+    static Napi::Value FieldToJS(Napi::Env env, Values::Field* field);
+    static Napi::Value RowToJS(Napi::Env env, Row* row, RowMode mode = OBJECT);
+    static Napi::Value TakeBuffer(Napi::Env env, std::unique_ptr<std::string>& output);
     void Schedule(Work_Callback callback, Baton* baton);
     void Process();
     void CleanQueue();
@@ -234,9 +473,20 @@ protected:
     bool prepared = false;
     bool locked = true;
     bool finalized = false;
+    RowMode row_mode = OBJECT;
 
-    std::queue<Call*> queue;
+    std::queue<Call> queue;
     std::string message;
+
+    // Set for read-only statements when the query cache is on: their SQL and
+    // the schemas and names of the tables they read.
+    bool cacheable = false;
+    std::string sql;
+    std::set<std::pair<std::string, std::string> > reads;
+
+    Pool<RowBaton> get_pool;
+    Pool<RunBaton> run_pool;
+    Pool<RowsBaton> all_pool;
 };
 
 }
@@ -0,0 +1,275 @@
+#include <unordered_map>
+#include <napi.h>
+#include "macros.h"
+#include "database.h"
+#include "statement.h"
+#include "query_cache.h"
+#include "watch.h"
+
+using namespace node_sqlite3;
+
+Napi::Object Watch::Init(Napi::Env env, Napi::Object exports) {
+    Napi::HandleScope scope(env);
+
+    // declare napi_default_method here as it is only available in Node v14.12.0+
+    auto napi_default_method = static_cast<napi_property_attributes>(napi_writable | napi_configurable);
+
+    auto t = DefineClass(env, "Watch", {
+        InstanceMethod("close", &Watch::Close, napi_default_method),
+    });
+
+    exports.Set("Watch", t);
+    return exports;
+}
+
+// new Watch(db, sql, [bind1, bind2, ...], callback)
+Watch::Watch(const Napi::CallbackInfo& info) : Napi::ObjectWrap<Watch>(info) {
+    auto env = info.Env();
+    if (!info.IsConstructCall()) {
+        Napi::TypeError::New(env, "Use the new operator to create new Watch objects").ThrowAsJavaScriptException();
+        return;
+    }
+
+    auto length = info.Length();
+
+    if (length <= 0 || !Database::HasInstance(info[0])) {
+        Napi::TypeError::New(env, "Database object expected").ThrowAsJavaScriptException();
+        return;
+    }
+    else if (length <= 1 || !info[1].IsString()) {
+        Napi::TypeError::New(env, "SQL query expected").ThrowAsJavaScriptException();
+        return;
+    }
+    else if (length <= 2 || !info[2].IsArray()) {
+        Napi::TypeError::New(env, "Array of parameters expected").ThrowAsJavaScriptException();
+        return;
+    }
+    else if (length <= 3 || !info[3].IsFunction()) {
+        Napi::TypeError::New(env, "Callback expected").ThrowAsJavaScriptException();
+        return;
+    }
+
+    this->db = Napi::ObjectWrap<Database>::Unwrap(info[0].As<Napi::Object>());
+    this->db->Ref();
+
+    sql = info[1].As<Napi::String>().Utf8Value();
+    Statement::GetArguments(info[2].As<Napi::Array>(), parameters);
+    callback.Reset(info[3].As<Napi::Function>(), 1);
+    info.This().As<Napi::Object>().DefineProperty(
+        Napi::PropertyDescriptor::Value("sql", info[1]));
+
+    // The watch stays alive until it is closed.
+    Ref();
+    db->watches.insert(this);
+    Rerun();
+}
+
+bool Watch::Affected(const Database::CommitInfo& info) const {
+    // Until the first run succeeded, the tables aren't known.
+    if (first || info.schema) return true;
+    for (auto& table : info.tables) {
+        if (tables.count(table)) return true;
+    }
+    return false;
+}
+
+void Watch::Rerun() {
+    if (closed) return;
+    if (running) {
+        stale = true;
+        return;
+    }
+    running = true;
+    db->Schedule(Work_BeginRun, new Baton(db, this));
+}
+
+void Watch::Stop() {
+    if (closed) return;
+    closed = true;
+    db->watches.erase(this);
+
+    if (db->watches.empty() && db->commit_event) {
+        // Nothing needs to know about commits anymore.
+        sqlite3_mutex* mtx = db->_handle ? db->GetMutex() : NULL;
+        sqlite3_mutex_enter(mtx);
+        db->commit_event->finish();
+        db->commit_event = NULL;
+        if (db->_handle) db->UpdateHooks();
+        sqlite3_mutex_leave(mtx);
+    }
+
+    Unref();
+}
+
+// Watch#close()
+Napi::Value Watch::Close(const Napi::CallbackInfo& info) {
+    Stop();
+    return info.This();
+}
+
+void Watch::Work_BeginRun(Database::Baton* b) {
+    auto* baton = static_cast<Baton*>(b);
+    auto* watch = baton->watch;
+    auto* db = baton->db;
+
+    if (watch->closed) {
+        watch->running = false;
+        delete baton;
+        return;
+    }
+
+    assert(db->open);
+    assert(db->_handle);
+
+    // Commits are collected from before the first run, so that none are
+    // missed between reading the tables and watching them.
+    if (!db->commit_event) {
+        db->commit_event = new Database::AsyncCommit(db, Database::CommitCallback);
+        sqlite3_mutex_enter(db->GetMutex());
+        db->UpdateHooks();
+        sqlite3_mutex_leave(db->GetMutex());
+    }
+
+    db->pending++;
+    auto env = db->Env();
+    CREATE_WORK("sqlite3.Watch.Run", Work_Run, Work_AfterRun);
+}
+
+void Watch::Work_Run(napi_env e, void* data) {
+    auto* baton = static_cast<Baton*>(data);
+    auto* watch = baton->watch;
+    auto* db = baton->db;
+
+    sqlite3_mutex* mtx = db->GetMutex();
+    sqlite3_mutex_enter(mtx);
+
+    // The query is prepared for every run so that the authorizer sees the
+    // tables it reads after schema changes, too.
+    sqlite3_stmt* stmt = NULL;
+    db->collecting = &baton->reads;
+    baton->status = sqlite3_prepare_v2(db->_handle, watch->sql.c_str(),
+        static_cast<int>(watch->sql.size()), &stmt, NULL);
+    db->collecting = NULL;
+
+    Rows rows;
+    if (baton->status != SQLITE_OK) {
+        baton->message = std::string(sqlite3_errmsg(db->_handle));
+    }
+    else if (!stmt || !sqlite3_stmt_readonly(stmt)) {
+        baton->status = SQLITE_MISUSE;
+        baton->message = "Only queries that don't change the database can be watched";
+    }
+    else if ((baton->status = Statement::BindParameters(stmt, watch->parameters)) != SQLITE_OK) {
+        baton->message = std::string(sqlite3_errmsg(db->_handle));
+    }
+    else {
+        while ((baton->status = sqlite3_step(stmt)) == SQLITE_ROW) {
+            auto row = std::make_unique<Row>();
+            Statement::GetRow(row.get(), stmt);
+            rows.emplace_back(std::move(row));
+        }
+        if (baton->status == SQLITE_DONE) {
+            baton->status = SQLITE_OK;
+        }
+        else {
+            baton->message = std::string(sqlite3_errmsg(db->_handle));
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    sqlite3_mutex_leave(mtx);
+
+    if (baton->status == SQLITE_OK) {
+        Diff(watch->rows, rows, baton);
+    }
+}
+
+static std::string RowKey(const Row& row) {
+    std::string key;
+    for (auto& field : row) {
+        key += field->name;
+        key += '\0';
+        QueryCache::AppendField(key, field.get());
+    }
+    return key;
+}
+
+// Compares the rows as multisets: rows that are only in the new result are
+// added, the ones that are only in the previous result are moved over to
+// the removed rows of the baton. The new result replaces the previous one.
+void Watch::Diff(Rows& previous, Rows& rows, Baton* baton) {
+    std::unordered_map<std::string, std::vector<size_t> > positions;
+    for (size_t i = 0; i < previous.size(); i++) {
+        positions[RowKey(*previous[i])].push_back(i);
+    }
+
+    std::vector<bool> kept(previous.size(), false);
+    for (size_t i = 0; i < rows.size(); i++) {
+        auto it = positions.find(RowKey(*rows[i]));
+        if (it != positions.end() && !it->second.empty()) {
+            kept[it->second.back()] = true;
+            it->second.pop_back();
+        }
+        else {
+            baton->added.push_back(i);
+        }
+    }
+
+    for (size_t i = 0; i < previous.size(); i++) {
+        if (!kept[i]) baton->removed.emplace_back(std::move(previous[i]));
+    }
+    previous = std::move(rows);
+}
+
+void Watch::Work_AfterRun(napi_env e, napi_status status, void* data) {
+    std::unique_ptr<Baton> baton(static_cast<Baton*>(data));
+    auto* watch = baton->watch;
+    auto* db = baton->db;
+    db->pending--;
+    watch->running = false;
+
+    auto env = watch->Env();
+    Napi::HandleScope scope(env);
+
+    if (!watch->closed) {
+        bool first = watch->first;
+        if (baton->status == SQLITE_OK) {
+            watch->tables = std::move(baton->reads.tables);
+            watch->first = false;
+        }
+        if (watch->stale) {
+            watch->stale = false;
+            watch->Rerun();
+        }
+
+        Napi::Function cb = watch->callback.Value();
+        if (baton->status != SQLITE_OK) {
+            EXCEPTION(Napi::String::New(env, baton->message.c_str()), baton->status, exception);
+            Napi::Value argv[] = { exception };
+            TRY_CATCH_CALL(watch->Value(), cb, 1, argv);
+        }
+        else if (first || baton->added.size() || baton->removed.size()) {
+            auto rows = Napi::Array::New(env, watch->rows.size());
+            for (uint32_t i = 0; i < watch->rows.size(); i++) {
+                rows.Set(i, Statement::RowToJS(env, watch->rows[i].get()));
+            }
+            auto added = Napi::Array::New(env, baton->added.size());
+            for (uint32_t i = 0; i < baton->added.size(); i++) {
+                added.Set(i, rows.Get(static_cast<uint32_t>(baton->added[i])));
+            }
+            auto removed = Napi::Array::New(env, baton->removed.size());
+            for (uint32_t i = 0; i < baton->removed.size(); i++) {
+                removed.Set(i, Statement::RowToJS(env, baton->removed[i].get()));
+            }
+
+            auto result = Napi::Object::New(env);
+            result.Set("rows", rows);
+            result.Set("added", added);
+            result.Set("removed", removed);
+            Napi::Value argv[] = { env.Null(), result };
+            TRY_CATCH_CALL(watch->Value(), cb, 2, argv);
+        }
+    }
+
+    db->Process();
+}
@@ -0,0 +1,107 @@
+#ifndef NODE_SQLITE3_SRC_WATCH_H
+#define NODE_SQLITE3_SRC_WATCH_H
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+#include <napi.h>
+
+#include "database.h"
+#include "statement.h"
+
+using namespace Napi;
+
+namespace node_sqlite3 {
+
+/**
+ *
+ * A live query: its callback gets the rows of the query, and then what
+ * changed about them each time a commit changes one of the tables it reads.
+ *
+ * Intended usage from node:
+ *
+ *   var watch = db.watch("SELECT * FROM orders WHERE status = ?", 'open',
+ *       function(err, result) {
+ *           // result.rows: all rows
+ *           // result.added, result.removed: rows that weren't in, or are no
+ *           // longer in the previous result
+ *       });
+ *   ...
+ *   watch.close();
+ *
+ * The authorizer records the tables the query reads when it is prepared,
+ * and the update and commit hooks collect the tables each transaction
+ * changed. The query is run again on the thread pool, in turn with the
+ * other calls on the database, only after a commit that changed one of its
+ * tables or the schema. Commits that happen while it runs are picked up by
+ * one more run. Rows are compared with the previous result natively, as a
+ * multiset of whole rows, and the callback is only made if something
+ * changed.
+ *
+ * Changes made through other connections are not seen. Closing the database
+ * closes its watches.
+ *
+ */
+class Watch : public Napi::ObjectWrap<Watch> {
+public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+
+    struct Baton : Database::Baton {
+        Watch* watch;
+        ReadSet reads;
+        // Indexes of the new rows in the result.
+        std::vector<size_t> added;
+        Rows removed;
+        Baton(Database* db_, Watch* watch_) :
+                Database::Baton(db_, Napi::Function()), watch(watch_) {
+            watch->Ref();
+        }
+        virtual ~Baton() override {
+            watch->Unref();
+        }
+    };
+
+    Watch(const Napi::CallbackInfo& info);
+
+    ~Watch() {
+        callback.Reset();
+        if (db) db->Unref();
+    }
+
+    Napi::Value Close(const Napi::CallbackInfo& info);
+
+    // Whether a commit could have changed the result.
+    bool Affected(const Database::CommitInfo& info) const;
+    // Runs the query again, or once more after the current run.
+    void Rerun();
+    // Stops watching. Called when the watch or the database is closed.
+    void Stop();
+
+protected:
+    static void Work_BeginRun(Database::Baton* baton);
+    static void Work_Run(napi_env env, void* data);
+    static void Work_AfterRun(napi_env env, napi_status status, void* data);
+
+    static void Diff(Rows& previous, Rows& rows, Baton* baton);
+
+    Database* db = NULL;
+    std::string sql;
+    Parameters parameters;
+    Napi::FunctionReference callback;
+
+    // Tables that the last run read.
+    std::set<Table> tables;
+    // Result of the last run. Only used by the run that is in progress.
+    Rows rows;
+
+    bool first = true;
+    bool running = false;
+    bool stale = false;
+    bool closed = false;
+};
+
+}
+
+#endif
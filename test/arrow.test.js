@@ -0,0 +1,154 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+// Reads the messages of an Arrow IPC stream: the names and type ids of the
+// fields of the schema, and the length of each record batch along with the
+// values of its Int64 columns.
+function readStream(buffer) {
+    function table(pos) {
+        var vtable = pos - buffer.readInt32LE(pos);
+        var size = buffer.readUInt16LE(vtable);
+        return {
+            field: function(id) {
+                if (4 + 2 * id >= size) return 0;
+                var offset = buffer.readUInt16LE(vtable + 4 + 2 * id);
+                return offset && pos + offset;
+            },
+            ref: function(id) {
+                var at = this.field(id);
+                return at + buffer.readUInt32LE(at);
+            }
+        };
+    }
+
+    var result = { fields: [], batches: [] };
+    var pos = 0;
+    while (true) {
+        assert.equal(buffer.readUInt32LE(pos), 0xFFFFFFFF);
+        var size = buffer.readInt32LE(pos + 4);
+        pos += 8;
+        if (size === 0) break;
+        var start = pos;
+        var message = table(start + buffer.readUInt32LE(start));
+        var type = buffer.readUInt8(message.field(1));
+        var header = table(message.ref(2));
+        var bodyLength = Number(buffer.readBigInt64LE(message.field(3)));
+        var body = start + size;
+
+        if (type === 1) {
+            var fields = header.ref(1);
+            for (var i = 0; i < buffer.readUInt32LE(fields); i++) {
+                var slot = fields + 4 + 4 * i;
+                var field = table(slot + buffer.readUInt32LE(slot));
+                var name = field.ref(0);
+                result.fields.push({
+                    name: buffer.toString('utf8', name + 4, name + 4 + buffer.readUInt32LE(name)),
+                    type: buffer.readUInt8(field.field(2))
+                });
+            }
+        }
+        else if (type === 3) {
+            var length = Number(buffer.readBigInt64LE(header.field(0)));
+            var buffers = header.ref(2);
+            var columns = [];
+            var index = 0;
+            result.fields.forEach(function(field) {
+                var read = function() {
+                    var at = buffers + 4 + 16 * index++;
+                    return body + Number(buffer.readBigInt64LE(at));
+                };
+                read();
+                if (field.type === 2) {
+                    var data = read();
+                    var values = [];
+                    for (var i = 0; i < length; i++) values.push(Number(buffer.readBigInt64LE(data + 8 * i)));
+                    columns.push(values);
+                }
+                else {
+                    if (field.type !== 3) read();
+                    read();
+                    columns.push(null);
+                }
+            });
+            result.batches.push({ length: length, columns: columns });
+        }
+        pos = body + bodyLength;
+    }
+    assert.equal(pos, buffer.length);
+    return result;
+}
+
+describe('arrow', function() {
+    var db;
+
+    before(function(done) {
+        db = new sqlite3.Database(':memory:');
+        db.serialize(function() {
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, num REAL, txt TEXT, data BLOB)");
+            db.run("INSERT INTO foo (num, txt, data) WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM c WHERE i < 1000) " +
+                   "SELECT i / 2.0, 'row ' || i, CASE WHEN i % 3 THEN randomblob(4) END FROM c", done);
+        });
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    it('encodes all rows as one stream', function(done) {
+        db.allArrow("SELECT id, num, txt, data, id * 2 AS twice FROM foo WHERE id <= ?", 500, function(err, ipc) {
+            if (err) throw err;
+            assert.ok(Buffer.isBuffer(ipc));
+            var stream = readStream(ipc);
+            assert.deepEqual(stream.fields, [
+                { name: 'id', type: 2 },
+                { name: 'num', type: 3 },
+                { name: 'txt', type: 5 },
+                { name: 'data', type: 4 },
+                { name: 'twice', type: 2 }
+            ]);
+            assert.equal(stream.batches.length, 1);
+            assert.equal(stream.batches[0].length, 500);
+            assert.equal(stream.batches[0].columns[0][499], 500);
+            assert.equal(stream.batches[0].columns[4][499], 1000);
+            done();
+        });
+    });
+
+    it('encodes empty results', function(done) {
+        db.allArrow("SELECT id, txt FROM foo WHERE 0", function(err, ipc) {
+            if (err) throw err;
+            var stream = readStream(ipc);
+            assert.deepEqual(stream.fields.map(function(field) { return field.name; }), ['id', 'txt']);
+            assert.equal(stream.batches.length, 0);
+            done();
+        });
+    });
+
+    it('streams batches', function(done) {
+        var lengths = [];
+        var next = 1;
+        db.eachArrow("SELECT id FROM foo", 300, function(err, ipc) {
+            if (err) throw err;
+            var stream = readStream(ipc);
+            assert.equal(stream.batches.length, 1);
+            var batch = stream.batches[0];
+            lengths.push(batch.length);
+            assert.equal(batch.columns[0][0], next);
+            next += batch.length;
+        }, function(err, batches) {
+            if (err) throw err;
+            assert.equal(batches, 4);
+            assert.deepEqual(lengths, [300, 300, 300, 100]);
+            done();
+        });
+    });
+
+    it('reports errors', function(done) {
+        var stmt = db.prepare("SELECT abs(-9223372036854775807 - id) FROM foo");
+        stmt.allArrow(function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_ERROR');
+            stmt.finalize(done);
+        });
+    });
+});
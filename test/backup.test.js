@@ -1,6 +1,7 @@
 var sqlite3 = require('..');
 var assert = require('assert');
 var fs = require('fs');
+var stream = require('stream');
 var helper = require('./support/helper');
 
 // Check that the number of rows in two tables matches.
@@ -276,4 +277,215 @@ describe('backup', function() {
             });
         });
     });
+
+    it ('auto backups step on their own and report progress', function(done) {
+        var progress = [];
+        var backup = db.backup('test/tmp/backup.db', { auto: true, targetStepMs: 1 }, function(err) {
+            if (err) throw err;
+            assert.equal(backup.completed, true);
+            assert.equal(backup.failed, false);
+            assert.equal(backup.idle, true);
+            assert.ok(progress.length >= 1);
+            assert.deepEqual(progress[progress.length - 1], [0, backup.pageCount]);
+            assertRowsMatchFile(db, 'test/tmp/backup.db', done);
+        });
+        backup.on('progress', function(remaining, pageCount) {
+            progress.push([remaining, pageCount]);
+        });
+    });
+
+    it ('auto backups can be rate limited', function(done) {
+        var backup = db.backup('test/tmp/backup.db', { auto: true, maxPagesPerSec: 100000 }, function(err) {
+            if (err) throw err;
+            assert.equal(backup.completed, true);
+            assertRowsMatchFile(db, 'test/tmp/backup.db', done);
+        });
+    });
+
+    it ('auto backups back off while the destination is locked', function(done) {
+        var db2 = new sqlite3.Database('test/tmp/backup.db', function(err) {
+            if (err) throw err;
+            db2.exec("PRAGMA locking_mode = EXCLUSIVE");
+            db2.exec("BEGIN EXCLUSIVE", function(err) {
+                if (err) throw err;
+                var backup = db.backup('test/tmp/backup.db', { auto: true }, function(err) {
+                    if (err) throw err;
+                    assert.equal(backup.completed, true);
+                    assertRowsMatchFile(db, 'test/tmp/backup.db', done);
+                });
+                setTimeout(function() {
+                    assert.equal(backup.completed, false);
+                    assert.equal(backup.failed, false);
+                    db2.close(function(err) {
+                        if (err) throw err;
+                    });
+                }, 50);
+            });
+        });
+    });
+
+    it ('auto backups fail on errors not listed in retryErrors', function(done) {
+        var db2 = new sqlite3.Database('test/tmp/backup.db', function(err) {
+            if (err) throw err;
+            db2.exec("PRAGMA locking_mode = EXCLUSIVE");
+            db2.exec("BEGIN EXCLUSIVE", function(err) {
+                if (err) throw err;
+                var backup = db.backup('test/tmp/backup.db', function(err) {
+                    if (err) throw err;
+                    backup.retryErrors = [];
+                    backup.run(function(err) {
+                        assert.ok(err);
+                        assert.equal(err.errno, sqlite3.BUSY);
+                        assert.equal(backup.failed, true);
+                        db2.close(done);
+                    });
+                });
+            });
+        });
+    });
+
+    it ('differential backups only write changed pages', function(done) {
+        helper.deleteFile('test/tmp/backup.db-pages');
+        helper.deleteFile('test/tmp/differential.db');
+        var source = new sqlite3.Database('test/tmp/differential.db');
+        source.serialize(function() {
+            source.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)");
+            source.run("WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM c WHERE i < 5000) " +
+                       "INSERT INTO foo(txt) SELECT hex(randomblob(50)) FROM c");
+        });
+        source.backup('test/tmp/backup.db', { incremental: true }, function(err, written) {
+            if (err) throw err;
+            var pageCount = this.pageCount;
+            assert.equal(written, pageCount);
+            assert.fileExists('test/tmp/backup.db-pages');
+            source.backup('test/tmp/backup.db', { incremental: true }, function(err, written) {
+                if (err) throw err;
+                assert.equal(written, 0);
+                source.run("UPDATE foo SET txt = 'changed' WHERE id = 2500", function(err) {
+                    if (err) throw err;
+                    source.backup('test/tmp/backup.db', { incremental: true }, function(err, written) {
+                        if (err) throw err;
+                        assert.ok(written > 0 && written < pageCount);
+                        var copy = new sqlite3.Database('test/tmp/backup.db', sqlite3.OPEN_READONLY);
+                        copy.get("SELECT txt FROM foo WHERE id = 2500", function(err, row) {
+                            if (err) throw err;
+                            assert.equal(row.txt, 'changed');
+                            assertRowsMatchDb(source, 'foo', copy, 'foo', function() {
+                                copy.close(function() {
+                                    source.close(done);
+                                });
+                            });
+                        });
+                    });
+                });
+            });
+        });
+    });
+
+    it ('differential backups wait for writers of the destination', function(done) {
+        var dest = new sqlite3.Database('test/tmp/backup.db');
+        dest.exec("BEGIN IMMEDIATE", function(err) {
+            if (err) throw err;
+            db.backup('test/tmp/backup.db', { incremental: true }, function(err) {
+                assert.ok(err);
+                assert.equal(err.errno, sqlite3.BUSY);
+                dest.exec("ROLLBACK", function(err) {
+                    if (err) throw err;
+                    dest.close(done);
+                });
+            });
+        });
+    });
+
+    it ('differential backups need a database file', function(done) {
+        var memory = new sqlite3.Database(':memory:');
+        memory.backup('test/tmp/backup.db', { incremental: true }, function(err) {
+            assert.ok(err);
+            assert.equal(err.errno, sqlite3.MISUSE);
+            memory.close(done);
+        });
+    });
+
+    it ('stops streaming when the writable fails while draining', function(done) {
+        var writable = new stream.Writable({
+            highWaterMark: 1024,
+            // Never done, so the stream doesn't drain.
+            write: function(chunk, encoding, callback) {}
+        });
+        db.backupToStream(writable, { pagesPerChunk: 4 }, function(err) {
+            assert.ok(err);
+            assert.equal(err.message, 'gone');
+            done();
+        });
+        setTimeout(function() {
+            writable.destroy(new Error('gone'));
+        }, 50);
+    });
+
+    it ('streams a consistent image into a writable', function(done) {
+        var stream = fs.createWriteStream('test/tmp/backup.db', { highWaterMark: 1024 });
+        db.backupToStream(stream, { pagesPerChunk: 4 }, function(err) {
+            if (err) throw err;
+            stream.end(function() {
+                assertRowsMatchFile(db, 'test/tmp/backup.db', done);
+            });
+        });
+    });
+
+    it ('does not stream in-memory databases', function(done) {
+        var memory = new sqlite3.Database(':memory:');
+        var writable = new stream.Writable({
+            write: function(chunk, encoding, callback) {
+                throw new Error('nothing should be written');
+            }
+        });
+        memory.backupToStream(writable, function(err) {
+            assert.ok(err);
+            assert.equal(err.message, 'Streaming a backup needs a database file');
+            memory.close(done);
+        });
+    });
+
+    it ('keeps streaming the image it started with', function(done) {
+        helper.deleteFile('test/tmp/backup_source.db');
+        helper.deleteFile('test/tmp/backup_source.db-wal');
+        helper.deleteFile('test/tmp/backup_source.db-shm');
+        fs.copyFileSync('test/support/prepare.db', 'test/tmp/backup_source.db');
+        var source = new sqlite3.Database('test/tmp/backup_source.db');
+        var chunks = [];
+        var changed = false;
+        var writable = new stream.Writable({
+            highWaterMark: 1024,
+            write: function(chunk, encoding, callback) {
+                chunks.push(chunk);
+                if (changed) return callback();
+                // Change the database while the image is being streamed.
+                changed = true;
+                var other = new sqlite3.Database('test/tmp/backup_source.db');
+                other.run("DELETE FROM foo", function(err) {
+                    if (err) throw err;
+                    other.close(callback);
+                });
+            }
+        });
+        source.run("PRAGMA journal_mode = WAL", function(err) {
+            if (err) throw err;
+            source.get("SELECT COUNT(*) AS count FROM foo", function(err, before) {
+                if (err) throw err;
+                assert.ok(before.count > 0);
+                source.backupToStream(writable, { pagesPerChunk: 1 }, function(err) {
+                    if (err) throw err;
+                    fs.writeFileSync('test/tmp/backup.db', Buffer.concat(chunks));
+                    var backup = new sqlite3.Database('test/tmp/backup.db');
+                    backup.get("SELECT COUNT(*) AS count FROM foo", function(err, after) {
+                        if (err) throw err;
+                        assert.equal(after.count, before.count);
+                        backup.close(function() {
+                            source.close(done);
+                        });
+                    });
+                });
+            });
+        });
+    });
 });
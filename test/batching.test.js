@@ -0,0 +1,66 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('batching', function() {
+    var db;
+    before(function(done) {
+        db = new sqlite3.Database(':memory:');
+        db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)", done);
+    });
+
+    it('should fire queued run callbacks in order', function(done) {
+        var stmt = db.prepare("INSERT INTO foo VALUES(?, ?)");
+        var count = 1000;
+        var fired = 0;
+
+        for (var i = 1; i <= count; i++) {
+            (function(i) {
+                stmt.run(i, 'row ' + i, function(err) {
+                    if (err) throw err;
+                    assert.equal(this.lastID, i);
+                    assert.equal(this.changes, 1);
+                    assert.equal(fired + 1, i);
+                    fired++;
+                });
+            })(i);
+        }
+
+        stmt.finalize(function() {
+            assert.equal(fired, count);
+            done();
+        });
+    });
+
+    it('should report errors to the right callback', function(done) {
+        var stmt = db.prepare("INSERT INTO foo VALUES(?, ?)");
+        var results = [];
+
+        stmt.run(2000, 'ok', function(err) { results.push(err ? err.code : null); });
+        stmt.run(2000, 'duplicate', function(err) { results.push(err ? err.code : null); });
+        stmt.run(2001, 'ok', function(err) { results.push(err ? err.code : null); });
+
+        stmt.finalize(function() {
+            assert.deepEqual(results, [null, 'SQLITE_CONSTRAINT', null]);
+            done();
+        });
+    });
+
+    it('should interleave bind and get', function(done) {
+        var stmt = db.prepare("SELECT txt FROM foo WHERE id = ?");
+        var rows = [];
+
+        stmt.bind(1);
+        stmt.get(function(err, row) { if (err) throw err; rows.push(row.txt); });
+        stmt.get(2, function(err, row) { if (err) throw err; rows.push(row.txt); });
+        stmt.get(-1, function(err, row) { if (err) throw err; rows.push(row); });
+
+        stmt.finalize(function() {
+            assert.deepEqual(rows, ['row 1', 'row 2', undefined]);
+            done();
+        });
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+});
@@ -0,0 +1,80 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('buffer', function() {
+    var db;
+    var image;
+    before(function(done) {
+        db = new sqlite3.Database(':memory:');
+        db.serialize(function() {
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)");
+            db.run("INSERT INTO foo VALUES(1, 'one'), (2, 'two')", done);
+        });
+    });
+
+    it('should serialize the database into a buffer', function(done) {
+        db.toBuffer(function(err, buffer) {
+            if (err) throw err;
+            assert.ok(Buffer.isBuffer(buffer));
+            assert.ok(buffer.length > 0);
+            assert.equal(buffer.toString('utf8', 0, 15), 'SQLite format 3');
+            image = buffer;
+            done();
+        });
+    });
+
+    it('should fail for an unknown schema', function(done) {
+        db.toBuffer('missing', function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_ERROR');
+            done();
+        });
+    });
+
+    it('should open a copy of the database from a buffer', function(done) {
+        var copy = sqlite3.Database.fromBuffer(image, function(err) {
+            if (err) throw err;
+            copy.run("INSERT INTO foo VALUES(3, 'three')", function(err) {
+                if (err) throw err;
+                copy.all("SELECT txt FROM foo ORDER BY id", function(err, rows) {
+                    if (err) throw err;
+                    assert.deepEqual(rows.map(function(row) { return row.txt; }), ['one', 'two', 'three']);
+                    copy.close(done);
+                });
+            });
+        });
+    });
+
+    it('should use the buffer in place when read-only', function(done) {
+        var copy = sqlite3.Database.fromBuffer(image, { readonly: true }, function(err) {
+            if (err) throw err;
+            copy.get("SELECT COUNT(*) AS count FROM foo", function(err, row) {
+                if (err) throw err;
+                assert.equal(row.count, 2);
+                copy.run("INSERT INTO foo VALUES(3, 'three')", function(err) {
+                    assert.ok(err);
+                    assert.equal(err.code, 'SQLITE_READONLY');
+                    copy.close(done);
+                });
+            });
+        });
+    });
+
+    it('should not affect the source when modifying a copy', function(done) {
+        db.get("SELECT COUNT(*) AS count FROM foo", function(err, row) {
+            if (err) throw err;
+            assert.equal(row.count, 2);
+            done();
+        });
+    });
+
+    it('should reject non-buffers', function() {
+        assert.throws(function() {
+            db.loadBuffer('SQLite format 3');
+        }, /Buffer expected/);
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+});
@@ -8,6 +8,7 @@ describe('constants', function() {
         assert.ok(sqlite3.OPEN_CREATE === 4);
         assert.ok(sqlite3.OPEN_URI === 0x00000040);
         assert.ok(sqlite3.OPEN_FULLMUTEX === 0x00010000);
+        assert.ok(sqlite3.OPEN_NOMUTEX === 0x00008000);
         assert.ok(sqlite3.OPEN_SHAREDCACHE === 0x00020000);
         assert.ok(sqlite3.OPEN_PRIVATECACHE === 0x00040000);
     });
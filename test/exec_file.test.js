@@ -0,0 +1,138 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+var fs = require('fs');
+var helper = require('./support/helper');
+
+describe('execFile', function() {
+    var db;
+
+    beforeEach(function(done) {
+        helper.ensureExists('test/tmp');
+        db = new sqlite3.Database(':memory:', done);
+    });
+
+    afterEach(function(done) {
+        db.close(done);
+    });
+
+    it('runs the same script as Database#exec', function(done) {
+        db.execFile('test/support/script.sql', function(err, result) {
+            if (err) throw err;
+            assert.equal(result.statements, 15);
+            assert.equal(result.bytes, fs.statSync('test/support/script.sql').size);
+            db.all("SELECT type, name FROM sqlite_master ORDER BY type, name", function(err, rows) {
+                if (err) throw err;
+                assert.equal(rows.length, 15);
+                done();
+            });
+        });
+    });
+
+    it('splits statements at the right semicolons', function(done) {
+        var file = 'test/tmp/exec_file.sql';
+        fs.writeFileSync(file,
+            "CREATE TABLE foo (txt TEXT);\n" +
+            "-- a comment; with a semicolon\n" +
+            "CREATE TRIGGER bar AFTER INSERT ON foo BEGIN SELECT 1; SELECT 2; END;\n" +
+            "INSERT INTO foo VALUES ('a;b');\n" +
+            "/* ; */ INSERT INTO foo VALUES ('two\nlines;');\n" +
+            "INSERT INTO foo VALUES ('no semicolon')");
+        db.execFile(file, function(err, result) {
+            if (err) throw err;
+            assert.equal(result.statements, 5);
+            db.all("SELECT txt FROM foo", function(err, rows) {
+                if (err) throw err;
+                assert.deepEqual(rows.map(function(row) { return row.txt; }),
+                    ['a;b', 'two\nlines;', 'no semicolon']);
+                done();
+            });
+        });
+    });
+
+    it('reads statements with many semicolons in strings', function(done) {
+        // The string goes on past the first read of the file.
+        var text = new Array(600001).join('a;');
+        var file = 'test/tmp/exec_file_strings.sql';
+        fs.writeFileSync(file,
+            "CREATE TABLE foo (txt TEXT);\n" +
+            "INSERT INTO foo VALUES ('" + text + "');\n" +
+            "INSERT INTO foo VALUES ('done');\n");
+        db.execFile(file, function(err, result) {
+            if (err) throw err;
+            assert.equal(result.statements, 3);
+            db.all("SELECT length(txt) AS length FROM foo", function(err, rows) {
+                if (err) throw err;
+                assert.deepEqual(rows, [{ length: text.length }, { length: 4 }]);
+                done();
+            });
+        });
+    });
+
+    it('groups statements into transactions and reports progress', function(done) {
+        var file = 'test/tmp/exec_file_dump.sql';
+        var sql = "CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT);\n";
+        for (var i = 1; i <= 2500; i++) {
+            sql += "INSERT INTO foo VALUES (" + i + ", 'row " + i + "');\n";
+        }
+        sql += "BEGIN;\nINSERT INTO foo VALUES (2501, 'own transaction');\nCOMMIT;\n";
+        fs.writeFileSync(file, sql);
+
+        var progress = [];
+        db.execFile(file, { transactionEvery: 1000, progress: function(info) {
+            progress.push(info.statements);
+        } }, function(err, result) {
+            if (err) throw err;
+            assert.equal(result.statements, 2504);
+            assert.deepEqual(progress, [1000, 2000]);
+            db.get("SELECT count(*) AS count FROM foo", function(err, row) {
+                if (err) throw err;
+                assert.equal(row.count, 2501);
+                done();
+            });
+        });
+    });
+
+    it('restores a .dump with transactionEvery', function(done) {
+        var file = 'test/tmp/exec_file_restore.sql';
+        fs.writeFileSync(file,
+            "PRAGMA foreign_keys=OFF;\n" +
+            "BEGIN TRANSACTION;\n" +
+            "CREATE TABLE parent (id INTEGER PRIMARY KEY);\n" +
+            "CREATE TABLE child (id INTEGER PRIMARY KEY, parent INTEGER REFERENCES parent(id));\n" +
+            "INSERT INTO child VALUES(1,2);\n" +
+            "INSERT INTO parent VALUES(2);\n" +
+            "COMMIT;\n" +
+            "INSERT INTO parent VALUES(3);\n" +
+            "ATTACH ':memory:' AS aux;\n" +
+            "CREATE TABLE aux.foo (id INTEGER);\n" +
+            "DETACH aux;\n" +
+            "VACUUM;\n");
+        db.run("PRAGMA foreign_keys = ON");
+        db.execFile(file, { transactionEvery: 100 }, function(err, result) {
+            if (err) throw err;
+            assert.equal(result.statements, 12);
+            db.get("SELECT (SELECT count(*) FROM parent) AS parents, (SELECT count(*) FROM child) AS children, " +
+                   "(SELECT foreign_keys FROM pragma_foreign_keys) AS fk", function(err, row) {
+                if (err) throw err;
+                assert.deepEqual(row, { parents: 2, children: 1, fk: 0 });
+                done();
+            });
+        });
+    });
+
+    it('reports the line of a failing statement', function(done) {
+        var file = 'test/tmp/exec_file_error.sql';
+        fs.writeFileSync(file, "CREATE TABLE foo (id INTEGER PRIMARY KEY);\n\nINSERT INTO foo VALUES (1);\nINSERT INTO foo VALUES (1);\n");
+        db.execFile(file, { transactionEvery: 10 }, function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_CONSTRAINT');
+            assert.ok(/^SQLITE_CONSTRAINT: Line 4: UNIQUE constraint failed/.test(err.message));
+            db.get("SELECT count(*) AS count FROM sqlite_master", function(err, row) {
+                if (err) throw err;
+                // The transaction was rolled back.
+                assert.equal(row.count, 0);
+                done();
+            });
+        });
+    });
+});
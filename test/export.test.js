@@ -0,0 +1,126 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+var fs = require('fs');
+var helper = require('./support/helper');
+
+describe('exportTo', function() {
+    var db;
+
+    before(function(done) {
+        helper.ensureExists('test/tmp');
+        db = new sqlite3.Database(':memory:');
+        db.serialize(function() {
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, num REAL, txt TEXT, data BLOB)");
+            db.run("INSERT INTO foo VALUES (1, 0.5, 'plain', x'00ff10')");
+            db.run("INSERT INTO foo VALUES (2, NULL, 'comma, \"quote\"' || char(10) || 'line', NULL)", done);
+        });
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    it('writes CSV with a header', function(done) {
+        var file = 'test/tmp/export.csv';
+        helper.deleteFile(file);
+        db.exportTo("SELECT * FROM foo ORDER BY id", file, function(err, result) {
+            if (err) throw err;
+            assert.deepEqual(result, { rows: 2, bytes: fs.statSync(file).size });
+            assert.equal(fs.readFileSync(file, 'utf8'),
+                'id,num,txt,data\n' +
+                '1,0.5,plain,AP8Q\n' +
+                '2,,"comma, ""quote""\nline",\n');
+            done();
+        });
+    });
+
+    it('writes infinities to CSV so that they read back', function(done) {
+        var file = 'test/tmp/export_inf.csv';
+        helper.deleteFile(file);
+        db.serialize(function() {
+            db.exportTo("SELECT 1e999 AS a, -1e999 AS b, -2.5e-7 AS c", file, { header: false }, function(err) {
+                if (err) throw err;
+                var text = fs.readFileSync(file, 'utf8');
+                assert.equal(text, '9e999,-9e999,-2.5e-7\n');
+                assert.deepEqual(text.trim().split(',').map(Number), [Infinity, -Infinity, -2.5e-7]);
+            });
+            db.run("CREATE TABLE inf (a REAL, b REAL, c REAL)");
+            db.importFile(file, 'inf', { header: false });
+            db.get("SELECT * FROM inf", function(err, row) {
+                if (err) throw err;
+                assert.deepEqual(row, { a: Infinity, b: -Infinity, c: -2.5e-7 });
+                done();
+            });
+        });
+    });
+
+    it('writes NDJSON with parameters', function(done) {
+        var file = 'test/tmp/export.ndjson';
+        helper.deleteFile(file);
+        db.exportTo("SELECT id, data FROM foo WHERE id >= ? ORDER BY id", file,
+                { format: 'ndjson', blobs: 'hex', params: [1] }, function(err, result) {
+            if (err) throw err;
+            assert.equal(result.rows, 2);
+            var lines = fs.readFileSync(file, 'utf8').split('\n');
+            assert.deepEqual(lines, ['{"id":1,"data":"00ff10"}', '{"id":2,"data":null}', '']);
+            done();
+        });
+    });
+
+    it('writes to a file descriptor and reports progress', function(done) {
+        var file = 'test/tmp/export_fd.csv';
+        var fd = fs.openSync(file, 'w');
+        var progress = [];
+        var stmt = db.prepare("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 200000) SELECT i FROM n");
+        stmt.exportTo(fd, { header: false, delimiter: ';', progress: function(info) {
+            progress.push(info.rows);
+        } }, function(err, result) {
+            if (err) throw err;
+            fs.closeSync(fd);
+            assert.equal(result.rows, 200000);
+            assert.deepEqual(progress, [65536, 131072, 196608]);
+            var lines = fs.readFileSync(file, 'utf8').split('\n');
+            assert.equal(lines.length, 200001);
+            assert.equal(lines[0], '1');
+            assert.equal(lines[199999], '200000');
+            stmt.finalize(done);
+        });
+    });
+
+    it('reports errors', function(done) {
+        db.exportTo("SELECT * FROM foo", 'test/tmp/missing/export.csv', function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_CANTOPEN');
+            var stmt = db.prepare("SELECT 1");
+            assert.throws(function() {
+                stmt.exportTo('test/tmp/export.csv', { format: 'xml' });
+            }, /Format must be "csv" or "ndjson"/);
+            stmt.finalize(done);
+        });
+    });
+
+    it('quotes numbers and blobs that hold the delimiter', function(done) {
+        var file = 'test/tmp/export_delimiter.csv';
+        helper.deleteFile(file);
+        db.exportTo("SELECT 0.5 AS a, 12 AS b, -3 AS c, x'00ff10' AS d", file,
+                { header: false, delimiter: '-', blobs: 'hex' }, function(err) {
+            if (err) throw err;
+            assert.equal(fs.readFileSync(file, 'utf8'), '0.5-12-"-3"-00ff10\n');
+            db.exportTo("SELECT 0.5 AS a, 12 AS b", file, { header: false, delimiter: '.' }, function(err) {
+                if (err) throw err;
+                assert.equal(fs.readFileSync(file, 'utf8'), '"0.5".12\n');
+                done();
+            });
+        });
+    });
+
+    it('quotes empty strings to tell them from NULL', function(done) {
+        var file = 'test/tmp/export_empty.csv';
+        helper.deleteFile(file);
+        db.exportTo("SELECT '' AS a, NULL AS b, 'x' AS c", file, { header: false }, function(err) {
+            if (err) throw err;
+            assert.equal(fs.readFileSync(file, 'utf8'), '"",,x\n');
+            done();
+        });
+    });
+});
@@ -0,0 +1,87 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+var helper = require('./support/helper');
+
+describe('external changes', function() {
+    var db;
+    var other;
+
+    beforeEach(function(done) {
+        helper.ensureExists('test/tmp');
+        helper.deleteFile('test/tmp/external_change.db');
+        helper.deleteFile('test/tmp/external_change.db-wal');
+        helper.deleteFile('test/tmp/external_change.db-shm');
+        db = new sqlite3.Database('test/tmp/external_change.db');
+        db.serialize(function() {
+            db.run("PRAGMA journal_mode = WAL");
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)");
+            db.run("INSERT INTO foo VALUES (1, 'a')", function(err) {
+                if (err) throw err;
+                other = new sqlite3.Database('test/tmp/external_change.db', done);
+            });
+        });
+    });
+
+    afterEach(function(done) {
+        db.close(function(err) {
+            if (err) throw err;
+            other.close(done);
+        });
+    });
+
+    it('notices commits of other connections', function(done) {
+        db.onExternalChange(function() {
+            assert.equal(this, db);
+            db.onExternalChange(false);
+            done();
+        }, { intervalMs: 5 });
+        other.run("INSERT INTO foo VALUES (2, 'b')");
+    });
+
+    it('ignores commits of its own connection', function(done) {
+        var calls = 0;
+        db.onExternalChange(function() { calls++; }, { intervalMs: 5 });
+        db.run("INSERT INTO foo VALUES (2, 'b')", function(err) {
+            if (err) throw err;
+            setTimeout(function() {
+                assert.equal(calls, 0);
+                db.onExternalChange(false);
+                done();
+            }, 50);
+        });
+    });
+
+    it('flushes the query cache and reruns watches', function(done) {
+        db.configure('queryCache', { entries: 16 });
+        var results = 0;
+        var watch = db.watch("SELECT count(*) AS n FROM foo", function(err, result) {
+            if (err) throw err;
+            results++;
+            if (results === 1) {
+                db.all("SELECT * FROM foo", function(err) {
+                    if (err) throw err;
+                    assert.equal(db.queryCacheStats.entries, 1);
+                    db.onExternalChange(function() {
+                        assert.equal(db.queryCacheStats.entries, 0);
+                    }, { intervalMs: 5 });
+                    other.run("INSERT INTO foo VALUES (2, 'b')");
+                });
+            }
+            else {
+                assert.deepEqual(result.rows, [{ n: 2 }]);
+                watch.close();
+                db.onExternalChange(false);
+                done();
+            }
+        });
+    });
+
+    it('validates its arguments', function() {
+        assert.throws(function() {
+            db.onExternalChange(function() {}, { intervalMs: 0 });
+        }, /Interval must be positive/);
+        assert.throws(function() {
+            db.onExternalChange('foo');
+        }, /Argument 0 must be a function/);
+    });
+});
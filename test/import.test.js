@@ -0,0 +1,147 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+var fs = require('fs');
+var helper = require('./support/helper');
+
+describe('importFile', function() {
+    var db;
+
+    beforeEach(function(done) {
+        helper.ensureExists('test/tmp');
+        db = new sqlite3.Database(':memory:');
+        db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, num REAL, txt TEXT)", done);
+    });
+
+    afterEach(function(done) {
+        db.close(done);
+    });
+
+    it('imports CSV with a header', function(done) {
+        var file = 'test/tmp/import.csv';
+        fs.writeFileSync(file, 'txt,id,num\r\nplain,1,0.5\r\n"comma, ""quote""\nline",2,\n"",3,1e3\n');
+        db.importFile(file, 'foo', function(err, result) {
+            if (err) throw err;
+            assert.equal(result.rows, 3);
+            assert.equal(result.bytes, fs.statSync(file).size);
+            db.all("SELECT * FROM foo ORDER BY id", function(err, rows) {
+                if (err) throw err;
+                assert.deepEqual(rows, [
+                    { id: 1, num: 0.5, txt: 'plain' },
+                    { id: 2, num: null, txt: 'comma, "quote"\nline' },
+                    { id: 3, num: 1000, txt: '' },
+                ]);
+                done();
+            });
+        });
+    });
+
+    it('imports what exportTo wrote', function(done) {
+        var file = 'test/tmp/import_export.csv';
+        db.serialize(function() {
+            db.run("INSERT INTO foo VALUES (1, 2.5, 'a;b'), (2, NULL, ''), (3, -1, NULL)");
+            db.exportTo("SELECT * FROM foo", file, { delimiter: ';' });
+            db.run("CREATE TABLE bar (id INTEGER PRIMARY KEY, num REAL, txt TEXT)");
+            db.importFile(file, 'bar', { delimiter: ';' }, function(err, result) {
+                if (err) throw err;
+                assert.equal(result.rows, 3);
+                db.all("SELECT * FROM foo EXCEPT SELECT * FROM bar", function(err, rows) {
+                    if (err) throw err;
+                    assert.deepEqual(rows, []);
+                    done();
+                });
+            });
+        });
+    });
+
+    it('imports NDJSON in batches', function(done) {
+        var file = 'test/tmp/import.ndjson';
+        var lines = [];
+        for (var i = 1; i <= 2500; i++) {
+            lines.push(JSON.stringify({ id: i, txt: 'row ' + i + ' é\n', extra: [i] }));
+        }
+        fs.writeFileSync(file, lines.join('\n') + '\n');
+        var progress = [];
+        db.importFile(file, 'foo', { format: 'ndjson', batchSize: 1000, progress: function(info) {
+            progress.push(info.rows);
+        } }, function(err, result) {
+            if (err) throw err;
+            assert.equal(result.rows, 2500);
+            assert.deepEqual(progress, [1000, 2000]);
+            db.get("SELECT count(*) AS count, sum(id) AS sum, max(num) AS num FROM foo", function(err, row) {
+                if (err) throw err;
+                assert.deepEqual(row, { count: 2500, sum: 2500 * 2501 / 2, num: null });
+                db.get("SELECT txt FROM foo WHERE id = 7", function(err, row) {
+                    if (err) throw err;
+                    assert.equal(row.txt, 'row 7 é\n');
+                    done();
+                });
+            });
+        });
+    });
+
+    it('gives columns of missing NDJSON keys their default', function(done) {
+        var file = 'test/tmp/import_defaults.ndjson';
+        fs.writeFileSync(file, '{"id":1,"txt":null}\n{"id":2}\n{}\n');
+        db.serialize(function() {
+            db.run("CREATE TABLE bar (id INTEGER PRIMARY KEY, txt TEXT DEFAULT 'none')");
+            db.importFile(file, 'bar', { format: 'ndjson' }, function(err, result) {
+                if (err) throw err;
+                assert.equal(result.rows, 3);
+            });
+            db.all("SELECT * FROM bar ORDER BY id", function(err, rows) {
+                if (err) throw err;
+                assert.deepEqual(rows, [
+                    { id: 1, txt: null },
+                    { id: 2, txt: 'none' },
+                    { id: 3, txt: 'none' },
+                ]);
+                done();
+            });
+        });
+    });
+
+    it('reports the line of bad records', function(done) {
+        var file = 'test/tmp/import_bad.csv';
+        fs.writeFileSync(file, '1,0.5,a\n2,1\n');
+        db.importFile(file, 'foo', { header: false }, function(err) {
+            assert.ok(err);
+            assert.equal(err.message, 'SQLITE_ERROR: Line 2: expected 3 fields, found 2');
+            db.get("SELECT count(*) AS count FROM foo", function(err, row) {
+                if (err) throw err;
+                // The batch was rolled back.
+                assert.equal(row.count, 0);
+                done();
+            });
+        });
+    });
+
+    it('only takes back the failing batch inside a transaction', function(done) {
+        var file = 'test/tmp/import_transaction.csv';
+        fs.writeFileSync(file, 'id,txt\n1,a\n2,b\n3,c\n3,d\n');
+        db.serialize(function() {
+            db.run("BEGIN");
+            db.run("INSERT INTO foo (id, txt) VALUES (10, 'before')");
+            db.importFile(file, 'foo', { batchSize: 2 }, function(err) {
+                assert.ok(err);
+                assert.equal(err.code, 'SQLITE_CONSTRAINT');
+            });
+            db.all("SELECT id FROM foo ORDER BY id", function(err, rows) {
+                if (err) throw err;
+                // The first batch stays, the second one is gone.
+                assert.deepEqual(rows, [{ id: 1 }, { id: 2 }, { id: 10 }]);
+            });
+            db.run("COMMIT", done);
+        });
+    });
+
+    it('reports constraint violations', function(done) {
+        var file = 'test/tmp/import_dup.csv';
+        fs.writeFileSync(file, 'id,txt\n1,a\n1,b\n');
+        db.importFile(file, 'foo', function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_CONSTRAINT');
+            assert.ok(/^SQLITE_CONSTRAINT: Line 3: UNIQUE constraint failed/.test(err.message));
+            done();
+        });
+    });
+});
@@ -0,0 +1,79 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('json output', function() {
+    var db;
+
+    before(function(done) {
+        db = new sqlite3.Database(':memory:');
+        db.serialize(function() {
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, num REAL, txt TEXT, data BLOB)");
+            db.run("INSERT INTO foo VALUES (1, 0.1, 'plain', x'00ff10')");
+            db.run("INSERT INTO foo VALUES (2, -2.5e-7, 'quote \" backslash \\ newline \n tab \t bell ' || char(7) || ' é', NULL)");
+            db.run("INSERT INTO foo VALUES (3, NULL, NULL, x'')", done);
+        });
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    it('matches JSON.stringify of Database#all', function(done) {
+        db.configure('json', { blobs: 'array' });
+        db.all("SELECT id, num, txt, 1e999 AS inf, id / 3.0 AS third FROM foo", function(err, rows) {
+            if (err) throw err;
+            db.allJSON("SELECT id, num, txt, 1e999 AS inf, id / 3.0 AS third FROM foo", function(err, json) {
+                if (err) throw err;
+                assert.ok(Buffer.isBuffer(json));
+                assert.equal(json.toString(), JSON.stringify(rows));
+                done();
+            });
+        });
+    });
+
+    it('encodes blobs', function(done) {
+        db.configure('json', { blobs: 'base64' });
+        db.allJSON("SELECT data FROM foo ORDER BY id", function(err, json) {
+            if (err) throw err;
+            assert.deepEqual(JSON.parse(json), [{ data: 'AP8Q' }, { data: null }, { data: '' }]);
+            db.configure('json', { blobs: 'hex' });
+            db.allJSON("SELECT data FROM foo WHERE id = ?", 1, function(err, json) {
+                if (err) throw err;
+                assert.deepEqual(JSON.parse(json), [{ data: '00ff10' }]);
+                db.configure('json', { blobs: 'array' });
+                db.allJSON("SELECT data FROM foo WHERE id = ?", 1, function(err, json) {
+                    if (err) throw err;
+                    assert.deepEqual(JSON.parse(json), [{ data: [0, 255, 16] }]);
+                    done();
+                });
+            });
+        });
+    });
+
+    it('gets single rows', function(done) {
+        var stmt = db.prepare("SELECT id, txt FROM foo WHERE id = ?");
+        stmt.getJSON(1, function(err, json) {
+            if (err) throw err;
+            assert.equal(json.toString(), '{"id":1,"txt":"plain"}');
+            stmt.getJSON(4, function(err, json) {
+                if (err) throw err;
+                assert.strictEqual(json, undefined);
+                stmt.finalize(done);
+            });
+        });
+    });
+
+    it('returns an empty array without rows', function(done) {
+        db.allJSON("SELECT * FROM foo WHERE 0", function(err, json) {
+            if (err) throw err;
+            assert.equal(json.toString(), '[]');
+            done();
+        });
+    });
+
+    it('validates the blob encoding', function() {
+        assert.throws(function() {
+            db.configure('json', { blobs: 'binary' });
+        }, /Blobs must be/);
+    });
+});
@@ -0,0 +1,88 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('maintenance', function() {
+    var db;
+
+    beforeEach(function(done) {
+        db = new sqlite3.Database(':memory:');
+        db.serialize(function() {
+            db.run("PRAGMA auto_vacuum = INCREMENTAL");
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)");
+            db.run("CREATE TABLE bar (id INTEGER PRIMARY KEY, txt TEXT)");
+            db.run("INSERT INTO bar(txt) WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM c WHERE i < 2000) " +
+                   "SELECT hex(randomblob(200)) FROM c");
+            db.run("DELETE FROM bar", done);
+        });
+    });
+
+    afterEach(function(done) {
+        db.close(done);
+    });
+
+    it('reclaims free pages while idle', function(done) {
+        db.get("PRAGMA freelist_count", function(err, row) {
+            if (err) throw err;
+            var free = row.freelist_count;
+            assert.ok(free > 0);
+
+            db.configure('maintenance', { interval: 5, vacuumPages: 10, budgetMs: 1000 });
+            db.once('maintenance', function(info) {
+                assert.equal(info.optimized, true);
+                assert.equal(info.vacuumedPages, free);
+                assert.equal(info.busy, false);
+                assert.deepEqual(info.checkedTables, []);
+                db.configure('maintenance', false);
+                db.get("PRAGMA freelist_count", function(err, row) {
+                    if (err) throw err;
+                    assert.equal(row.freelist_count, 0);
+                    done();
+                });
+            });
+        });
+    });
+
+    it('waits for open transactions to end', function(done) {
+        var ran = false;
+        db.on('maintenance', function() { ran = true; });
+        db.exec("BEGIN", function(err) {
+            if (err) throw err;
+            db.configure('maintenance', { interval: 5, vacuumPages: 10 });
+            setTimeout(function() {
+                assert.equal(ran, false);
+                db.exec("ROLLBACK", function(err) {
+                    if (err) throw err;
+                    db.once('maintenance', function(info) {
+                        assert.ok(info.vacuumedPages > 0);
+                        db.configure('maintenance', false);
+                        done();
+                    });
+                });
+            }, 50);
+        });
+    });
+
+    it('checks tables a few at a time', function(done) {
+        var checked = [];
+        db.configure('maintenance', { interval: 5, quickCheck: true, optimize: false, budgetMs: 0.001 });
+        db.on('maintenance', function(info) {
+            assert.equal(info.optimized, false);
+            assert.deepEqual(info.problems, []);
+            checked = checked.concat(info.checkedTables);
+            if (checked.length >= 3) {
+                db.configure('maintenance', false);
+                assert.deepEqual(checked.slice(0, 3), ['bar', 'foo', 'bar']);
+                done();
+            }
+        });
+    });
+
+    it('rejects invalid options', function() {
+        assert.throws(function() {
+            db.configure('maintenance', true);
+        }, /Value must be an object or false/);
+        assert.throws(function() {
+            db.configure('maintenance', { interval: 0 });
+        }, /must be positive/);
+    });
+});
@@ -0,0 +1,121 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+var helper = require('./support/helper');
+
+describe('parallelQuery', function() {
+    var db;
+    var count = 10000;
+
+    before(function(done) {
+        helper.ensureExists('test/tmp');
+        helper.deleteFile('test/tmp/parallel_query.db');
+        db = new sqlite3.Database('test/tmp/parallel_query.db');
+        db.serialize(function() {
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, grp TEXT, num INTEGER)");
+            db.run("WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM c WHERE i < ?) " +
+                   "INSERT INTO foo SELECT i, 'g' || (i % 3), i FROM c", count, done);
+        });
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    it('sums up the partitions', function(done) {
+        db.parallelQuery("SELECT count(*) AS n, sum(num) AS total, min(num) AS lo, max(num) AS hi " +
+                         "FROM foo WHERE rowid BETWEEN $first AND $last", {
+            workers: 4,
+            combine: { n: 'count', total: 'sum', lo: 'min', hi: 'max' }
+        }, function(err, rows) {
+            if (err) throw err;
+            assert.deepEqual(rows, [{ n: count, total: count * (count + 1) / 2, lo: 1, hi: count }]);
+            done();
+        });
+    });
+
+    it('combines groups', function(done) {
+        db.parallelQuery("SELECT grp, count(*) AS n FROM foo WHERE id BETWEEN $first AND $last GROUP BY grp", {
+            partitionBy: 'id',
+            workers: 3,
+            combine: { n: 'count' },
+            orderBy: 'grp DESC'
+        }, function(err, rows) {
+            if (err) throw err;
+            assert.deepEqual(rows, [
+                { grp: 'g2', n: 3333 },
+                { grp: 'g1', n: 3334 },
+                { grp: 'g0', n: 3333 },
+            ]);
+            done();
+        });
+    });
+
+    it('merges ordered results', function(done) {
+        db.parallelQuery("SELECT id, num % 100 AS r FROM foo WHERE rowid BETWEEN $first AND $last " +
+                         "AND num > $min ORDER BY r, id", {
+            params: { $min: count - 500 },
+            orderBy: ['r', 'id'],
+        }, function(err, rows) {
+            if (err) throw err;
+            assert.equal(rows.length, 500);
+            for (var i = 1; i < rows.length; i++) {
+                var a = rows[i - 1];
+                var b = rows[i];
+                assert.ok(a.r < b.r || (a.r === b.r && a.id < b.id));
+            }
+            done();
+        });
+    });
+
+    it('concatenates in partition order', function(done) {
+        db.parallelQuery("SELECT id FROM foo WHERE rowid BETWEEN $first AND $last", { workers: 8 }, function(err, rows) {
+            if (err) throw err;
+            assert.equal(rows.length, count);
+            rows.forEach(function(row, i) { assert.equal(row.id, i + 1); });
+            done();
+        });
+    });
+
+    it('needs the partition parameters', function(done) {
+        db.parallelQuery("SELECT count(*) FROM foo", function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_MISUSE');
+            assert.ok(/\$first/.test(err.message));
+            done();
+        });
+    });
+
+    it('binds positional params next to the partition parameters', function(done) {
+        db.parallelQuery("SELECT count(*) AS n FROM foo WHERE num > ? AND rowid BETWEEN $first AND $last", {
+            params: [count - 10],
+            combine: { n: 'count' }
+        }, function(err, rows) {
+            if (err) throw err;
+            assert.deepEqual(rows, [{ n: 10 }]);
+            done();
+        });
+    });
+
+    it('does not let params bind the partition parameters', function(done) {
+        var sql = "SELECT count(*) AS n FROM foo WHERE num > ? AND rowid BETWEEN $first AND $last";
+        db.parallelQuery(sql, { params: [0, 1] }, function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_MISUSE');
+            db.parallelQuery(sql, { params: { 1: 0, $last: 5 } }, function(err) {
+                assert.ok(err);
+                assert.equal(err.code, 'SQLITE_MISUSE');
+                done();
+            });
+        });
+    });
+
+    it('reports unknown columns', function(done) {
+        db.parallelQuery("SELECT count(*) AS n FROM foo WHERE rowid BETWEEN $first AND $last", {
+            combine: { m: 'sum' }
+        }, function(err) {
+            assert.ok(err);
+            assert.ok(/No such column/.test(err.message));
+            done();
+        });
+    });
+});
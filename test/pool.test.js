@@ -0,0 +1,63 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('baton pool', function() {
+    var db;
+    before(function(done) {
+        db = new sqlite3.Database(':memory:');
+        db.serialize(function() {
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)");
+            db.run("INSERT INTO foo VALUES (1, 'one')", done);
+        });
+    });
+
+    it('should start with empty counters', function() {
+        var other = new sqlite3.Database(':memory:');
+        assert.deepEqual(other.poolStats, { hits: 0, misses: 0 });
+        other.close();
+    });
+
+    it('should reuse batons for repeated calls', function(done) {
+        var before = db.poolStats;
+        var stmt = db.prepare("SELECT txt FROM foo WHERE id = ?");
+        var remaining = 50;
+
+        function next() {
+            stmt.get(1, function(err, row) {
+                if (err) throw err;
+                assert.equal(row.txt, 'one');
+                if (--remaining) return next();
+
+                stmt.finalize(function() {
+                    var after = db.poolStats;
+                    assert.equal(after.hits + after.misses - before.hits - before.misses, 50);
+                    assert.ok(after.hits - before.hits >= 45);
+                    done();
+                });
+            });
+        }
+        next();
+    });
+
+    it('should not leak state between reused batons', function(done) {
+        var stmt = db.prepare("INSERT INTO foo (txt) VALUES (?)");
+        stmt.run('a', function(err) {
+            if (err) throw err;
+            var first = this.lastID;
+            stmt.run('b', function(err) {
+                if (err) throw err;
+                assert.equal(this.lastID, first + 1);
+                stmt.run('c', function(err) {
+                    if (err) throw err;
+                    assert.equal(this.lastID, first + 2);
+                    assert.equal(this.changes, 1);
+                    stmt.finalize(done);
+                });
+            });
+        });
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+});
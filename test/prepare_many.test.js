@@ -0,0 +1,81 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('prepareMany', function() {
+    var db;
+    before(function(done) {
+        db = new sqlite3.Database(':memory:');
+        db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)", done);
+    });
+
+    it('should prepare all statements before calling back', function(done) {
+        var statements = db.prepareMany([
+            "INSERT INTO foo VALUES(?, ?)",
+            "SELECT txt FROM foo WHERE id = ?",
+            "SELECT COUNT(*) AS count FROM foo"
+        ], function(err) {
+            if (err) throw err;
+            assert.equal(statements.length, 3);
+            assert.ok(statements[0] instanceof sqlite3.Statement);
+            assert.equal(statements[1].sql, "SELECT txt FROM foo WHERE id = ?");
+            done();
+        });
+    });
+
+    it('should queue calls on statements that are still being prepared', function(done) {
+        var statements = db.prepareMany([
+            "INSERT INTO foo VALUES(?, ?)",
+            "SELECT txt FROM foo WHERE id = ?"
+        ]);
+        // Both calls are queued while the statements are being prepared. The
+        // get waits for the insert, since statements run in parallel.
+        statements[1].bind(10);
+        statements[0].run(10, 'ten', function(err) {
+            if (err) throw err;
+            statements[0].finalize();
+            statements[1].get(function(err, row) {
+                if (err) throw err;
+                assert.equal(row.txt, 'ten');
+                statements[1].finalize(done);
+            });
+        });
+    });
+
+    it('should report the first error', function(done) {
+        var statements = db.prepareMany([
+            "SELECT 1",
+            "SELECT * FROM missing_table",
+            "SELECT 2 FROM"
+        ], function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_ERROR');
+            assert.ok(err.message.indexOf('missing_table') >= 0);
+            statements[0].get(function(err, row) {
+                if (err) throw err;
+                assert.equal(row['1'], 1);
+                done();
+            });
+        });
+    });
+
+    it('should accept an empty list', function(done) {
+        var statements = db.prepareMany([], function(err) {
+            if (err) throw err;
+            assert.deepEqual(statements, []);
+            done();
+        });
+    });
+
+    it('should throw on invalid arguments', function() {
+        assert.throws(function() {
+            db.prepareMany("SELECT 1");
+        }, /Array of SQL queries expected/);
+        assert.throws(function() {
+            db.prepareMany(["SELECT 1", 2]);
+        }, /Array of SQL queries expected/);
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+});
@@ -0,0 +1,85 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('query', function() {
+    var db;
+
+    before(function(done) {
+        db = new sqlite3.Database(':memory:');
+        db.serialize(function() {
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)");
+            db.run("INSERT INTO foo VALUES (1, 'one'), (2, 'two'), (3, 'three')", done);
+        });
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    it('returns the results of every statement', function(done) {
+        db.query("SELECT txt FROM foo WHERE id = 1; " +
+                 "UPDATE foo SET txt = upper(txt) WHERE id > 1; " +
+                 "INSERT INTO foo (txt) VALUES ('four'); " +
+                 "SELECT count(*) AS count FROM foo; -- the end", function(err, results) {
+            if (err) throw err;
+            assert.deepEqual(results, [
+                // lastID is the last rowid inserted over this connection.
+                { rows: [{ txt: 'one' }], changes: 0, lastID: 3 },
+                { rows: [], changes: 2, lastID: 3 },
+                { rows: [], changes: 1, lastID: 4 },
+                { rows: [{ count: 4 }], changes: 0, lastID: 4 },
+            ]);
+            done();
+        });
+    });
+
+    it('hands out positional parameters in turn', function(done) {
+        db.query("SELECT txt FROM foo WHERE id = ?; SELECT ? + ? AS sum", [2, 3, 4], function(err, results) {
+            if (err) throw err;
+            assert.deepEqual(results[0].rows, [{ txt: 'TWO' }]);
+            assert.deepEqual(results[1].rows, [{ sum: 7 }]);
+            done();
+        });
+    });
+
+    it('binds named parameters to every statement that has them', function(done) {
+        db.query("SELECT txt FROM foo WHERE id = $id; SELECT $id * 10 AS id, $other AS other",
+                { $id: 3, $other: 'x' }, function(err, results) {
+            if (err) throw err;
+            assert.deepEqual(results[0].rows, [{ txt: 'THREE' }]);
+            assert.deepEqual(results[1].rows, [{ id: 30, other: 'x' }]);
+            done();
+        });
+    });
+
+    it('does not count named parameters as positional ones', function(done) {
+        db.query("SELECT $a AS a; SELECT ? AS b", { 1: 1, $a: 'x' }, function(err, results) {
+            if (err) throw err;
+            assert.deepEqual(results[0].rows, [{ a: 'x' }]);
+            assert.deepEqual(results[1].rows, [{ b: 1 }]);
+            done();
+        });
+    });
+
+    it('rejects statements that mix positional and named parameters', function(done) {
+        db.query("SELECT ? AS a; SELECT $b AS b, ? AS c", { 1: 1, 2: 2, $b: 'x' }, function(err, results) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_MISUSE');
+            assert.equal(err.message, 'SQLITE_MISUSE: Statement 2 mixes positional and named parameters');
+            done();
+        });
+    });
+
+    it('stops at the first error', function(done) {
+        db.query("DELETE FROM foo WHERE id = 4; SELECT * FROM missing; DELETE FROM foo", function(err, results) {
+            assert.ok(err);
+            assert.equal(err.message, 'SQLITE_ERROR: no such table: missing');
+            assert.equal(results, undefined);
+            db.get("SELECT count(*) AS count FROM foo", function(err, row) {
+                if (err) throw err;
+                assert.equal(row.count, 3);
+                done();
+            });
+        });
+    });
+});
@@ -0,0 +1,136 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('query cache', function() {
+    var db;
+
+    beforeEach(function(done) {
+        db = new sqlite3.Database(':memory:');
+        db.configure('queryCache', { entries: 16 });
+        db.serialize(function() {
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)");
+            db.run("CREATE TABLE bar (id INTEGER PRIMARY KEY, txt TEXT)");
+            db.run("CREATE TABLE baz (id INTEGER PRIMARY KEY, txt TEXT) WITHOUT ROWID");
+            db.run("INSERT INTO foo VALUES (1, 'a'), (2, 'b'), (3, 'c')");
+            db.run("INSERT INTO bar VALUES (1, 'x')");
+            db.run("INSERT INTO baz VALUES (1, 'y')", done);
+        });
+    });
+
+    afterEach(function(done) {
+        db.close(done);
+    });
+
+    function all(sql, params, callback) {
+        db.all(sql, params, function(err, rows) {
+            if (err) throw err;
+            callback(rows);
+        });
+    }
+
+    it('answers repeated queries from the cache', function(done) {
+        all("SELECT * FROM foo WHERE id >= ?", [2], function(rows) {
+            assert.deepEqual(rows, [{ id: 2, txt: 'b' }, { id: 3, txt: 'c' }]);
+            assert.equal(db.queryCacheStats.entries, 1);
+            var hits = db.queryCacheStats.hits;
+            all("SELECT * FROM foo WHERE id >= ?", [2], function(again) {
+                assert.deepEqual(again, rows);
+                assert.notStrictEqual(again, rows);
+                assert.equal(db.queryCacheStats.hits, hits + 1);
+                done();
+            });
+        });
+    });
+
+    it('keys results by parameters', function(done) {
+        all("SELECT txt FROM foo WHERE id = ?", [1], function(rows) {
+            assert.deepEqual(rows, [{ txt: 'a' }]);
+            all("SELECT txt FROM foo WHERE id = ?", [2], function(rows) {
+                assert.deepEqual(rows, [{ txt: 'b' }]);
+                assert.equal(db.queryCacheStats.entries, 2);
+                done();
+            });
+        });
+    });
+
+    it('drops results when a table they read changes', function(done) {
+        all("SELECT count(*) AS n FROM foo", [], function() {
+            all("SELECT count(*) AS n FROM bar", [], function() {
+                assert.equal(db.queryCacheStats.entries, 2);
+                db.run("INSERT INTO foo VALUES (4, 'd')", function(err) {
+                    if (err) throw err;
+                    assert.equal(db.queryCacheStats.entries, 1);
+                    all("SELECT count(*) AS n FROM foo", [], function(rows) {
+                        assert.deepEqual(rows, [{ n: 4 }]);
+                        done();
+                    });
+                });
+            });
+        });
+    });
+
+    it('notices tables that are emptied', function(done) {
+        all("SELECT * FROM foo", [], function() {
+            db.run("DELETE FROM foo", function(err) {
+                if (err) throw err;
+                all("SELECT * FROM foo", [], function(rows) {
+                    assert.deepEqual(rows, []);
+                    done();
+                });
+            });
+        });
+    });
+
+    it('forgets changes that are rolled back', function(done) {
+        db.exec("BEGIN; UPDATE foo SET txt = 'z' WHERE id = 1", function(err) {
+            if (err) throw err;
+            all("SELECT txt FROM foo WHERE id = 1", [], function(rows) {
+                assert.deepEqual(rows, [{ txt: 'z' }]);
+                assert.equal(db.queryCacheStats.entries, 0);
+                db.exec("ROLLBACK", function(err) {
+                    if (err) throw err;
+                    all("SELECT txt FROM foo WHERE id = 1", [], function(rows) {
+                        assert.deepEqual(rows, [{ txt: 'a' }]);
+                        done();
+                    });
+                });
+            });
+        });
+    });
+
+    it('does not cache queries it cannot keep up to date', function(done) {
+        all("SELECT random() AS r FROM foo", [], function() {
+            all("SELECT * FROM baz", [], function() {
+                all("SELECT name FROM sqlite_schema", [], function() {
+                    assert.equal(db.queryCacheStats.entries, 0);
+                    done();
+                });
+            });
+        });
+    });
+
+    it('is cleared by schema changes', function(done) {
+        all("SELECT * FROM bar", [], function() {
+            db.run("DROP TABLE bar", function(err) {
+                if (err) throw err;
+                assert.equal(db.queryCacheStats.entries, 0);
+                db.all("SELECT * FROM bar", function(err) {
+                    assert.ok(err);
+                    assert.equal(err.code, 'SQLITE_ERROR');
+                    done();
+                });
+            });
+        });
+    });
+
+    it('can be turned off', function(done) {
+        all("SELECT * FROM foo", [], function() {
+            db.configure('queryCache', false);
+            db.wait(function() {
+                assert.strictEqual(db.queryCacheStats, null);
+                assert.strictEqual(db.cachedRows("SELECT * FROM foo", []), undefined);
+                done();
+            });
+        });
+    });
+});
@@ -0,0 +1,109 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('rowMode', function() {
+    var db;
+
+    before(function(done) {
+        db = new sqlite3.Database(':memory:');
+        db.serialize(function() {
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT, num REAL)");
+            db.run("INSERT INTO foo VALUES (1, 'one', 1.5), (2, 'two', NULL), (3, 'three', -3)", done);
+        });
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    it('returns arrays of values', function(done) {
+        var stmt = db.prepare("SELECT id, txt, num FROM foo ORDER BY id").rowMode('array');
+        stmt.get(function(err, row) {
+            if (err) throw err;
+            assert.deepEqual(row, [1, 'one', 1.5]);
+        });
+        stmt.all(function(err, rows) {
+            if (err) throw err;
+            assert.deepEqual(rows, [[1, 'one', 1.5], [2, 'two', null], [3, 'three', -3]]);
+        });
+        var rows = [];
+        stmt.each(function(err, row) {
+            if (err) throw err;
+            rows.push(row);
+        }, function(err, count) {
+            if (err) throw err;
+            assert.equal(count, 3);
+            assert.deepEqual(rows[2], [3, 'three', -3]);
+            stmt.finalize(done);
+        });
+    });
+
+    it('plucks the first column', function(done) {
+        var stmt = db.prepare("SELECT txt, id FROM foo WHERE id >= ? ORDER BY id").rowMode('pluck');
+        stmt.all(2, function(err, rows) {
+            if (err) throw err;
+            assert.deepEqual(rows, ['two', 'three']);
+        });
+        stmt.get(4, function(err, row) {
+            if (err) throw err;
+            assert.equal(row, undefined);
+            stmt.finalize(done);
+        });
+    });
+
+    it('applies to calls made after it', function(done) {
+        var stmt = db.prepare("SELECT id FROM foo WHERE id = 1");
+        assert.equal(stmt.rowMode(), 'object');
+        stmt.get(function(err, row) {
+            if (err) throw err;
+            assert.deepEqual(row, { id: 1 });
+        });
+        stmt.rowMode('pluck').get(function(err, row) {
+            if (err) throw err;
+            assert.strictEqual(row, 1);
+            stmt.rowMode('object').get(function(err, row) {
+                if (err) throw err;
+                assert.deepEqual(row, { id: 1 });
+                stmt.finalize(done);
+            });
+        });
+    });
+
+    it('maps array and plucked rows', function(done) {
+        var stmt = db.prepare("SELECT id, txt FROM foo ORDER BY id").rowMode('array');
+        stmt.map(function(err, map) {
+            if (err) throw err;
+            assert.deepEqual(map, { 1: 'one', 2: 'two', 3: 'three' });
+            stmt.rowMode('pluck').map(function(err, map) {
+                if (err) throw err;
+                assert.deepEqual(map, { 1: 1, 2: 2, 3: 3 });
+                stmt.finalize(done);
+            });
+        });
+    });
+
+    it('maps plucked blobs and wide array rows', function(done) {
+        var blobs = db.prepare("SELECT x'6869' UNION ALL SELECT x'686f'").rowMode('pluck');
+        assert.equal(blobs.rowMode(), 'pluck');
+        blobs.map(function(err, map) {
+            if (err) throw err;
+            assert.deepEqual(Object.keys(map), ['hi', 'ho']);
+            assert.ok(Buffer.isBuffer(map.hi));
+            blobs.finalize();
+            var rows = db.prepare("SELECT id, txt, num FROM foo WHERE id = 1").rowMode('array');
+            rows.map(function(err, map) {
+                if (err) throw err;
+                assert.deepEqual(map, { 1: [1, 'one', 1.5] });
+                rows.finalize(done);
+            });
+        });
+    });
+
+    it('rejects unknown modes', function(done) {
+        var stmt = db.prepare("SELECT 1");
+        assert.throws(function() {
+            stmt.rowMode('columns');
+        }, /Row mode must be 'object', 'array' or 'pluck'/);
+        stmt.finalize(done);
+    });
+});
@@ -0,0 +1,105 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('session', function() {
+    var source;
+    var target;
+
+    function setup(db, done) {
+        db.serialize(function() {
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)");
+            db.run("INSERT INTO foo VALUES (1, 'one'), (2, 'two'), (3, 'three')", done);
+        });
+    }
+
+    beforeEach(function(done) {
+        source = new sqlite3.Database(':memory:');
+        target = new sqlite3.Database(':memory:');
+        setup(source, function(err) {
+            if (err) return done(err);
+            setup(target, done);
+        });
+    });
+
+    afterEach(function(done) {
+        source.close(function(err) {
+            if (err) return done(err);
+            target.close(done);
+        });
+    });
+
+    function rows(db, callback) {
+        db.all("SELECT id, txt FROM foo ORDER BY id", callback);
+    }
+
+    it('records changes and applies them to another database', function(done) {
+        var session = source.session();
+        session.attach();
+        source.run("UPDATE foo SET txt = 'TWO' WHERE id = 2");
+        source.run("DELETE FROM foo WHERE id = 3");
+        source.run("INSERT INTO foo VALUES (4, 'four')");
+        session.changeset(function(err, changeset) {
+            if (err) throw err;
+            assert.ok(Buffer.isBuffer(changeset));
+            assert.ok(changeset.length > 0);
+            target.applyChangeset(changeset, function(err, conflicts) {
+                if (err) throw err;
+                assert.equal(conflicts, 0);
+                rows(target, function(err, result) {
+                    if (err) throw err;
+                    assert.deepEqual(result, [
+                        { id: 1, txt: 'one' },
+                        { id: 2, txt: 'TWO' },
+                        { id: 4, txt: 'four' },
+                    ]);
+                    session.close(done);
+                });
+            });
+        });
+    });
+
+    it('only records attached tables', function(done) {
+        source.run("CREATE TABLE bar (id INTEGER PRIMARY KEY)");
+        var session = source.session();
+        session.attach('bar');
+        source.run("UPDATE foo SET txt = 'ONE' WHERE id = 1");
+        session.patchset(function(err, patchset) {
+            if (err) throw err;
+            assert.equal(patchset.length, 0);
+            done();
+        });
+    });
+
+    it('resolves conflicts with the given policy', function(done) {
+        var session = source.session();
+        session.attach('foo');
+        source.run("UPDATE foo SET txt = 'TWO' WHERE id = 2");
+        target.run("UPDATE foo SET txt = 'deux' WHERE id = 2");
+        session.changeset(function(err, changeset) {
+            if (err) throw err;
+            target.applyChangeset(changeset, 'abort', function(err) {
+                assert.ok(err);
+                assert.equal(err.code, 'SQLITE_ABORT');
+                target.applyChangeset(changeset, 'replace', function(err, conflicts) {
+                    if (err) throw err;
+                    assert.equal(conflicts, 1);
+                    target.get("SELECT txt FROM foo WHERE id = 2", function(err, row) {
+                        if (err) throw err;
+                        assert.equal(row.txt, 'TWO');
+                        done();
+                    });
+                });
+            });
+        });
+    });
+
+    it('fails after the session is closed', function(done) {
+        var session = source.session();
+        session.close();
+        session.changeset(function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_MISUSE');
+            done();
+        });
+    });
+});
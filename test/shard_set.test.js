@@ -0,0 +1,93 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+var helper = require('./support/helper');
+
+describe('ShardSet', function() {
+    var files = [0, 1, 2, 3].map(function(i) { return 'test/tmp/shard_' + i + '.db'; });
+    var shards;
+
+    before(function(done) {
+        helper.ensureExists('test/tmp');
+        files.forEach(function(file) { helper.deleteFile(file); });
+        shards = new sqlite3.ShardSet(files, function(err) {
+            if (err) throw err;
+            shards.run("CREATE TABLE orders (id INTEGER PRIMARY KEY, tenant TEXT, total INTEGER)", done);
+        });
+    });
+
+    after(function(done) {
+        shards.close(done);
+    });
+
+    it('has one shard per file', function() {
+        assert.equal(shards.length, 4);
+    });
+
+    it('routes writes by key', function(done) {
+        var tenants = ['alpha', 'beta', 'gamma', 'delta', 'epsilon', 'zeta'];
+        var remaining = tenants.length * 10;
+        tenants.forEach(function(tenant) {
+            for (var i = 1; i <= 10; i++) {
+                shards.run("INSERT INTO orders (tenant, total) VALUES (?, ?)", {
+                    params: [tenant, i],
+                    key: tenant
+                }, function(err, changes) {
+                    if (err) throw err;
+                    assert.equal(changes, 1);
+                    if (--remaining === 0) done();
+                });
+            }
+        });
+    });
+
+    it('keeps each tenant on one shard', function(done) {
+        var shard = shards.shardFor('alpha');
+        shards.all("SELECT count(*) AS n FROM orders WHERE tenant = 'alpha'", {
+            shards: [shard]
+        }, function(err, rows) {
+            if (err) throw err;
+            assert.deepEqual(rows, [{ n: 10 }]);
+            done();
+        });
+    });
+
+    it('combines aggregates from all shards', function(done) {
+        shards.all("SELECT tenant, sum(total) AS total, count(*) AS n FROM orders GROUP BY tenant", {
+            combine: { total: 'sum', n: 'count' },
+            orderBy: 'tenant'
+        }, function(err, rows) {
+            if (err) throw err;
+            assert.deepEqual(rows.map(function(row) { return row.tenant; }),
+                ['alpha', 'beta', 'delta', 'epsilon', 'gamma', 'zeta']);
+            rows.forEach(function(row) {
+                assert.equal(row.total, 55);
+                assert.equal(row.n, 10);
+            });
+            done();
+        });
+    });
+
+    it('merges ordered results', function(done) {
+        shards.all("SELECT tenant, total FROM orders WHERE total > 8 ORDER BY total DESC, tenant", {
+            orderBy: ['total DESC', 'tenant']
+        }, function(err, rows) {
+            if (err) throw err;
+            assert.equal(rows.length, 12);
+            assert.deepEqual(rows.slice(0, 2), [
+                { tenant: 'alpha', total: 10 },
+                { tenant: 'beta', total: 10 },
+            ]);
+            assert.equal(rows[6].total, 9);
+            done();
+        });
+    });
+
+    it('reports errors', function(done) {
+        shards.all("SELECT * FROM missing", function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_ERROR');
+            assert.ok(/no such table/.test(err.message));
+            done();
+        });
+    });
+});
@@ -0,0 +1,83 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+var helper = require('./support/helper');
+
+describe('snapshot', function() {
+    var db;
+
+    before(function(done) {
+        helper.ensureExists('test/tmp');
+        helper.deleteFile('test/tmp/snapshot.db');
+        helper.deleteFile('test/tmp/snapshot.db-wal');
+        helper.deleteFile('test/tmp/snapshot.db-shm');
+        db = new sqlite3.Database('test/tmp/snapshot.db');
+        db.serialize(function() {
+            db.run("PRAGMA journal_mode = WAL");
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)");
+            db.run("INSERT INTO foo(txt) VALUES ('a'), ('b'), ('c')", done);
+        });
+    });
+
+    after(function(done) {
+        db.close(done);
+    });
+
+    function insert(txt) {
+        return new Promise(function(resolve, reject) {
+            db.run("INSERT INTO foo(txt) VALUES (?)", txt, function(err) {
+                if (err) reject(err);
+                else resolve();
+            });
+        });
+    }
+
+    it('sees the same state on every connection', function() {
+        return db.snapshot(function(snap) {
+            return snap.get("SELECT count(*) AS count FROM foo").then(function(row) {
+                assert.equal(row.count, 3);
+                return insert('d');
+            }).then(function() {
+                var queries = [];
+                for (var i = 0; i < 8; i++) {
+                    queries.push(snap.get("SELECT count(*) AS count FROM foo"));
+                }
+                queries.push(snap.all("SELECT txt FROM foo ORDER BY id"));
+                return Promise.all(queries);
+            }).then(function(results) {
+                var rows = results.pop();
+                results.forEach(function(row) { assert.equal(row.count, 3); });
+                assert.deepEqual(rows.map(function(row) { return row.txt; }), ['a', 'b', 'c']);
+                return 'done';
+            });
+        }, { connections: 3 }).then(function(result) {
+            assert.equal(result, 'done');
+            return new Promise(function(resolve, reject) {
+                db.get("SELECT count(*) AS count FROM foo", function(err, row) {
+                    if (err) return reject(err);
+                    assert.equal(row.count, 4);
+                    resolve();
+                });
+            });
+        });
+    });
+
+    it('rejects with the error thrown by the function', function() {
+        return db.snapshot(function() {
+            throw new Error('nope');
+        }).then(function() {
+            assert.fail('expected an error');
+        }, function(err) {
+            assert.equal(err.message, 'nope');
+        });
+    });
+
+    it('needs a database file', function() {
+        var memory = new sqlite3.Database(':memory:');
+        return memory.snapshot(function() {}).then(function() {
+            assert.fail('expected an error');
+        }, function(err) {
+            assert.ok(/database file/.test(err.message));
+            return new Promise(function(resolve) { memory.close(resolve); });
+        });
+    });
+});
@@ -0,0 +1,55 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+function parallelReads(mode, done) {
+    var db = new sqlite3.Database(':memory:', mode);
+    db.serialize(function() {
+        db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)");
+        var stmt = db.prepare("INSERT INTO foo (txt) VALUES (?)");
+        for (var i = 0; i < 1000; i++) stmt.run('row ' + i);
+        stmt.finalize();
+    });
+
+    db.parallelize(function() {
+        var pending = 0;
+        function finished(err) {
+            if (err) throw err;
+            if (--pending === 0) db.close(done);
+        }
+
+        for (var i = 0; i < 10; i++) {
+            pending++;
+            db.all("SELECT * FROM foo", function(err, rows) {
+                if (!err) assert.equal(rows.length, 1000);
+                finished(err);
+            });
+            pending++;
+            db.each("SELECT id FROM foo", function(err) {
+                if (err) throw err;
+            }, function(err, count) {
+                if (!err) assert.equal(count, 1000);
+                finished(err);
+            });
+            pending++;
+            db.run("UPDATE foo SET txt = txt WHERE id = ?", i + 1, finished);
+        }
+    });
+}
+
+describe('threading mode', function() {
+    it('should default to multi-thread connections', function(done) {
+        var db = new sqlite3.Database(':memory:', function(err) {
+            if (err) throw err;
+            assert.ok(db.mode & sqlite3.OPEN_NOMUTEX);
+            db.close(done);
+        });
+    });
+
+    it('should run parallel statements on a NOMUTEX connection', function(done) {
+        parallelReads(sqlite3.OPEN_READWRITE | sqlite3.OPEN_CREATE | sqlite3.OPEN_NOMUTEX, done);
+    });
+
+    it('should run parallel statements on a FULLMUTEX connection', function(done) {
+        parallelReads(sqlite3.OPEN_READWRITE | sqlite3.OPEN_CREATE | sqlite3.OPEN_FULLMUTEX, done);
+    });
+});
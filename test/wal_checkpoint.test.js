@@ -0,0 +1,97 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+var helper = require('./support/helper');
+
+describe('wal checkpoint', function() {
+    var db;
+
+    before(function() {
+        helper.ensureExists('test/tmp');
+    });
+
+    beforeEach(function(done) {
+        helper.deleteFile('test/tmp/wal_checkpoint.db');
+        helper.deleteFile('test/tmp/wal_checkpoint.db-wal');
+        helper.deleteFile('test/tmp/wal_checkpoint.db-shm');
+        db = new sqlite3.Database('test/tmp/wal_checkpoint.db');
+        db.serialize(function() {
+            db.run("PRAGMA journal_mode = WAL");
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)", done);
+        });
+    });
+
+    afterEach(function(done) {
+        db.close(done);
+    });
+
+    function insert(count, callback) {
+        db.run("WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM c WHERE i < ?) " +
+               "INSERT INTO foo(txt) SELECT hex(randomblob(500)) FROM c", count, callback);
+    }
+
+    it('checkpoints in the background once the WAL is large enough', function(done) {
+        db.configure('walCheckpoint', { pages: 10 });
+        db.once('checkpoint', function(info) {
+            assert.equal(info.database, 'main');
+            assert.equal(info.mode, 'passive');
+            assert.equal(info.busy, false);
+            assert.ok(info.walFrames >= 10);
+            assert.ok(info.logFrames >= 10);
+            assert.equal(info.checkpointedFrames, info.logFrames);
+            assert.equal(typeof info.duration, 'number');
+            done();
+        });
+        insert(100, function(err) {
+            if (err) throw err;
+        });
+    });
+
+    it('escalates to truncating the WAL', function(done) {
+        db.configure('walCheckpoint', { pages: 1, restartPages: 2, truncatePages: 3 });
+        db.once('checkpoint', function(info) {
+            assert.equal(info.mode, 'truncate');
+            assert.equal(info.busy, false);
+            assert.equal(info.logFrames, 0);
+            done();
+        });
+        insert(100, function(err) {
+            if (err) throw err;
+        });
+    });
+
+    it('does not checkpoint below the threshold', function(done) {
+        db.configure('walCheckpoint', { pages: 100000 });
+        db.on('checkpoint', function() {
+            throw new Error('should not checkpoint');
+        });
+        insert(10, function(err) {
+            if (err) throw err;
+            db.get("PRAGMA wal_checkpoint(PASSIVE)", function(err, row) {
+                if (err) throw err;
+                assert.ok(row.log > 0);
+                done();
+            });
+        });
+    });
+
+    it('can be turned off again', function(done) {
+        db.configure('walCheckpoint', { pages: 1 });
+        db.configure('walCheckpoint', false);
+        db.on('checkpoint', function() {
+            throw new Error('should not checkpoint');
+        });
+        insert(100, function(err) {
+            if (err) throw err;
+            setTimeout(done, 20);
+        });
+    });
+
+    it('rejects invalid options', function() {
+        assert.throws(function() {
+            db.configure('walCheckpoint', true);
+        }, /Value must be an object or false/);
+        assert.throws(function() {
+            db.configure('walCheckpoint', { pages: -1 });
+        }, /must be positive/);
+    });
+});
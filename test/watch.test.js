@@ -0,0 +1,140 @@
+var sqlite3 = require('..');
+var assert = require('assert');
+
+describe('watch', function() {
+    var db;
+
+    beforeEach(function(done) {
+        db = new sqlite3.Database(':memory:');
+        db.serialize(function() {
+            db.run("CREATE TABLE foo (id INTEGER PRIMARY KEY, txt TEXT)");
+            db.run("CREATE TABLE bar (id INTEGER PRIMARY KEY, txt TEXT)");
+            db.run("INSERT INTO foo VALUES (1, 'a'), (2, 'b')", done);
+        });
+    });
+
+    afterEach(function(done) {
+        db.close(done);
+    });
+
+    it('starts with all rows', function(done) {
+        var watch = db.watch("SELECT * FROM foo WHERE id >= ?", 1, function(err, result) {
+            if (err) throw err;
+            assert.deepEqual(result.rows, [{ id: 1, txt: 'a' }, { id: 2, txt: 'b' }]);
+            assert.deepEqual(result.added, result.rows);
+            assert.deepEqual(result.removed, []);
+            assert.equal(this, watch);
+            assert.equal(watch.sql, "SELECT * FROM foo WHERE id >= ?");
+            watch.close();
+            done();
+        });
+    });
+
+    it('reports inserted, updated and deleted rows', function(done) {
+        var results = [];
+        var watch = db.watch("SELECT * FROM foo", function(err, result) {
+            if (err) throw err;
+            results.push(result);
+            if (results.length === 1) {
+                db.run("INSERT INTO foo VALUES (3, 'c')");
+            }
+            else if (results.length === 2) {
+                assert.deepEqual(result.added, [{ id: 3, txt: 'c' }]);
+                assert.deepEqual(result.removed, []);
+                assert.strictEqual(result.added[0], result.rows[2]);
+                db.run("UPDATE foo SET txt = 'z' WHERE id = 1");
+            }
+            else if (results.length === 3) {
+                assert.deepEqual(result.added, [{ id: 1, txt: 'z' }]);
+                assert.deepEqual(result.removed, [{ id: 1, txt: 'a' }]);
+                db.run("DELETE FROM foo");
+            }
+            else {
+                assert.deepEqual(result.rows, []);
+                assert.deepEqual(result.added, []);
+                assert.equal(result.removed.length, 3);
+                watch.close();
+                done();
+            }
+        });
+    });
+
+    it('ignores changes to other tables', function(done) {
+        var calls = 0;
+        var watch = db.watch("SELECT count(*) AS n FROM foo", function(err, result) {
+            if (err) throw err;
+            calls++;
+            if (calls === 1) {
+                db.run("INSERT INTO bar VALUES (1, 'x')");
+                db.run("UPDATE foo SET txt = txt WHERE id = 1");
+                db.run("INSERT INTO foo VALUES (3, 'c')");
+            }
+            else {
+                assert.equal(calls, 2);
+                assert.deepEqual(result.rows, [{ n: 3 }]);
+                watch.close();
+                done();
+            }
+        });
+    });
+
+    it('reports only the committed state of transactions', function(done) {
+        var results = [];
+        var watch = db.watch("SELECT txt FROM foo WHERE id = 1", function(err, result) {
+            if (err) throw err;
+            results.push(result);
+            if (results.length === 1) {
+                db.exec("BEGIN; UPDATE foo SET txt = 'x' WHERE id = 1; UPDATE foo SET txt = 'y' WHERE id = 1; COMMIT");
+            }
+            else {
+                assert.deepEqual(result.removed, [{ txt: 'a' }]);
+                assert.deepEqual(result.added, [{ txt: 'y' }]);
+                watch.close();
+                done();
+            }
+        });
+    });
+
+    it('reports errors', function(done) {
+        var watch = db.watch("SELECT * FROM missing", function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_ERROR');
+            watch.close();
+            done();
+        });
+    });
+
+    it('only watches queries', function(done) {
+        var watch = db.watch("DELETE FROM foo", function(err) {
+            assert.ok(err);
+            assert.equal(err.code, 'SQLITE_MISUSE');
+            watch.close();
+            done();
+        });
+    });
+
+    it('stops after close', function(done) {
+        var calls = 0;
+        var watch = db.watch("SELECT * FROM foo", function(err) {
+            if (err) throw err;
+            calls++;
+            watch.close();
+            db.run("INSERT INTO foo VALUES (3, 'c')", function(err) {
+                if (err) throw err;
+                db.wait(function() {
+                    assert.equal(calls, 1);
+                    done();
+                });
+            });
+        });
+    });
+
+    it('is closed with the database', function(done) {
+        var other = new sqlite3.Database(':memory:');
+        other.watch("SELECT 1 AS one", function(err, result) {
+            if (err) throw err;
+            assert.deepEqual(result.rows, [{ one: 1 }]);
+            other.close(done);
+        });
+    });
+});